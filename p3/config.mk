@@ -104,7 +104,15 @@ UPDATE_METHOD = afs
 #
 STUDENTTESTS = test_suite exec_args_test exec_args_test_helper new_pages_test\
                myscore bad_status_ptr fork_exit_bomb_cleanup test_threads\
-			   vq_test test_all big_test_all ydm2
+			   vq_test test_all big_test_all ydm2 exec_bench\
+			   readfile_bench map_file_bench tmpfs_bench vanish_wait_bench\
+			   tid_lookup_bench exit_rate_bench reap_latency_bench\
+			   reap_rate_bench thread_churn_bench thread_limit_bench \
+			   switch_overhead_bench task_snapshot_bench top \
+			   fair_share_bench deadline_miss_bench group_quota_test \
+			   wakeup_latency_bench wake_policy_bench gang_dispatch_bench \
+			   pi_inversion_test mutex_handoff_bench \
+			   rwlock_lookup_bench wake_all_bench sysenter_bench
 
 ###########################################################################
 # Data files provided by course staff to build into the RAM disk
@@ -145,7 +153,12 @@ SYSCALL_OBJS = syscall.o gettid.o fork.o test.o yield.o deschedule.o \
 			   set_cursor_pos.o get_cursor_pos.o set_term_color.o \
 			   new_pages.o remove_pages.o readfile.o halt.o vanish.o \
 			   readline.o task_vanish.o set_status.o swexn.o wait.o \
-			   misbehave.o
+			   misbehave.o map_file.o open.o read.o write.o lseek.o \
+			   close.o unlink.o waitpid.o wait_many.o getrusage.o \
+			   task_snapshot.o thread_exit.o thread_join.o \
+			   set_priority.o set_deadline.o wait_period.o \
+			   set_group_quota.o join_group.o set_wake_policy.o \
+			   set_gang_batch.o sysenter.o
 
 ###########################################################################
 # Object files for your automatic stack handling
@@ -163,11 +176,13 @@ AUTOSTACK_OBJS = autostack.o
 # Kernel object files you provide in from kern/
 #
 
-KERNEL_OBJS = console.o kernel.o loader.o malloc_wrappers.o \
+KERNEL_OBJS = console.o kernel.o loader.o ramdisk.o malloc_wrappers.o \
 			  memory_manager.o task_manager.o iret_travel.o \
 			  keybd_driver.o timer_driver.o install_handler.o \
 			  asm_interrupt_handler.o context_switch.o \
-			  scheduler.o logger.o tests.o atomic_utils.o panic.o\
+			  scheduler.o logger.o tests.o atomic_utils.o panic.o idr.o \
+			  variable_htable.o variable_tree.o reaper.o idle.o kstack.o gdt.o \
+			  rusage.o sysenter.o \
 			  \
 			  lib_thread_management/asm_thread_management_handlers.o \
 			  lib_thread_management/gettid.o \
@@ -178,8 +193,15 @@ KERNEL_OBJS = console.o kernel.o loader.o malloc_wrappers.o \
 			  lib_thread_management/sleep.o \
 			  lib_thread_management/swexn.o \
 			  lib_thread_management/swexn_set_regs.o \
-			  lib_thread_management/hashmap.o \
 			  lib_thread_management/mutex.o \
+			  lib_thread_management/rwlock.o \
+			  lib_thread_management/waitqueue.o \
+			  lib_thread_management/thread_join.o \
+			  lib_thread_management/set_priority.o \
+			  lib_thread_management/deadline.o \
+			  lib_thread_management/task_group.o \
+			  lib_thread_management/wake_policy.o \
+			  lib_thread_management/gang_dispatch.o \
 			  \
 			  lib_life_cycle/asm_life_cycle_handlers.o \
 			  lib_life_cycle/save_child_regs.o \
@@ -194,6 +216,7 @@ KERNEL_OBJS = console.o kernel.o loader.o malloc_wrappers.o \
 			  lib_memory_management/asm_memory_management_handlers.o \
 			  lib_memory_management/new_pages.o \
 			  lib_memory_management/remove_pages.o \
+			  lib_memory_management/map_file.o \
 			  lib_memory_management/physalloc.o \
 			  lib_memory_management/pagefault_handler.o \
 			  lib_memory_management/is_valid_pd.o \
@@ -212,6 +235,16 @@ KERNEL_OBJS = console.o kernel.o loader.o malloc_wrappers.o \
 			  lib_misc/halt.o \
 			  lib_misc/call_halt.o \
               lib_misc/misbehave.o \
+			  lib_misc/task_snapshot.o \
+			  \
+			  lib_fs/asm_fs_handlers.o \
+			  lib_fs/tmpfs.o \
+			  lib_fs/open.o \
+			  lib_fs/read.o \
+			  lib_fs/write.o \
+			  lib_fs/lseek.o \
+			  lib_fs/close.o \
+			  lib_fs/unlink.o \
 			  \
 			  fault_handlers/asm_fault_handlers.o \
 			  fault_handlers/divide_handler.o \
@@ -262,3 +295,40 @@ KERNEL_OBJS = console.o kernel.o loader.o malloc_wrappers.o \
 # won't.
 #
 STUDENTREQPROGS =
+
+###########################################################################
+# Compressed RAM disk
+###########################################################################
+# Set CONFIG_COMPRESS_RAMDISK to "yes" to store user programs and files on
+# the RAM disk block compressed (see kern/inc/ramdisk.h). getbytes() reads
+# both formats, so this only trades boot image size for decompression time
+# when loading. Files are compressed in place in $(BUILDDIR) right before
+# the RAM disk is assembled from them; rdcompress leaves files that are
+# already compressed alone and prints the size of every file it shrinks.
+# It also generates $(BUILDDIR)/ramdisk_compressed_names.c, the list of
+# files the kernel decompresses. Otherwise the kernel gets the empty list
+# in kern/ramdisk_uncompressed.c and no host tool is built.
+#
+CONFIG_COMPRESS_RAMDISK = no
+
+ifeq (yes,$(CONFIG_COMPRESS_RAMDISK))
+RAMDISK_CONTENTS = $(410REQPROGS) $(STUDENTREQPROGS) $(410TESTS) \
+                   $(STUDENTTESTS) $(410FILES) $(STUDENTFILES)
+
+# Kernel objects are named relative to $(STUKDIR)
+RAMDISK_NAMES = ../$(BUILDDIR)/ramdisk_compressed_names
+KERNEL_OBJS += $(RAMDISK_NAMES).o
+STUKCLEANS += $(BUILDDIR)/rdcompress $(BUILDDIR)/ramdisk_compressed_names.c
+
+$(BUILDDIR)/rdcompress: tools/rdcompress.c kern/inc/ramdisk.h
+	mkdir -p $(BUILDDIR)
+	cc -O2 -Wall -Werror -DRAMDISK_HOST_TOOL -Ikern/inc -o $@ $<
+
+$(STUKDIR)/$(RAMDISK_NAMES).c: $(BUILDDIR)/rdcompress config.mk \
+                               $(RAMDISK_CONTENTS:%=$(BUILDDIR)/%)
+	$(BUILDDIR)/rdcompress -t $@ $(RAMDISK_CONTENTS:%=$(BUILDDIR)/%)
+
+$(BUILDDIR)/user_apps.S: $(STUKDIR)/$(RAMDISK_NAMES).c
+else
+KERNEL_OBJS += ramdisk_uncompressed.o
+endif
@@ -35,6 +35,38 @@ call_ ## HANDLER_NAME ## :;\
 	popa; /* Restores all registers onto the stack */\
 	iret; /* Return to procedure before interrupt */
 
+/** @define CALL_IRQ_HANDLER(HANDLER_NAME)
+ *  @brief Assembly wrapper to call device interrupt handlers, which run on
+ *         the interrupt stack through run_irq_handler()
+ *
+ *  @param HANDLER_NAME name of handler function to call
+ */
+#define CALL_IRQ_HANDLER(HANDLER_NAME)\
+\
+.globl call_##HANDLER_NAME; /* create the asm function call_HANDLER_NAME */\
+\
+call_ ## HANDLER_NAME ## :;\
+	pusha; /* Pushes all registers onto the stack */\
+	pushl %ds;\
+	pushl %es;\
+	pushl %fs;\
+	pushl %gs;\
+	/* set the new values for ds, es, fs, gs */\
+	mov %ss, %ax;\
+	mov %ax, %ds;\
+	mov %ax, %es;\
+	mov %ax, %fs;\
+	mov %ax, %gs;\
+	pushl $HANDLER_NAME;\
+	call run_irq_handler; /* switches stacks and calls the handler */\
+	addl $4, %esp; /* ignore argument */\
+	popl %gs;\
+	popl %fs;\
+	popl %es;\
+	popl %ds;\
+	popa; /* Restores all registers onto the stack */\
+	iret; /* Return to procedure before interrupt */
+
 /** @define CALL_FAULT_HANDLER_TEMPLATE(HANDLER_NAME)
  *  @brief Assembly wrapper to call interupt handlers that do not service
  *         syscalls (hence the need to save _all_ general registers)
@@ -156,6 +188,9 @@ call_ ## HANDLER_NAME ## :;\
 	mov %ax, %es;\
 	mov %ax, %fs;\
 	mov %ax, %gs;\
+\
+	/* Charge the syscall to the running thread, see rusage.c */\
+	call count_syscall;\
 \
 	HANDLER_SPECIFIC_CODE\
 \
@@ -276,6 +311,27 @@ call_ ## HANDLER_NAME ## :;\
 	))
 
 
+/** @def CALL_W_TRIPLE_ARG(HANDLER_NAME)
+ *  @brief Macro for assembly wrapper for calling a syscall with 3 arguments
+ *
+ *  @param HANDLER_NAME handler name to call
+ */
+#define CALL_W_TRIPLE_ARG(HANDLER_NAME)\
+\
+/* Declare and define asm function call_HANDLER_NAME */\
+.globl call_##HANDLER_NAME;\
+call_ ## HANDLER_NAME ## :;\
+\
+	CALL_HANDLER_TEMPLATE(SINGLE_MACRO_ARG_W_COMMAS\
+	(\
+		pushl 8(%esi);      /* push 3rd argument onto stack */\
+		pushl 4(%esi);      /* push 2nd argument onto stack */\
+		pushl (%esi);       /* push 1st argument onto stack */\
+		call HANDLER_NAME;  /* calls syscall handler */\
+		addl $12, %esp;     /* ignore arguments */\
+	))
+
+
 /** @def CALL_W_FOUR_ARG(HANDLER_NAME)
  *  @brief Macro for assembly wrapper for calling a syscall with 4 arguments
  *
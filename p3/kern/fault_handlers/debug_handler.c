@@ -8,6 +8,8 @@
 #include <assert.h> /* panic() */
 #include <panic_thread.h> /* panic_thread() */
 #include <interrupt_defines.h> /* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <eflags.h> /* EFL_TF */
+#include <sysenter.h> /* sysenter_handler() */
 
 /** @brief Debug handler
  *
@@ -19,6 +21,15 @@ debug_handler( int *ebp )
 	int eip	= *(ebp + 1);
 	int cs	= *(ebp + 2);
 
+	/* sysenter keeps EFL_TF, so a thread single stepping into it traps on
+	 * the first instruction of the entry, on sysenter's own stack. Clear
+	 * it for the kernel and let the entry hand it back to user mode */
+	if (cs == SEGSEL_KERNEL_CS && eip == (int) sysenter_handler) {
+		*(ebp + 3) &= ~EFL_TF;
+		sysenter_stepping = 1;
+		return;
+	}
+
 	if (cs == SEGSEL_KERNEL_CS) {
 		panic("[Kernel mode] Debug condition encountered at 0x%x."
 				"Please contact kernel developers.", eip);
@@ -0,0 +1,68 @@
+/** @file idle.c
+ *  @brief Kernel thread which halts the CPU when no other thread can run.
+ *
+ *  The idle thread is never runnable in the scheduler's sense: it is in no
+ *  runnable tree, and get_next_run() only returns it when both trees are
+ *  empty. It halts until the next interrupt, and if the interrupt made a
+ *  thread runnable, run_irq_handler() switches to that thread on the way
+ *  out, so the wakeup does not wait for the idle thread's time slice to
+ *  end.
+ *
+ *  Like the reaper, the idle thread belongs to a task of its own whose page
+ *  directory is the initial page directory, and never leaves kernel mode.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <idle.h>
+#include <task_manager.h>			/* create_pcb, create_tcb */
+#include <scheduler.h>				/* set_idle_thread */
+#include <memory_manager.h>			/* get_initial_pd */
+#include <x86/cr.h>					/* get_cr0 */
+#include <stdint.h>					/* uint32_t */
+#include <lib_misc/call_halt.h>		/* call_sti_hlt */
+
+static void idle_main( void );
+
+/** @brief Creates the idle thread and hands it to the scheduler.
+ *
+ *  @return 0 on success, negative value on failure
+ */
+int
+idle_init( void )
+{
+	uint32_t pid, tid;
+	pcb_t *pcb = create_pcb(&pid, get_initial_pd(), NULL);
+	if (!pcb)
+		return -1;
+	set_task_name(pcb, "idle");
+
+	tcb_t *tcb = create_tcb(pcb, &tid);
+	if (!tcb)
+		return -1;
+
+	/* Lay out the stack as context_switch() leaves it, so that switching to
+	 * the idle thread for the first time returns into idle_main() */
+	uint32_t *esp = get_kern_stack_hi(tcb);
+	*(--esp) = 0; /* idle_main() does not return */
+	*(--esp) = (uint32_t) idle_main;
+	for (int i = 0; i < 7; ++i)
+		*(--esp) = 0; /* %ebp, %eax, %ebx, %ecx, %edx, %edi, %esi */
+	*(--esp) = get_cr0();
+	*(--esp) = (uint32_t) get_initial_pd();
+	set_kern_esp(tcb, esp);
+
+	set_idle_thread(tcb);
+	return 0;
+}
+
+/** @brief Body of the idle thread, halts until interrupted, forever.
+ *
+ *  @return Does not return.
+ */
+static void
+idle_main( void )
+{
+	while (1)
+		call_sti_hlt();
+}
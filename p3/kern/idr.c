@@ -0,0 +1,305 @@
+/** @file idr.c
+ *  @brief ID allocator which maps IDs to pointers, see idr.h.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <idr.h>
+#include <stdint.h>		/* uint32_t */
+#include <stddef.h>		/* NULL */
+#include <string.h>		/* memset */
+#include <malloc.h>		/* smalloc */
+#include <assert.h>		/* affirm */
+#include <logger.h>		/* log_warn */
+
+#define ALL_ONES 0xFFFFFFFF
+
+/** @brief Index of the lowest clear bit of a word which is not all ones */
+#define LOWEST_ZERO_BIT(WORD) (__builtin_ctz(~(WORD)))
+
+/** @brief Gets the slot of an ID in use.
+ *
+ *  @pre idr->lock is held
+ *  @param idr ID allocator
+ *  @param id ID
+ *  @return Slot of the ID, NULL if the ID is not in use
+ */
+static idr_slot_t *
+get_slot( idr_t *idr, uint32_t id )
+{
+	if (id == 0 || id >= IDR_MAX_ID)
+		return NULL;
+
+	idr_chunk_t *chunk = idr->chunks[id / IDR_CHUNK_SLOTS];
+	if (!chunk)
+		return NULL;
+
+	idr_slot_t *slot = &chunk->slots[id % IDR_CHUNK_SLOTS];
+	return slot->refs ? slot : NULL;
+}
+
+/** @brief Marks an ID as used or free, updating which chunks are full.
+ *
+ *  @pre idr->lock is held
+ *  @param idr ID allocator
+ *  @param id ID
+ *  @param used 1 to mark the ID used, 0 to mark it free
+ *  @return Void.
+ */
+static void
+mark_id( idr_t *idr, uint32_t id, int used )
+{
+	uint32_t c = id / IDR_CHUNK_SLOTS;
+	uint32_t i = id % IDR_CHUNK_SLOTS;
+	idr_chunk_t *chunk = idr->chunks[c];
+	affirm(chunk);
+
+	uint32_t bit = 1U << (i % IDR_WORD_BITS);
+	uint32_t chunk_bit = 1U << (c % IDR_WORD_BITS);
+	uint32_t group_bit = 1U << ((c / IDR_WORD_BITS) % IDR_WORD_BITS);
+	uint32_t *group_word = &idr->full_groups[c / IDR_WORD_BITS
+	                                         / IDR_WORD_BITS];
+
+	if (!used) {
+		chunk->used[i / IDR_WORD_BITS] &= ~bit;
+		idr->full_chunks[c / IDR_WORD_BITS] &= ~chunk_bit;
+		*group_word &= ~group_bit;
+		return;
+	}
+	chunk->used[i / IDR_WORD_BITS] |= bit;
+	for (int w = 0; w < IDR_CHUNK_SLOTS / IDR_WORD_BITS; ++w) {
+		if (chunk->used[w] != ALL_ONES)
+			return;
+	}
+	idr->full_chunks[c / IDR_WORD_BITS] |= chunk_bit;
+	if (idr->full_chunks[c / IDR_WORD_BITS] == ALL_ONES)
+		*group_word |= group_bit;
+}
+
+/** @brief Initializes an ID allocator with no IDs in use.
+ *
+ *  @param idr ID allocator
+ *  @return 0 on success, negative value on failure
+ */
+int
+idr_init( idr_t *idr )
+{
+	affirm(idr);
+
+	memset(idr->full_groups, 0, sizeof(idr->full_groups));
+	memset(idr->full_chunks, 0, sizeof(idr->full_chunks));
+	for (int i = 0; i < IDR_NUM_CHUNKS; ++i)
+		idr->chunks[i] = NULL;
+
+	/* Lookups far outnumber changes, which must not wait behind them */
+	if (rwlock_init(&idr->lock) < 0)
+		return -1;
+	rwlock_set_prefer_writers(&idr->lock, 1);
+
+	/* Reserve ID 0, which is never handed out */
+	idr->chunks[0] = smalloc(sizeof(idr_chunk_t));
+	if (!idr->chunks[0])
+		return -1;
+	memset(idr->chunks[0], 0, sizeof(idr_chunk_t));
+	idr->chunks[0]->slots[0].refs = 1;
+	mark_id(idr, 0, 1);
+	return 0;
+}
+
+/** @brief Hands out the lowest free ID.
+ *
+ *  @param idr ID allocator
+ *  @param ptr Pointer the ID maps to
+ *  @param idp Where the ID is stored
+ *  @return 0 on success, negative value if out of IDs or memory
+ */
+int
+idr_alloc( idr_t *idr, void *ptr, uint32_t *idp )
+{
+	affirm(idr);
+	affirm(idp);
+
+	rwlock_write_lock(&idr->lock);
+
+	/* First group with a chunk that is not full */
+	int g = 0;
+	int num_groups = IDR_NUM_CHUNKS / IDR_WORD_BITS / IDR_WORD_BITS;
+	while (g < num_groups && idr->full_groups[g] == ALL_ONES)
+		++g;
+	if (g == num_groups) {
+		rwlock_write_unlock(&idr->lock);
+		log_warn("idr_alloc(): out of IDs");
+		return -1;
+	}
+	uint32_t word = g * IDR_WORD_BITS + LOWEST_ZERO_BIT(idr->full_groups[g]);
+	uint32_t c = word * IDR_WORD_BITS
+	             + LOWEST_ZERO_BIT(idr->full_chunks[word]);
+
+	idr_chunk_t *chunk = idr->chunks[c];
+	if (!chunk) {
+		chunk = smalloc(sizeof(idr_chunk_t));
+		if (!chunk) {
+			rwlock_write_unlock(&idr->lock);
+			log_warn("idr_alloc(): unable to allocate chunk %lu", c);
+			return -1;
+		}
+		memset(chunk, 0, sizeof(idr_chunk_t));
+		idr->chunks[c] = chunk;
+	}
+	int w = 0;
+	while (chunk->used[w] == ALL_ONES)
+		++w;
+	uint32_t i = w * IDR_WORD_BITS + LOWEST_ZERO_BIT(chunk->used[w]);
+	uint32_t id = c * IDR_CHUNK_SLOTS + i;
+
+	chunk->slots[i].ptr = ptr;
+	chunk->slots[i].refs = 1;
+	mark_id(idr, id, 1);
+
+	rwlock_write_unlock(&idr->lock);
+	*idp = id;
+	return 0;
+}
+
+/** @brief Looks up the pointer an ID maps to.
+ *
+ *  @param idr ID allocator
+ *  @param id ID
+ *  @return Pointer the ID maps to, NULL if the ID is not in use or was
+ *          cleared with idr_set()
+ */
+void *
+idr_find( idr_t *idr, uint32_t id )
+{
+	affirm(idr);
+
+	rwlock_read_lock(&idr->lock);
+	idr_slot_t *slot = get_slot(idr, id);
+	void *ptr = slot ? slot->ptr : NULL;
+	rwlock_read_unlock(&idr->lock);
+	return ptr;
+}
+
+/** @brief Looks up the pointer an ID maps to, and calls a function on it
+ *         before the mapping can change, e.g. to take a reference on it.
+ *
+ *  The function runs with idr->lock read locked, possibly alongside other
+ *  lookups. It must be short, safe to run concurrently with itself and must
+ *  not call back into this ID allocator.
+ *
+ *  @param idr ID allocator
+ *  @param id ID
+ *  @param hold Function called with the pointer if there is one
+ *  @return Pointer the ID maps to, NULL if the ID is not in use or was
+ *          cleared with idr_set()
+ */
+void *
+idr_find_hold( idr_t *idr, uint32_t id, void (*hold)( void *ptr ) )
+{
+	affirm(idr);
+	affirm(hold);
+
+	rwlock_read_lock(&idr->lock);
+	idr_slot_t *slot = get_slot(idr, id);
+	void *ptr = slot ? slot->ptr : NULL;
+	if (ptr)
+		hold(ptr);
+	rwlock_read_unlock(&idr->lock);
+	return ptr;
+}
+
+/** @brief Changes the pointer an ID in use maps to.
+ *
+ *  @param idr ID allocator
+ *  @param id ID in use
+ *  @param ptr New pointer, NULL to hide the ID from idr_find()
+ *  @return Void.
+ */
+void
+idr_set( idr_t *idr, uint32_t id, void *ptr )
+{
+	affirm(idr);
+
+	rwlock_write_lock(&idr->lock);
+	idr_slot_t *slot = get_slot(idr, id);
+	affirm_msg(slot, "idr_set(): id:%lu not in use", id);
+	slot->ptr = ptr;
+	rwlock_write_unlock(&idr->lock);
+}
+
+/** @brief Takes another reference on an ID in use.
+ *
+ *  @param idr ID allocator
+ *  @param id ID in use
+ *  @return Void.
+ */
+void
+idr_get( idr_t *idr, uint32_t id )
+{
+	affirm(idr);
+
+	rwlock_write_lock(&idr->lock);
+	idr_slot_t *slot = get_slot(idr, id);
+	affirm_msg(slot, "idr_get(): id:%lu not in use", id);
+	slot->refs++;
+	rwlock_write_unlock(&idr->lock);
+}
+
+/** @brief Drops a reference on an ID, freeing it with the last reference.
+ *
+ *  @param idr ID allocator
+ *  @param id ID in use
+ *  @return Void.
+ */
+void
+idr_put( idr_t *idr, uint32_t id )
+{
+	affirm(idr);
+
+	rwlock_write_lock(&idr->lock);
+	idr_slot_t *slot = get_slot(idr, id);
+	affirm_msg(slot, "idr_put(): id:%lu not in use", id);
+	if (--slot->refs == 0) {
+		slot->ptr = NULL;
+		mark_id(idr, id, 0);
+	}
+	rwlock_write_unlock(&idr->lock);
+}
+
+/** @brief Calls a function on every ID in use which maps to a pointer, in
+ *         increasing ID order.
+ *
+ *  The function runs with idr->lock read locked, so the mapping of the ID it
+ *  is called on cannot change under it. It must be short and must not call
+ *  back into this ID allocator.
+ *
+ *  @param idr ID allocator
+ *  @param fn Function called with each ID, its pointer and data
+ *  @param data Passed on to fn
+ *  @return Void.
+ */
+void
+idr_for_each( idr_t *idr, void (*fn)( uint32_t id, void *ptr, void *data ),
+              void *data )
+{
+	affirm(idr);
+	affirm(fn);
+
+	rwlock_read_lock(&idr->lock);
+	for (uint32_t c = 0; c < IDR_NUM_CHUNKS; ++c) {
+		idr_chunk_t *chunk = idr->chunks[c];
+		if (!chunk)
+			continue;
+		for (int w = 0; w < IDR_CHUNK_SLOTS / IDR_WORD_BITS; ++w) {
+			uint32_t used = chunk->used[w];
+			while (used) {
+				int b = __builtin_ctz(used);
+				used &= used - 1;
+				uint32_t i = w * IDR_WORD_BITS + b;
+				if (chunk->slots[i].ptr)
+					fn(c * IDR_CHUNK_SLOTS + i, chunk->slots[i].ptr, data);
+			}
+		}
+	}
+	rwlock_read_unlock(&idr->lock);
+}
@@ -0,0 +1,15 @@
+/** @file asm_fs_handlers.h
+ *  @brief Assembly wrappers to call file system syscall handlers
+ */
+
+#ifndef ASM_FS_HANDLERS_H_
+#define ASM_FS_HANDLERS_H_
+
+void call_open(void);
+void call_read(void);
+void call_write(void);
+void call_lseek(void);
+void call_close(void);
+void call_unlink(void);
+
+#endif /* ASM_FS_HANDLERS_H_ */
@@ -13,6 +13,8 @@ extern void call_vanish( void );
 extern void call_task_vanish( void );
 extern void call_set_status( void );
 extern void call_wait( void );
+extern void call_waitpid( void );
+extern void call_wait_many( void );
 extern void call_thread_fork( void );
 
 #endif /* ASM_LIFE_CYCLE_HANDLERS_H_ */
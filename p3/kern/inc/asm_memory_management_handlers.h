@@ -13,5 +13,7 @@ void call_new_pages( void );
 
 void call_remove_pages( void );
 
+void call_map_file( void );
+
 #endif /* ASM_MEMORY_MANAGEMENT_HANDLERS_H_ */
 
@@ -8,5 +8,7 @@
 void call_halt(void);
 void call_readfile(void);
 void call_misbehave(void);
+void call_getrusage(void);
+void call_task_snapshot(void);
 
 #endif /* ASM_MISC_HANDLERS_H_ */
@@ -14,5 +14,14 @@ extern void call_deschedule( void );
 extern void call_make_runnable( void );
 extern void call_sleep( void );
 extern void call_swexn( void );
+extern void call_thread_exit( void );
+extern void call_thread_join( void );
+extern void call_set_priority( void );
+extern void call_set_deadline( void );
+extern void call_wait_period( void );
+extern void call_set_group_quota( void );
+extern void call_join_group( void );
+extern void call_set_wake_policy( void );
+extern void call_set_gang_batch( void );
 
 #endif /* ASM_THREAD_MANAGEMENT_HANDLERS_H_ */
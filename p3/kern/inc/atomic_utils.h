@@ -21,4 +21,10 @@ uint32_t compare_and_swap_atomic( uint32_t *at,
  *  @return Value at location before adding 1 */
 uint32_t add_one_atomic( uint32_t *at );
 
+/** @brief Subtracts one atomically from some value.
+ *
+ *  @param at Location to subtract one from
+ *  @return Value at location before subtracting 1 */
+uint32_t sub_one_atomic( uint32_t *at );
+
 #endif /* ATOMIC_UTILS_H_ */
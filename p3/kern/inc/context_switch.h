@@ -3,6 +3,11 @@
 #ifndef CONTEXT_SWITCH_H_
 #define CONTEXT_SWITCH_H_
 
+#include <stdint.h> /* uint32_t */
+
+/* Times context_switch() loaded a different page directory since boot */
+extern volatile uint32_t cr3_writes;
+
 /** @brief Switches between two threads, saving the current
  *		   thread's registers and updating current register's
  *		   to the new thread's.
@@ -15,5 +20,13 @@
  *	@return Returns with new context (ie doesn't return in C sense) */
 void context_switch( void **save_esp, void *restore_esp );
 
+/** @brief Calls a function on another stack, returning on the current one.
+ *
+ *	@param func Function to call
+ *	@param stack_hi Address just above the top of the other stack, the
+ *		   function's return address is pushed right below it
+ *	@return Void. */
+void call_on_stack( void (*func)( void ), void *stack_hi );
+
 #endif /* CONTEXT_SWITCH_H_ */
 
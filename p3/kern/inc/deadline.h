@@ -0,0 +1,25 @@
+/** @file deadline.h
+ *  @brief Deadline class of periodic threads, which run earliest deadline
+ *         first ahead of every other thread, see scheduler.c.
+ *
+ *  set_deadline() puts the calling thread in the deadline class, with a
+ *  period, a runtime budget per period and a deadline relative to the start
+ *  of each period, all in ticks. It fails if the deadline threads' budgets
+ *  over deadlines would add up to more than one. wait_period() ends the
+ *  thread's work for the current period and sleeps until the next one.
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef DEADLINE_H_
+#define DEADLINE_H_
+
+/* Longest period in ticks */
+#define DL_MAX_PERIOD 65535
+
+int set_deadline( int period, int runtime, int deadline );
+int wait_period( void );
+
+#endif /* DEADLINE_H_ */
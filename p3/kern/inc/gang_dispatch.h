@@ -0,0 +1,23 @@
+/** @file gang_dispatch.h
+ *  @brief Dispatching threads of one task in batches, see scheduler.c.
+ *
+ *  Switching between threads of different tasks loads %cr3, which flushes
+ *  the TLB. set_gang_batch() lets up to batch switches in a row stay in the
+ *  running thread's task, so its threads run back to back in a warm TLB,
+ *  as long as they are not far ahead of the leftmost thread. A batch of 0
+ *  turns this off, which is the default.
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef GANG_DISPATCH_H_
+#define GANG_DISPATCH_H_
+
+/* Most switches in a row set_gang_batch() may keep within a task */
+#define GANG_BATCH_MAX 64
+
+int set_gang_batch( int batch );
+
+#endif /* GANG_DISPATCH_H_ */
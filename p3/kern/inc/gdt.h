@@ -0,0 +1,14 @@
+/** @file gdt.h
+ *  @brief Access to the global descriptor table. */
+
+#ifndef GDT_H_
+#define GDT_H_
+
+#include <stdint.h> /* uint32_t */
+
+/** @brief Gets the linear address of the GDT, as sgdt reads it.
+ *
+ *  @return Base address of the GDT */
+uint32_t gdt_base_addr( void );
+
+#endif /* GDT_H_ */
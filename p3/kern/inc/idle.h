@@ -0,0 +1,12 @@
+/** @file idle.h
+ *  @brief Kernel thread which halts the CPU when no other thread can run.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef IDLE_H_
+#define IDLE_H_
+
+int idle_init( void );
+
+#endif /* IDLE_H_ */
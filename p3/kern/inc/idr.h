@@ -0,0 +1,78 @@
+/** @file idr.h
+ *  @brief ID allocator which maps IDs to pointers.
+ *
+ *  Hands out the lowest free ID between 1 and IDR_MAX_ID - 1, 0 is never
+ *  handed out so it can mean "no ID". Slots live in chunks of
+ *  IDR_CHUNK_SLOTS, allocated the first time one of their IDs is handed out
+ *  and never freed. Two levels of bitmaps above the chunks record which
+ *  chunks are full, so finding the lowest free ID, like looking one up, takes
+ *  a bounded number of steps however many IDs are in use.
+ *
+ *  Every ID has a reference count. idr_alloc() returns an ID holding one
+ *  reference, and the ID is only recycled when idr_put() drops the last one,
+ *  so holders of an ID can keep it from being reused while they still look
+ *  it up. The pointer an ID maps to is separate, idr_set() may clear it
+ *  while references remain, after which lookups return NULL.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef IDR_H_
+#define IDR_H_
+
+#include <stdint.h> /* uint32_t */
+#include <lib_thread_management/rwlock.h> /* rwlock_t */
+
+#define IDR_WORD_BITS 32
+
+/* 512 slots of 8 bytes, a chunk is about a page */
+#define IDR_CHUNK_SLOTS 512
+#define IDR_NUM_CHUNKS 2048
+#define IDR_MAX_ID (IDR_NUM_CHUNKS * IDR_CHUNK_SLOTS)
+
+/** @brief A slot for one ID
+ *
+ *  @param ptr Pointer the ID maps to
+ *  @param refs References held on the ID, 0 if the ID is free
+ */
+typedef struct {
+	void *ptr;
+	uint32_t refs;
+} idr_slot_t;
+
+/** @brief A chunk of consecutive IDs
+ *
+ *  @param used Bit i set if slot i is in use
+ *  @param slots Slots of the chunk's IDs
+ */
+typedef struct {
+	uint32_t used[IDR_CHUNK_SLOTS / IDR_WORD_BITS];
+	idr_slot_t slots[IDR_CHUNK_SLOTS];
+} idr_chunk_t;
+
+/** @brief An ID allocator
+ *
+ *  @param lock Guards every other field, read locked by lookups
+ *  @param full_groups Bit i set if all IDR_WORD_BITS chunks of full_chunks
+ *         word i are full
+ *  @param full_chunks Bit i set if chunk i is full
+ *  @param chunks Chunks, NULL until first used
+ */
+typedef struct {
+	rwlock_t lock;
+	uint32_t full_groups[IDR_NUM_CHUNKS / IDR_WORD_BITS / IDR_WORD_BITS];
+	uint32_t full_chunks[IDR_NUM_CHUNKS / IDR_WORD_BITS];
+	idr_chunk_t *chunks[IDR_NUM_CHUNKS];
+} idr_t;
+
+int idr_init( idr_t *idr );
+int idr_alloc( idr_t *idr, void *ptr, uint32_t *idp );
+void *idr_find( idr_t *idr, uint32_t id );
+void *idr_find_hold( idr_t *idr, uint32_t id, void (*hold)( void *ptr ) );
+void idr_set( idr_t *idr, uint32_t id, void *ptr );
+void idr_get( idr_t *idr, uint32_t id );
+void idr_put( idr_t *idr, uint32_t id );
+void idr_for_each( idr_t *idr, void (*fn)( uint32_t id, void *ptr, void *data ),
+                   void *data );
+
+#endif /* IDR_H_ */
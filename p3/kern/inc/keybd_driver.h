@@ -16,6 +16,7 @@ typedef uint8_t raw_byte;
 
 void init_keybd(void);
 void keybd_int_handler(void);
+int has_next_aug_char( void );
 int get_next_aug_char( aug_char *next_char );
 
 /** @brief unbounded circular array heavily inspired by 15-122 unbounded array
@@ -0,0 +1,29 @@
+/** @file kstack.h
+ *  @brief Allocator of thread kernel stacks with guard pages, and the
+ *         interrupt stack.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef KSTACK_H_
+#define KSTACK_H_
+
+#include <page.h> /* PAGE_SIZE */
+
+/* Most freed kernel stacks kept for reuse */
+#define KSTACK_CACHE_MAX 64
+
+/* Stack the timer and keyboard handlers run on */
+#define IRQ_STACK_SIZE (2 * PAGE_SIZE)
+
+/* Unused kernel stack words hold this, see kstack_high_water_mark() */
+#define KSTACK_POISON 0xdeadbeef
+
+int kstack_init( void );
+void *kstack_alloc( void );
+void kstack_free( void *stack_lo, int tid );
+int is_kstack_guard( void *stack_lo, void *addr );
+void *get_irq_stack_lo( void );
+int kstack_high_water_mark( void *stack_lo, int len );
+
+#endif /* KSTACK_H_ */
@@ -9,6 +9,9 @@
 
 int getbytes( const char *filename, int offset, int size, char *buf );
 
+int get_ramdisk_file( const char *filename, const char **execbytesp,
+                      int *execlenp );
+
 int execute_user_program( char *fname, char **argv);
 
 int load_initial_user_program( char *fname, int argc, char **argv );
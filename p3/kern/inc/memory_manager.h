@@ -48,10 +48,16 @@ typedef enum write_mode write_mode_t;
 enum write_mode { READ_ONLY, READ_WRITE, READ };
 
 void *new_pd_from_elf( simple_elf_t *elf );
+int reuse_pd_for_elf( void *pd, simple_elf_t *elf, uint32_t stack_lo,
+                      uint32_t stack_len );
 void *new_pd_from_parent( void *parent_pd );
 void vm_enable_task( void *ptd );
 void enable_write_protection( void );
 void disable_write_protection( void );
+void *map_phys_frame( uint32_t phys_address );
+void unmap_phys_frame( void *window );
+void set_guard_page( void *page, int is_guard );
+uint32_t smalloc_calls( void );
 int vm_new_pages ( void *ptd, void *base, int len );
 
 int is_valid_pt( uint32_t *pt, int pd_index );
@@ -60,10 +66,12 @@ int is_valid_pd( void *pd );
 int is_user_pointer_allocated( void *ptr );
 
 int is_valid_user_pointer( void *ptr, write_mode_t write_mode );
+int is_valid_user_buffer( char *buf, int len, write_mode_t write_mode );
 int is_valid_user_string( char *s, int max_len );
 int is_valid_null_terminated_user_string( char *s, int max_len );
 int is_valid_user_argvec( char *execname, char **argvec );
 void free_pd_memory( void *pd );
+int free_pd_memory_some( void *pd, int *next, int max_tables );
 
 int allocate_user_zero_frame( uint32_t **pd, uint32_t virtual_address,
 							  uint32_t sys_prog_flag );
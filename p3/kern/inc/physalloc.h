@@ -19,6 +19,7 @@ int is_physframe( uint32_t phys_address );
 uint32_t physalloc( void );
 void physfree( uint32_t phys_address );
 uint32_t num_free_phys_frames( void );
+uint32_t physalloc_calls( void );
 
 /* Test functions */
 void test_physalloc( void );
@@ -0,0 +1,27 @@
+/** @file priority.h
+ *  @brief Nice values of threads and tasks, which weigh their share of the
+ *         CPU, see scheduler.c.
+ *
+ *  set_priority() sets the nice value of one thread, or of every thread of
+ *  a task. New threads take the nice value of the thread creating them, so
+ *  it carries over fork() and thread_fork().
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef PRIORITY_H_
+#define PRIORITY_H_
+
+/* Range of nice values, lower ones get more of the CPU */
+#define NICE_MIN -20
+#define NICE_MAX 19
+
+/* set_priority() which */
+#define PRIO_THREAD 0
+#define PRIO_TASK 1
+
+int set_priority( int which, int id, int nice );
+
+#endif /* PRIORITY_H_ */
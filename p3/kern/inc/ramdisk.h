@@ -0,0 +1,63 @@
+/** @file ramdisk.h
+ *  @brief Compressed RAM disk file format and access functions.
+ *
+ *  A RAM disk file may be stored compressed by tools/rdcompress. A compressed
+ *  file starts with a ramdisk_header_t, followed by num_blocks + 1 block
+ *  offsets, followed by the compressed blocks. Block i holds raw bytes
+ *  [i * RAMDISK_BLOCK_SIZE, (i + 1) * RAMDISK_BLOCK_SIZE) of the file, and
+ *  its compressed bytes are [offsets[i], offsets[i + 1]) relative to the end
+ *  of the offset table. A block whose compressed length equals its raw
+ *  length is stored as is, otherwise it is an LZ4 block.
+ *
+ *  Other files are stored raw, so both formats coexist on the same RAM disk.
+ *  rdcompress also generates the table ramdisk_compressed_names, which lists
+ *  the files it stores compressed. The kernel goes by that table, the magic
+ *  number is only checked on files it lists.
+ *
+ *  This header is also compiled into the host side tools/rdcompress, so it
+ *  must only depend on stdint.h.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef RAMDISK_H_
+#define RAMDISK_H_
+
+#include <stdint.h> /* uint32_t */
+
+/* "LZRD" read as a little endian uint32_t */
+#define RAMDISK_MAGIC 0x44525a4c
+
+/* Raw bytes per compressed block, one page so exec() loads page by page */
+#define RAMDISK_BLOCK_SIZE 4096
+
+/** @brief Header at the start of every compressed RAM disk file
+ *
+ *  @param magic RAMDISK_MAGIC
+ *  @param raw_len Length of the uncompressed file
+ *  @param num_blocks Number of compressed blocks
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t raw_len;
+	uint32_t num_blocks;
+} ramdisk_header_t;
+
+/* Name of the table rdcompress generates */
+#define RAMDISK_TABLE_NAME "ramdisk_compressed_names"
+
+#ifndef RAMDISK_HOST_TOOL
+
+/* Names of the RAM disk files stored compressed, NULL terminated, generated
+ * by rdcompress or empty in ramdisk_uncompressed.c */
+extern const char *ramdisk_compressed_names[];
+
+int ramdisk_init( void );
+int ramdisk_is_compressed( const char *execbytes, int execlen );
+int ramdisk_file_len( const char *execbytes, int execlen );
+int ramdisk_getbytes( const char *execbytes, int execlen, int offset,
+                      int size, char *buf );
+
+#endif /* RAMDISK_HOST_TOOL */
+
+#endif /* RAMDISK_H_ */
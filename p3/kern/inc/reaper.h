@@ -0,0 +1,16 @@
+/** @file reaper.h
+ *  @brief Kernel thread which frees the memory of vanished tasks.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef REAPER_H_
+#define REAPER_H_
+
+#include <task_manager.h> /* pcb_t, tcb_t */
+
+int reaper_init( void );
+int reap_task_later( pcb_t *owning_task, tcb_t *last_tcb );
+void reap_tcb_later( tcb_t *tcb );
+
+#endif /* REAPER_H_ */
@@ -0,0 +1,69 @@
+/** @file rusage.h
+ *  @brief CPU and resource usage accounting of threads and tasks.
+ *
+ *  Every thread counts its own usage in its TCB. A vanishing thread folds
+ *  its usage into its task's PCB, and wait() folds a reaped child task's
+ *  usage, its own and its reaped children's, into the parent's PCB.
+ *  getrusage() reports the usage of the calling thread, its task or its
+ *  task's reaped children.
+ *
+ *  The rusage_t layout and the RUSAGE_* definitions have to match the ones
+ *  in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef RUSAGE_H_
+#define RUSAGE_H_
+
+#include <stdint.h> /* uint32_t, uint64_t */
+#include <task_manager.h> /* pcb_t, tcb_t */
+
+/* getrusage() who */
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN 1
+#define RUSAGE_THREAD 2
+
+/** @brief Usage counters kept in TCBs and PCBs
+ *
+ *  @param runtime CPU time in TSC cycles
+ *  @param voluntary_switches Times switched out by blocking or yielding
+ *  @param involuntary_switches Times preempted
+ *  @param page_faults Page faults taken
+ *  @param syscalls System calls made
+ *  @param threads Threads counted
+ */
+typedef struct {
+	uint64_t runtime;
+	uint32_t voluntary_switches;
+	uint32_t involuntary_switches;
+	uint32_t page_faults;
+	uint32_t syscalls;
+	uint32_t threads;
+} usage_t;
+
+/** @brief Usage as getrusage() reports it
+ *
+ *  Same as usage_t, plus the CPU time in milliseconds.
+ */
+typedef struct {
+	uint64_t runtime_cycles;
+	uint32_t runtime_ms;
+	uint32_t voluntary_switches;
+	uint32_t involuntary_switches;
+	uint32_t page_faults;
+	uint32_t syscalls;
+	uint32_t threads;
+} rusage_t;
+
+void usage_init( usage_t *usage );
+void usage_add( usage_t *to, const usage_t *from );
+void count_syscall( void );
+void count_page_fault( void );
+void fold_thread_usage( tcb_t *tcb );
+void fold_child_usage( pcb_t *parent, pcb_t *child );
+void get_task_usage( pcb_t *pcb, usage_t *usage );
+uint32_t cycles_to_ms( uint64_t cycles );
+int getrusage( int who, rusage_t *rusage );
+
+#endif /* RUSAGE_H_ */
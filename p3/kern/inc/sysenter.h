@@ -0,0 +1,55 @@
+/** @file sysenter.h
+ *  @brief Fast system call entry with sysenter and sysexit, next to the
+ *         INT gates, see sysenter.c */
+
+#ifndef SYSENTER_H_
+#define SYSENTER_H_
+
+#include <stdint.h> /* uint32_t */
+
+/* MSRs sysenter takes the kernel's code segment, stack and entry point
+ * from */
+#define IA32_SYSENTER_CS	0x174
+#define IA32_SYSENTER_ESP	0x175
+#define IA32_SYSENTER_EIP	0x176
+
+/* cpuid leaf, and bit of %edx in it, telling whether the CPU has sysenter
+ * and sysexit */
+#define CPUID_FEATURES	1
+#define CPUID_SEP		(1 << 11)
+
+/* Offset of esp0 in the TSS */
+#define TSS_ESP0_OFFSET 4
+
+/* Words of the stack sysenter starts on. Only the debug handler ever runs
+ * on it, see debug_handler() */
+#define SYSENTER_STACK_WORDS 256
+
+/* One dispatch table entry per IDT vector, the system call numbers taken
+ * in %eax are the vectors of the matching INT gates */
+#define SYSENTER_VECTORS 256
+
+/** @brief A system call the fast entry dispatches to
+ *
+ *  @param vector   IDT vector of the same system call's INT gate
+ *  @param handler  C handler, which the INT gate's wrapper calls too
+ *  @param num_args 0 or 1 for an argument in %esi itself, more for a
+ *                  packet of that many arguments %esi points to
+ */
+typedef struct {
+	uint32_t vector;
+	void (*handler)( void );
+	uint32_t num_args;
+} fast_syscall_t;
+
+int install_sysenter( void );
+int sysenter_dispatch( uint32_t vector, uint32_t *args );
+
+/* Defined in sysenter.S */
+void sysenter_handler( void );
+extern uint32_t sysenter_stepping;
+uint32_t cpuid_edx( uint32_t leaf );
+extern fast_syscall_t fast_syscalls[];
+extern uint32_t num_fast_syscalls;
+
+#endif /* SYSENTER_H_ */
@@ -0,0 +1,27 @@
+/** @file task_group.h
+ *  @brief Task groups, whose tasks share a quota of CPU time per period,
+ *         see scheduler.c.
+ *
+ *  Every task starts in its parent's task group, group 0 for the first
+ *  tasks, and join_group() moves the calling task to another one.
+ *  set_group_quota() gives a group other than 0 a quota of ticks per
+ *  period, which the group's threads are throttled at.
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef TASK_GROUP_H_
+#define TASK_GROUP_H_
+
+/* Number of task groups, group 0 never has a quota */
+#define TASK_GROUP_MAX 16
+
+/* Longest quota period in ticks */
+#define TASK_GROUP_MAX_PERIOD 65535
+
+int set_group_quota( int group, int quota, int period );
+int join_group( int group );
+
+#endif /* TASK_GROUP_H_ */
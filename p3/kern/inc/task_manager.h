@@ -11,7 +11,8 @@
 #include <stdint.h>    /* uint32_t */
 #include <elf_410.h>   /* simple_elf_t */
 
-#define KERNEL_THREAD_STACK_SIZE (2 * PAGE_SIZE)
+/* Interrupt handlers run on their own stack, see kstack.h */
+#define KERNEL_THREAD_STACK_SIZE (PAGE_SIZE)
 #define USER_THREAD_STACK_SIZE (2 * PAGE_SIZE)
 
 typedef enum status status_t;
@@ -30,7 +31,12 @@ void task_start( uint32_t tid, uint32_t esp, uint32_t entry_point );
 
 /* Utility functions for getting and setting task and thread information */
 tcb_t *find_tcb( uint32_t tid );
+tcb_t *find_and_get_tcb( uint32_t tid );
+void put_tcb( tcb_t *tcb );
+int no_tcb_lookups( void );
+void free_tcb_memory( tcb_t *tcb );
 pcb_t *find_pcb( uint32_t pid );
+pcb_t *find_and_get_pcb( uint32_t pid );
 uint32_t get_pid( void );
 status_t get_tcb_status( tcb_t *tcb );
 uint32_t get_tcb_tid(tcb_t *tcb);
@@ -47,6 +53,9 @@ void free_pcb_but_not_pd(pcb_t *pcb);
 void free_pcb_but_not_pd_no_last_thread( pcb_t *pcb );
 
 void remove_pcb( pcb_t *pcbp );
+void get_pcb( pcb_t *pcb );
+void put_pcb( pcb_t *pcb );
+void for_each_task( void (*fn)( pcb_t *pcb, void *data ), void *data );
 pcb_t *get_init_pcbp( void );
 void register_if_init_task( char *execname, uint32_t pid );
 
@@ -0,0 +1,92 @@
+/** @file task_snapshot.h
+ *  @brief Binary snapshot of the tasks in the system, for ps and top.
+ *
+ *  task_snapshot() fills a user buffer with a task_snapshot_header_t
+ *  followed by num_entries task_snapshot_entry_t, one per task, in
+ *  increasing pid order. Readers check version and step through entries by
+ *  header_size and entry_size, so fields may be added at the end of either
+ *  struct without breaking them. Any other change bumps
+ *  TASK_SNAPSHOT_VERSION.
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef TASK_SNAPSHOT_H_
+#define TASK_SNAPSHOT_H_
+
+#include <stdint.h> /* uint32_t, uint64_t */
+
+#define TASK_SNAPSHOT_VERSION 1
+
+/* Bytes of an entry's execname, including the terminating '\0' */
+#define TASK_SNAPSHOT_NAME_LEN 32
+
+/** @brief Snapshot header
+ *
+ *  @param version TASK_SNAPSHOT_VERSION
+ *  @param header_size Bytes of the header, the first entry follows it
+ *  @param entry_size Bytes of each entry
+ *  @param num_entries Entries in the buffer
+ *  @param num_tasks Tasks found, more than num_entries if the buffer was too
+ *         small for all of them
+ *  @param ticks Timer ticks since boot when the snapshot was taken
+ *  @param tsc_per_tick TSC cycles per timer tick
+ *  @param cr3_writes Times a context switch loaded another task's page
+ *         directory since boot, flushing the TLB
+ */
+typedef struct {
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t num_entries;
+	uint32_t num_tasks;
+	uint32_t ticks;
+	uint32_t tsc_per_tick;
+	uint32_t cr3_writes;
+} task_snapshot_header_t;
+
+/** @brief Snapshot of a task
+ *
+ *  Usage counters are those of rusage.h, summed over the task's active and
+ *  vanished threads.
+ *
+ *  @param pid Task ID
+ *  @param ppid Task ID of its parent, init once the parent has vanished, 0
+ *         if none
+ *  @param execname Executable the task runs, cut short if too long
+ *  @param num_threads Threads which have not vanished
+ *  @param num_running Threads running
+ *  @param num_runnable Threads waiting to run
+ *  @param num_blocked Threads blocked on a lock, a child task or sleep()
+ *  @param num_descheduled Threads descheduled
+ *  @param num_child_tasks Child tasks which have not vanished
+ *  @param runtime_cycles CPU time in TSC cycles
+ *  @param runtime_ms CPU time in milliseconds
+ *  @param voluntary_switches Times switched out by blocking or yielding
+ *  @param involuntary_switches Times preempted
+ *  @param page_faults Page faults taken
+ *  @param syscalls System calls made
+ */
+typedef struct {
+	uint32_t pid;
+	uint32_t ppid;
+	char execname[TASK_SNAPSHOT_NAME_LEN];
+	uint32_t num_threads;
+	uint32_t num_running;
+	uint32_t num_runnable;
+	uint32_t num_blocked;
+	uint32_t num_descheduled;
+	uint32_t num_child_tasks;
+	uint64_t runtime_cycles;
+	uint32_t runtime_ms;
+	uint32_t voluntary_switches;
+	uint32_t involuntary_switches;
+	uint32_t page_faults;
+	uint32_t syscalls;
+} task_snapshot_entry_t;
+
+int task_snapshot( void *buf, int len );
+
+#endif /* TASK_SNAPSHOT_H_ */
@@ -10,8 +10,11 @@
 #ifndef P1_TIMER_DRIVER_H_
 #define P1_TIMER_DRIVER_H_
 
+#include <stdint.h> /* uint32_t */
+
 void init_timer( void (*tickback)(unsigned int) );
 unsigned int get_total_ticks( void );
+uint32_t get_tsc_per_tick( void );
 
 #endif /* P1_TIMER_DRIVER_H_ */
 
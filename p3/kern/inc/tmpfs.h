@@ -0,0 +1,43 @@
+/** @file tmpfs.h
+ *  @brief In-memory file system and per task file descriptor tables.
+ *
+ *  Files created with open() live in memory until unlinked, RAM disk files
+ *  appear read-only in the same namespace. Every task has a table of
+ *  MAX_OPEN_FILES file descriptors, each referring to an open file. fork()
+ *  shares the parent's open files with the child, so both see the same
+ *  file offset, as on Unix.
+ *
+ *  The flag and whence definitions have to match the ones in
+ *  user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef TMPFS_H_
+#define TMPFS_H_
+
+/* File descriptors per task */
+#define MAX_OPEN_FILES 32
+
+/* open() flags, one access mode ORed with any of the others */
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR   2
+#define O_ACCMODE 3
+#define O_CREAT  0x100
+#define O_TRUNC  0x200
+#define O_APPEND 0x400
+
+/* lseek() whence */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+typedef struct open_file open_file_t;
+
+void fd_table_init( open_file_t **fd_table );
+void fd_table_inherit( open_file_t **child_fd_table,
+                       open_file_t **parent_fd_table );
+void fd_table_close_all( open_file_t **fd_table );
+
+#endif /* TMPFS_H_ */
@@ -0,0 +1,31 @@
+/** @file wake_policy.h
+ *  @brief Whether a thread being woken preempts the running thread, see
+ *         scheduler.c.
+ *
+ *  set_wake_policy() picks one of:
+ *  WAKE_TAIL: the woken thread only becomes runnable.
+ *  WAKE_PREEMPT: the woken thread runs right away.
+ *  WAKE_PREEMPT_SLICE: the woken thread runs right away only if the
+ *  running thread has used at least slice_percent of its time slice.
+ *
+ *  These definitions have to match the ones in user/inc/syscall_ext.h
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef WAKE_POLICY_H_
+#define WAKE_POLICY_H_
+
+#define WAKE_TAIL 0
+#define WAKE_PREEMPT 1
+#define WAKE_PREEMPT_SLICE 2
+
+/* A waker which has run half a slice has done most of what it woke others
+ * for, so switching then costs it little, and no thread waits more than
+ * half a slice to be run */
+#define WAKE_DEFAULT_POLICY WAKE_PREEMPT_SLICE
+#define WAKE_DEFAULT_SLICE_PERCENT 50
+
+int set_wake_policy( int policy, int slice_percent );
+
+#endif /* WAKE_POLICY_H_ */
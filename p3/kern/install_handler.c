@@ -26,9 +26,13 @@
 #include <asm_life_cycle_handlers.h>
 #include <asm_thread_management_handlers.h>
 #include <asm_memory_management_handlers.h>
+#include <asm_fs_handlers.h>
 #include <tests.h>                          /* install_test_handler() */
 
 #include <syscall_int.h> /* *_INT */
+#include <syscall_ext_int.h> /* MAP_FILE_INT, OPEN_INT, ... */
+#include <lib_fs/fs.h> /* init_tmpfs() */
+#include <sysenter.h> /* install_sysenter() */
 
 /** @brief INT vector for test suite */
 #define TEST_INT SYSCALL_RESERVED_0
@@ -227,6 +231,51 @@ handler_install(void (*tick)(unsigned int))
 		return -1;
 	}
 
+	if (install_handler(THREAD_EXIT_INT, NULL, call_thread_exit, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(THREAD_JOIN_INT, NULL, call_thread_join, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(SET_PRIORITY_INT, NULL, call_set_priority, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(SET_DEADLINE_INT, NULL, call_set_deadline, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(WAIT_PERIOD_INT, NULL, call_wait_period, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(SET_GROUP_QUOTA_INT, NULL, call_set_group_quota,
+		DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(JOIN_GROUP_INT, NULL, call_join_group, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(SET_WAKE_POLICY_INT, NULL, call_set_wake_policy,
+		DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+
+	if (install_handler(SET_GANG_BATCH_INT, NULL, call_set_gang_batch,
+		DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+
 	/* Lib lifecycle*/
 	if (install_handler(FORK_INT, NULL, call_fork, DPL_3, D32_TRAP) < 0) {
 		return -1;
@@ -248,6 +297,14 @@ handler_install(void (*tick)(unsigned int))
 	if (install_handler(WAIT_INT, NULL, call_wait, DPL_3, D32_TRAP) < 0) {
 		return -1;
 	}
+	if (install_handler(WAITPID_INT, NULL, call_waitpid, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(WAIT_MANY_INT, NULL, call_wait_many, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
 	if (install_handler(THREAD_FORK_INT, NULL, call_thread_fork, DPL_3,
 		D32_TRAP) < 0) {
 		return -1;
@@ -262,6 +319,10 @@ handler_install(void (*tick)(unsigned int))
 		D32_TRAP) < 0) {
 		return -1;
 	}
+	if (install_handler(MAP_FILE_INT, NULL, call_map_file, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
 	if (install_handler(IDT_PF, NULL, call_pagefault_handler, DPL_3,
 		D32_TRAP) < 0) {
 		return -1;
@@ -288,6 +349,28 @@ handler_install(void (*tick)(unsigned int))
 		return -1;
 	}
 
+	/* Lib fs */
+	if (install_handler(OPEN_INT, init_tmpfs, call_open, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(READ_INT, NULL, call_read, DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(WRITE_INT, NULL, call_write, DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(CLOSE_INT, NULL, call_close, DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(UNLINK_INT, NULL, call_unlink, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(LSEEK_INT, NULL, call_lseek, DPL_3, D32_TRAP) < 0) {
+		return -1;
+	}
+
 	/* Lib misc */
 	if (install_handler(READFILE_INT, NULL, call_readfile, DPL_3,
 		D32_TRAP) < 0) {
@@ -301,6 +384,14 @@ handler_install(void (*tick)(unsigned int))
 		D32_TRAP) < 0) {
 		return -1;
 	}
+	if (install_handler(GETRUSAGE_INT, NULL, call_getrusage, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
+	if (install_handler(TASK_SNAPSHOT_INT, NULL, call_task_snapshot, DPL_3,
+		D32_TRAP) < 0) {
+		return -1;
+	}
 
 	/* Fault handlers */
 	if (install_handler(IDT_DE, NULL, call_divide_handler, DPL_3,
@@ -374,6 +465,11 @@ handler_install(void (*tick)(unsigned int))
 		D32_INTERRUPT) < 0) {
 		return -1;
 	}
+
+	/* Fast entry for most of the system calls above, if the CPU has it */
+	if (install_sysenter() < 0) {
+		return -1;
+	}
 	return 0;
 }
 
@@ -34,6 +34,10 @@
 #include <task_manager.h>	/* task_manager_init() */
 #include <memory_manager.h>	/* initialize_zero_frame() */
 #include <keybd_driver.h>	/* readline() */
+#include <reaper.h>			/* reaper_init() */
+#include <idle.h>			/* idle_init() */
+#include <kstack.h>			/* kstack_init() */
+#include <ramdisk.h>			/* ramdisk_init() */
 #include <lib_thread_management/sleep.h>	/* sleep_on_tick() */
 #include <simics.h>
 
@@ -69,25 +73,8 @@ tick( unsigned int numTicks ) {
 	 * to (in most cases). */
 	sleep_on_tick(numTicks);
 
-	/* Validate stack canaries for currently running thread */
-	if (get_running_thread()) {
-		affirm (*((uint32_t *) get_kern_stack_hi((get_running_thread())))
-		== 0xcafebabe);
-
-		affirm(*((uint32_t *) get_kern_stack_lo((get_running_thread())))
-		== 0xdeadbeef);
-	}
-
 	/* Scheduler tick handler should be last, as it triggers context_switch */
 	scheduler_on_tick(numTicks);
-
-	if (get_running_thread()) {
-		affirm (*((uint32_t *) get_kern_stack_hi((get_running_thread())))
-		== 0xcafebabe);
-
-		affirm(*((uint32_t *) get_kern_stack_lo((get_running_thread())))
-		== 0xdeadbeef);
-	}
 }
 
 /** @brief Kernel entrypoint.
@@ -115,6 +102,12 @@ kernel_main( mbinfo_t *mbinfo, int argc, char **argv, char **envp )
 
 	init_memory_manager();
 
+	/* Kernel stack guard pages live in the initial page directory */
+	affirm(kstack_init() == 0);
+
+	/* Before the first program is read off the RAM disk */
+	affirm(ramdisk_init() == 0);
+
 	log("this is DEBUG");
 	log_info("this is INFO");
 	log_warn("this is WARN");
@@ -122,8 +115,11 @@ kernel_main( mbinfo_t *mbinfo, int argc, char **argv, char **envp )
 	char *init_args[] = {"init", 0};
 	affirm(load_initial_user_program("init", 1, init_args) == 0);
 
-	char *idle_args[] = {"idle", 0};
-	affirm(load_initial_user_program("idle", 1, idle_args) == 0);
+	/* After the initial programs, which must run first */
+	affirm(reaper_init() == 0);
+
+	/* Runs in the kernel whenever nothing else can */
+	affirm(idle_init() == 0);
 
 	start_first_running_thread();
 
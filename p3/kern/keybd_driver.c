@@ -117,6 +117,18 @@ init_keybd( void )
 /*																	 */
 /*********************************************************************/
 
+/** @brief Whether there are scancodes left to read.
+ *
+ *  Does not touch the interrupt flag, so that it may be checked with
+ *  interrupts disabled, see wait_event().
+ *
+ *  @return 1 if get_next_aug_char() has a scancode to process, 0 otherwise */
+int
+has_next_aug_char( void )
+{
+	return !buf_empty(&key_buf);
+}
+
 /** @brief Gets next aug char.
  *
  *  Not thread-safe.
@@ -0,0 +1,328 @@
+/** @file kstack.c
+ *  @brief Allocator of thread kernel stacks, see kstack.h.
+ *
+ *  Each kernel stack of KERNEL_THREAD_STACK_SIZE bytes sits right above a
+ *  guard page whose direct mapping is removed, so a thread overflowing its
+ *  kernel stack faults on the spot instead of corrupting the memory below.
+ *  The interrupt stack gets a guard page the same way.
+ *
+ *  An overflow usually moves %esp itself into the guard page, leaving the
+ *  processor no stack to push the page fault on. The double fault that
+ *  follows is therefore taken through a task gate, on a TSS and stack of
+ *  its own, and double_fault_task() reports which guard page was hit.
+ *
+ *  Unmapping and mapping the guard page again is what makes a stack
+ *  expensive to create, so freed stacks keep their guard page and go on a
+ *  free list, up to KSTACK_CACHE_MAX of them, for the next thread to reuse.
+ *  The free list is linked through the top word of each free stack.
+ *
+ *  Unused stack words hold KSTACK_POISON, so the deepest a stack was ever
+ *  used can be read off it. A stack is poisoned in full when created and
+ *  only down to its high-water mark when freed, and the largest high-water
+ *  mark of any thread is logged whenever it grows, so stack sizes can be
+ *  tuned from measurements.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <kstack.h>
+#include <page.h>				/* PAGE_SIZE */
+#include <stdint.h>				/* uint32_t */
+#include <stddef.h>				/* NULL */
+#include <malloc.h>				/* smemalign, sfree */
+#include <assert.h>				/* affirm */
+#include <logger.h>				/* log_warn */
+#include <task_manager.h>		/* KERNEL_THREAD_STACK_SIZE */
+#include <memory_manager.h>		/* set_guard_page */
+#include <cr.h>					/* get_cr2(), get_cr3() */
+#include <asm.h>				/* idt_base() */
+#include <idt.h>				/* IDT_DF */
+#include <seg.h>				/* SEGSEL_* */
+#include <gdt.h>				/* gdt_base_addr() */
+#include <scheduler.h>			/* get_running_thread() */
+#include <install_handler.h>	/* BYTES_PER_GATE */
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/* Bytes of one allocation: the guard page and the stack above it */
+#define KSTACK_ALLOC_SIZE (PAGE_SIZE + KERNEL_THREAD_STACK_SIZE)
+
+/* Free list link of a free stack, in its top word */
+#define FREE_LINK(STACK_LO) \
+	(*(void **) ((char *) (STACK_LO) + KERNEL_THREAD_STACK_SIZE \
+	             - sizeof(void *)))
+
+/* Free stacks, linked through their top word */
+static void *free_stacks = NULL;
+static int num_free_stacks = 0;
+static mutex_t kstack_mux;
+
+/* Largest high-water mark of a freed thread kernel stack, in bytes */
+static int max_high_water_mark = 0;
+
+/* Lowest writable address of the interrupt stack */
+static void *irq_stack_lo = NULL;
+
+/* GDT entry of the double fault task's TSS, one the GDT leaves spare */
+#define SEGSEL_DF_TSS SEGSEL_SPARE0
+
+/* Stack double_fault_task() runs on */
+#define DF_STACK_SIZE (2 * PAGE_SIZE)
+
+/* Access byte of a present, DPL 0, available 32 bit TSS descriptor */
+#define TSS_DESC_ACCESS 0x89
+
+/* Access byte of a present, DPL 0 task gate */
+#define TASK_GATE_ACCESS 0x85
+
+/* Kernel mode flags, with only the reserved bit set */
+#define DF_TASK_EFLAGS 0x2
+
+/* 32 bit task state segment, see intel-sys 7.2.1 */
+typedef struct {
+	uint32_t link;
+	uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+	uint32_t cr3, eip, eflags;
+	uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+	uint32_t es, cs, ss, ds, fs, gs, ldt;
+	uint16_t trap, iomap_base;
+} tss_t;
+
+static tss_t df_tss;
+static uint32_t df_stack[DF_STACK_SIZE / sizeof(uint32_t)];
+
+/** @brief Fills part of a stack with KSTACK_POISON
+ *
+ *  @param stack_lo Lowest address to fill
+ *  @param len Bytes to fill
+ *  @return Void.
+ */
+static void
+poison( void *stack_lo, int len )
+{
+	uint32_t *word = stack_lo;
+	for (int i = 0; i < (int) (len / sizeof(uint32_t)); ++i)
+		word[i] = KSTACK_POISON;
+}
+
+/** @brief Allocates a stack above a guard page
+ *
+ *  @param len Bytes of stack, a multiple of PAGE_SIZE
+ *  @return Lowest writable address of the stack, NULL if out of memory
+ */
+static void *
+alloc_guarded( int len )
+{
+	char *guard = smemalign(PAGE_SIZE, PAGE_SIZE + len);
+	if (!guard)
+		return NULL;
+	set_guard_page(guard, 1);
+	poison(guard + PAGE_SIZE, len);
+	return guard + PAGE_SIZE;
+}
+
+/** @brief Gets the base address of the segment a GDT descriptor describes
+ *
+ *  @param sel Segment selector of the descriptor
+ *  @return Base address, scattered over the descriptor
+ */
+static uint32_t
+gdt_desc_base( uint32_t sel )
+{
+	uint8_t *desc = (uint8_t *) gdt_base_addr() + (sel & ~0x7);
+	return desc[2] | (desc[3] << 8) | (desc[4] << 16)
+	       | ((uint32_t) desc[7] << 24);
+}
+
+/** @brief Reports a double fault, which is most likely a kernel stack
+ *         overflow, and stops the kernel.
+ *
+ *  Entered through the double fault task gate with interrupts disabled, on
+ *  df_stack. The task switch saved the state of the thread which faulted
+ *  in the TSS df_tss.link selects. The error code of a double fault, always
+ *  0, sits where a return address would.
+ *
+ *  @return Does not return.
+ */
+static void
+double_fault_task( void )
+{
+	tss_t *prev = (tss_t *) gdt_desc_base(df_tss.link);
+	void *esp = (void *) prev->esp;
+	void *cr2 = (void *) get_cr2();
+
+	tcb_t *tcb = get_running_thread();
+	if (tcb) {
+		void *stack_lo = get_kern_stack_lo(tcb);
+		if (is_kstack_guard(stack_lo, cr2) || is_kstack_guard(stack_lo, esp))
+			panic("double fault: kernel stack overflow in tid:%d eip:0x%lx "
+			      "esp:%p cr2:%p", get_running_tid(), prev->eip, esp, cr2);
+	}
+	if (is_kstack_guard(irq_stack_lo, cr2)
+	    || is_kstack_guard(irq_stack_lo, esp))
+		panic("double fault: interrupt stack overflow eip:0x%lx esp:%p "
+		      "cr2:%p", prev->eip, esp, cr2);
+
+	panic("double fault: eip:0x%lx esp:%p cr2:%p", prev->eip, esp, cr2);
+}
+
+/** @brief Takes double faults through a task gate to double_fault_task().
+ *
+ *  @return 0 on success, negative value if the GDT entry is taken
+ */
+static int
+install_double_fault_task( void )
+{
+	uint8_t *desc = (uint8_t *) gdt_base_addr() + SEGSEL_DF_TSS;
+	if (desc[5] & 0x80)
+		return -1;
+
+	df_tss.cr3 = get_cr3();
+	df_tss.eip = (uint32_t) double_fault_task;
+	df_tss.eflags = DF_TASK_EFLAGS;
+	df_tss.esp = (uint32_t) &df_stack[DF_STACK_SIZE / sizeof(uint32_t)];
+	df_tss.cs = SEGSEL_KERNEL_CS;
+	df_tss.ss = df_tss.ds = df_tss.es = SEGSEL_KERNEL_DS;
+	df_tss.fs = df_tss.gs = SEGSEL_KERNEL_DS;
+	df_tss.iomap_base = sizeof(df_tss);
+
+	uint32_t base = (uint32_t) &df_tss;
+	uint32_t limit = sizeof(df_tss) - 1;
+	desc[0] = limit & 0xff;
+	desc[1] = (limit >> 8) & 0xff;
+	desc[2] = base & 0xff;
+	desc[3] = (base >> 8) & 0xff;
+	desc[4] = (base >> 16) & 0xff;
+	desc[6] = (limit >> 16) & 0xf;
+	desc[7] = base >> 24;
+	desc[5] = TSS_DESC_ACCESS;
+
+	uint32_t *gate = (uint32_t *) ((char *) idt_base()
+	                              + IDT_DF * BYTES_PER_GATE);
+	gate[0] = SEGSEL_DF_TSS << 16;
+	gate[1] = TASK_GATE_ACCESS << 8;
+	return 0;
+}
+
+/** @brief Initializes the kernel stack allocator, the interrupt stack and
+ *         the double fault task reporting overflows.
+ *
+ *  @return 0 on success, negative value on failure
+ */
+int
+kstack_init( void )
+{
+	if (mutex_init(&kstack_mux) < 0)
+		return -1;
+
+	irq_stack_lo = alloc_guarded(IRQ_STACK_SIZE);
+	if (!irq_stack_lo)
+		return -1;
+
+	return install_double_fault_task();
+}
+
+/** @brief Gets the interrupt stack.
+ *
+ *  @return Lowest writable address of the IRQ_STACK_SIZE interrupt stack,
+ *          NULL before kstack_init()
+ */
+void *
+get_irq_stack_lo( void )
+{
+	return irq_stack_lo;
+}
+
+/** @brief Hands out a kernel stack, reusing a freed one if possible.
+ *
+ *  Words of the stack below its top word hold KSTACK_POISON.
+ *
+ *  @return Lowest writable address of the stack, NULL if out of memory
+ */
+void *
+kstack_alloc( void )
+{
+	mutex_lock(&kstack_mux);
+	void *stack_lo = free_stacks;
+	if (stack_lo) {
+		free_stacks = FREE_LINK(stack_lo);
+		num_free_stacks--;
+	}
+	mutex_unlock(&kstack_mux);
+	if (stack_lo)
+		return stack_lo;
+
+	stack_lo = alloc_guarded(KERNEL_THREAD_STACK_SIZE);
+	if (!stack_lo)
+		log_warn("kstack_alloc(): unable to allocate kernel stack");
+	return stack_lo;
+}
+
+/** @brief Gives back a kernel stack no thread runs on anymore, recording
+ *         how deep it was used.
+ *
+ *  @param stack_lo Lowest writable address of the stack, as returned by
+ *         kstack_alloc()
+ *  @param tid Thread which ran on the stack
+ *  @return Void.
+ */
+void
+kstack_free( void *stack_lo, int tid )
+{
+	affirm(stack_lo);
+
+	int used = kstack_high_water_mark(stack_lo, KERNEL_THREAD_STACK_SIZE);
+	poison((char *) stack_lo + KERNEL_THREAD_STACK_SIZE - used, used);
+
+	mutex_lock(&kstack_mux);
+	if (used > max_high_water_mark) {
+		max_high_water_mark = used;
+		log_warn("kstack_free(): new kernel stack high-water mark %d of %d "
+		         "bytes, tid:%d", used, KERNEL_THREAD_STACK_SIZE, tid);
+	}
+	if (num_free_stacks < KSTACK_CACHE_MAX) {
+		FREE_LINK(stack_lo) = free_stacks;
+		free_stacks = stack_lo;
+		num_free_stacks++;
+		mutex_unlock(&kstack_mux);
+		return;
+	}
+	mutex_unlock(&kstack_mux);
+
+	/* The allocator may write to any page it is given back */
+	char *guard = (char *) stack_lo - PAGE_SIZE;
+	set_guard_page(guard, 0);
+	sfree(guard, KSTACK_ALLOC_SIZE);
+}
+
+/** @brief Measures how deep a stack has been used.
+ *
+ *  Scans up from the bottom for the lowest word not holding KSTACK_POISON,
+ *  so a used word which happens to hold the poison value makes the mark at
+ *  most a word too low.
+ *
+ *  @param stack_lo Lowest writable address of the stack
+ *  @param len Bytes of stack
+ *  @return Bytes between the top of the stack and its lowest used word
+ */
+int
+kstack_high_water_mark( void *stack_lo, int len )
+{
+	uint32_t *word = stack_lo;
+	int i = 0;
+	while (i < (int) (len / sizeof(uint32_t)) && word[i] == KSTACK_POISON)
+		++i;
+	return len - i * sizeof(uint32_t);
+}
+
+/** @brief Checks if an address lies in the guard page of a kernel stack.
+ *
+ *  @param stack_lo Lowest writable address of the stack
+ *  @param addr Address
+ *  @return 1 if addr is in the guard page below stack_lo, 0 otherwise
+ */
+int
+is_kstack_guard( void *stack_lo, void *addr )
+{
+	return (char *) addr < (char *) stack_lo
+	       && (char *) addr >= (char *) stack_lo - PAGE_SIZE;
+}
@@ -13,17 +13,16 @@
 #include <keyhelp.h>		/* process_scancode() */
 #include <scheduler.h>		/* status_t, queue_t, make_runnable  */
 #include <keybd_driver.h>	/* aug_char*/
-#include <atomic_utils.h>	/* compare_and_swap_atomic */
-#include <keybd_driver.h>	/* get_next_aug_char */
+#include <keybd_driver.h>	/* get_next_aug_char, has_next_aug_char */
 #include <task_manager.h>	/* tcb_t */
 #include <video_defines.h>	/* CONSOLE_HEIGHT, CONSOLE_WIDTH */
 #include <variable_queue.h> /* Q_ macros */
 #include <memory_manager.h> /* READ_WRITE, is_valid_user_pointer */
 #include <task_manager_internal.h> /* struct tcb */
 #include <lib_thread_management/mutex.h> /* mutex_t */
+#include <lib_thread_management/waitqueue.h> /* wait_event() */
 #include <logger.h>
 
-static void mark_curr_blocked( tcb_t *tcb, void *data );
 static char get_next_char( void );
 static int readchar( void );
 static int _readline(char *buf, int len);
@@ -31,11 +30,8 @@ static int _readline(char *buf, int len);
 /** @brief Thread being served. Can be blocked, running or runnable. */
 static tcb_t   *readline_curr;
 
-/** @brief Whether thread being served is blocked.
- *
- *	Readline_curr may blind write to this, keybd int handler
- *	should atomically compare-and-swap to avoid race conditions. */
-static uint32_t	curr_blocked;
+/** @brief Where the thread being served waits for characters. */
+static waitqueue_t readline_wq;
 
 /** @brief Mutex for readline_curr and readline_q. */
 static mutex_t	readline_mux;
@@ -50,7 +46,7 @@ init_readline( void )
 {
 	mutex_init(&readline_mux);
 	readline_curr = NULL;
-	curr_blocked = 0;
+	waitqueue_init(&readline_wq);
 }
 
 
@@ -182,39 +178,17 @@ _readline(char *buf, int len)
 void
 readline_char_arrived_handler( void )
 {
-	/* If curr_blocked, readline_char_arrived_handler is the only one who can
-	 * operate on curr_blocked and readline_curr. However, we can get another
-	 * keybd interrupt, leading to a race condition. A simple way to ensure
-	 * make_runnable is called only once is a CAS on curr_blocked. */
-	int curr_blocked_start = curr_blocked;
-
-	if (compare_and_swap_atomic(&curr_blocked, 1, 0)) {
-		switch_safe_make_thread_runnable(readline_curr);
-		log("readline_char_arrived_handler(): "
-				 "curr_blocked_start:%d "
-		         "curr_block:%d "
-		         "readline_curr:%p, "
-		         "readline_curr->tid:%d ",
-		         curr_blocked_start, curr_blocked, readline_curr,
-				 readline_curr->tid);
-	}
+	/* The character is in the keyboard buffer by now, so the thread being
+	 * served either sees it or is on the wait queue already. On the
+	 * interrupt stack this never switches, but lets the wakeup policy
+	 * decide whether to switch once off it */
+	if (wake_one(&readline_wq))
+		log("readline_char_arrived_handler(): woke readline_curr:%p",
+		    readline_curr);
 }
 
 /* --- HELPERS --- */
 
-/** @brief Callback to mark tcb as blocked.
- *
- *  @param tcb Tcb to mark blocked
- *  @param data Unused
- *  @return Void.
- *  */
-static void
-mark_curr_blocked( tcb_t *tcb, void *data )
-{
-	assert(readline_curr == tcb);
-	curr_blocked = 1;
-}
-
 /** @brief Gets next char from user input,
  *		   blocking if no more characters to read
  *
@@ -227,9 +201,8 @@ get_next_char( void )
 	int res;
 	/* If no character, deschedule ourselves and wait for user input. */
 	while ((res = readchar()) == -1) {
-		log("mark self as blocked, running_thread:%p",
-				get_running_thread());
-		yield_execution(BLOCKED, NULL, mark_curr_blocked, NULL);
+		log("wait for input, running_thread:%p", get_running_thread());
+		wait_event(&readline_wq, has_next_aug_char());
 	}
 	assert(res >= 0);
 
@@ -0,0 +1,22 @@
+/** @file close.c
+ *  @brief close syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_close() */
+
+/** @brief Handler for close syscall.
+ *
+ *  @param fd File descriptor to close
+ *  @return 0 on success, negative value on failure */
+int
+close( int fd )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	return tmpfs_close(fd);
+}
@@ -0,0 +1,19 @@
+/** @file fs.h
+ *  @brief File system functions the lib_fs syscall handlers call into.
+ *
+ *  All of them act on the file descriptor table of the running task, and
+ *  expect user buffers to have been validated already.
+ */
+
+#ifndef FS_H_
+#define FS_H_
+
+void init_tmpfs( void );
+int tmpfs_open( const char *name, int flags );
+int tmpfs_read( int fd, char *buf, int len );
+int tmpfs_write( int fd, char *buf, int len );
+int tmpfs_lseek( int fd, int offset, int whence );
+int tmpfs_close( int fd );
+int tmpfs_unlink( const char *name );
+
+#endif /* FS_H_ */
@@ -0,0 +1,24 @@
+/** @file lseek.c
+ *  @brief lseek syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_lseek() */
+
+/** @brief Handler for lseek syscall.
+ *
+ *  @param fd File descriptor whose offset to move
+ *  @param offset Offset relative to whence
+ *  @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ *  @return New offset on success, negative value on failure */
+int
+lseek( int fd, int offset, int whence )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	return tmpfs_lseek(fd, offset, whence);
+}
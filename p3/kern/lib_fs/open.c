@@ -0,0 +1,35 @@
+/** @file open.c
+ *  @brief open syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <string.h>				/* strncpy */
+#include <exec2obj.h>			/* MAX_EXECNAME_LEN */
+#include <memory_manager.h>		/* is_valid_null_terminated_user_string */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_open() */
+
+/** @brief Handler for open syscall.
+ *
+ *  @param filename Name of file to open
+ *  @param flags An access mode ORed with O_CREAT, O_TRUNC, O_APPEND
+ *  @return File descriptor on success, negative value on failure */
+int
+open( char *filename, int flags )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_null_terminated_user_string(filename, MAX_EXECNAME_LEN))
+		return -1;
+
+	/* Copy name into kernel memory, the user may change it under us */
+	char name[MAX_EXECNAME_LEN];
+	strncpy(name, filename, MAX_EXECNAME_LEN);
+	if (name[0] == '\0')
+		return -1;
+
+	return tmpfs_open(name, flags);
+}
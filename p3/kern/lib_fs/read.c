@@ -0,0 +1,29 @@
+/** @file read.c
+ *  @brief read syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <memory_manager.h>		/* is_valid_user_buffer */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_read() */
+
+/** @brief Handler for read syscall.
+ *
+ *  @param fd File descriptor to read from
+ *  @param buf Buffer in which to place file's bytes
+ *  @param len Maximum number of bytes to read
+ *  @return Number of bytes read, 0 at end of file, negative value on
+ *          failure */
+int
+read( int fd, char *buf, int len )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_user_buffer(buf, len, READ_WRITE))
+		return -1;
+
+	return tmpfs_read(fd, buf, len);
+}
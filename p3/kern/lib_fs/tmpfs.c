@@ -0,0 +1,692 @@
+/** @file tmpfs.c
+ *  @brief In-memory file system and file descriptor tables.
+ *
+ *  A file's data lives in frames from physalloc(), found through a page
+ *  index: entry i holds the frame with bytes [i * PAGE_SIZE, (i + 1) *
+ *  PAGE_SIZE) of the file, or 0 for a page never written, which reads as
+ *  zeros. Reads and writes walk the index a page at a time and copy each page
+ *  through the frame window (see map_phys_frame()) with a single memcpy.
+ *
+ *  User buffers are never touched while holding tmpfs_mux or the frame
+ *  window, since a page fault on them may block. A read or write goes
+ *  through a kernel bounce buffer BOUNCE_LEN bytes at a time, copying
+ *  between it and the user buffer with no lock held. A large sequential
+ *  transfer therefore costs two copies and one mapping per page.
+ *
+ *  A name not held by an in-memory file is looked up on the RAM disk, and
+ *  such files are read through ramdisk_getbytes() so compressed ones work
+ *  too. RAM disk files are read-only, and no in-memory file may shadow one.
+ *
+ *  All file system state, including every task's file descriptor table, is
+ *  guarded by tmpfs_mux. Frames are taken under pages_mux, since
+ *  new_pages() counts free frames before allocating them.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <tmpfs.h>
+#include <lib_fs/fs.h>
+#include <stdint.h>		/* uint32_t */
+#include <limits.h>		/* INT_MAX */
+#include <stddef.h>		/* NULL */
+#include <string.h>		/* memcpy, memset, strcmp, strncpy */
+#include <malloc.h>		/* smalloc, sfree */
+#include <assert.h>		/* affirm */
+#include <logger.h>		/* log_warn */
+#include <page.h>		/* PAGE_SIZE */
+#include <exec2obj.h>	/* MAX_EXECNAME_LEN */
+#include <loader.h>		/* get_ramdisk_file() */
+#include <ramdisk.h>	/* ramdisk_getbytes(), ramdisk_file_len() */
+#include <physalloc.h>	/* physalloc(), physfree() */
+#include <scheduler.h>	/* get_running_task() */
+#include <variable_queue.h>
+#include <memory_manager.h> /* map_phys_frame() */
+#include <memory_manager_internal.h> /* pages_mux */
+#include <task_manager_internal.h>
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/* Smallest page index allocated for a file */
+#define MIN_PAGE_INDEX_LEN 8
+
+/* Bytes moved under tmpfs_mux at a time by a read or write */
+#define BOUNCE_LEN PAGE_SIZE
+
+typedef struct inode inode_t;
+
+/** @brief An in-memory file
+ *
+ *  @param name File name
+ *  @param size File length in bytes
+ *  @param pages Page index, frames holding the file's data
+ *  @param pages_len Number of entries in pages
+ *  @param open_count Number of open files referring to this file
+ *  @param unlinked 1 once removed from the namespace, the file is freed when
+ *         the last open file referring to it is closed
+ *  @param inode_link Link in inode_list
+ */
+struct inode {
+	char name[MAX_EXECNAME_LEN];
+	int size;
+	uint32_t *pages;
+	int pages_len;
+	int open_count;
+	int unlinked;
+	Q_NEW_LINK(inode) inode_link;
+};
+
+Q_NEW_HEAD(inode_list_t, inode);
+
+/** @brief An open file, which file descriptors refer to
+ *
+ *  @param inode In-memory file, NULL for a RAM disk file
+ *  @param execbytes Bytes of the RAM disk file if inode is NULL
+ *  @param execlen Number of bytes of the RAM disk file if inode is NULL
+ *  @param flags Flags passed to open()
+ *  @param offset Offset of the next read or write
+ *  @param refcount Number of file descriptor table entries referring to
+ *         this open file, across tasks sharing it since fork()
+ */
+struct open_file {
+	inode_t *inode;
+	const char *execbytes;
+	int execlen;
+	int flags;
+	int offset;
+	int refcount;
+};
+
+/* All in-memory files that have not been unlinked */
+static inode_list_t inode_list;
+
+static mutex_t tmpfs_mux;
+
+/** @brief Initializes the file system.
+ *
+ *  @return Void.
+ */
+void
+init_tmpfs( void )
+{
+	mutex_init(&tmpfs_mux);
+	Q_INIT_HEAD(&inode_list);
+}
+
+/** @brief Finds an in-memory file by name.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param name File name
+ *  @return The file, NULL if there is none with that name
+ */
+static inode_t *
+find_inode( const char *name )
+{
+	inode_t *inode = Q_GET_FRONT(&inode_list);
+	while (inode) {
+		if (strcmp(inode->name, name) == 0)
+			return inode;
+		inode = Q_GET_NEXT(inode, inode_link);
+	}
+	return NULL;
+}
+
+/** @brief Grows a file's page index to hold at least a number of pages.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param inode File
+ *  @param num_pages Number of pages the index must hold
+ *  @return 0 on success, -1 if out of memory
+ */
+static int
+grow_page_index( inode_t *inode, int num_pages )
+{
+	if (num_pages <= inode->pages_len)
+		return 0;
+
+	int new_len = inode->pages_len ? inode->pages_len : MIN_PAGE_INDEX_LEN;
+	while (new_len < num_pages)
+		new_len *= 2;
+
+	uint32_t *pages = smalloc(new_len * sizeof(uint32_t));
+	if (!pages)
+		return -1;
+
+	memset(pages, 0, new_len * sizeof(uint32_t));
+	if (inode->pages) {
+		memcpy(pages, inode->pages, inode->pages_len * sizeof(uint32_t));
+		sfree(inode->pages, inode->pages_len * sizeof(uint32_t));
+	}
+	inode->pages = pages;
+	inode->pages_len = new_len;
+	return 0;
+}
+
+/** @brief Frees all of a file's data and sets its size to 0.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param inode File
+ *  @return Void.
+ */
+static void
+truncate_inode( inode_t *inode )
+{
+	mutex_lock(&pages_mux);
+	for (int i = 0; i < inode->pages_len; ++i) {
+		if (inode->pages[i])
+			physfree(inode->pages[i]);
+	}
+	mutex_unlock(&pages_mux);
+
+	if (inode->pages)
+		sfree(inode->pages, inode->pages_len * sizeof(uint32_t));
+	inode->pages = NULL;
+	inode->pages_len = 0;
+	inode->size = 0;
+}
+
+/** @brief Drops a file descriptor table reference to an open file, freeing
+ *         it with the last reference.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param file Open file
+ *  @return Void.
+ */
+static void
+release_file( open_file_t *file )
+{
+	affirm(file->refcount > 0);
+	if (--file->refcount > 0)
+		return;
+
+	inode_t *inode = file->inode;
+	if (inode && --inode->open_count == 0 && inode->unlinked) {
+		truncate_inode(inode);
+		sfree(inode, sizeof(inode_t));
+	}
+	sfree(file, sizeof(open_file_t));
+}
+
+/** @brief Gets the open file a file descriptor of the running task refers to.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param fd File descriptor
+ *  @return Open file, NULL if fd is not open
+ */
+static open_file_t *
+get_open_file( int fd )
+{
+	if (fd < 0 || fd >= MAX_OPEN_FILES)
+		return NULL;
+
+	pcb_t *pcb = get_running_task();
+	affirm(pcb);
+	return pcb->fd_table[fd];
+}
+
+/** @brief Copies bytes of an in-memory file into a buffer.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param inode File
+ *  @param offset Offset into the file to copy from
+ *  @param buf Buffer to copy into
+ *  @param len Maximum number of bytes to copy
+ *  @return Number of bytes copied
+ */
+static int
+read_inode( inode_t *inode, int offset, char *buf, int len )
+{
+	if (offset >= inode->size)
+		return 0;
+	if (len > inode->size - offset)
+		len = inode->size - offset;
+
+	int copied = 0;
+	while (copied < len) {
+		int pos = offset + copied;
+		int page = pos / PAGE_SIZE;
+		int page_off = pos % PAGE_SIZE;
+		int to_copy = PAGE_SIZE - page_off;
+		if (to_copy > len - copied)
+			to_copy = len - copied;
+
+		uint32_t frame = page < inode->pages_len ? inode->pages[page] : 0;
+		if (frame) {
+			char *window = map_phys_frame(frame);
+			memcpy(buf + copied, window + page_off, to_copy);
+			unmap_phys_frame(window);
+		} else {
+			memset(buf + copied, 0, to_copy);
+		}
+		copied += to_copy;
+	}
+	return copied;
+}
+
+/** @brief Copies a buffer into an in-memory file, growing it if needed.
+ *
+ *  @pre tmpfs_mux is held
+ *  @param inode File
+ *  @param offset Offset into the file to copy to
+ *  @param buf Buffer to copy from
+ *  @param len Number of bytes to copy
+ *  @return Number of bytes copied, which is less than len if frames ran out,
+ *          negative value if nothing could be copied
+ */
+static int
+write_inode( inode_t *inode, int offset, char *buf, int len )
+{
+	/* File sizes must fit in an int */
+	if (len > INT_MAX - offset)
+		len = INT_MAX - offset;
+	if (len == 0)
+		return 0;
+
+	if (grow_page_index(inode, (offset + len - 1) / PAGE_SIZE + 1) < 0) {
+		log_warn("write_inode(): unable to grow page index of %s",
+		         inode->name);
+		return -1;
+	}
+	int copied = 0;
+	while (copied < len) {
+		int pos = offset + copied;
+		int page = pos / PAGE_SIZE;
+		int page_off = pos % PAGE_SIZE;
+		int to_copy = PAGE_SIZE - page_off;
+		if (to_copy > len - copied)
+			to_copy = len - copied;
+
+		int is_new_frame = 0;
+		if (!inode->pages[page]) {
+			mutex_lock(&pages_mux);
+			inode->pages[page] = physalloc();
+			mutex_unlock(&pages_mux);
+			if (!inode->pages[page])
+				break;
+			is_new_frame = 1;
+		}
+		char *window = map_phys_frame(inode->pages[page]);
+
+		/* Bytes of a new page not written here must read as zeros */
+		if (is_new_frame && to_copy < PAGE_SIZE)
+			memset(window, 0, PAGE_SIZE);
+
+		memcpy(window + page_off, buf + copied, to_copy);
+		unmap_phys_frame(window);
+		copied += to_copy;
+	}
+	if (offset + copied > inode->size)
+		inode->size = offset + copied;
+
+	if (copied == 0) {
+		log_warn("write_inode(): out of frames writing %s", inode->name);
+		return -1;
+	}
+	return copied;
+}
+
+/** @brief Opens a file, creating it if asked to.
+ *
+ *  @param name File name, in kernel memory
+ *  @param flags An access mode ORed with O_CREAT, O_TRUNC, O_APPEND
+ *  @return Lowest free file descriptor on success, negative value on error
+ */
+int
+tmpfs_open( const char *name, int flags )
+{
+	affirm(name);
+
+	int access = flags & O_ACCMODE;
+	if (access == O_ACCMODE
+	    || (flags & ~(O_ACCMODE | O_CREAT | O_TRUNC | O_APPEND)))
+		return -1;
+
+	open_file_t *file = smalloc(sizeof(open_file_t));
+	if (!file)
+		return -1;
+
+	file->inode = NULL;
+	file->execbytes = NULL;
+	file->execlen = 0;
+	file->flags = flags;
+	file->offset = 0;
+	file->refcount = 1;
+
+	mutex_lock(&tmpfs_mux);
+
+	pcb_t *pcb = get_running_task();
+	affirm(pcb);
+	int fd = 0;
+	while (fd < MAX_OPEN_FILES && pcb->fd_table[fd])
+		++fd;
+	if (fd == MAX_OPEN_FILES) {
+		log_warn("tmpfs_open(): no free file descriptors");
+		goto fail;
+	}
+
+	inode_t *inode = find_inode(name);
+	if (!inode) {
+		/* RAM disk files are read-only */
+		if (get_ramdisk_file(name, &file->execbytes, &file->execlen) == 0) {
+			if (access != O_RDONLY || (flags & O_TRUNC)) {
+				log_warn("tmpfs_open(): %s is read-only", name);
+				goto fail;
+			}
+			pcb->fd_table[fd] = file;
+			mutex_unlock(&tmpfs_mux);
+			return fd;
+		}
+		if (!(flags & O_CREAT))
+			goto fail;
+
+		inode = smalloc(sizeof(inode_t));
+		if (!inode)
+			goto fail;
+
+		strncpy(inode->name, name, MAX_EXECNAME_LEN - 1);
+		inode->name[MAX_EXECNAME_LEN - 1] = '\0';
+		inode->size = 0;
+		inode->pages = NULL;
+		inode->pages_len = 0;
+		inode->open_count = 0;
+		inode->unlinked = 0;
+		Q_INIT_ELEM(inode, inode_link);
+		Q_INSERT_TAIL(&inode_list, inode, inode_link);
+
+	} else if ((flags & O_TRUNC) && access != O_RDONLY) {
+		truncate_inode(inode);
+	}
+	inode->open_count++;
+	file->inode = inode;
+	pcb->fd_table[fd] = file;
+
+	mutex_unlock(&tmpfs_mux);
+	return fd;
+
+fail:
+	mutex_unlock(&tmpfs_mux);
+	sfree(file, sizeof(open_file_t));
+	return -1;
+}
+
+/** @brief Reads from an open file at its offset into kernel memory,
+ *         advancing the offset.
+ *
+ *  @param fd File descriptor
+ *  @param buf Kernel buffer to read into
+ *  @param len Maximum number of bytes to read
+ *  @return Number of bytes read, 0 at end of file, negative value on error
+ */
+static int
+read_chunk( int fd, char *buf, int len )
+{
+	mutex_lock(&tmpfs_mux);
+	open_file_t *file = get_open_file(fd);
+	if (!file || (file->flags & O_ACCMODE) == O_WRONLY) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	int res;
+	if (file->inode) {
+		res = read_inode(file->inode, file->offset, buf, len);
+	} else if (file->offset
+	           >= ramdisk_file_len(file->execbytes, file->execlen)) {
+		res = 0;
+	} else {
+		res = ramdisk_getbytes(file->execbytes, file->execlen, file->offset,
+		                       len, buf);
+	}
+	if (res > 0)
+		file->offset += res;
+
+	mutex_unlock(&tmpfs_mux);
+	return res;
+}
+
+/** @brief Reads from an open file at its offset, advancing the offset.
+ *
+ *  @param fd File descriptor
+ *  @param buf Buffer to read into
+ *  @param len Maximum number of bytes to read
+ *  @return Number of bytes read, 0 at end of file, negative value on error
+ */
+int
+tmpfs_read( int fd, char *buf, int len )
+{
+	affirm(buf);
+
+	char *bounce = smalloc(BOUNCE_LEN);
+	if (!bounce)
+		return -1;
+
+	int copied = 0;
+	int chunk, res;
+	do {
+		chunk = len - copied < BOUNCE_LEN ? len - copied : BOUNCE_LEN;
+		res = read_chunk(fd, bounce, chunk);
+		if (res > 0) {
+			memcpy(buf + copied, bounce, res);
+			copied += res;
+		}
+	} while (res == chunk && copied < len);
+
+	sfree(bounce, BOUNCE_LEN);
+	return copied > 0 ? copied : res;
+}
+
+/** @brief Writes to an open file at its offset from kernel memory,
+ *         advancing the offset.
+ *
+ *  With O_APPEND the offset is first moved to the end of the file.
+ *
+ *  @param fd File descriptor
+ *  @param buf Kernel buffer to write from
+ *  @param len Number of bytes to write
+ *  @return Number of bytes written, negative value on error
+ */
+static int
+write_chunk( int fd, char *buf, int len )
+{
+	mutex_lock(&tmpfs_mux);
+	open_file_t *file = get_open_file(fd);
+	if (!file || (file->flags & O_ACCMODE) == O_RDONLY) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	/* Only in-memory files can be opened for writing */
+	affirm(file->inode);
+
+	if (file->flags & O_APPEND)
+		file->offset = file->inode->size;
+
+	int res = write_inode(file->inode, file->offset, buf, len);
+	if (res > 0)
+		file->offset += res;
+
+	mutex_unlock(&tmpfs_mux);
+	return res;
+}
+
+/** @brief Writes to an open file at its offset, advancing the offset.
+ *
+ *  With O_APPEND the offset is first moved to the end of the file.
+ *
+ *  @param fd File descriptor
+ *  @param buf Buffer to write from
+ *  @param len Number of bytes to write
+ *  @return Number of bytes written, negative value on error
+ */
+int
+tmpfs_write( int fd, char *buf, int len )
+{
+	affirm(buf);
+
+	char *bounce = smalloc(BOUNCE_LEN);
+	if (!bounce)
+		return -1;
+
+	int copied = 0;
+	int chunk, res;
+	do {
+		chunk = len - copied < BOUNCE_LEN ? len - copied : BOUNCE_LEN;
+		memcpy(bounce, buf + copied, chunk);
+		res = write_chunk(fd, bounce, chunk);
+		if (res > 0)
+			copied += res;
+	} while (res == chunk && copied < len);
+
+	sfree(bounce, BOUNCE_LEN);
+	return copied > 0 ? copied : res;
+}
+
+/** @brief Moves the offset of an open file.
+ *
+ *  The offset may be moved past the end of the file, a later write then
+ *  leaves a hole that reads as zeros.
+ *
+ *  @param fd File descriptor
+ *  @param offset Offset relative to whence
+ *  @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ *  @return New offset on success, negative value on error
+ */
+int
+tmpfs_lseek( int fd, int offset, int whence )
+{
+	mutex_lock(&tmpfs_mux);
+	open_file_t *file = get_open_file(fd);
+	if (!file) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	int base;
+	switch (whence) {
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = file->offset;
+		break;
+	case SEEK_END:
+		base = file->inode ? file->inode->size
+		                   : ramdisk_file_len(file->execbytes, file->execlen);
+		break;
+	default:
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	/* base is never negative, so only positive offsets can overflow */
+	if (offset < -base || (offset > 0 && offset > INT_MAX - base)) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	file->offset = base + offset;
+
+	int res = file->offset;
+	mutex_unlock(&tmpfs_mux);
+	return res;
+}
+
+/** @brief Closes a file descriptor.
+ *
+ *  @param fd File descriptor
+ *  @return 0 on success, negative value if fd is not open
+ */
+int
+tmpfs_close( int fd )
+{
+	mutex_lock(&tmpfs_mux);
+	open_file_t *file = get_open_file(fd);
+	if (!file) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	get_running_task()->fd_table[fd] = NULL;
+	release_file(file);
+
+	mutex_unlock(&tmpfs_mux);
+	return 0;
+}
+
+/** @brief Removes an in-memory file from the namespace.
+ *
+ *  The file's data is freed once no open file refers to it.
+ *
+ *  @param name File name, in kernel memory
+ *  @return 0 on success, negative value if there is no in-memory file with
+ *          that name
+ */
+int
+tmpfs_unlink( const char *name )
+{
+	affirm(name);
+
+	mutex_lock(&tmpfs_mux);
+	inode_t *inode = find_inode(name);
+	if (!inode) {
+		mutex_unlock(&tmpfs_mux);
+		return -1;
+	}
+	Q_REMOVE(&inode_list, inode, inode_link);
+	inode->unlinked = 1;
+	if (inode->open_count == 0) {
+		truncate_inode(inode);
+		sfree(inode, sizeof(inode_t));
+	}
+	mutex_unlock(&tmpfs_mux);
+	return 0;
+}
+
+/** @brief Initializes a new task's file descriptor table with no open files.
+ *
+ *  @param fd_table File descriptor table
+ *  @return Void.
+ */
+void
+fd_table_init( open_file_t **fd_table )
+{
+	affirm(fd_table);
+
+	for (int i = 0; i < MAX_OPEN_FILES; ++i)
+		fd_table[i] = NULL;
+}
+
+/** @brief Shares every open file of a parent task with its child on fork().
+ *
+ *  @param child_fd_table Child's file descriptor table, with no open files
+ *  @param parent_fd_table Parent's file descriptor table
+ *  @return Void.
+ */
+void
+fd_table_inherit( open_file_t **child_fd_table,
+                  open_file_t **parent_fd_table )
+{
+	affirm(child_fd_table);
+	affirm(parent_fd_table);
+
+	mutex_lock(&tmpfs_mux);
+	for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+		affirm(!child_fd_table[i]);
+		child_fd_table[i] = parent_fd_table[i];
+		if (child_fd_table[i])
+			child_fd_table[i]->refcount++;
+	}
+	mutex_unlock(&tmpfs_mux);
+}
+
+/** @brief Closes every file descriptor of a vanishing task.
+ *
+ *  @param fd_table File descriptor table
+ *  @return Void.
+ */
+void
+fd_table_close_all( open_file_t **fd_table )
+{
+	affirm(fd_table);
+
+	mutex_lock(&tmpfs_mux);
+	for (int i = 0; i < MAX_OPEN_FILES; ++i) {
+		if (fd_table[i]) {
+			release_file(fd_table[i]);
+			fd_table[i] = NULL;
+		}
+	}
+	mutex_unlock(&tmpfs_mux);
+}
@@ -0,0 +1,32 @@
+/** @file unlink.c
+ *  @brief unlink syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <string.h>				/* strncpy */
+#include <exec2obj.h>			/* MAX_EXECNAME_LEN */
+#include <memory_manager.h>		/* is_valid_null_terminated_user_string */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_unlink() */
+
+/** @brief Handler for unlink syscall.
+ *
+ *  @param filename Name of in-memory file to remove
+ *  @return 0 on success, negative value on failure */
+int
+unlink( char *filename )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_null_terminated_user_string(filename, MAX_EXECNAME_LEN))
+		return -1;
+
+	/* Copy name into kernel memory, the user may change it under us */
+	char name[MAX_EXECNAME_LEN];
+	strncpy(name, filename, MAX_EXECNAME_LEN);
+
+	return tmpfs_unlink(name);
+}
@@ -0,0 +1,28 @@
+/** @file write.c
+ *  @brief write syscall handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb */
+#include <memory_manager.h>		/* is_valid_user_buffer */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_fs/fs.h>			/* tmpfs_write() */
+
+/** @brief Handler for write syscall.
+ *
+ *  @param fd File descriptor to write to
+ *  @param buf Buffer holding the bytes to write
+ *  @param len Number of bytes to write
+ *  @return Number of bytes written, negative value on failure */
+int
+write( int fd, char *buf, int len )
+{
+	/* Acknowledge interrupt */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_user_buffer(buf, len, READ))
+		return -1;
+
+	return tmpfs_write(fd, buf, len);
+}
@@ -109,6 +109,9 @@ fork( void )
 
 	set_task_name(child_pcb, parent_pcb->execname);
 
+	/* Child shares parent's open files */
+	fd_table_inherit(child_pcb->fd_table, parent_pcb->fd_table);
+
 	register_if_init_task(child_pcb->execname, child_pcb->pid);
 
 
@@ -145,6 +148,9 @@ fork( void )
 	child_tcb->swexn_handler	 = parent_tcb->swexn_handler;
 	child_tcb->has_swexn_handler = parent_tcb->has_swexn_handler;
 
+	/* Child inherits parent's nice value and virtual runtime */
+	inherit_scheduling(child_tcb, parent_tcb);
+
     /* After setting up child stack and VM, register with scheduler */
     if (make_thread_runnable(child_tcb) < 0) {
 		log_warn("fork(): unable to make child thread runnable");
@@ -5,6 +5,12 @@
 #ifndef LIFE_CYCLE_H_
 #define LIFE_CYCLE_H_
 
+/* wait_many() and waitpid() flags, these have to match user/inc/syscall_ext.h */
+#define WNOHANG 0x1
+
+/* Most child tasks one wait_many() call collects */
+#define WAIT_MANY_MAX 256
+
 void _vanish( void );
 void _set_status( int status );
 
@@ -6,7 +6,7 @@
 #include <asm.h>				/* outb() */
 #include <stdint.h>				/* uint32_t */
 #include <logger.h>				/* log_info */
-#include <scheduler.h>			/* get_running_thread */
+#include <scheduler.h>			/* get_running_thread, inherit_scheduling */
 #include <task_manager.h>		/* get_tcb_tid() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
 #include <lib_thread_management/mutex.h> /* mutex_t */
@@ -35,6 +35,9 @@ thread_fork( void )
 
 	assert(child_tcb == find_tcb(child_tid));
 
+	/* Child inherits parent's nice value and virtual runtime */
+	inherit_scheduling(child_tcb, parent_tcb);
+
 	/* Set up childrens stack. Child should return to user mode with same
 	 * registers as parent. Only %eax will be different. */
 	uint32_t *parent_kern_stack_hi = get_kern_stack_hi(parent_tcb);
@@ -27,6 +27,22 @@
  *  threads, with the bankers method of determining amortized cost, we
  *  still run in amortized constant time since freeing each vanished sibling
  *  TCB has been "paid for" when that sibling called vanish() earlier.
+ *
+ *  Vanishing takes no global lock. The task tree is guarded by the
+ *  set_status_vanish_wait_mux of each PCB, which guards that task's child
+ *  task lists, waiting threads list and has_vanished flag. Lock order: a
+ *  thread holds at most one such mutex at a time. The last thread of a task
+ *  releases its own before taking its parent's, and its parent's before
+ *  taking init's, so tasks in unrelated subtrees vanish in parallel and the
+ *  only mutex they share is init's.
+ *
+ *  A task's parent_pcb never changes and holds a reference on the parent
+ *  PCB until the task is reaped, so it may be read and its mutex taken
+ *  without any other lock, even once the parent has vanished and been
+ *  reaped. When a task vanishes it sets has_vanished, hands its vanished
+ *  child tasks to init with one list append and forgets its active ones.
+ *  Those find has_vanished set when they vanish and go to init instead, so
+ *  reparenting costs O(1) for the parent and for each orphan.
  */
 #include <x86/asm.h>   /* outb() */
 #include <x86/interrupt_defines.h> /* INT_CTL_PORT, INT_ACK_CURRENT */
@@ -34,40 +50,22 @@
 #include <timer_driver.h>		/* get_total_ticks() */
 #include <scheduler.h>			/* yield_execution() */
 #include <task_manager_internal.h>
-#include <lib_thread_management/hashmap.h>
 #include <lib_thread_management/mutex.h>
 #include <memory_manager.h> /* get_initial_pd() */
 #include <x86/cr.h>		/* {get,set}_{cr0,cr3} */
 #include <malloc.h> /* sfree() */
 #include <scheduler.h> /* make_thread_runnable() */
+#include <reaper.h> /* reap_task_later() */
+#include <rusage.h> /* fold_thread_usage() */
 #include <simics.h>
 
-static mutex_t vanish_tree_mux;
-static int is_mutex_init = 0;
-
-/* These macros allow us to easily initialize the vanish_tree_mux
- * upon the first call to vanish. */
-#define TREE_LOCK do\
-{\
-	if (!is_mutex_init) {\
-		mutex_init(&vanish_tree_mux);\
-		is_mutex_init = 1;\
-	}\
-	mutex_lock(&vanish_tree_mux);\
-} while(0)\
-
-#define TREE_UNLOCK do\
-{\
-	affirm(is_mutex_init);\
-	mutex_unlock(&vanish_tree_mux);\
-} while(0)\
-
-
 static void assign_child_task_to_parent_thread( tcb_t *child_last_thread,
                                                 void *v_waiting_thread );
 
 static void call_back_mutex_unlock( tcb_t *unused, void *v_parent_pcb_muxp );
 
+static void wake_joiner( tcb_t *dead_tcb, void *v_muxp );
+
 /** @brief Frees all TCBs in a task except the last running thread's TCB
  *
  *  @param owning_task PCB of task to free TCBs from
@@ -89,7 +87,6 @@ free_sibling_tcb(pcb_t *owning_task, tcb_t *last_tcb)
 	while (curr && curr != last_tcb) {
 		tcb_t *next = Q_GET_NEXT(curr, task_thread_link);
 		Q_REMOVE(&(owning_task->vanished_threads_list), curr, task_thread_link);
-		map_remove(curr->tid);
 		free_tcb(curr);
 		removed++;
 		curr = next;
@@ -129,22 +126,90 @@ free_task_pd( pcb_t *owning_task )
 	owning_task->pd = NULL;
 }
 
+/** @brief Finds the thread a vanished child task should be handed to.
+ *
+ *  A thread waiting for this very child task goes first, then a thread
+ *  waiting for any child task, so that a thread waiting for a given child
+ *  task is never left blocked by another thread taking it.
+ *
+ *  @param pcb PCB of the parent task
+ *  @param child PCB of the vanished child task
+ *  @pre pcb->set_status_vanish_wait_mux is held
+ *  @return Waiting thread, NULL if no thread is waiting for this child task
+ */
+static tcb_t *
+find_waiting_thread( pcb_t *pcb, pcb_t *child )
+{
+	tcb_t *any = NULL;
+	tcb_t *waiting_tcb = Q_GET_FRONT(&(pcb->waiting_threads_list));
+	while (waiting_tcb) {
+		if (waiting_tcb->wait_tid == child->first_thread_tid)
+			return waiting_tcb;
+		if (!any && !waiting_tcb->wait_tid)
+			any = waiting_tcb;
+		waiting_tcb = Q_GET_NEXT(waiting_tcb, waiting_threads_link);
+	}
+	return any;
+}
+
+/** @brief Hands vanished child tasks to as many waiting threads as are
+ *         waiting for them and releases the PCB's mutex.
+ *
+ *  @param pcb PCB whose vanished child tasks and waiting threads to pair up
+ *  @pre pcb->set_status_vanish_wait_mux is held
+ *  @return Void.
+ */
+static void
+hand_off_vanished_children( pcb_t *pcb )
+{
+	waiting_threads_list_t woken;
+	Q_INIT_HEAD(&woken);
+
+	tcb_t *waiting_tcb;
+	pcb_t *child = Q_GET_FRONT(&(pcb->vanished_child_tasks_list));
+	while (child && Q_GET_FRONT(&(pcb->waiting_threads_list))) {
+		pcb_t *next = Q_GET_NEXT(child, vanished_child_tasks_link);
+
+		waiting_tcb = find_waiting_thread(pcb, child);
+		if (waiting_tcb) {
+			Q_REMOVE(&(pcb->vanished_child_tasks_list), child,
+			         vanished_child_tasks_link);
+			pcb->num_vanished_child_tasks--;
+			Q_REMOVE(&(pcb->waiting_threads_list), waiting_tcb,
+			         waiting_threads_link);
+			pcb->num_waiting_threads--;
+
+			waiting_tcb->collected_vanished_child = child;
+			Q_INSERT_TAIL(&woken, waiting_tcb, waiting_threads_link);
+		}
+		child = next;
+	}
+	mutex_unlock(&(pcb->set_status_vanish_wait_mux));
+
+	/* Woken threads only look at the child task they were handed */
+	while ((waiting_tcb = Q_GET_FRONT(&woken))) {
+		Q_REMOVE(&woken, waiting_tcb, waiting_threads_link);
+		affirm(waiting_tcb->status == BLOCKED);
+		affirm(make_thread_runnable(waiting_tcb) == 0);
+	}
+}
+
 /** @brief Makes a task ready for collection by its parent, ceases task
  *         thread execution that calls vanish.
  *
  *  If not last task thread, add own TCB to owning task's PCB vanished threads
  *  list and yield to other runnable threads.
  *
- *  Else, we are the last thread. We clean up all vanished sibling threads
- *  TCBS, free our task's page directory, empty out our active child tasks
- *  list since all our child tasks will find the init PCB as their new
- *  parent to clean up after them, and transfer our vanished child tasks list
- *  to the init PCB and wakeup any sleeping init threads waiting for vanished
- *  child tasks.
+ *  Else, we are the last thread. We mark our task as vanished so our child
+ *  tasks go to init from now on, hand all vanished sibling threads TCBS and
+ *  our task's page directory to the reaper to free, forget our active child
+ *  tasks list, and
+ *  transfer our vanished child tasks list to the init PCB, waking up any
+ *  sleeping init threads waiting for vanished child tasks.
  *
- *  We also try to find our own parent PCB / init PCB and wake a parent waiting
- *  thread up if one exists, else we add ourselves to our parent PCB / init
- *  PCB vanished_child_tasks_list to wait for cleanup.
+ *  We then lock our parent PCB, or the init PCB if our parent has vanished,
+ *  and wake a waiting thread up if one exists, else we add ourselves to its
+ *  vanished_child_tasks_list to wait for cleanup.
  *
  *  @return Void.
  */
@@ -155,7 +220,6 @@ _vanish( void )
 	tcb_t *tcb = get_running_thread();
 	pcb_t *owning_task = tcb->owning_task;
 
-	TREE_LOCK;
 	mutex_lock(&(owning_task->set_status_vanish_wait_mux));
 
 	/* Move current TCB from active threads to vanished threads */
@@ -164,125 +228,113 @@ _vanish( void )
 
 	Q_INSERT_TAIL(&(owning_task->vanished_threads_list), tcb, task_thread_link);
 	(owning_task->num_vanished_threads)++;
+	fold_thread_usage(tcb);
 
 	affirm(owning_task->num_active_threads + owning_task->num_vanished_threads
 	       == owning_task->total_threads);
 
-	/* Not the last task, yield elsewhere */
+	/* From now on thread_join() may reap this TCB, though not before we
+	 * have switched away from it */
+	tcb->exited = 1;
+
+	/* Not the last task, wake up any thread joining us and yield elsewhere */
 	if (get_num_active_threads_in_owning_task(tcb) > 0) {
 		log("_vanish(): not last task thread");
-		TREE_UNLOCK;
-
-		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
-
-		affirm(yield_execution(DEAD, NULL, NULL, NULL) == 0);
+		affirm(yield_execution(DEAD, NULL, wake_joiner,
+		       &(owning_task->set_status_vanish_wait_mux)) == 0);
+		return;
+	}
 
 	/* Last task thread cleans up and contacts parent/init PCB */
-	} else {
-		log("_vanish(): last task thread");
-		remove_pcb(owning_task);
-
-		/* All my active child tasks will automatically look for init,
-		 * time to clear my active child tasks list */
-		Q_INIT_HEAD(&(owning_task->active_child_tasks_list));
-		TREE_UNLOCK;
-
-		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
-
-		/* Free sibling threads TCB */
-		owning_task->last_thread = tcb;
+	log("_vanish(): last task thread");
+	remove_pcb(owning_task);
+
+	/* From now on my child tasks go to init. Take my vanished child tasks
+	 * to hand to init, my active child tasks will find init themselves */
+	owning_task->has_vanished = 1;
+	vanished_child_tasks_list_t orphans = owning_task->vanished_child_tasks_list;
+	uint32_t num_orphans = owning_task->num_vanished_child_tasks;
+	Q_INIT_HEAD(&(owning_task->vanished_child_tasks_list));
+	owning_task->num_vanished_child_tasks = 0;
+	Q_INIT_HEAD(&(owning_task->active_child_tasks_list));
+	owning_task->num_active_child_tasks = 0;
+
+	mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+
+	/* Close open files */
+	owning_task->last_thread = tcb;
+	fd_table_close_all(owning_task->fd_table);
+
+	/* Leave freeing sibling threads TCBs and the page directory to the
+	 * reaper, unless it cannot take them */
+	if (reap_task_later(owning_task, tcb) < 0) {
 		free_sibling_tcb(owning_task, tcb);
-
-		/* Free page directory */
 		free_task_pd(owning_task);
+	}
 
-		/* Transfer all my vanished children to init in O(1) */
-		pcb_t *init_pcbp = get_init_pcbp();
-		if (Q_GET_FRONT(&(owning_task->vanished_child_tasks_list))) {
-
-			mutex_lock(&(init_pcbp->set_status_vanish_wait_mux));
-
-			Q_APPEND(&(init_pcbp->vanished_child_tasks_list),
-					 &(owning_task->vanished_child_tasks_list),
-					 vanished_child_tasks_link);
-			init_pcbp->num_vanished_child_tasks
-				+= owning_task->num_vanished_child_tasks;
-
-			log("_vanish(): added my children to init_pcbp");
+	/* Transfer all my vanished children to init in O(1) */
+	pcb_t *init_pcbp = get_init_pcbp();
+	if (Q_GET_FRONT(&orphans)) {
+		mutex_lock(&(init_pcbp->set_status_vanish_wait_mux));
 
-			/* wakeup if there's a waiting init thread */
-			tcb_t *waiting_tcb =
-			    Q_GET_FRONT(&(init_pcbp->waiting_threads_list));
-			if (waiting_tcb) {
-				pcb_t *child =
-					Q_GET_FRONT(&(init_pcbp->vanished_child_tasks_list));
+		Q_APPEND(&(init_pcbp->vanished_child_tasks_list), &orphans,
+		         vanished_child_tasks_link);
+		init_pcbp->num_vanished_child_tasks += num_orphans;
 
-				Q_REMOVE(&(init_pcbp->vanished_child_tasks_list), child,
-						 vanished_child_tasks_link);
-				init_pcbp->num_vanished_child_tasks--;
+		log("_vanish(): added my children to init_pcbp");
+		hand_off_vanished_children(init_pcbp);
+	}
 
-				assign_child_task_to_parent_thread(child->last_thread,
-					waiting_tcb);
-			} else {
-				mutex_unlock(&(init_pcbp->set_status_vanish_wait_mux));
-			}
+	/* My parent PCB is kept around until I am reaped, see create_pcb() */
+	pcb_t *parent_pcb = owning_task->parent_pcb;
+	if (parent_pcb) {
+		mutex_lock(&(parent_pcb->set_status_vanish_wait_mux));
+		if (parent_pcb->has_vanished) {
+			mutex_unlock(&(parent_pcb->set_status_vanish_wait_mux));
+			parent_pcb = NULL;
 		}
+	}
+	if (parent_pcb) {
+		log("_vanish(): found my parent ");
 
-		/* Insert into parent PCB's list of vanished child tasks */
-		TREE_LOCK;
-
-		pcb_t *parent_pcb = find_pcb(owning_task->parent_pid);
-		if (parent_pcb) {
-			mutex_lock(&(parent_pcb->set_status_vanish_wait_mux));
-			TREE_UNLOCK;
-
-			log("_vanish(): found my parent ");
-
-			affirm( find_pcb(owning_task->parent_pid));
-
-			/* Remove from active_child_tasks_list */
-			Q_REMOVE(&parent_pcb->active_child_tasks_list, owning_task,
-					 vanished_child_tasks_link);
-			parent_pcb->num_active_child_tasks--;
-		} else {
-			/* Parent did not remove me from their active_child tasks list cuz
-			 * parent has vanished, re-initialize myself by setting my next
-			 * and prev to NULL */
-			Q_INIT_ELEM(owning_task, vanished_child_tasks_link);
+		/* Remove from active_child_tasks_list */
+		Q_REMOVE(&parent_pcb->active_child_tasks_list, owning_task,
+				 vanished_child_tasks_link);
+		parent_pcb->num_active_child_tasks--;
+	} else {
+		/* Parent forgot its active_child tasks list when it vanished,
+		 * re-initialize myself by setting my next and prev to NULL */
+		Q_INIT_ELEM(owning_task, vanished_child_tasks_link);
 
-			parent_pcb = init_pcbp;
-			assert(parent_pcb);
+		parent_pcb = init_pcbp;
+		assert(parent_pcb);
+		mutex_lock(&(parent_pcb->set_status_vanish_wait_mux));
 
-			mutex_lock(&(parent_pcb->set_status_vanish_wait_mux));
-			TREE_UNLOCK;
+		log("(init) parent_pcb->execname:%s", parent_pcb->execname);
+	}
 
-			log("(init) parent_pcb->execname:%s", parent_pcb->execname);
-		}
-		affirm(parent_pcb);
+	/* Look for a parent thread waiting for me, if there is one, wake up */
+	tcb_t *waiting_tcb = find_waiting_thread(parent_pcb, owning_task);
+	if (waiting_tcb) {
 
-		/* Look at list of waiting parent threads, if non-empty, wake up */
-		tcb_t *waiting_tcb = Q_GET_FRONT(&(parent_pcb->waiting_threads_list));
-		if (waiting_tcb) {
+		log("_vanish(): "
+		    "collected owning_task->first_thread_tid:%d, exit_status:%d",
+			owning_task->first_thread_tid, owning_task->exit_status);
 
-			log("_vanish(): "
-			    "collected owning_task->first_thread_tid:%d, exit_status:%d",
-				owning_task->first_thread_tid, owning_task->exit_status);
+		/* Yield to parent task's waiting thread */
+		affirm(yield_execution(DEAD, NULL,
+		       assign_child_task_to_parent_thread, waiting_tcb) == 0);
 
-			/* Yield to parent task's waiting thread */
-			affirm(yield_execution(DEAD, NULL,
-		           assign_child_task_to_parent_thread, waiting_tcb) == 0);
-
-		/* No parent threads waiting, add self to vanished child list */
-		} else {
+	/* No parent threads waiting, add self to vanished child list */
+	} else {
 
-			Q_INSERT_TAIL(&(parent_pcb->vanished_child_tasks_list),
-						  owning_task, vanished_child_tasks_link);
-			parent_pcb->num_vanished_child_tasks++;
-			log("_vanish(): no parent waiting for me");
+		Q_INSERT_TAIL(&(parent_pcb->vanished_child_tasks_list),
+					  owning_task, vanished_child_tasks_link);
+		parent_pcb->num_vanished_child_tasks++;
+		log("_vanish(): no parent waiting for me");
 
-			affirm(yield_execution(DEAD, NULL, call_back_mutex_unlock,
-				&(parent_pcb->set_status_vanish_wait_mux)) == 0);
-		}
+		affirm(yield_execution(DEAD, NULL, call_back_mutex_unlock,
+			&(parent_pcb->set_status_vanish_wait_mux)) == 0);
 	}
 }
 
@@ -305,8 +357,61 @@ call_back_mutex_unlock( tcb_t *unused, void *v_parent_pcb_muxp )
 	switch_safe_mutex_unlock(parent_pcb_muxp);
 }
 
+/** @brief Unlocks the owning task's PCB mutex and wakes the thread joining
+ *         the vanished thread, if any. To be passed as a callback
+ *         function.
+ *
+ *  The joining thread only runs once we have switched away, so it never
+ *  frees the TCB we are still running on.
+ *
+ *  @param dead_tcb This TCB, switched out for good
+ *  @param v_muxp Pointer to the owning task's PCB mutex
+ *  @pre v_muxp must be locked prior to calling this function
+ *  @return Void.
+ */
+static void
+wake_joiner( tcb_t *dead_tcb, void *v_muxp )
+{
+	assert(dead_tcb);
+	assert(v_muxp);
+	switch_safe_wake_n(&dead_tcb->exit_wq, 1);
+	switch_safe_mutex_unlock((mutex_t *) v_muxp);
+}
+
+/** @brief Wakes threads waiting for any child task with no child task left
+ *         for them, their wait fails.
+ *
+ *  wait.c never lets more threads wait than there are child tasks, so this
+ *  only guards against a child task claimed by a thread waiting for it
+ *  being the last one a thread waiting for any child task could get.
+ *
+ *  @param pcb PCB of the parent task
+ *  @pre pcb->set_status_vanish_wait_mux is held
+ *  @pre Interrupts are disabled
+ *  @return Void.
+ */
+static void
+fail_stranded_waiters( pcb_t *pcb )
+{
+	tcb_t *waiting_tcb = Q_GET_FRONT(&(pcb->waiting_threads_list));
+	while (waiting_tcb
+	       && pcb->num_waiting_threads
+	          > pcb->num_active_child_tasks + pcb->num_vanished_child_tasks) {
+		tcb_t *next = Q_GET_NEXT(waiting_tcb, waiting_threads_link);
+		if (!waiting_tcb->wait_tid) {
+			Q_REMOVE(&(pcb->waiting_threads_list), waiting_tcb,
+			         waiting_threads_link);
+			pcb->num_waiting_threads--;
+
+			affirm(waiting_tcb->status == BLOCKED);
+			waiting_tcb->collected_vanished_child = NULL;
+			switch_safe_make_thread_runnable(waiting_tcb);
+		}
+		waiting_tcb = next;
+	}
+}
 
-/** @brief Assigns the first waiting parent thread a vanished child task
+/** @brief Assigns a waiting parent thread a vanished child task
  *
  *  @param child_last_thread Last running thread of child task
  *  @param v_waiting_thread Parent thread waiting to cleanup this child task
@@ -330,7 +435,8 @@ assign_child_task_to_parent_thread( tcb_t *child_last_thread,
 	pcb_t *parent_pcb = waiting_thread->owning_task;
 	affirm(parent_pcb);
 
-	affirm(waiting_thread == Q_GET_FRONT(&(parent_pcb->waiting_threads_list)));
+	affirm(!waiting_thread->wait_tid
+	       || waiting_thread->wait_tid == child_pcb->first_thread_tid);
 
 	Q_REMOVE(&(parent_pcb->waiting_threads_list), waiting_thread,
 	         waiting_threads_link);
@@ -343,6 +449,10 @@ assign_child_task_to_parent_thread( tcb_t *child_last_thread,
 	affirm(waiting_thread->status == BLOCKED);
 
 	waiting_thread->collected_vanished_child = child_pcb;
+	if (child_pcb->claimed) {
+		child_pcb->claimed = 0;
+		fail_stranded_waiters(parent_pcb);
+	}
 
 	switch_safe_mutex_unlock(&(parent_pcb->set_status_vanish_wait_mux));
 	switch_safe_make_thread_runnable(waiting_thread);
@@ -1,20 +1,185 @@
 /** @brief wait.c
  *
- *  Implements wait() and helper functions.
+ *  Implements wait(), waitpid(), wait_many() and helper functions.
+ *
+ *  Child tasks are named by the tid of their first thread, which is what
+ *  fork() returned to the parent. A thread which blocks waiting for a child
+ *  task records which one in its wait_tid, 0 if any will do, and vanish()
+ *  only hands it a child task it is waiting for. Only one thread at a time
+ *  may wait for a given child task, which is then claimed by it.
  */
 #include <x86/asm.h>   /* outb() */
 #include <logger.h>    /* log() */
 #include <timer_driver.h>		/* get_total_ticks() */
 #include <scheduler.h>			/* yield_execution() */
 #include <task_manager_internal.h>
+#include <memory_manager.h>		/* is_valid_user_pointer() */
+#include <lib_life_cycle/life_cycle.h> /* WNOHANG, WAIT_MANY_MAX */
 #include <x86/interrupt_defines.h> /* INT_CTL_PORT, INT_ACK_CURRENT */
-#include <lib_thread_management/hashmap.h>
+#include <rusage.h>				/* fold_child_usage() */
 #include <simics.h>
 
 
 static void store_waiting_thread( tcb_t *waiting_thread,
                                   void *owning_task_mux );
 
+/** @brief Removes a vanished child task from a task's vanished child tasks
+ *         list.
+ *
+ *  @param owning_task Task whose vanished child task to take
+ *  @param child_tid First thread ID of the child task, 0 for any
+ *  @pre owning_task->set_status_vanish_wait_mux is held
+ *  @return Vanished child task PCB, NULL if there is none
+ */
+static pcb_t *
+take_vanished_child( pcb_t *owning_task, uint32_t child_tid )
+{
+	pcb_t *child = Q_GET_FRONT(&(owning_task->vanished_child_tasks_list));
+	while (child && child_tid && child->first_thread_tid != child_tid)
+		child = Q_GET_NEXT(child, vanished_child_tasks_link);
+
+	if (child) {
+		affirm(child->last_thread->status == DEAD);
+		Q_REMOVE(&(owning_task->vanished_child_tasks_list), child,
+		         vanished_child_tasks_link);
+		owning_task->num_vanished_child_tasks--;
+	}
+	return child;
+}
+
+/** @brief Finds a running child task.
+ *
+ *  @param owning_task Task whose child task to find
+ *  @param child_tid First thread ID of the child task
+ *  @pre owning_task->set_status_vanish_wait_mux is held
+ *  @return Active child task PCB, NULL if there is none
+ */
+static pcb_t *
+find_active_child( pcb_t *owning_task, uint32_t child_tid )
+{
+	pcb_t *child = Q_GET_FRONT(&(owning_task->active_child_tasks_list));
+	while (child && child->first_thread_tid != child_tid)
+		child = Q_GET_NEXT(child, vanished_child_tasks_link);
+	return child;
+}
+
+/** @brief Checks whether waiting could ever collect a child task.
+ *
+ *  Every waiting thread, whether it waits for a given child task or any,
+ *  takes one child task, so a thread may only wait while there are more
+ *  child tasks than threads already waiting for them. A given child task
+ *  can also only be collected while it is still running and no other
+ *  thread waits for it.
+ *
+ *  @param owning_task Task which would wait
+ *  @param child_tid First thread ID of the child task, 0 for any
+ *  @pre owning_task->set_status_vanish_wait_mux is held
+ *  @return 1 if waiting could collect a child task, 0 otherwise
+ */
+static int
+can_collect_child( pcb_t *owning_task, uint32_t child_tid )
+{
+	if (owning_task->num_waiting_threads
+	    >= (owning_task->num_active_child_tasks
+	        + owning_task->num_vanished_child_tasks)) {
+		return 0;
+	}
+	if (!child_tid)
+		return 1;
+
+	pcb_t *child = find_active_child(owning_task, child_tid);
+	return child && !child->claimed;
+}
+
+/** @brief Collects a vanished child task, blocking until one vanishes unless
+ *         WNOHANG is set.
+ *
+ *  @param child_tid First thread ID of the child task, 0 for any
+ *  @param flags WNOHANG or 0
+ *  @param childp Where the collected child task PCB is stored
+ *  @return 1 if a child task was collected, 0 if WNOHANG is set and no
+ *          child task has vanished yet, negative value if no child task can
+ *          ever be collected, or stopped being collectable while blocked
+ */
+static int
+collect_child( uint32_t child_tid, int flags, pcb_t **childp )
+{
+	tcb_t *waiting_thread = get_running_thread();
+	affirm(waiting_thread);
+	affirm(!(waiting_thread->collected_vanished_child));
+
+	pcb_t *owning_task = waiting_thread->owning_task;
+	affirm(owning_task);
+
+	log_info("collect_child(): beginning wait "
+	         "waiting_thread->tid:%d, "
+			 "waiting_thread->owning_task->first_thread_tid:%d, "
+			 "child_tid:%d", waiting_thread->tid,
+			 owning_task->first_thread_tid, child_tid);
+
+	mutex_lock(&(owning_task->set_status_vanish_wait_mux));
+	pcb_t *child = take_vanished_child(owning_task, child_tid);
+
+	/* Collected vanished child on first try */
+	if (child) {
+		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+		*childp = child;
+		return 1;
+	}
+	/* Will definitely never successfully wait for a child task */
+	if (!can_collect_child(owning_task, child_tid)) {
+		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+		return -1;
+	}
+	if (flags & WNOHANG) {
+		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+		return 0;
+	}
+
+	/* Claim a given child task so no other thread waits for it */
+	if (child_tid)
+		find_active_child(owning_task, child_tid)->claimed = 1;
+
+	/* Block self and yield until vanish() hands us a child task */
+	waiting_thread->wait_tid = child_tid;
+	affirm(yield_execution(BLOCKED, NULL, store_waiting_thread,
+		   &(owning_task->set_status_vanish_wait_mux)) == 0);
+
+	/* We've been woken up, without a child task if there are none left
+	 * for us, see fail_stranded_waiters() */
+	child = waiting_thread->collected_vanished_child;
+	waiting_thread->collected_vanished_child = NULL;
+	waiting_thread->wait_tid = 0;
+	if (!child)
+		return -1;
+	affirm(!child_tid || child->first_thread_tid == child_tid);
+
+	*childp = child;
+	return 1;
+}
+
+/** @brief Frees a collected child task, storing its exit status
+ *
+ *  @param child Collected vanished child task PCB
+ *  @param status_ptr Where the exit status is stored, NULL to ignore it
+ *  @return First thread ID of the child task
+ */
+static int
+reap_child( pcb_t *child, int *status_ptr )
+{
+	int tid = child->first_thread_tid;
+	affirm(tid >= 0);
+
+	log_info("reap_child(): child->first_thread_tid:%d, exit_status:%d",
+	         tid, child->exit_status);
+	if (status_ptr)
+		*status_ptr = child->exit_status;
+
+	fold_child_usage(get_running_task(), child);
+	free_pcb_but_not_pd(child);
+	return tid;
+}
+
 /** @brief waits on vanished child tasks and collects the child task's status
  *        if status_ptr is non-NULL and user writable.
  *
@@ -30,77 +195,103 @@ wait (int *status_ptr)
 		return -1;
 	}
 
-	tcb_t *waiting_thread = get_running_thread();
-	affirm(waiting_thread);
-	affirm(!(waiting_thread->collected_vanished_child));
-
-	pcb_t *owning_task = waiting_thread->owning_task;
-	affirm(owning_task);
+	pcb_t *child;
+	if (collect_child(0, 0, &child) < 0)
+		return -1;
 
-	log_info("wait(): beginning wait "
-	         "waiting_thread->tid:%d, "
-			 "waiting_thread->owning_task->first_thread_tid:%d",
-			 waiting_thread->tid, owning_task->first_thread_tid);
+	return reap_child(child, status_ptr);
+}
 
-	int tid = -1;
+/** @brief Waits on a given child task, or any child task if tid is -1,
+ *         and collects its exit status if status_ptr is non-NULL.
+ *
+ *  @param tid First thread ID of the child task, as returned by fork(), or -1
+ *  @param status_ptr Pointer to store exit status of collected vanished child
+ *                    task.
+ *  @param flags WNOHANG to return instead of blocking, or 0
+ *  @return Collected vanished child task's first thread ID on success, 0 if
+ *          WNOHANG is set and the child task has not vanished yet, negative
+ *          value on error.
+ */
+int
+waitpid( int tid, int *status_ptr, int flags )
+{
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
 
-	mutex_lock(&(owning_task->set_status_vanish_wait_mux));
-	waiting_thread->collected_vanished_child =
-		Q_GET_FRONT(&(owning_task->vanished_child_tasks_list));
-
-	/* Could not collect vanished child on first try, block self and yield */
-	if (!waiting_thread->collected_vanished_child) {
-
-		if (owning_task->num_waiting_threads
-			< (owning_task->num_active_child_tasks
-			   + owning_task->num_vanished_child_tasks)) {
-
-			affirm(yield_execution(BLOCKED, NULL, store_waiting_thread,
-				   &(owning_task->set_status_vanish_wait_mux)) == 0);
-
-		/* Will definitely never successfully wait for a child task */
-		} else {
-			mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
-			return -1;
-		}
-	/* Collected vanished child on first try, so remove them from vanish list*/
-	} else {
-		affirm(
-			waiting_thread->collected_vanished_child->last_thread->status
-			== DEAD);
-		Q_REMOVE(&(owning_task->vanished_child_tasks_list),
-		         waiting_thread->collected_vanished_child,
-                 vanished_child_tasks_link);
-		owning_task->num_vanished_child_tasks--;
-		mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+	if (tid == 0 || tid < -1 || (flags & ~WNOHANG)) {
+		return -1;
+	}
+	if (status_ptr && !is_valid_user_pointer(status_ptr, READ_WRITE)) {
+		return -1;
 	}
-	/* We've been woken up */
 
-	affirm(waiting_thread->collected_vanished_child);
+	pcb_t *child;
+	int res = collect_child(tid == -1 ? 0 : tid, flags, &child);
+	if (res <= 0)
+		return res;
 
-	/* Get needed information and return */
-	tid = waiting_thread->collected_vanished_child->first_thread_tid;
-	affirm(tid >= 0);
-	if (status_ptr) {
-		*status_ptr = waiting_thread->collected_vanished_child->exit_status;
+	return reap_child(child, status_ptr);
+}
+
+/** @brief Collects up to max vanished child tasks in one call.
+ *
+ *  Blocks until a child task vanishes unless WNOHANG is set, then collects
+ *  every other vanished child task, up to max in total, without blocking.
+ *  Child task i's first thread ID is stored in tid_array[i] and its exit
+ *  status in status_array[i].
+ *
+ *  @param status_array Array of max exit statuses, NULL to ignore them
+ *  @param tid_array Array of max first thread IDs
+ *  @param max Most child tasks to collect, at most WAIT_MANY_MAX
+ *  @param flags WNOHANG to return instead of blocking, or 0
+ *  @return Number of child tasks collected, 0 if WNOHANG is set and no child
+ *          task has vanished yet, negative value on error.
+ */
+int
+wait_many( int *status_array, int *tid_array, int max, int flags )
+{
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
 
+	if (max <= 0 || max > WAIT_MANY_MAX || (flags & ~WNOHANG)) {
+		return -1;
+	}
+	if (!is_valid_user_buffer((char *) tid_array, max * sizeof(int),
+	                          READ_WRITE)) {
+		return -1;
 	}
-	if (status_ptr) {
-		log_info("wait(): "
-				 "waiting_thread->collected_vanished_child->first_thread_tid:"
-				 "%d, "
-				 "exit_status:%d", tid, *status_ptr);
-	} else {
-		log_info("wait(): "
-				 "waiting_thread->collected_vanished_child->first_thread_tid:"
-				 "%d, "
-				 "exit_status (ignored):%d", tid,
-				 waiting_thread->collected_vanished_child->exit_status);
+	if (status_array
+	    && !is_valid_user_buffer((char *) status_array, max * sizeof(int),
+	                             READ_WRITE)) {
+		return -1;
 	}
 
-	free_pcb_but_not_pd(waiting_thread->collected_vanished_child);
-	waiting_thread->collected_vanished_child = NULL;
-	return tid;
+	pcb_t *child;
+	int res = collect_child(0, flags, &child);
+	if (res <= 0)
+		return res;
+
+	/* Detach every other vanished child task we have room for at once */
+	pcb_t *owning_task = get_running_thread()->owning_task;
+	vanished_child_tasks_list_t collected;
+	Q_INIT_HEAD(&collected);
+	Q_INSERT_TAIL(&collected, child, vanished_child_tasks_link);
+
+	mutex_lock(&(owning_task->set_status_vanish_wait_mux));
+	int num_collected = 1;
+	while (num_collected < max
+	       && (child = take_vanished_child(owning_task, 0))) {
+		Q_INSERT_TAIL(&collected, child, vanished_child_tasks_link);
+		num_collected++;
+	}
+	mutex_unlock(&(owning_task->set_status_vanish_wait_mux));
+
+	for (int i = 0; i < num_collected; ++i) {
+		child = Q_GET_FRONT(&collected);
+		Q_REMOVE(&collected, child, vanished_child_tasks_link);
+		tid_array[i] = reap_child(child,
+		                          status_array ? &status_array[i] : NULL);
+	}
+	return num_collected;
 }
 
 /** @brief Stores waiting thread in its task's waiting threads list and
@@ -133,4 +324,3 @@ store_waiting_thread( tcb_t *waiting_thread, void *owning_task_mux )
 	         "unlocked mux:%p, &waiting_threads_list:%p", mux,
 			 &(owning_task->waiting_threads_list));
 }
-
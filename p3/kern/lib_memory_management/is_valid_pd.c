@@ -88,8 +88,14 @@ is_valid_pt( uint32_t *pt, int pd_index )
                 }
 
 
-				/* Frame must be a valid physical address by physalloc */
-				if ((phys_address != SYS_ZERO_FRAME)
+				/* Frame must be a valid physical address by physalloc,
+				 * unless it is a RAM disk frame shared by map_file() */
+				int is_shared_frame = phys_address < USER_MEM_START
+				  && (SYS_PROG_FLAG(pt_entry) == MAP_FILE_BASE_FLAG
+				      || SYS_PROG_FLAG(pt_entry)
+				         == MAP_FILE_CONTINUE_FROM_BASE_FLAG)
+				  && !(pt_entry & RW_FLAG);
+				if ((phys_address != SYS_ZERO_FRAME) && !is_shared_frame
 					&& !is_physframe(phys_address)) {
 					log_warn("is_valid_pt(): "
                              "pt at address: %p has invalid frame physical "
@@ -101,8 +107,10 @@ is_valid_pt( uint32_t *pt, int pd_index )
 			/* pt holds physical frame in kernel VM */
 			} else {
 
-				/* Frame must be < USER_MEM_START */
-				if (phys_address >= USER_MEM_START) {
+				/* Frame must be < USER_MEM_START, unless it is the frame
+				 * window mapping a physalloc() frame */
+				if (phys_address >= USER_MEM_START
+				    && !is_frame_window_entry(pd_index, i)) {
 					log_warn("is_valid_pt(): "
                              "pt at address: %p has invalid frame physical "
 							 "address: %p >= USER_MEM_START with pt_entry: "
@@ -0,0 +1,181 @@
+/** @file map_file.c
+ *  @brief map_file syscall handler
+ *
+ *  RAM disk files live in direct mapped kernel memory, so map_file() maps the
+ *  frames holding a file read-only into the caller's address space instead
+ *  of copying the file. Since a file need not start on a page boundary, its
+ *  first byte lands at the same offset into the first mapped page as it has
+ *  in its kernel frame. The first and last pages may hold bytes of other
+ *  kernel data, so those are copied into private frames instead, as is all
+ *  of a compressed file.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <common_kern.h>/* USER_MEM_START */
+#include <x86/cr.h>
+#include <logger.h>
+#include <memory_manager.h>
+#include <assert.h>
+#include <x86/asm.h>   /* outb() */
+#include <x86/interrupt_defines.h> /* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <page.h> /* PAGE_SIZE */
+#include <string.h> /* memset(), memcpy() */
+#include <exec2obj.h> /* MAX_EXECNAME_LEN */
+#include <loader.h> /* get_ramdisk_file() */
+#include <ramdisk.h> /* ramdisk_getbytes() */
+#include <physalloc.h>
+#include <memory_manager_internal.h>
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/** @brief Checks if a page of a file mapping needs a private frame.
+ *
+ *  @param page Index of the page in the mapping
+ *  @param compressed Whether the file is compressed
+ *  @param skew Offset of the first file byte into the first page
+ *  @param file_len Length of the file
+ *  @return 1 if the page must get a private frame, 0 if it can be shared
+ */
+static int
+needs_private_frame( uint32_t page, int compressed, uint32_t skew,
+                     int file_len )
+{
+	/* A page is shared only if it holds nothing but file bytes */
+	return compressed || (page == 0 && skew)
+	       || (page + 1) * PAGE_SIZE > skew + file_len;
+}
+
+/** @brief Maps a RAM disk file read-only into the caller's address space.
+ *
+ *  The mapping covers whole pages starting at base, and is removed with
+ *  remove_pages(base).
+ *
+ *  @param filename Name of the RAM disk file
+ *  @param base Page aligned address to map the file at
+ *  @param datap Where the address of the first byte of the file is stored,
+ *         which is within the first page mapped
+ *  @return Length of the file on success, negative value on error.
+ */
+int
+map_file( char *filename, void *base, char **datap )
+{
+    /* Acknowledge interrupt immediately */
+    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_null_terminated_user_string(filename, MAX_EXECNAME_LEN))
+		return -1;
+
+	if (!is_valid_user_pointer(datap, READ_WRITE)
+	    || !is_valid_user_pointer((char *) (datap + 1) - 1, READ_WRITE))
+		return -1;
+
+    if ((uint32_t)base < USER_MEM_START) {
+        log_warn("map_file(): "
+                 "base < USER_MEM_START");
+        return -1;
+    }
+    if (!PAGE_ALIGNED(base)) {
+        log_warn("map_file(): "
+                 "base not page aligned!");
+        return -1;
+    }
+	const char *execbytes;
+	int execlen;
+	if (get_ramdisk_file(filename, &execbytes, &execlen) < 0)
+		return -1;
+
+	int file_len = ramdisk_file_len(execbytes, execlen);
+	if (file_len <= 0)
+		return -1;
+
+	/* Offset of the first byte into its frame, kept in the mapping so
+	 * frames can be shared. Compressed files have no raw frames to share. */
+	int compressed = ramdisk_is_compressed(execbytes, execlen);
+	uint32_t skew = compressed ? 0 : ((uint32_t) execbytes & PAGE_OFFSET);
+	uint32_t num_pages = (skew + file_len + PAGE_SIZE - 1) / PAGE_SIZE;
+	uint32_t first_frame = TABLE_ADDRESS(execbytes);
+
+	if ((uint32_t) base + num_pages * PAGE_SIZE - 1 < (uint32_t) base) {
+        log_warn("map_file(): "
+                 "mapping wraps around the address space");
+		return -1;
+	}
+
+	mutex_lock(&pages_mux);
+
+    /* Check if any portion is currently allocated in task address space */
+	uint32_t **pd = get_pd();
+    char *base_char = (char *) base;
+	for (uint32_t i = 0; i < num_pages; ++i) {
+        if (is_user_pointer_allocated(base_char + i * PAGE_SIZE)) {
+            log_warn("map_file(): "
+                     "%p is already allocated!", base_char + i * PAGE_SIZE);
+			mutex_unlock(&pages_mux);
+            return -1;
+        }
+	}
+	uint32_t private_pages = 0;
+	for (uint32_t i = 0; i < num_pages; ++i) {
+		if (needs_private_frame(i, compressed, skew, file_len))
+			++private_pages;
+	}
+    if (num_free_phys_frames() < private_pages) {
+        log_warn("map_file(): "
+                 "not enough free frames to satisfy request!");
+		mutex_unlock(&pages_mux);
+        return -1;
+    }
+
+	for (uint32_t i = 0; i < num_pages; ++i) {
+		uint32_t virtual_address = (uint32_t) base + i * PAGE_SIZE;
+		uint32_t flag = i == 0 ? MAP_FILE_BASE_FLAG
+		                       : MAP_FILE_CONTINUE_FROM_BASE_FLAG;
+		uint32_t frame = first_frame + i * PAGE_SIZE;
+		if (needs_private_frame(i, compressed, skew, file_len))
+			frame = 0;
+
+		if (map_user_frame(pd, virtual_address, frame, flag) < 0) {
+            log_warn("map_file(): "
+                     "unable to map page %p", (void *) virtual_address);
+			for (uint32_t j = 0; j < i; ++j)
+				unallocate_frame(pd, (uint32_t) base + j * PAGE_SIZE);
+			mutex_unlock(&pages_mux);
+			return -1;
+		}
+	}
+
+	/* Fill private frames, which are read-only to the user */
+	int res = 0;
+	disable_write_protection();
+	for (uint32_t i = 0; i < num_pages && res == 0; ++i) {
+		if (!needs_private_frame(i, compressed, skew, file_len))
+			continue;
+
+		char *page = base_char + i * PAGE_SIZE;
+		memset(page, 0, PAGE_SIZE);
+
+		/* File bytes held by this page */
+		int start = i == 0 ? skew : 0;
+		int offset = i * PAGE_SIZE + start - skew;
+		int len = PAGE_SIZE - start;
+		if (len > file_len - offset)
+			len = file_len - offset;
+
+		if (ramdisk_getbytes(execbytes, execlen, offset, len,
+		                     page + start) != len)
+			res = -1;
+	}
+	enable_write_protection();
+
+	if (res < 0) {
+		log_warn("map_file(): unable to read RAM disk file");
+		for (uint32_t i = 0; i < num_pages; ++i)
+			unallocate_frame(pd, (uint32_t) base + i * PAGE_SIZE);
+		mutex_unlock(&pages_mux);
+		return -1;
+	}
+	mutex_unlock(&pages_mux);
+
+	*datap = base_char + skew;
+	return file_len;
+}
@@ -14,8 +14,11 @@
 #include <common_kern.h>		/* USER_MEM_START  */
 #include <panic_thread.h>		/* panic_thread() */
 #include <memory_manager.h>		/* zero_page_pf_handler */
+#include <kstack.h>				/* is_kstack_guard() */
+#include <task_manager.h>		/* get_kern_stack_lo() */
 #include <install_handler.h>	/* install_handler_in_idt() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <rusage.h>				/* count_page_fault() */
 
 
 #include <simics.h>
@@ -74,6 +77,7 @@ pagefault_handler( int *ebp )
 	(void) ss;
 
 	uint32_t faulting_vm_address = get_cr2();
+	count_page_fault();
 
 	char user_mode[] = "[USER-MODE]";
 	char supervisor_mode[] = "[SUPERVISOR-MODE]";
@@ -94,6 +98,24 @@ pagefault_handler( int *ebp )
 				return;
 			}
 		}
+		/* Ran past the bottom of this thread's kernel stack. Only faults
+		 * which leave room below esp for the processor to push the fault
+		 * get here, running out of stack altogether is a double fault
+		 * reported by double_fault_task() in kstack.c */
+		tcb_t *tcb = get_running_thread();
+		if (tcb && is_kstack_guard(get_kern_stack_lo(tcb),
+		                           (void *) faulting_vm_address)) {
+			panic("pagefault_handler(): kernel stack overflow in tid:%d "
+			      "eip:0x%x faulting_vm_address:%p",
+			      get_running_tid(), eip, faulting_vm_address);
+		}
+		if (get_irq_stack_lo()
+		    && is_kstack_guard(get_irq_stack_lo(),
+		                       (void *) faulting_vm_address)) {
+			panic("pagefault_handler(): interrupt stack overflow "
+			      "eip:0x%x faulting_vm_address:%p",
+			      eip, faulting_vm_address);
+		}
 		panic("pagefault_handler(): %s "
 		      "pagefault while running in kernel mode! "
  	          "error_code:0x%x "
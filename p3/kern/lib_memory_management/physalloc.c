@@ -51,6 +51,9 @@ static stack_t reuse_stack;
 
 static mutex_t mux;
 
+/* Calls to physalloc() so far, for benchmarks */
+static uint32_t num_physalloc_calls = 0;
+
 /** @brief Checks if a physical address is page aligned and could have
  *         been given out by physalloc
  *
@@ -82,6 +85,16 @@ num_free_phys_frames( void )
 	return UNCLAIMED_PAGES + reuse_stack.top;
 }
 
+/** @brief Returns how many times physalloc() has been called
+ *
+ *  @return Number of physalloc() calls since boot
+ */
+uint32_t
+physalloc_calls( void )
+{
+	return num_physalloc_calls;
+}
+
 /** @brief Initializes physical allocator family of functions
  *
  *  Must be called once and only once
@@ -121,6 +134,7 @@ physalloc( void )
 		init_physalloc();
 
 	mutex_lock(&mux);
+	num_physalloc_calls++;
 
 	if (reuse_stack.top > 0) {
 		uint32_t page = reuse_stack.data[--reuse_stack.top];
@@ -20,7 +20,8 @@
 #include <memory_manager_internal.h>
 #include <lib_thread_management/mutex.h> /* mutex_t */
 
-/** @brief Removes memory allocated starting from base.
+/** @brief Removes memory allocated starting from base, either by new_pages()
+ *         or by map_file().
  *
  *  @base Lowest address to start freeing pages from
  *  @return 0 on success, -1 on error.
@@ -60,7 +61,13 @@ remove_pages( void *base )
 	int sys_prog_flag = SYS_PROG_FLAG(*ptep);
 	assert(is_valid_sys_prog_flag(sys_prog_flag));
 
-	if (sys_prog_flag != NEW_PAGE_BASE_FLAG) {
+	/* Regions mapped by map_file() are removed the same way */
+	int continue_flag;
+	if (sys_prog_flag == NEW_PAGE_BASE_FLAG) {
+		continue_flag = NEW_PAGE_CONTINUE_FROM_BASE_FLAG;
+	} else if (sys_prog_flag == MAP_FILE_BASE_FLAG) {
+		continue_flag = MAP_FILE_CONTINUE_FROM_BASE_FLAG;
+	} else {
 		log_warn("remove_pages(): "
 				 "base:%p not previously allocated by new_pages(), "
 				 "sys_prog_flag:0x%08x",
@@ -77,7 +84,7 @@ remove_pages( void *base )
 
 	/* Free remaining frames */
 	ptep = get_ptep((const uint32_t **) pd, curr);
-	while (ptep && (SYS_PROG_FLAG(*ptep) == NEW_PAGE_CONTINUE_FROM_BASE_FLAG)) {
+	while (ptep && (SYS_PROG_FLAG(*ptep) == continue_flag)) {
 		unallocate_frame(pd, curr);
 		curr += PAGE_SIZE;
 		assert(is_valid_pd(pd));
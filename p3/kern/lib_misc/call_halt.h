@@ -9,4 +9,7 @@
 /* Calls hlt asm instruction */
 void call_hlt( void );
 
+/* Enables interrupts and halts until the next one */
+void call_sti_hlt( void );
+
 #endif /* CALL_HALT_H_ */
@@ -0,0 +1,223 @@
+/** @file task_snapshot.c
+ *  @brief task_snapshot() syscall handler, see task_snapshot.h.
+ *
+ *  Taking a snapshot holds locks only for as long as it takes to copy, never
+ *  while writing to user memory. It first walks the pid map, taking a
+ *  reference on the PCB of each task that fits in the buffer. Then, one task
+ *  at a time, it copies the task's fields into a kernel entry under the
+ *  task's own mutex, drops the reference, and only then writes the entry to
+ *  the user buffer. So at no point does it hold more than one lock, and the
+ *  pid map is locked just long enough to count references, however many
+ *  tasks there are.
+ *
+ *  References are taken SNAPSHOT_BATCH PCBs at a time, walking the pid map
+ *  again from the next pid for each batch, so the kernel allocation does
+ *  not grow with the buffer the user passes.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <task_snapshot.h>
+#include <asm.h>				/* outb() */
+#include <stdint.h>				/* uint32_t */
+#include <stddef.h>				/* NULL */
+#include <string.h>				/* memcpy(), memset(), strncpy() */
+#include <malloc.h>				/* malloc(), free() */
+#include <rusage.h>				/* get_task_usage(), cycles_to_ms() */
+#include <logger.h>				/* log_warn() */
+#include <scheduler.h>			/* status_t */
+#include <timer_driver.h>		/* get_total_ticks(), get_tsc_per_tick() */
+#include <context_switch.h>	/* cr3_writes */
+#include <task_manager.h>		/* for_each_task(), get_pcb(), put_pcb() */
+#include <memory_manager.h>		/* is_valid_user_buffer() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <task_manager_internal.h> /* pcb_t, tcb_t */
+#include <variable_queue.h>		/* Q_GET_FRONT(), Q_GET_NEXT() */
+#include <lib_thread_management/mutex.h> /* mutex_lock() */
+
+/* Most PCBs a reference is held on at once */
+#define SNAPSHOT_BATCH 256
+
+/** @brief PCBs collected from the pid map
+ *
+ *  @param pcbs PCBs a reference was taken on
+ *  @param max Most PCBs to collect
+ *  @param min_pid Lowest pid to collect
+ *  @param num_pcbs PCBs collected
+ *  @param num_tasks Tasks seen
+ */
+typedef struct {
+	pcb_t **pcbs;
+	uint32_t max;
+	uint32_t min_pid;
+	uint32_t num_pcbs;
+	uint32_t num_tasks;
+} collected_t;
+
+/** @brief Collects a PCB if there is room left for it, see for_each_task()
+ *
+ *  @param pcb PCB
+ *  @param data Where to collect it
+ *  @return Void.
+ */
+static void
+collect_pcb( pcb_t *pcb, void *data )
+{
+	collected_t *collected = data;
+	collected->num_tasks++;
+	if (pcb->pid < collected->min_pid
+	    || collected->num_pcbs == collected->max)
+		return;
+
+	get_pcb(pcb);
+	collected->pcbs[collected->num_pcbs++] = pcb;
+}
+
+/** @brief Copies a task into a snapshot entry.
+ *
+ *  @param pcb Task, on which a reference is held
+ *  @param init_pid Task ID of init, which adopts orphaned tasks
+ *  @param entry Entry to fill in
+ *  @return 0 on success, negative value if the task vanished in the
+ *          meantime
+ */
+static int
+snapshot_task( pcb_t *pcb, uint32_t init_pid, task_snapshot_entry_t *entry )
+{
+	memset(entry, 0, sizeof(task_snapshot_entry_t));
+
+	mutex_lock(&pcb->set_status_vanish_wait_mux);
+
+	/* Once vanished, the task may be reaped and its parent PCB freed */
+	if (pcb->has_vanished) {
+		mutex_unlock(&pcb->set_status_vanish_wait_mux);
+		return -1;
+	}
+	entry->pid = pcb->pid;
+	/* A vanished parent's pid may already be reused, and init is about to
+	 * adopt the task anyway */
+	pcb_t *parent = pcb->parent_pcb;
+	if (!parent)
+		entry->ppid = 0;
+	else if (parent->has_vanished)
+		entry->ppid = init_pid;
+	else
+		entry->ppid = parent->pid;
+	strncpy(entry->execname, pcb->execname, TASK_SNAPSHOT_NAME_LEN - 1);
+	entry->num_threads = pcb->num_active_threads;
+	entry->num_child_tasks = pcb->num_active_child_tasks;
+
+	for (tcb_t *tcb = Q_GET_FRONT(&pcb->active_threads_list); tcb;
+	     tcb = Q_GET_NEXT(tcb, task_thread_link)) {
+		switch (get_tcb_status(tcb)) {
+			case RUNNING:
+				entry->num_running++;
+				break;
+			case RUNNABLE:
+				entry->num_runnable++;
+				break;
+			case BLOCKED:
+				entry->num_blocked++;
+				break;
+			case DESCHEDULED:
+				entry->num_descheduled++;
+				break;
+			default:
+				break;
+		}
+	}
+	usage_t usage;
+	get_task_usage(pcb, &usage);
+
+	mutex_unlock(&pcb->set_status_vanish_wait_mux);
+
+	entry->runtime_cycles = usage.runtime;
+	entry->runtime_ms = cycles_to_ms(usage.runtime);
+	entry->voluntary_switches = usage.voluntary_switches;
+	entry->involuntary_switches = usage.involuntary_switches;
+	entry->page_faults = usage.page_faults;
+	entry->syscalls = usage.syscalls;
+	return 0;
+}
+
+/** @brief Handler for the task_snapshot() syscall.
+ *
+ *  Fills buf with a task_snapshot_header_t followed by as many
+ *  task_snapshot_entry_t as fit, one per task. If header.num_tasks is more
+ *  than header.num_entries, a larger buffer would have held more tasks.
+ *
+ *  @param buf User buffer
+ *  @param len Bytes of buf
+ *  @return Bytes written to buf on success, negative value on error
+ */
+int
+task_snapshot( void *buf, int len )
+{
+	/* Acknowledge interrupt */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (len < (int) sizeof(task_snapshot_header_t)
+	    || !is_valid_user_buffer(buf, len, READ_WRITE))
+		return -1;
+
+	uint32_t max_entries = (len - sizeof(task_snapshot_header_t))
+	                       / sizeof(task_snapshot_entry_t);
+	collected_t collected;
+	collected.min_pid = 0;
+	collected.pcbs = NULL;
+	if (max_entries > 0) {
+		collected.pcbs = malloc(SNAPSHOT_BATCH * sizeof(pcb_t *));
+		if (!collected.pcbs) {
+			log_warn("task_snapshot(): unable to allocate PCB pointers");
+			return -1;
+		}
+	}
+	uint32_t init_pid = get_init_pcbp()->pid;
+
+	task_snapshot_entry_t *entries = (task_snapshot_entry_t *)
+		((char *) buf + sizeof(task_snapshot_header_t));
+	uint32_t num_entries = 0;
+	uint32_t num_tasks = 0;
+	int first_walk = 1;
+	do {
+		collected.max = max_entries - num_entries;
+		if (collected.max > SNAPSHOT_BATCH)
+			collected.max = SNAPSHOT_BATCH;
+		collected.num_pcbs = 0;
+		collected.num_tasks = 0;
+		for_each_task(collect_pcb, &collected);
+
+		/* Tasks found on the first walk */
+		if (first_walk)
+			num_tasks = collected.num_tasks;
+		first_walk = 0;
+
+		for (uint32_t i = 0; i < collected.num_pcbs; ++i) {
+			pcb_t *pcb = collected.pcbs[i];
+			collected.min_pid = pcb->pid + 1;
+
+			task_snapshot_entry_t entry;
+			int vanished = snapshot_task(pcb, init_pid, &entry);
+			put_pcb(pcb);
+			if (vanished < 0)
+				continue;
+			memcpy(&entries[num_entries++], &entry, sizeof(entry));
+		}
+	} while (collected.num_pcbs > 0 && collected.num_pcbs == collected.max
+	         && num_entries < max_entries);
+	if (collected.pcbs)
+		free(collected.pcbs);
+
+	task_snapshot_header_t header;
+	header.version = TASK_SNAPSHOT_VERSION;
+	header.header_size = sizeof(task_snapshot_header_t);
+	header.entry_size = sizeof(task_snapshot_entry_t);
+	header.num_entries = num_entries;
+	header.num_tasks = num_tasks;
+	header.ticks = get_total_ticks();
+	header.tsc_per_tick = get_tsc_per_tick();
+	header.cr3_writes = cr3_writes;
+	memcpy(buf, &header, sizeof(header));
+
+	return sizeof(header) + num_entries * sizeof(task_snapshot_entry_t);
+}
@@ -0,0 +1,64 @@
+/** @file deadline.c
+ *  @brief Contains the set_deadline() and wait_period() interrupt handlers
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <deadline.h>
+#include <asm.h>				/* outb() */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* set_thread_deadline(), end_thread_period() */
+#include <timer_driver.h>		/* get_total_ticks() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_thread_management/sleep.h> /* sleep_until() */
+
+/** @brief set_deadline syscall handler, puts the calling thread in the
+ *         deadline class or takes it out.
+ *
+ *  @param period Period in ticks, at most DL_MAX_PERIOD, 0 to leave the
+ *         deadline class
+ *  @param runtime Ticks of CPU time per period
+ *  @param deadline Ticks from the start of each period to its deadline
+ *  @return 0 on success, negative value if the parameters are invalid or
+ *          admission fails
+ */
+int
+set_deadline( int period, int runtime, int deadline )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (period == 0)
+		return set_thread_deadline(0, 0, 0);
+
+	if (runtime <= 0 || runtime > deadline || deadline > period
+	    || period > DL_MAX_PERIOD) {
+		log_info("set_deadline(): invalid period:%d runtime:%d deadline:%d",
+		         period, runtime, deadline);
+		return -1;
+	}
+	return set_thread_deadline(period, runtime, deadline);
+}
+
+/** @brief wait_period syscall handler, ends the calling deadline thread's
+ *         work for the current period and sleeps until the next one.
+ *
+ *  @return 1 if the current period's deadline was missed, 0 if not,
+ *          negative value if the calling thread is not a deadline thread
+ */
+int
+wait_period( void )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	unsigned int release;
+	int missed = end_thread_period(&release);
+	if (missed < 0)
+		return -1;
+
+	/* The next period starts when the sleep queue wakes this thread up */
+	if (release > get_total_ticks())
+		sleep_until(release);
+	return missed;
+}
@@ -0,0 +1,32 @@
+/** @file gang_dispatch.c
+ *  @brief Contains the set_gang_batch() interrupt handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <gang_dispatch.h>
+#include <asm.h>				/* outb() */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* set_scheduler_gang_batch() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+
+/** @brief set_gang_batch syscall handler, sets how many switches in a row
+ *         may go to threads of the running thread's task, for every task.
+ *
+ *  @param batch Switches in a row, from 0 to GANG_BATCH_MAX, 0 to always
+ *         run the leftmost thread
+ *  @return 0 on success, negative value if batch is invalid
+ */
+int
+set_gang_batch( int batch )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (batch < 0 || batch > GANG_BATCH_MAX) {
+		log_info("set_gang_batch(): invalid batch:%d", batch);
+		return -1;
+	}
+	set_scheduler_gang_batch(batch);
+	return 0;
+}
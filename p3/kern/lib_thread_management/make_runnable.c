@@ -6,7 +6,7 @@
 #include <asm.h>				/* outb() */
 #include <scheduler.h>			/* make_thread_runnable() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
-#include <task_manager.h>       /* get_tcb_status() */
+#include <task_manager.h>       /* find_and_get_tcb(), get_tcb_status() */
 #include <logger.h>
 
 /** @brief Makes a previously descheduled thread runnable.
@@ -21,9 +21,13 @@ make_runnable( int tid )
     /* Acknowledge interrupt immediately */
     outb(INT_CTL_PORT, INT_ACK_CURRENT);
 
-	tcb_t *tcbp = find_tcb(tid);
-	if (!tcbp || get_tcb_status(tcbp) != DESCHEDULED)
+	tcb_t *tcbp = find_and_get_tcb(tid);
+	if (!tcbp)
 		return -1;
 
-	return make_thread_runnable(tcbp);
+	int res = -1;
+	if (get_tcb_status(tcbp) == DESCHEDULED)
+		res = make_thread_runnable(tcbp);
+	put_tcb(tcbp);
+	return res;
 }
@@ -5,6 +5,21 @@
  *  by moving locked threads into a separate mutex queue. Threads who
  *  acquire the lock are subsequently made runnable.
  *
+ *  Waiters are queued in priority order, see get_thread_priority(). By
+ *  default unlocking does not hand the lock to the first waiter: it frees
+ *  the lock and wakes that waiter to compete for it, so a thread which
+ *  unlocks and locks again before the waiter runs does so without a
+ *  context switch. Only one woken waiter competes at a time, and a waiter
+ *  which finds the lock taken again goes back to the front of its
+ *  priority. Once it has lost MUTEX_MAX_LOSSES times, the lock is handed
+ *  to it, which bounds how long it can be barged past. Mutexes set to
+ *  handoff with mutex_set_handoff() always hand the lock over.
+ *
+ *  While threads wait, the owner inherits the priority of the highest
+ *  one, and passes it on to the owner of any mutex it waits on itself, and
+ *  so on down the chain. Unlocking drops what the owner inherited through
+ *  that mutex.
+ *
  *  @author Andre Nascimento (anascime)
  *  */
 
@@ -14,8 +29,21 @@
 #include <asm.h>        /* enable/disable_interrupts() */
 #include <logger.h>     /* log */
 #include <task_manager_internal.h> /* Q MACRO for tcb */
+#include <priority.h>   /* NICE_MAX */
+
+/* Most owners a waiter passes its priority on to, which bounds the time
+ * spent with interrupts disabled */
+#define PI_CHAIN_MAX 16
+
+/* Times a woken waiter may find the lock taken again before it is handed
+ * the lock */
+#define MUTEX_MAX_LOSSES 4
 
 static void store_tcb_in_mutex_queue( tcb_t *tcb, void *data );
+static void take_mutex( mutex_t *mp, tcb_t *tcb );
+static void insert_waiter( mutex_t *mp, tcb_t *tcb, int ahead );
+static void boost_owners( mutex_t *mp, int priority );
+static void restore_priority( tcb_t *tcb );
 
 /** @brief Initialize a mutex
  *
@@ -29,12 +57,30 @@ mutex_init( mutex_t *mp )
         return -1;
 
     Q_INIT_HEAD(&mp->waiters_queue);
+    Q_INIT_ELEM(mp, held_link);
     mp->initialized = 1;
     mp->owned = 0;
+    mp->owner = NULL;
+    mp->handoff = 0;
+    mp->waking = 0;
 
     return 0;
 }
 
+/** @brief Sets whether unlocking a mutex hands it to the first waiter
+ *         rather than letting the woken waiter compete for it.
+ *
+ *  @param mp Mutex, not locked
+ *  @param handoff 1 to hand it over, 0 to let waiters compete
+ *  @return Void.
+ *  */
+void
+mutex_set_handoff( mutex_t *mp, int handoff )
+{
+	affirm(mp && mp->initialized && !mp->owned);
+	mp->handoff = handoff;
+}
+
 /** @brief Destroy a mutex
  *
  *  @param mp Pointer to memory location where mutex should be destroyed
@@ -65,6 +111,7 @@ mutex_lock( mutex_t *mp )
 	if (!is_multi_threads()) {
 		mp->owned = 1;
 		mp->owner_tid = get_running_tid();
+		mp->owner = NULL;
 		goto mutex_exit;
 	}
 
@@ -76,19 +123,27 @@ mutex_lock( mutex_t *mp )
 
     /* Atomically check if there is no owner, if so keep going, otherwise
      * add self to queue and let scheduler run next. */
+    tcb_t *tcb = get_running_thread();
     disable_interrupts(); /* ATOMICALLY { */
-    if (!mp->owned) {
-        mp->owned = 1;
-        mp->owner_tid = get_running_tid();
-        enable_interrupts(); /* } */
-        goto mutex_exit;
-    }
-    log("Waiting on lock %p. mp->owned %d, mp->owner_tid %d",
-			mp, mp->owned, mp->owner_tid);
+    while (mp->owned && mp->owner != tcb) {
+        log("Waiting on lock %p. mp->owned %d, mp->owner_tid %d",
+                mp, mp->owned, mp->owner_tid);
 
-	enable_interrupts();
-
-    affirm(yield_execution(BLOCKED, NULL, store_tcb_in_mutex_queue, mp) == 0);
+        /* Interrupts stay disabled until yield_execution() has queued
+         * this thread, or the owner could unlock in between and never wake
+         * it. It comes back woken or handed the lock */
+        affirm(yield_execution(BLOCKED, NULL, store_tcb_in_mutex_queue,
+                               mp) == 0);
+        disable_interrupts();
+        if (mp->owner != tcb) {
+            mp->waking = 0;
+            tcb->mutex_losses++;
+        }
+    }
+    if (!mp->owned)
+        take_mutex(mp, tcb);
+    tcb->mutex_losses = 0;
+    enable_interrupts(); /* } */
 
 mutex_exit:
 	assert(mp->owned);
@@ -127,18 +182,31 @@ mutex_unlock_helper( mutex_t *mp, int switch_safe )
     if (!switch_safe)
 		disable_interrupts();
 
-    tcb_t *to_run;
-    if ((to_run = Q_GET_FRONT(&mp->waiters_queue))) {
+	/* Whatever the owner inherited through this mutex goes with it */
+	if (mp->owner) {
+		Q_REMOVE(&mp->owner->held_mutexes, mp, held_link);
+		restore_priority(mp->owner);
+	}
+	mp->owned = 0;
+	mp->owner = NULL;
+
+	/* Wake the first waiter unless one woken earlier has yet to compete,
+	 * handing it the lock if it has lost too often */
+    tcb_t *to_run = Q_GET_FRONT(&mp->waiters_queue);
+    if (to_run && (!mp->waking || mp->handoff
+                   || to_run->mutex_losses >= MUTEX_MAX_LOSSES)) {
         Q_REMOVE(&mp->waiters_queue, to_run, scheduler_queue);
-        mp->owner_tid = to_run->tid;
+        to_run->blocked_on = NULL;
+        if (mp->handoff || to_run->mutex_losses >= MUTEX_MAX_LOSSES)
+            take_mutex(mp, to_run);
+        else
+            mp->waking = 1;
 		if (switch_safe) {
 			switch_safe_make_thread_runnable(to_run);
 		} else {
 			enable_interrupts();
 			make_thread_runnable(to_run);
 		}
-    } else {
-        mp->owned = 0;
     }
 
 	if (!switch_safe)
@@ -172,16 +240,110 @@ switch_safe_mutex_unlock( mutex_t *mp )
 
 /** @brief Callback used in yield_execution to store tcb
  *		   in mutex queue while it is descheduled waiting
- *		   on the mutex.
+ *		   on the mutex, and pass its priority on to the owner.
  *
  *	@param tcb Thread to store.
- *	@param data Unused.
+ *	@param data Mutex waited on.
  *	*/
 static void
 store_tcb_in_mutex_queue( tcb_t *tcb, void *data )
 {
 	affirm(tcb && data && tcb->status == BLOCKED);
-	/* Since thread not running, might as well use the scheduler queue link! */
 	mutex_t *mp = (mutex_t *)data;
-	Q_INSERT_TAIL(&mp->waiters_queue, tcb, scheduler_queue);
+	affirm(mp->owned);
+	tcb->blocked_on = mp;
+	/* A waiter which lost the lock keeps its place */
+	insert_waiter(mp, tcb, tcb->mutex_losses > 0);
+	boost_owners(mp, get_thread_priority(tcb));
+}
+
+/** @brief Makes a thread the owner of an unowned mutex, inheriting from
+ *         the threads still waiting on it.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param mp Mutex
+ *	@param tcb New owner, waiting on no mutex
+ *	@return Void.
+ *	*/
+static void
+take_mutex( mutex_t *mp, tcb_t *tcb )
+{
+	mp->owned = 1;
+	mp->owner_tid = tcb->tid;
+	mp->owner = tcb;
+	Q_INSERT_TAIL(&tcb->held_mutexes, mp, held_link);
+	if (Q_GET_FRONT(&mp->waiters_queue))
+		restore_priority(tcb);
+}
+
+/** @brief Queues a waiter behind those of higher priority, and behind or
+ *         ahead of those of its own.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param mp Mutex
+ *	@param tcb Waiter, in no queue
+ *	@param ahead Whether to go ahead of waiters of its own priority
+ *	@return Void.
+ *	*/
+static void
+insert_waiter( mutex_t *mp, tcb_t *tcb, int ahead )
+{
+	/* Since thread not running, might as well use the scheduler queue link! */
+	int priority = get_thread_priority(tcb);
+	tcb_t *next = Q_GET_FRONT(&mp->waiters_queue);
+	while (next && (get_thread_priority(next) < priority
+	                || (!ahead && get_thread_priority(next) == priority)))
+		next = Q_GET_NEXT(next, scheduler_queue);
+
+	if (next)
+		Q_INSERT_BEFORE(&mp->waiters_queue, next, tcb, scheduler_queue);
+	else
+		Q_INSERT_TAIL(&mp->waiters_queue, tcb, scheduler_queue);
+}
+
+/** @brief Passes a waiter's priority on to the owner of the mutex, and on
+ *         to the owner of the mutex that owner waits on, and so on, until
+ *         an owner already runs at that priority or higher.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param mp Mutex waited on
+ *	@param priority Waiter's priority
+ *	@return Void.
+ *	*/
+static void
+boost_owners( mutex_t *mp, int priority )
+{
+	for (int i = 0; i < PI_CHAIN_MAX && mp && mp->owner; ++i) {
+		tcb_t *owner = mp->owner;
+		if (get_thread_priority(owner) <= priority)
+			return;
+		set_thread_inherited_nice(owner, priority);
+
+		/* A waiting owner moves up its own mutex's queue */
+		mp = owner->blocked_on;
+		if (mp) {
+			Q_REMOVE(&mp->waiters_queue, owner, scheduler_queue);
+			insert_waiter(mp, owner, 0);
+		}
+	}
+}
+
+/** @brief Sets what a thread inherits to the highest priority of the first
+ *         waiters on the mutexes it holds.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param tcb Thread, waiting on no mutex
+ *	@return Void.
+ *	*/
+static void
+restore_priority( tcb_t *tcb )
+{
+	int inherited = NICE_MAX;
+	mutex_t *mp = Q_GET_FRONT(&tcb->held_mutexes);
+	for (; mp; mp = Q_GET_NEXT(mp, held_link)) {
+		tcb_t *waiter = Q_GET_FRONT(&mp->waiters_queue);
+		if (waiter && get_thread_priority(waiter) < inherited)
+			inherited = get_thread_priority(waiter);
+	}
+	set_thread_inherited_nice(tcb, inherited);
 }
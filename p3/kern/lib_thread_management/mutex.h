@@ -9,21 +9,35 @@
 
 /** @brief A mutex struct
  *
- *  @param waiters_queue Queue of threads waiting on this mutex
+ *  @param waiters_queue Queue of threads waiting on this mutex, in priority
+ *                       order
  *  @param initialized	 Whether this mutex has been initialized
  *  @param owner_tid	 Tid of this mutex's owner
  *  @param owned		 Whether this mutex is owned
+ *  @param owner		 Owner, NULL if unowned or locked before the first
+ *						 thread ran
+ *  @param held_link	 Link for the owner's list of held mutexes
+ *  @param handoff		 Whether unlocking hands the lock to the first waiter
+ *  @param waking		 Whether a woken waiter has yet to compete for the lock
  *  */
 struct mutex {
     queue_t waiters_queue;
     int initialized;
     int owner_tid;
     int owned;
+    struct tcb *owner;
+    Q_NEW_LINK(mutex) held_link;
+    int handoff;
+    int waking;
 };
 
 typedef struct mutex mutex_t;
 
+/* Mutexes a thread holds, whose waiters it inherits priority from */
+Q_NEW_HEAD(held_mutexes_t, mutex);
+
 int mutex_init( mutex_t *mp );
+void mutex_set_handoff( mutex_t *mp, int handoff );
 void mutex_destroy( mutex_t *mp );
 void mutex_lock( mutex_t *mp );
 void mutex_unlock( mutex_t *mp );
@@ -0,0 +1,255 @@
+/** @file rwlock.c
+ *  @brief A readers-writer lock object
+ *
+ *  Any number of readers or a single writer hold the lock. Locking and
+ *  unlocking take a single compare and swap on the lock state when no
+ *  thread waits, without disabling interrupts. Otherwise they fall back to
+ *  an atomic section, like mutex.c, in which threads that cannot take the
+ *  lock queue themselves and block.
+ *
+ *  Unlocking hands the lock over to the threads it wakes, so they own it
+ *  by the time they run: either the first waiting writer or every waiting
+ *  reader. Writers go first if the lock prefers writers, in which case
+ *  waiting writers also keep new readers out. Otherwise readers go first,
+ *  and new readers join readers holding the lock even while writers wait.
+ *
+ *  Unlike mutexes, readers-writer locks do not pass priority on to their
+ *  holders, and are not reentrant: a reader which read locks again may
+ *  wait behind a writer forever.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ *  */
+
+#include "rwlock.h"
+#include <assert.h>        /* affirm() */
+#include <stddef.h>        /* NULL */
+#include <scheduler.h>     /* yield_execution(), make_thread_runnable() */
+#include <asm.h>           /* enable/disable_interrupts() */
+#include <atomic_utils.h>  /* compare_and_swap_atomic() */
+#include <task_manager_internal.h> /* Q MACRO for tcb */
+
+static void store_tcb_in_readers_queue( tcb_t *tcb, void *data );
+static void store_tcb_in_writers_queue( tcb_t *tcb, void *data );
+static tcb_t *release_lock( rwlock_t *rwp );
+
+/** @brief Initialize a readers-writer lock, preferring readers
+ *
+ *  @param rwp Pointer to memory location where lock should be initialized
+ *  @return 0 on success, negative number on error
+ *  */
+int
+rwlock_init( rwlock_t *rwp )
+{
+	if (!rwp)
+		return -1;
+
+	rwp->state = 0;
+	Q_INIT_HEAD(&rwp->readers_queue);
+	Q_INIT_HEAD(&rwp->writers_queue);
+	rwp->prefer_writers = 0;
+	rwp->initialized = 1;
+
+	return 0;
+}
+
+/** @brief Sets whether waiting writers go ahead of readers.
+ *
+ *  @param rwp Lock, not locked
+ *  @param prefer_writers 1 to prefer writers, 0 to prefer readers
+ *  @return Void.
+ *  */
+void
+rwlock_set_prefer_writers( rwlock_t *rwp, int prefer_writers )
+{
+	affirm(rwp && rwp->initialized && rwp->state == 0);
+	rwp->prefer_writers = prefer_writers;
+}
+
+/** @brief Destroy a readers-writer lock
+ *
+ *  @param rwp Pointer to memory location where lock should be destroyed
+ *  @return Void.
+ *  */
+void
+rwlock_destroy( rwlock_t *rwp )
+{
+	/* Nothing to do */
+}
+
+/** @brief Lock for reading, along with other readers.
+ *
+ *  @param rwp Lock
+ *  @return Void.
+ *  */
+void
+rwlock_read_lock( rwlock_t *rwp )
+{
+	affirm(rwp && rwp->initialized);
+
+	/* Fast path, no writer holds it and no thread waits */
+	uint32_t state = rwp->state;
+	if (!(state & (RW_WRITER | RW_WAITERS))
+	    && compare_and_swap_atomic(&rwp->state, state, state + 1) == state)
+		return;
+
+	disable_interrupts(); /* ATOMICALLY { */
+	if (!(rwp->state & RW_WRITER)
+	    && !(rwp->prefer_writers && Q_GET_FRONT(&rwp->writers_queue))) {
+		rwp->state++;
+		enable_interrupts(); /* } */
+		return;
+	}
+
+	/* Interrupts stay disabled until yield_execution() has queued this
+	 * thread, or the lock could be released in between and never handed
+	 * over. It is by the time this returns */
+	rwp->state |= RW_WAITERS;
+	affirm(yield_execution(BLOCKED, NULL, store_tcb_in_readers_queue,
+	                       rwp) == 0);
+	assert(rwp->state & RW_READERS);
+}
+
+/** @brief Unlock after reading.
+ *
+ *  @param rwp Lock, read locked by calling thread
+ *  @return Void.
+ *  */
+void
+rwlock_read_unlock( rwlock_t *rwp )
+{
+	assert(rwp && rwp->initialized);
+
+	/* Fast path, no thread to wake */
+	uint32_t state = rwp->state;
+	assert(!(state & RW_WRITER) && (state & RW_READERS));
+	if (!(state & RW_WAITERS)
+	    && compare_and_swap_atomic(&rwp->state, state, state - 1) == state)
+		return;
+
+	disable_interrupts(); /* ATOMICALLY { */
+	rwp->state--;
+	tcb_t *to_run = (rwp->state & RW_READERS) ? NULL : release_lock(rwp);
+	enable_interrupts(); /* } */
+	if (to_run)
+		make_thread_runnable(to_run);
+}
+
+/** @brief Lock for writing, excluding every other thread.
+ *
+ *  @param rwp Lock
+ *  @return Void.
+ *  */
+void
+rwlock_write_lock( rwlock_t *rwp )
+{
+	affirm(rwp && rwp->initialized);
+
+	/* Fast path, nobody holds it */
+	if (compare_and_swap_atomic(&rwp->state, 0, RW_WRITER) == 0)
+		return;
+
+	disable_interrupts(); /* ATOMICALLY { */
+	if (rwp->state == 0) {
+		rwp->state = RW_WRITER;
+		enable_interrupts(); /* } */
+		return;
+	}
+
+	/* As for readers, owned by the time this returns */
+	rwp->state |= RW_WAITERS;
+	affirm(yield_execution(BLOCKED, NULL, store_tcb_in_writers_queue,
+	                       rwp) == 0);
+	assert(rwp->state & RW_WRITER);
+}
+
+/** @brief Unlock after writing.
+ *
+ *  @param rwp Lock, write locked by calling thread
+ *  @return Void.
+ *  */
+void
+rwlock_write_unlock( rwlock_t *rwp )
+{
+	assert(rwp && rwp->initialized);
+	assert(rwp->state & RW_WRITER);
+
+	/* Fast path, no thread to wake */
+	if (compare_and_swap_atomic(&rwp->state, RW_WRITER, 0) == RW_WRITER)
+		return;
+
+	disable_interrupts(); /* ATOMICALLY { */
+	rwp->state &= ~RW_WRITER;
+	tcb_t *to_run = release_lock(rwp);
+	enable_interrupts(); /* } */
+	if (to_run)
+		make_thread_runnable(to_run);
+}
+
+/** @brief Hands a lock nobody holds to the first waiting writer or to
+ *         every waiting reader.
+ *
+ *  Every thread woken but the last is made runnable here. The caller makes
+ *  the last one runnable once it enables interrupts, so that it may preempt
+ *  the caller.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param rwp Lock, held by nobody
+ *	@return Last thread woken, to be made runnable, NULL if none
+ *	*/
+static tcb_t *
+release_lock( rwlock_t *rwp )
+{
+	affirm(!(rwp->state & (RW_WRITER | RW_READERS)));
+
+	tcb_t *writer = Q_GET_FRONT(&rwp->writers_queue);
+	tcb_t *reader = Q_GET_FRONT(&rwp->readers_queue);
+	tcb_t *last = NULL;
+	if (writer && (rwp->prefer_writers || !reader)) {
+		Q_REMOVE(&rwp->writers_queue, writer, scheduler_queue);
+		rwp->state |= RW_WRITER;
+		last = writer;
+	} else {
+		while (reader) {
+			Q_REMOVE(&rwp->readers_queue, reader, scheduler_queue);
+			rwp->state++;
+			if (last)
+				switch_safe_make_thread_runnable(last);
+			last = reader;
+			reader = Q_GET_FRONT(&rwp->readers_queue);
+		}
+	}
+
+	if (!Q_GET_FRONT(&rwp->writers_queue)
+	    && !Q_GET_FRONT(&rwp->readers_queue))
+		rwp->state &= ~RW_WAITERS;
+	return last;
+}
+
+/** @brief Callback used in yield_execution to store tcb in the readers
+ *         queue while it waits on the lock.
+ *
+ *	@param tcb Thread to store.
+ *	@param data Lock waited on.
+ *	*/
+static void
+store_tcb_in_readers_queue( tcb_t *tcb, void *data )
+{
+	affirm(tcb && data && tcb->status == BLOCKED);
+	rwlock_t *rwp = (rwlock_t *)data;
+	/* Since thread not running, might as well use the scheduler queue link! */
+	Q_INSERT_TAIL(&rwp->readers_queue, tcb, scheduler_queue);
+}
+
+/** @brief Callback used in yield_execution to store tcb in the writers
+ *         queue while it waits on the lock.
+ *
+ *	@param tcb Thread to store.
+ *	@param data Lock waited on.
+ *	*/
+static void
+store_tcb_in_writers_queue( tcb_t *tcb, void *data )
+{
+	affirm(tcb && data && tcb->status == BLOCKED);
+	rwlock_t *rwp = (rwlock_t *)data;
+	Q_INSERT_TAIL(&rwp->writers_queue, tcb, scheduler_queue);
+}
@@ -0,0 +1,46 @@
+/** @file rwlock.h
+ *
+ *  Definitions for readers-writer locks */
+
+#ifndef RWLOCK_H_
+#define RWLOCK_H_
+
+#include <stdint.h>    /* uint32_t */
+#include <scheduler.h> /* queue_t */
+
+/* Bits of rwlock_t state, the rest counts the readers holding it */
+#define RW_WRITER	0x80000000 /* Held by a writer */
+#define RW_WAITERS	0x40000000 /* Threads are waiting, unlocks must wake them */
+#define RW_READERS	0x3FFFFFFF
+
+/** @brief A readers-writer lock struct
+ *
+ *  @param state			 RW_WRITER and RW_WAITERS bits and number of
+ *							 readers, only changed with a compare and swap or
+ *							 with interrupts disabled
+ *  @param readers_queue	 Queue of readers waiting on this lock, in FIFO
+ *							 order
+ *  @param writers_queue	 Queue of writers waiting on this lock, in FIFO
+ *							 order
+ *  @param initialized		 Whether this lock has been initialized
+ *  @param prefer_writers	 Whether waiting writers keep out new readers
+ *  */
+struct rwlock {
+	uint32_t state;
+	queue_t readers_queue;
+	queue_t writers_queue;
+	int initialized;
+	int prefer_writers;
+};
+
+typedef struct rwlock rwlock_t;
+
+int rwlock_init( rwlock_t *rwp );
+void rwlock_set_prefer_writers( rwlock_t *rwp, int prefer_writers );
+void rwlock_destroy( rwlock_t *rwp );
+void rwlock_read_lock( rwlock_t *rwp );
+void rwlock_read_unlock( rwlock_t *rwp );
+void rwlock_write_lock( rwlock_t *rwp );
+void rwlock_write_unlock( rwlock_t *rwp );
+
+#endif /* RWLOCK_H_ */
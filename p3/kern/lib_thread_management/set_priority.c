@@ -0,0 +1,88 @@
+/** @file set_priority.c
+ *  @brief Contains the set_priority() interrupt handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <priority.h>
+#include <asm.h>				/* outb() */
+#include <stddef.h>				/* NULL */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* set_thread_nice() */
+#include <task_manager.h>		/* find_and_get_{tcb,pcb}(), put_{tcb,pcb}() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <task_manager_internal.h> /* pcb_t, tcb_t */
+#include <variable_queue.h>		/* Q_GET_FRONT(), Q_GET_NEXT() */
+#include <lib_thread_management/mutex.h> /* mutex_lock() */
+
+/** @brief Sets the nice value of every active thread of a task.
+ *
+ *  @param pid Task, 0 for the calling task
+ *  @param nice Nice value
+ *  @return 0 on success, negative value if there is no such task
+ */
+static int
+set_task_nice( int pid, int nice )
+{
+	pcb_t *pcb;
+	if (pid == 0) {
+		pcb = get_running_task();
+		get_pcb(pcb);
+	} else if (pid < 0 || !(pcb = find_and_get_pcb(pid))) {
+		return -1;
+	}
+
+	/* Threads created from now on inherit it from these */
+	mutex_lock(&pcb->set_status_vanish_wait_mux);
+	for (tcb_t *tcb = Q_GET_FRONT(&pcb->active_threads_list); tcb;
+	     tcb = Q_GET_NEXT(tcb, task_thread_link))
+		set_thread_nice(tcb, nice);
+	mutex_unlock(&pcb->set_status_vanish_wait_mux);
+
+	put_pcb(pcb);
+	return 0;
+}
+
+/** @brief set_priority syscall handler, sets the nice value of a thread or
+ *         of every thread of a task.
+ *
+ *  @param which PRIO_THREAD to set a thread's, PRIO_TASK a task's
+ *  @param id Thread or task, 0 for the calling one
+ *  @param nice Nice value, from NICE_MIN to NICE_MAX
+ *  @return 0 on success, negative value on invalid arguments
+ */
+int
+set_priority( int which, int id, int nice )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (nice < NICE_MIN || nice > NICE_MAX)
+		return -1;
+
+	switch (which) {
+		case PRIO_THREAD: {
+			if (id == 0) {
+				set_thread_nice(get_running_thread(), nice);
+				return 0;
+			}
+			tcb_t *tcb = find_and_get_tcb(id);
+			if (!tcb)
+				return -1;
+
+			int res = -1;
+			if (tcb->status != DEAD) {
+				set_thread_nice(tcb, nice);
+				res = 0;
+			} else {
+				log_info("set_priority(): no thread with tid:%d", id);
+			}
+			put_tcb(tcb);
+			return res;
+		}
+		case PRIO_TASK:
+			return set_task_nice(id, nice);
+		default:
+			return -1;
+	}
+}
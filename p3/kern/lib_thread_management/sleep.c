@@ -1,6 +1,15 @@
 /** @file sleep.c
  *  @brief Sleep interrupt handler and facilities for managing
  *		   sleeping threads
+ *
+ *  Besides sleep(), the sleep queue holds deadline threads waiting for their
+ *  next period in wait_period(), and deadline threads throttled until then
+ *  for overrunning their budget, see scheduler.c, and threads waiting on a
+ *  wait queue with a timeout, which the first of the wakeup and the timeout
+ *  takes off the other queue, see waitqueue.c.
+ *
+ *  sleep() itself is such a wait, on a wait queue nobody wakes, so only its
+ *  timeout ends it.
  */
 #include <asm.h>				/* outb() */
 #include <limits.h>				/* UINT_MAX */
@@ -10,19 +19,21 @@
 #include <atomic_utils.h>		/* compare_and_swap_atomic() */
 #include <install_handler.h>	/* install_handler_in_idt() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <lib_thread_management/sleep.h> /* sleep_until(), enqueue_sleeper() */
+#include <lib_thread_management/waitqueue.h> /* waitqueue_cancel() */
 #include <task_manager_internal.h> /* Q MACROS on tcb */
-#include <lib_thread_management/mutex.h>	/* mutex_t */
 
 /* Using linked list as a naive priority queue implementation.
  * TODO: Use a heap instead! (or something else, like fibonnaci heaps...) */
 
 /** @brief Whether someone is handling the sleep queue.
- *  Acts as a guard for mux since muxes are not re-entrant
- *  but timer interrupts are. */
+ *  Guards against re-entering the tick handler, which should not happen
+ *  as it keeps interrupts disabled. */
 static uint32_t handling_sleep_queue;
 
-/** @brief mux for sleep queue and earliest expiry date */
-static mutex_t sleep_mux;
+/* The sleep queue and earliest expiry date are guarded by disabling
+ * interrupts, as the timer handler runs on the interrupt stack and so
+ * cannot block on a mutex */
 
 /** @brief Earliest date a thread should be woken up, out of all sleeping
  *  threads*/
@@ -31,11 +42,12 @@ static unsigned int earliest_expiry_date;
 /* Queue for all sleeping threads. */
 static queue_t sleep_q;
 
+/* Wait queue of sleep_until(), which only times out */
+static waitqueue_t sleepers_wq;
+
 /* 0 if uninitialized, 1 if initialized, -1 if failed to initialize */
 static int sleep_initialized = 0;
 
-static void store_tcb_in_sleep_queue( tcb_t *tcb, void *data );
-
 /** @brief Initializes sleep syscall
  *
  *  @pre Has not been called before.
@@ -45,7 +57,7 @@ init_sleep( void )
 {
 	affirm(!sleep_initialized);
 	Q_INIT_HEAD(&sleep_q);
-	mutex_init(&sleep_mux);
+	affirm(waitqueue_init(&sleepers_wq) == 0);
 	earliest_expiry_date = UINT_MAX;
 	handling_sleep_queue = 0;
 	sleep_initialized = 1;
@@ -58,6 +70,7 @@ init_sleep( void )
  *	the earliest expiry date and go over the list only if that
  *	date has been reached.
  *
+ *  @pre Interrupts disabled, as the timer interrupt gate leaves them
  *  @param total_ticks Number of ticks since startup
  *  @return Void.
  */
@@ -80,16 +93,18 @@ sleep_on_tick( unsigned int total_ticks )
 	 * remove earliest expired thread(s) */
 	earliest_expiry_date = UINT_MAX;
 
-	mutex_lock(&sleep_mux);
 	tcb_t *curr = Q_GET_FRONT(&sleep_q);
 	tcb_t *next;
 	while (curr) {
 		/* After curr is removed from the sleep queue and is made runnable, we
-		 * can no longer safely operated on its scheduler_queue link. As such,
+		 * can no longer safely operated on its sleep_link. As such,
 		 * we must get the next member of the queue before making it runnable.*/
-		next = Q_GET_NEXT(curr, scheduler_queue);
+		next = Q_GET_NEXT(curr, sleep_link);
 		if (curr->sleep_expiry_date <= total_ticks) {
-			Q_REMOVE(&sleep_q, curr, scheduler_queue);
+			Q_REMOVE(&sleep_q, curr, sleep_link);
+			curr->sleep_expiry_date = 0;
+			/* Timed out waiting on a wait queue, if it was */
+			waitqueue_cancel(curr);
 			make_thread_runnable(curr);
 		} else {
 			if (curr->sleep_expiry_date < earliest_expiry_date)
@@ -97,7 +112,6 @@ sleep_on_tick( unsigned int total_ticks )
 		}
 		curr = next;
 	}
-	mutex_unlock(&sleep_mux);
 
 	/* Release CAS lock */
 	handling_sleep_queue = 0;
@@ -124,32 +138,64 @@ sleep( int ticks )
 	if (ticks == 0)
 		return 0;
 
-	/* No race condition as only sleep manages sleep_expiry_date */
-	tcb_t *me = get_running_thread();
-	me->sleep_expiry_date = get_total_ticks() + ticks;
+	sleep_until(get_total_ticks() + ticks);
+	return 0;
+}
 
-	/* TODO:
-	 * We could lock the sleep_q mux here and release it through the callback?
-	 * This should ensure no conflicts with the sleep q stuff */
-	mutex_lock(&sleep_mux);
-	affirm(yield_execution(BLOCKED, NULL, store_tcb_in_sleep_queue, NULL) == 0);
+/** @brief Blocks the running thread until a given tick.
+ *
+ *  @param expiry Tick to wake up at
+ *  @return Void.
+ */
+void
+sleep_until( unsigned int expiry )
+{
+	if (!sleep_initialized)
+		init_sleep();
 
-	return 0;
+	/* The expiry date is only set once switched out, with interrupts
+	 * disabled, as the scheduler may set it too when throttling this
+	 * thread before then */
+	disable_interrupts();
+	while (get_total_ticks() < expiry) {
+		waitqueue_block(&sleepers_wq, expiry);
+		disable_interrupts();
+	}
+	enable_interrupts();
 }
 
-/** @brief Callback which stores tcb inside sleep queue.
+/** @brief Puts a thread which is switched out in the sleep queue.
  *
- *  @param tcb Thread to put in sleep queue.
- *  @param data Ignored.
+ *  Switch safe, it neither switches nor enables interrupts.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb BLOCKED thread, not in the sleep queue
+ *  @param expiry Tick to wake it up at
  *  @return Void.
- *  */
-static void
-store_tcb_in_sleep_queue( tcb_t *tcb, void *data )
+ */
+void
+enqueue_sleeper( tcb_t *tcb, unsigned int expiry )
 {
+	if (!sleep_initialized)
+		init_sleep();
+
 	affirm(tcb && tcb->status == BLOCKED);
-	if (tcb->sleep_expiry_date < earliest_expiry_date)
-		earliest_expiry_date = tcb->sleep_expiry_date;
-	/* Since thread not running, might as well use the scheduler queue link! */
-	Q_INSERT_TAIL(&sleep_q, tcb, scheduler_queue);
-	switch_safe_mutex_unlock(&sleep_mux);
+	tcb->sleep_expiry_date = expiry;
+	if (expiry < earliest_expiry_date)
+		earliest_expiry_date = expiry;
+	/* Not the scheduler queue link, which a wait queue may be using */
+	Q_INSERT_TAIL(&sleep_q, tcb, sleep_link);
+}
+
+/** @brief Takes a thread out of the sleep queue before its expiry date.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb BLOCKED thread in the sleep queue
+ *  @return Void.
+ */
+void
+dequeue_sleeper( tcb_t *tcb )
+{
+	/* A stale earliest_expiry_date only costs an extra pass */
+	Q_REMOVE(&sleep_q, tcb, sleep_link);
 }
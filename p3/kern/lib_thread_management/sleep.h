@@ -1,6 +1,11 @@
 #ifndef SLEEP_H_
 #define SLEEP_H_
 
+#include <task_manager.h> /* tcb_t */
+
 void sleep_on_tick( unsigned int total_ticks );
+void sleep_until( unsigned int expiry );
+void enqueue_sleeper( tcb_t *tcb, unsigned int expiry );
+void dequeue_sleeper( tcb_t *tcb );
 
 #endif /* SLEEP_H_ */
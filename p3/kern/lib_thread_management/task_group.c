@@ -0,0 +1,54 @@
+/** @file task_group.c
+ *  @brief Contains the set_group_quota() and join_group() interrupt handlers
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <task_group.h>
+#include <asm.h>				/* outb() */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* set_task_group_quota(), set_task_group() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+
+/** @brief set_group_quota syscall handler, sets the CPU quota of a task
+ *         group.
+ *
+ *  @param group Task group, from 1 to TASK_GROUP_MAX - 1
+ *  @param quota Ticks of CPU time per period, 0 for no quota
+ *  @param period Period in ticks, from quota to TASK_GROUP_MAX_PERIOD
+ *  @return 0 on success, negative value if the arguments are invalid
+ */
+int
+set_group_quota( int group, int quota, int period )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (group <= 0 || group >= TASK_GROUP_MAX || quota < 0
+	    || (quota && (quota > period || period > TASK_GROUP_MAX_PERIOD))) {
+		log_info("set_group_quota(): invalid group:%d quota:%d period:%d",
+		         group, quota, period);
+		return -1;
+	}
+	set_task_group_quota(group, quota, period);
+	return 0;
+}
+
+/** @brief join_group syscall handler, moves the calling task to a task
+ *         group.
+ *
+ *  @param group Task group, from 0 to TASK_GROUP_MAX - 1
+ *  @return 0 on success, negative value if there is no such group
+ */
+int
+join_group( int group )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (group < 0 || group >= TASK_GROUP_MAX)
+		return -1;
+
+	set_task_group(get_running_task(), group);
+	return 0;
+}
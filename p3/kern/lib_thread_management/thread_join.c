@@ -0,0 +1,97 @@
+/** @file thread_join.c
+ *  @brief Contains the thread_exit() and thread_join() interrupt handlers
+ *
+ *  A thread leaves its exit value in its TCB when it vanishes with
+ *  thread_exit(). Its TCB stays on the owning task's vanished threads list
+ *  until another thread of the task reaps it with thread_join(), or the
+ *  whole task goes away.
+ *
+ *  A thread joining a thread which has not vanished yet records itself as
+ *  the joiner in the TCB and blocks on the TCB's exit wait queue. The
+ *  vanishing thread wakes the joiner in the same critical section which
+ *  switches it away for good, see _vanish(), so nobody spins and the joiner
+ *  never frees a kernel stack still in use. At most one thread may join a
+ *  given thread.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <asm.h>				/* outb() */
+#include <assert.h>				/* affirm() */
+#include <stddef.h>				/* NULL */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* get_running_thread() */
+#include <task_manager.h>		/* find_and_get_tcb(), free_tcb() */
+#include <memory_manager.h>		/* is_valid_user_pointer() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <task_manager_internal.h> /* pcb_t, tcb_t */
+#include <variable_queue.h>		/* Q_REMOVE() */
+#include <lib_life_cycle/life_cycle.h> /* _vanish() */
+#include <lib_thread_management/mutex.h> /* mutex_t */
+#include <lib_thread_management/waitqueue.h> /* wait_unlock() */
+
+/** @brief thread_exit syscall handler, vanishes the calling thread leaving
+ *         an exit value for thread_join().
+ *
+ *  @param status Exit value
+ *  @return Does not return.
+ */
+void
+thread_exit( void *status )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	/* Only read by thread_join() once this thread has vanished */
+	get_running_thread()->exit_value = status;
+	_vanish();
+}
+
+/** @brief thread_join syscall handler, blocks until a thread of the calling
+ *         task has vanished, then reaps it.
+ *
+ *  @param tid Thread to join
+ *  @param statusp Where to store the thread's exit value, or NULL
+ *  @return 0 on success, negative value if tid is not a thread of the
+ *          calling task, is the calling thread or is already being joined
+ */
+int
+thread_join( int tid, void **statusp )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (statusp && !is_valid_user_pointer(statusp, READ_WRITE))
+		return -1;
+
+	tcb_t *me = get_running_thread();
+	pcb_t *pcb = me->owning_task;
+
+	mutex_lock(&(pcb->set_status_vanish_wait_mux));
+	tcb_t *tcb = find_and_get_tcb(tid);
+	if (!tcb || tcb == me || tcb->owning_task != pcb || tcb->joiner) {
+		mutex_unlock(&(pcb->set_status_vanish_wait_mux));
+		if (tcb)
+			put_tcb(tcb);
+		log_info("thread_join(): cannot join tid:%d", tid);
+		return -1;
+	}
+	tcb->joiner = me;
+	while (!tcb->exited) {
+		wait_unlock(&tcb->exit_wq, &(pcb->set_status_vanish_wait_mux));
+		mutex_lock(&(pcb->set_status_vanish_wait_mux));
+	}
+	affirm(tcb->status == DEAD);
+
+	Q_REMOVE(&(pcb->vanished_threads_list), tcb, task_thread_link);
+	pcb->num_vanished_threads--;
+	pcb->total_threads--;
+	void *exit_value = tcb->exit_value;
+	mutex_unlock(&(pcb->set_status_vanish_wait_mux));
+
+	put_tcb(tcb);
+	free_tcb(tcb);
+	if (statusp)
+		*statusp = exit_value;
+	return 0;
+}
@@ -0,0 +1,247 @@
+/** @file waitqueue.c
+ *  @brief A wait queue object
+ *
+ *  Threads block on a wait queue with wait_event() until a condition
+ *  holds, and are woken by threads which make it hold with wake_one(),
+ *  wake_n() or wake_all(). Woken threads check the condition again, so a
+ *  waker need not know what each waiter waits for. Waiters whose condition
+ *  is guarded by a mutex rather than by disabling interrupts check it with
+ *  the mutex held and block with wait_unlock(), which releases the mutex
+ *  once they are queued.
+ *
+ *  The queue is guarded by disabling interrupts, so wakers may run on the
+ *  interrupt stack. Waking takes every thread to wake off the queue at once
+ *  and hands them to make_threads_runnable(), which switches at most once
+ *  however many there are.
+ *
+ *  A waiter with a timeout is also in the sleep queue, through its own
+ *  link, until whichever of the wakeup and the timeout comes first takes it
+ *  off the other, see sleep_on_tick().
+ *
+ *  @author Nicklaus Choo (nchoo)
+ *  */
+
+#include "waitqueue.h"
+#include <limits.h>        /* INT_MAX */
+#include <assert.h>        /* affirm() */
+#include <stddef.h>        /* NULL */
+#include <scheduler.h>     /* yield_execution(), make_threads_runnable() */
+#include <task_manager_internal.h> /* Q MACRO for tcb */
+#include <lib_thread_management/sleep.h> /* enqueue_sleeper() */
+
+/** @brief What a thread blocking on a wait queue passes its callback
+ *
+ *  @param wq Wait queue
+ *  @param expiry Tick to time out at, 0 for none
+ *  @param mp Mutex to release once queued, or NULL
+ *  */
+typedef struct {
+	waitqueue_t *wq;
+	unsigned int expiry;
+	mutex_t *mp;
+} wait_args_t;
+
+static void store_tcb_in_waitqueue( tcb_t *tcb, void *data );
+static int wake_helper( waitqueue_t *wq, int n, int switch_safe );
+
+/** @brief Initialize a wait queue
+ *
+ *  @param wq Pointer to memory location where wait queue should be
+ *         initialized
+ *  @return 0 on success, negative number on error
+ *  */
+int
+waitqueue_init( waitqueue_t *wq )
+{
+	if (!wq)
+		return -1;
+
+	Q_INIT_HEAD(&wq->waiters);
+	wq->num_waiters = 0;
+	wq->initialized = 1;
+
+	return 0;
+}
+
+/** @brief Blocks the running thread on a wait queue until woken or, if
+ *         given an expiry, until that tick. See wait_event().
+ *
+ *  @pre Interrupts disabled when called, enabled on return.
+ *  @param wq Wait queue
+ *  @param expiry Tick to time out at, 0 for none
+ *  @return Void.
+ *  */
+void
+waitqueue_block( waitqueue_t *wq, unsigned int expiry )
+{
+	affirm(wq && wq->initialized);
+
+	wait_args_t args = { wq, expiry, NULL };
+	affirm(yield_execution(BLOCKED, NULL, store_tcb_in_waitqueue,
+	                       &args) == 0);
+}
+
+/** @brief Blocks the running thread on a wait queue and releases a mutex
+ *         once it is queued.
+ *
+ *  The caller checks its condition with the mutex held, and wakers make it
+ *  hold with the mutex held, so no wakeup is missed in between. The mutex
+ *  is not held on return, the caller locks it again to check again.
+ *
+ *  @param wq Wait queue
+ *  @param mp Mutex held by the calling thread
+ *  @return Void.
+ *  */
+void
+wait_unlock( waitqueue_t *wq, mutex_t *mp )
+{
+	affirm(wq && wq->initialized && mp);
+
+	wait_args_t args = { wq, 0, mp };
+	disable_interrupts();
+	affirm(yield_execution(BLOCKED, NULL, store_tcb_in_waitqueue,
+	                       &args) == 0);
+}
+
+/** @brief Wakes the thread which has waited longest on a wait queue.
+ *
+ *  @param wq Wait queue
+ *  @return Number of threads woken
+ *  */
+int
+wake_one( waitqueue_t *wq )
+{
+	return wake_helper(wq, 1, 0);
+}
+
+/** @brief Wakes up to a number of threads waiting on a wait queue, longest
+ *         waiting first.
+ *
+ *  @param wq Wait queue
+ *  @param n Most threads to wake
+ *  @return Number of threads woken
+ *  */
+int
+wake_n( waitqueue_t *wq, int n )
+{
+	return wake_helper(wq, n, 0);
+}
+
+/** @brief Wakes every thread waiting on a wait queue.
+ *
+ *  @param wq Wait queue
+ *  @return Number of threads woken
+ *  */
+int
+wake_all( waitqueue_t *wq )
+{
+	return wake_helper(wq, INT_MAX, 0);
+}
+
+/** @brief Wakes up to a number of threads waiting on a wait queue without
+ *         triggering a context switch or enabling interrupts.
+ *
+ *  @param wq Wait queue
+ *  @param n Most threads to wake
+ *  @return Number of threads woken
+ *  */
+int
+switch_safe_wake_n( waitqueue_t *wq, int n )
+{
+	return wake_helper(wq, n, 1);
+}
+
+/** @brief Takes a thread whose timeout expired off the wait queue it
+ *         waits on, if any. The sleep queue has already let go of it.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb BLOCKED thread
+ *  @return Void.
+ *  */
+void
+waitqueue_cancel( tcb_t *tcb )
+{
+	waitqueue_t *wq = tcb->waitqueue;
+	if (!wq)
+		return;
+
+	Q_REMOVE(&wq->waiters, tcb, scheduler_queue);
+	wq->num_waiters--;
+	tcb->waitqueue = NULL;
+}
+
+/* --- HELPERS --- */
+
+/** @brief Takes up to n threads off a wait queue and makes them runnable.
+ *
+ *  @param wq Wait queue
+ *  @param n Most threads to wake
+ *  @param switch_safe Whether this function should not cause context switch
+ *  @return Number of threads woken
+ *  */
+static int
+wake_helper( waitqueue_t *wq, int n, int switch_safe )
+{
+	affirm(wq && wq->initialized && n >= 0);
+
+	/* Waiters are queued with interrupts disabled, and wakers make the
+	 * condition hold first, so a waiter not counted yet will find it holds
+	 * without blocking */
+	if (!wq->num_waiters)
+		return 0;
+
+	queue_t woken;
+	Q_INIT_HEAD(&woken);
+	int count = 0;
+
+	if (!switch_safe)
+		disable_interrupts();
+	tcb_t *tcb;
+	while (count < n && (tcb = Q_GET_FRONT(&wq->waiters))) {
+		waitqueue_cancel(tcb);
+		if (tcb->sleep_expiry_date) {
+			dequeue_sleeper(tcb);
+			tcb->sleep_expiry_date = 0;
+		}
+		Q_INSERT_TAIL(&woken, tcb, scheduler_queue);
+		count++;
+	}
+
+	if (switch_safe) {
+		while ((tcb = Q_GET_FRONT(&woken))) {
+			Q_REMOVE(&woken, tcb, scheduler_queue);
+			switch_safe_make_thread_runnable(tcb);
+		}
+	} else if (count) {
+		make_threads_runnable(&woken);
+	} else {
+		enable_interrupts();
+	}
+	return count;
+}
+
+/** @brief Callback used in yield_execution to store tcb in a wait queue,
+ *         and in the sleep queue if it has a timeout, while it waits.
+ *
+ *	@param tcb Thread to store.
+ *	@param data What the thread blocking passed, see wait_args_t.
+ *	*/
+static void
+store_tcb_in_waitqueue( tcb_t *tcb, void *data )
+{
+	affirm(tcb && data && tcb->status == BLOCKED);
+	wait_args_t *args = (wait_args_t *)data;
+
+	tcb->waitqueue = args->wq;
+	/* Since thread not running, might as well use the scheduler queue link! */
+	Q_INSERT_TAIL(&args->wq->waiters, tcb, scheduler_queue);
+	args->wq->num_waiters++;
+
+	/* The sleep queue has a link of its own */
+	tcb->sleep_expiry_date = 0;
+	if (args->expiry)
+		enqueue_sleeper(tcb, args->expiry);
+
+	if (args->mp)
+		switch_safe_mutex_unlock(args->mp);
+}
@@ -0,0 +1,85 @@
+/** @file waitqueue.h
+ *
+ *  Definitions for wait queues, on which threads block until a condition
+ *  holds, see waitqueue.c */
+
+#ifndef WAITQUEUE_H_
+#define WAITQUEUE_H_
+
+#include <asm.h>           /* disable/enable_interrupts() */
+#include <scheduler.h>     /* queue_t */
+#include <timer_driver.h>  /* get_total_ticks() */
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/** @brief A wait queue struct
+ *
+ *  @param waiters		 Queue of threads waiting, in FIFO order
+ *  @param num_waiters	 Number of threads waiting
+ *  @param initialized	 Whether this wait queue has been initialized
+ *  */
+struct waitqueue {
+	queue_t waiters;
+	int num_waiters;
+	int initialized;
+};
+
+typedef struct waitqueue waitqueue_t;
+
+/** @def wait_event(WQ, COND)
+ *
+ *  @brief Blocks on a wait queue until a condition holds.
+ *
+ *  COND is evaluated with interrupts disabled, first before blocking and
+ *  again every time the thread is woken, so a waker which makes it hold
+ *  before calling wake_one() and the like is never missed. It must be
+ *  short and must not block or enable interrupts.
+ *
+ *  @param WQ pointer to the waitqueue_t
+ *  @param COND condition to wait for
+ **/
+#define wait_event(WQ, COND) \
+do {\
+	disable_interrupts();\
+	while (!(COND)) {\
+		waitqueue_block((WQ), 0);\
+		disable_interrupts();\
+	}\
+	enable_interrupts();\
+} while (0)
+
+/** @def wait_event_timeout(WQ, COND, TICKS, RES)
+ *
+ *  @brief Blocks on a wait queue until a condition holds or a number of
+ *         ticks have passed, see wait_event().
+ *
+ *  @param WQ pointer to the waitqueue_t
+ *  @param COND condition to wait for
+ *  @param TICKS most ticks to wait for
+ *  @param RES int set to 1 if COND holds, 0 if it timed out
+ **/
+#define wait_event_timeout(WQ, COND, TICKS, RES) \
+do {\
+	unsigned int wq_expiry_ = get_total_ticks() + (TICKS);\
+	(RES) = 1;\
+	disable_interrupts();\
+	while (!(COND)) {\
+		if (get_total_ticks() >= wq_expiry_) {\
+			(RES) = 0;\
+			break;\
+		}\
+		waitqueue_block((WQ), wq_expiry_);\
+		disable_interrupts();\
+	}\
+	enable_interrupts();\
+} while (0)
+
+int waitqueue_init( waitqueue_t *wq );
+void waitqueue_block( waitqueue_t *wq, unsigned int expiry );
+void wait_unlock( waitqueue_t *wq, mutex_t *mp );
+int wake_one( waitqueue_t *wq );
+int wake_n( waitqueue_t *wq, int n );
+int wake_all( waitqueue_t *wq );
+int switch_safe_wake_n( waitqueue_t *wq, int n );
+void waitqueue_cancel( tcb_t *tcb );
+
+#endif /* WAITQUEUE_H_ */
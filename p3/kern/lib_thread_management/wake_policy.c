@@ -0,0 +1,42 @@
+/** @file wake_policy.c
+ *  @brief Contains the set_wake_policy() interrupt handler
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <wake_policy.h>
+#include <asm.h>				/* outb() */
+#include <logger.h>				/* log_info() */
+#include <scheduler.h>			/* set_scheduler_wake_policy() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+
+/** @brief set_wake_policy syscall handler, sets whether woken threads
+ *         preempt the thread waking them, for every thread.
+ *
+ *  @param policy WAKE_TAIL, WAKE_PREEMPT or WAKE_PREEMPT_SLICE
+ *  @param slice_percent Under WAKE_PREEMPT_SLICE, share of its time slice in
+ *         percent the running thread must have used to be preempted, from 0
+ *         to 100. Ignored otherwise
+ *  @return 0 on success, negative value if the arguments are invalid
+ */
+int
+set_wake_policy( int policy, int slice_percent )
+{
+	/* Acknowledge interrupt immediately */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (policy != WAKE_TAIL && policy != WAKE_PREEMPT
+	    && policy != WAKE_PREEMPT_SLICE) {
+		log_info("set_wake_policy(): invalid policy:%d", policy);
+		return -1;
+	}
+	if (policy != WAKE_PREEMPT_SLICE)
+		slice_percent = 0;
+	if (slice_percent < 0 || slice_percent > 100) {
+		log_info("set_wake_policy(): invalid slice_percent:%d",
+		         slice_percent);
+		return -1;
+	}
+	set_scheduler_wake_policy(policy, slice_percent);
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include <asm.h>				/* outb() */
 #include <logger.h>				/* log_warn() */
 #include <scheduler.h>			/* yield_execution() */
+#include <task_manager.h>		/* find_and_get_tcb(), put_tcb() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
 
 /** @brief Yield syscall handler
@@ -24,10 +25,12 @@ yield( int tid )
 		return yield_execution(RUNNABLE, NULL, NULL, NULL);
 	}
 	/* Else see if given tid is valid */
-	tcb_t *tcb = find_tcb(tid);
+	tcb_t *tcb = find_and_get_tcb(tid);
 	if (!tcb) {
 		log_info("Trying to yield to non-existent thread with tid %d", tid);
 		return -1;
 	}
-	return yield_execution(RUNNABLE, tcb, NULL, NULL);
+	int res = yield_execution(RUNNABLE, tcb, NULL, NULL);
+	put_tcb(tcb);
+	return res;
 }
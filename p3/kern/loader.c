@@ -20,8 +20,10 @@
 #include <assert.h>		/* assert() */
 #include <elf_410.h>    /* simple_elf_t, elf_load_helper */
 #include <exec2obj.h>   /* exec2obj_TOC */
+#include <ramdisk.h>    /* ramdisk_getbytes(), ramdisk_file_len() */
 #include <scheduler.h>	/* get_running_tid() */
 #include <iret_travel.h> /* iret_travel() */
+#include <panic_thread.h> /* panic_thread() */
 #include <task_manager_internal.h>
 #include <eflags.h>	/* get_eflags*/
 #include <seg.h>	/* SEGSEL_... */
@@ -32,16 +34,40 @@
 
 #include <simics.h>
 
-/* Having a helper means we evaluate the arguments before expanding _MIN
- *  and therefore avoid evaluating A and B multiple times. */
-#define _MIN(A, B) ((A) < (B) ? (A) : (B))
-#define MIN(A,B) _MIN(A,B)
+/* Bytes of execute_user_program()'s copies of the argument strings, one
+ * USER_STR_LEN slot for each, followed by the executable name */
+#define EXEC_STRS_LEN ((NUM_USER_ARGS + 1) * USER_STR_LEN)
 
 static int configure_initial_task_stack( tcb_t *tcbp, uint32_t user_esp,
  	uint32_t entry_point, void *user_pd );
 static int register_with_simics( uint32_t tid, char *fname );
 static int load_user_program_info(simple_elf_t *se_hdrp, char *fname);
 
+/** @brief Finds a file on the RAM disk.
+ *
+ *  @param filename Name of the file
+ *  @param execbytesp Where the address of the file's bytes is stored
+ *  @param execlenp Where the number of bytes of the file is stored, which
+ *         for a compressed file is its compressed length
+ *  @return 0 on success, -1 if there is no such file
+ */
+int
+get_ramdisk_file( const char *filename, const char **execbytesp,
+                  int *execlenp )
+{
+	affirm(filename && execbytesp && execlenp);
+
+    for (int i = 0; i < exec2obj_userapp_count; ++i) {
+        if (strncmp(filename, exec2obj_userapp_TOC[i].execname,
+			MAX_EXECNAME_LEN) == 0) {
+			*execbytesp = exec2obj_userapp_TOC[i].execbytes;
+			*execlenp = exec2obj_userapp_TOC[i].execlen;
+			return 0;
+        }
+    }
+	return -1;
+}
+
 /** Copies data from a file into a buffer.
  *
  *  @param filename   the name of the file to copy data from
@@ -63,30 +89,23 @@ getbytes( const char *filename, int offset, int size, char *buf )
     }
 
     /* Find file in TOC */
-    int i;
-    for (i=0; i < exec2obj_userapp_count; ++i) {
-        if (strncmp(filename, exec2obj_userapp_TOC[i].execname,
-			MAX_EXECNAME_LEN) == 0) {
-            break;
-        }
-    }
-
-    if (i == exec2obj_userapp_count) {
+	const char *execbytes;
+	int execlen;
+    if (get_ramdisk_file(filename, &execbytes, &execlen) < 0) {
         log_warn("Loader [getbytes]: Executable not found");
         return -1;
     }
 
-	if (offset > exec2obj_userapp_TOC[i].execlen) {
+	/* Offset is into the uncompressed file */
+	int file_len = ramdisk_file_len(execbytes, execlen);
+	if (offset > file_len) {
 		log_warn("Loader [getbytes]: Offset (%d) is greater than executable "
-				 "size (%d)", offset, exec2obj_userapp_TOC[i].execlen);
+				 "size (%d)", offset, file_len);
 		return -1;
 	}
 
-    int bytes_to_copy = MIN(size, exec2obj_userapp_TOC[i].execlen - offset);
-
-    memcpy(buf, exec2obj_userapp_TOC[i].execbytes + offset, bytes_to_copy);
-
-    return bytes_to_copy;
+    /* Decompresses only the blocks needed if the file is compressed */
+    return ramdisk_getbytes(execbytes, execlen, offset, size, buf);
 }
 
 /** @brief Zeroes out a memory region (including rounding up to their end)
@@ -233,6 +252,11 @@ configure_stack( int argc, char **argv )
  *  a single thread) and for the syscall exec(). We disable calls to
  *  exec() when there is more than 1 thread in the invoking task.
  *
+ *  The invoking task keeps its page directory, which reuse_pd_for_elf()
+ *  reinitializes in place for the new image. If loading fails after the old
+ *  image has been torn down the task is killed, since there is no longer any
+ *  program to return -1 to.
+ *
  *  @param fname Name of program to run.
  *  @param arg   Argument count
  *  @param argv  Argument vector
@@ -253,17 +277,17 @@ execute_user_program( char *fname, char **argv)
 		return -1;
 	}
 
-    /* Transfer execname to kernel stack so unaffected by page directory */
-	char kern_stack_execname[USER_STR_LEN];
-	memset(kern_stack_execname, 0, USER_STR_LEN);
-	memcpy(kern_stack_execname, fname, strlen(fname));
-
-	/* char array to store each argvec string on kernel stack */
-	char *kern_stack_args = smalloc(NUM_USER_ARGS * USER_STR_LEN);
+	/* char array to store each argvec string, then execname, in kernel
+	 * memory. Kernel stacks are one page, too small to hold them */
+	char *kern_stack_args = smalloc(EXEC_STRS_LEN);
     if (!kern_stack_args) {
         return -1;
     }
-	memset(kern_stack_args, 0, NUM_USER_ARGS * USER_STR_LEN);
+	memset(kern_stack_args, 0, EXEC_STRS_LEN);
+
+    /* Transfer execname to kernel memory so unaffected by page directory */
+	char *kern_execname = kern_stack_args + NUM_USER_ARGS * USER_STR_LEN;
+	memcpy(kern_execname, fname, strlen(fname));
 
 	/* char * array for argvec on kernel stack */
 	char *kern_stack_argvec[NUM_USER_ARGS];
@@ -279,7 +303,7 @@ execute_user_program( char *fname, char **argv)
 	}
 	/* Load user program information */
 	simple_elf_t se_hdr;
-	if (load_user_program_info(&se_hdr, kern_stack_execname) < 0) {
+	if (load_user_program_info(&se_hdr, kern_execname) < 0) {
 		goto cleanup;
 	}
     uint32_t pid, tid;
@@ -289,54 +313,49 @@ execute_user_program( char *fname, char **argv)
 	tid = get_running_tid();
 	pcb_t *pcb = get_running_task();
 
-	/* Create new pd */
-
-	void *new_pd = new_pd_from_elf(&se_hdr);
-	if (!new_pd) {
+	/* Reuse the current pd, its page tables and frames for the new image
+	 * and its user stack */
+	uint32_t stack_lo = UINT32_MAX - USER_THREAD_STACK_SIZE + 1;
+	int res = reuse_pd_for_elf(pcb->pd, &se_hdr, stack_lo,
+	                           USER_THREAD_STACK_SIZE);
+	if (res == -1) {
 		goto cleanup;
 	}
-	void *old_pd = swap_task_pd(new_pd, pcb);
-
-	set_task_name(pcb, kern_stack_execname);
+	/* From here on the old image is gone, there is nothing to return to */
+	if (res < 0) {
+		goto cleanup_no_return;
+	}
+	set_task_name(pcb, kern_execname);
 
 	log_warn("process tid:%d, execname:%s", tid, pcb->execname);
 
-	register_with_simics(tid, kern_stack_execname);
+	register_with_simics(tid, kern_execname);
 
 	/* If this is the init task, let the world know */
-	register_if_init_task(kern_stack_execname, pid);
-
-	/* Update page directory, enable VM if necessary */
-	activate_task_memory(pcb);
-
-	/* Allocate user stack space */
-	uint32_t stack_lo = UINT32_MAX - USER_THREAD_STACK_SIZE + 1;
-	if (_new_pages((uint32_t *) stack_lo, USER_THREAD_STACK_SIZE) < 0) {
-		goto cleanup_w_pd;
-	}
+	register_if_init_task(kern_execname, pid);
 
-	/* Cleaning up the new page directory also implicitly cleans up the pages
-	 * allocated by _new_pages() above */
+	/* reuse_pd_for_elf() set up the user stack as _new_pages() would, so
+	 * exiting the task cleans it up */
     if (transplant_program_memory(&se_hdr) < 0) {
-		goto cleanup_w_pd;
+		goto cleanup_no_return;
 	}
     uint32_t *esp = configure_stack(argc, kern_stack_argvec);
 
 	/* Start the task */
-	sfree(kern_stack_args, NUM_USER_ARGS * USER_STR_LEN);
-	free_pd_memory(old_pd);
-	sfree(old_pd, PAGE_SIZE);
+	sfree(kern_stack_args, EXEC_STRS_LEN);
 	task_start(tid, (uint32_t)esp, se_hdr.e_entry);
 
 	panic("execute_user_program does not return");
 
-	/* Swap back to old pd and clean up */
-cleanup_w_pd:
-	new_pd = swap_task_pd(old_pd, pcb);
-	free_pd_memory(new_pd);
+	/* Old image already torn down, so the task can only exit */
+cleanup_no_return:
+	log_warn("execute_user_program(): unable to load '%s' after "
+	         "tearing down old image", kern_execname);
+	sfree(kern_stack_args, EXEC_STRS_LEN);
+	panic_thread("execute_user_program(): old image already torn down");
 
 cleanup:
-	sfree(kern_stack_args, NUM_USER_ARGS * USER_STR_LEN);
+	sfree(kern_stack_args, EXEC_STRS_LEN);
 	return -1;
 }
 
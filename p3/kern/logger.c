@@ -33,10 +33,16 @@
 #include <scheduler.h> /* get_running_tid() */
 #include <logger.h>
 #include <assert.h> /* affirm_msg() */
+#include <asm.h> /* disable_interrupts() */
+#include <eflags.h> /* get_eflags(), set_eflags() */
 
 /** @brief Maximum length of vtprintf string */
 #define PRINT_LEN 256
 
+/* Where vtprintf() builds its string, kept off the one page kernel stacks.
+ * Used with interrupts disabled, so only one log line is built at a time */
+static char str[PRINT_LEN];
+
 /** @brief Prepends the thread id to printed format. Takes in a va_list as
  *         argument.
  *
@@ -49,6 +55,9 @@
  *  the wrong arguments, no need to cause an assertion failure as the error
  *  is promptly displayed.
  *
+ *  The string is built in a static buffer with interrupts disabled, and the
+ *  interrupt flag is restored as it was once it is printed.
+ *
  *  @param format String format to print to
  *  @param args A va_list of all arguments to include in format
  *  @param priority Logging priority.
@@ -57,7 +66,8 @@
 void
 vtprintf( const char *format, va_list args, int priority )
 {
-	char str[PRINT_LEN];
+	uint32_t eflags = get_eflags();
+	disable_interrupts();
 
 	/* Get tid and prepend to output*/
 	int tid = get_running_tid();
@@ -87,6 +97,7 @@ vtprintf( const char *format, va_list args, int priority )
 			         "tid[%d]: UNRECOGNIZED priority:%d for vtprintf()",
 					 tid, priority);
 			sim_puts(str);
+			set_eflags(eflags);
 			return;
 	}
 	/* Print rest of output, and a little extra for CRITICAL priority */
@@ -101,6 +112,7 @@ vtprintf( const char *format, va_list args, int priority )
 	sim_puts(str);
 	//TODO print on actual hardware
 
+	set_eflags(eflags);
 	return;
 }
 
@@ -8,6 +8,8 @@
 #include <malloc.h>
 #include <assert.h>				/* affirm */
 #include <stddef.h>				/* size_t */
+#include <stdint.h>				/* uint32_t */
+#include <memory_manager.h>		/* smalloc_calls() */
 #include <malloc_internal.h>	/* _malloc family of functions */
 #include <lib_thread_management/mutex.h> /* mutex_t */
 #include <logger.h>
@@ -17,6 +19,9 @@
 static mutex_t malloc_mux;
 static int is_mutex_init = 0;
 
+/* Calls to smalloc() and smemalign() so far, for benchmarks */
+static uint32_t num_smalloc_calls = 0;
+
 /* These macros allow us to easily initialize the malloc mutex
  * upon the first call to the malloc library. */
 #define LOCK do\
@@ -110,6 +115,7 @@ void free(void *buf)
 void *smalloc(size_t size)
 {
 	LOCK;
+	num_smalloc_calls++;
     void *p = _smalloc(size);
 	log("smalloc returned %p, size %u", p, size);
 
@@ -126,6 +132,7 @@ void *smalloc(size_t size)
 void *smemalign(size_t alignment, size_t size)
 {
 	LOCK;
+	num_smalloc_calls++;
     void *p = _smemalign(alignment, size);
 	log("smemalign returned %p, size %u", p, size);
 
@@ -149,4 +156,10 @@ void sfree(void *buf, size_t size)
 	UNLOCK;
 }
 
-
+/** @brief Returns how many times smalloc() or smemalign() have been called
+ *
+ *  @return Number of calls since boot */
+uint32_t smalloc_calls(void)
+{
+	return num_smalloc_calls;
+}
@@ -34,6 +34,11 @@ static int paging_enabled = 0;
  * other page directory's lowest 4 indexed page tables */
 static uint32_t **initial_pd = NULL;
 
+/* Direct mapped kernel page whose page table entry map_phys_frame() points
+ * at a physalloc() frame, since those frames lie above kernel memory */
+static char *frame_window = NULL;
+static mutex_t frame_window_mux;
+
 static int allocate_frame( uint32_t **pd, uint32_t virtual_address,
                            write_mode_t write_mode, uint32_t sys_prog_flag );
 static int allocate_region( uint32_t **pd, void *start, uint32_t len,
@@ -56,8 +61,15 @@ void
 init_memory_manager( void )
 {
 	mutex_init(&pages_mux);
+	mutex_init(&frame_window_mux);
 	initialize_zero_frame();
 	create_initial_pd();
+
+	/* Kernel page tables are shared by every page directory, so the window
+	 * is the same page in every address space */
+	frame_window = smemalign(PAGE_SIZE, PAGE_SIZE);
+	affirm_msg(frame_window, "init_memory_manager(): "
+	           "unable to allocate frame window");
 }
 
 /** @brief returns the address of the initial page directory
@@ -149,8 +161,9 @@ unallocate_frame( uint32_t **pd, uint32_t virtual_address )
 
 	uint32_t phys_address = TABLE_ADDRESS(pt_entry);
 
-	/* Only physfree physically allocated frames (as opposed to ZFOD frames) */
-	if (phys_address != SYS_ZERO_FRAME)
+	/* Only physfree physically allocated frames (as opposed to ZFOD frames
+	 * and shared RAM disk frames) */
+	if (IS_OWNED_FRAME(phys_address))
 		physfree(phys_address);
 
 	/* Zero the entry as well */
@@ -302,6 +315,204 @@ new_pd_from_elf( simple_elf_t *elf )
 	return pd;
 }
 
+/** @brief Checks if the page at a virtual address overlaps a memory region.
+ *
+ *  @param virtual_address Page aligned VM address
+ *  @param start Start of memory region, not necessarily page aligned
+ *  @param len Length of memory region
+ *  @return 1 if the page overlaps the region, 0 otherwise
+ */
+static int
+page_in_region( uint32_t virtual_address, uint32_t start, uint32_t len )
+{
+	if (len == 0)
+		return 0;
+
+	return TABLE_ADDRESS(start) <= virtual_address
+	       && virtual_address <= TABLE_ADDRESS(start + len - 1);
+}
+
+/** @brief Checks if the page at a virtual address overlaps any of the
+ *         memory regions of an ELF image.
+ *
+ *  @param virtual_address Page aligned VM address
+ *  @param elf ELF header
+ *  @return 1 if the page overlaps the image, 0 otherwise
+ */
+static int
+page_in_elf( uint32_t virtual_address, simple_elf_t *elf )
+{
+	return page_in_region(virtual_address, elf->e_txtstart, elf->e_txtlen)
+	       || page_in_region(virtual_address, elf->e_datstart, elf->e_datlen)
+	       || page_in_region(virtual_address, elf->e_rodatstart,
+	                         elf->e_rodatlen)
+	       || page_in_region(virtual_address, elf->e_bssstart, elf->e_bsslen);
+}
+
+/** @brief Checks if page table at pd_index covers part of a memory region.
+ *
+ *  @param pd_index Page directory index
+ *  @param start Start of memory region
+ *  @param len Length of memory region
+ *  @return 1 if the page table covers part of the region, 0 otherwise
+ */
+static int
+pt_in_region( uint32_t pd_index, uint32_t start, uint32_t len )
+{
+	if (len == 0)
+		return 0;
+
+	return PD_INDEX(start) <= pd_index && pd_index <= PD_INDEX(start + len - 1);
+}
+
+/** @brief Sets up the user stack of a new image as new_pages() would,
+ *         claiming the frames reuse_pd_for_elf() kept for it.
+ *
+ *  Kept frames are zeroed, pages without one get the system wide zero
+ *  frame.
+ *
+ *  @pre pd is the active page directory, with no stale stack translations
+ *  @param pd Page directory
+ *  @param stack_lo Lowest address of the user stack
+ *  @param stack_len Length of the user stack, a multiple of PAGE_SIZE
+ *  @return 0 on success, -1 on error
+ */
+static int
+reuse_user_stack( uint32_t **pd, uint32_t stack_lo, uint32_t stack_len )
+{
+	for (uint32_t i = 0; i < stack_len / PAGE_SIZE; ++i) {
+		uint32_t virtual_address = stack_lo + i * PAGE_SIZE;
+		uint32_t sys_prog_flag = i == 0 ? NEW_PAGE_BASE_FLAG
+		                                : NEW_PAGE_CONTINUE_FROM_BASE_FLAG;
+		uint32_t *ptep = get_ptep((const uint32_t **) pd, virtual_address);
+
+		if (ptep && SYS_PROG_FLAG(*ptep) == EXEC_REUSE_FLAG) {
+			*ptep = TABLE_ADDRESS(*ptep) | PE_USER_WRITABLE | sys_prog_flag;
+			invalidate_tlb((void *) virtual_address);
+			memset((void *) virtual_address, 0, PAGE_SIZE);
+		} else if (allocate_user_zero_frame(pd, virtual_address,
+		                                    sys_prog_flag) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/** @brief Reinitializes the active page directory of a task in place for a
+ *         new ELF image. Used by exec() instead of new_pd_from_elf() so the
+ *         page directory, the page tables and the physical frames of the old
+ *         image are recycled rather than freed and allocated again.
+ *
+ *  Frames mapped at pages the new image or the user stack occupies are kept
+ *  and marked with EXEC_REUSE_FLAG so that allocate_region() and
+ *  reuse_user_stack() claim them with the right permissions. All other
+ *  frames are freed, as are page tables which cover neither the new image
+ *  nor the user stack. The caller must still transplant program memory.
+ *
+ *  Frame availability is checked before the old image is touched, so a
+ *  return value of -1 leaves the old image intact. Any later failure leaves
+ *  the old image torn down and the page directory only partially set up.
+ *
+ *  @pre pd is the page directory of the calling task, which has one thread.
+ *  @param v_pd Page directory of the calling task
+ *  @param elf ELF header of the new image
+ *  @param stack_lo Lowest address of the user stack to set up
+ *  @param stack_len Length of the user stack, a multiple of PAGE_SIZE
+ *  @return 0 on success, -1 if the old image is intact on failure, -2 if
+ *          the old image was torn down on failure.
+ */
+int
+reuse_pd_for_elf( void *v_pd, simple_elf_t *elf, uint32_t stack_lo,
+                  uint32_t stack_len )
+{
+	affirm(v_pd);
+	affirm(elf);
+	affirm((uint32_t) v_pd == TABLE_ADDRESS(get_cr3()));
+	assert(is_valid_pd(v_pd));
+	uint32_t **pd = (uint32_t **) v_pd;
+
+	/* Every frame currently mapped is either reused or freed, so it counts
+	 * towards the frames available to the new image */
+	uint32_t frames_needed = (elf->e_txtlen + PAGE_SIZE - 1) / PAGE_SIZE
+	                         + (elf->e_datlen + PAGE_SIZE - 1) / PAGE_SIZE
+	                         + (elf->e_rodatlen + PAGE_SIZE - 1) / PAGE_SIZE
+	                         + (elf->e_bsslen + PAGE_SIZE - 1) / PAGE_SIZE
+	                         + stack_len / PAGE_SIZE;
+	uint32_t frames_held = 0;
+	for (int i = NUM_KERN_PAGE_TABLES; i < PAGE_SIZE / sizeof(uint32_t); ++i) {
+		if (!pd[i])
+			continue;
+		uint32_t *pt = (uint32_t *) TABLE_ADDRESS(pd[i]);
+		for (int j = 0; j < PAGE_SIZE / sizeof(uint32_t); ++j) {
+			uint32_t phys_address = TABLE_ADDRESS(pt[j]);
+			if (IS_OWNED_FRAME(phys_address))
+				++frames_held;
+		}
+	}
+	if (num_free_phys_frames() + frames_held < frames_needed) {
+		log_warn("reuse_pd_for_elf(): "
+		         "not enough free frames for new image");
+		return -1;
+	}
+
+	/* Point of no return, tear down the old image */
+	for (int i = NUM_KERN_PAGE_TABLES; i < PAGE_SIZE / sizeof(uint32_t); ++i) {
+		if (!pd[i])
+			continue;
+		uint32_t *pt = (uint32_t *) TABLE_ADDRESS(pd[i]);
+
+		for (int j = 0; j < PAGE_SIZE / sizeof(uint32_t); ++j) {
+			uint32_t pt_entry = pt[j];
+			if (!pt_entry)
+				continue;
+			uint32_t virtual_address =
+				((i << PAGE_DIRECTORY_SHIFT) | (j << PAGE_TABLE_SHIFT));
+			uint32_t phys_address = TABLE_ADDRESS(pt_entry);
+
+			if (IS_OWNED_FRAME(phys_address)
+			    && (page_in_elf(virtual_address, elf)
+			        || page_in_region(virtual_address, stack_lo,
+			                          stack_len))) {
+				pt[j] = phys_address | PE_USER_READABLE | EXEC_REUSE_FLAG;
+			} else {
+				if (IS_OWNED_FRAME(phys_address))
+					physfree(phys_address);
+				pt[j] = 0;
+			}
+		}
+		/* Keep page tables the new image or user stack will use */
+		if (!pt_in_region(i, elf->e_txtstart, elf->e_txtlen)
+		    && !pt_in_region(i, elf->e_datstart, elf->e_datlen)
+		    && !pt_in_region(i, elf->e_rodatstart, elf->e_rodatlen)
+		    && !pt_in_region(i, elf->e_bssstart, elf->e_bsslen)
+		    && !pt_in_region(i, stack_lo, stack_len)) {
+			sfree(pt, PAGE_SIZE);
+			pd[i] = NULL;
+		}
+	}
+    /* Allocate regions with appropriate read/write permissions. */
+    int i = 0;
+	i += allocate_region(pd, (void *)elf->e_txtstart, elf->e_txtlen, READ_ONLY);
+	i += allocate_region(pd, (void *)elf->e_datstart, elf->e_datlen,
+	                     READ_WRITE);
+	i += allocate_region(pd, (void *)elf->e_rodatstart, elf->e_rodatlen,
+	                     READ_ONLY);
+	i += allocate_region(pd, (void *)elf->e_bssstart, elf->e_bsslen,
+	                     READ_WRITE);
+
+	/* Flush every stale user translation at once */
+	vm_set_pd(pd);
+
+	if (i < 0) {
+		return -2;
+	}
+	if (reuse_user_stack(pd, stack_lo, stack_len) < 0) {
+		return -2;
+	}
+	assert(is_valid_pd(pd));
+	return 0;
+}
+
 /** @brief Initialized child pd from parent pd. Deep copies writable
  *		   entries, allocating new physical frame. Returns child_pd on success
  *
@@ -365,7 +576,12 @@ new_pd_from_parent( void *v_parent_pd )
 				assert(PAGE_ALIGNED(vm_address));
 				assert(vm_address >= USER_MEM_START);
 
-				if (parent_pt[j] & PRESENT_FLAG) {
+				/* RAM disk frames mapped by map_file() are shared as is */
+				if ((parent_pt[j] & PRESENT_FLAG)
+				    && TABLE_ADDRESS(parent_pt[j]) < USER_MEM_START) {
+					child_pt[j] = parent_pt[j];
+
+				} else if (parent_pt[j] & PRESENT_FLAG) {
 					/* Allocate new physical frame for child. */
 					child_pt[j] = physalloc();
 					assert((PAGE_ALIGNED(child_pt[j])));
@@ -465,6 +681,121 @@ disable_write_protection( void )
 }
 
 
+/** @brief Maps a physalloc() frame into kernel memory.
+ *
+ *  Frames handed out by physalloc() are above the direct mapped kernel memory,
+ *  so the kernel can otherwise only reach them through a user mapping. This
+ *  points the frame window's page table entry at the frame until
+ *  unmap_phys_frame() is called. There is a single window, so callers block
+ *  until it is free and must not map a second frame while holding it.
+ *
+ *  @param phys_address Frame returned by physalloc()
+ *  @return Kernel address of the frame
+ */
+void *
+map_phys_frame( uint32_t phys_address )
+{
+	affirm(frame_window);
+	affirm(PAGE_ALIGNED(phys_address));
+	assert(is_physframe(phys_address));
+
+	mutex_lock(&frame_window_mux);
+	uint32_t *ptep = get_ptep((const uint32_t **) initial_pd,
+	                          (uint32_t) frame_window);
+	affirm(ptep);
+	*ptep = phys_address | PE_KERN_WRITABLE;
+	invalidate_tlb(frame_window);
+
+	return frame_window;
+}
+
+/** @brief Restores the frame window to its direct mapping and frees it.
+ *
+ *  @param window Address returned by map_phys_frame()
+ *  @return Void.
+ */
+void
+unmap_phys_frame( void *window )
+{
+	affirm(window == frame_window);
+
+	uint32_t *ptep = get_ptep((const uint32_t **) initial_pd,
+	                          (uint32_t) frame_window);
+	affirm(ptep);
+	*ptep = (uint32_t) frame_window | PE_KERN_WRITABLE;
+	invalidate_tlb(frame_window);
+
+	mutex_unlock(&frame_window_mux);
+}
+
+/** @brief Unmaps or restores the direct mapping of a kernel page.
+ *
+ *  Kernel page tables are shared by every page directory, so an unmapped
+ *  page faults on any access in every address space. Used for the guard
+ *  pages below kernel stacks.
+ *
+ *  @param page Page aligned kernel address, not the frame window
+ *  @param is_guard 1 to unmap the page, 0 to map it again
+ *  @return Void.
+ */
+void
+set_guard_page( void *page, int is_guard )
+{
+	affirm(PAGE_ALIGNED(page));
+	affirm(page && (uint32_t) page < USER_MEM_START);
+	affirm((char *) page != frame_window);
+
+	uint32_t *ptep = get_ptep((const uint32_t **) initial_pd,
+	                          (uint32_t) page);
+	affirm(ptep);
+	*ptep = is_guard ? PE_UNMAPPED : (uint32_t) page | PE_KERN_WRITABLE;
+	invalidate_tlb(page);
+}
+
+/** @brief Checks if a kernel page table entry is the frame window's, which
+ *         may map a frame above kernel memory.
+ *
+ *  @param pd_index Page directory index of the page table
+ *  @param pt_index Index of the entry in the page table
+ *  @return 1 if the entry maps the frame window, 0 otherwise
+ */
+int
+is_frame_window_entry( int pd_index, int pt_index )
+{
+	return frame_window && PD_INDEX(frame_window) == pd_index
+	       && PT_INDEX(frame_window) == pt_index;
+}
+
+/** @brief Checks if every byte of a user buffer is valid.
+ *
+ *  Permissions are per page, so only one byte of each page is checked.
+ *
+ *  @param buf Start of the buffer
+ *  @param len Length of the buffer
+ *  @param write_mode What permission is needed
+ *  @return 1 if valid, 0 if not
+ */
+int
+is_valid_user_buffer( char *buf, int len, write_mode_t write_mode )
+{
+	if (len < 0)
+		return 0;
+	if (len == 0)
+		return 1;
+
+	/* Buffer must not wrap around the address space */
+	if ((uint32_t) buf + len - 1 < (uint32_t) buf)
+		return 0;
+
+	char *last = buf + len - 1;
+	for (char *p = buf; TABLE_ADDRESS(p) < TABLE_ADDRESS(last);
+	     p = (char *) TABLE_ADDRESS(p) + PAGE_SIZE) {
+		if (!is_valid_user_pointer(p, write_mode))
+			return 0;
+	}
+	return is_valid_user_pointer(last, write_mode);
+}
+
 /** @brief Checks if a user pointer is valid.
  *	Valid means the pointer is non-NULL, belongs to
  *	user memory and is in an allocated memory region.
@@ -854,8 +1185,13 @@ allocate_frame( uint32_t **pd, uint32_t virtual_address,
 		/* Must be present else broken invariant */
 		affirm_msg(pt_entry & PRESENT_FLAG, "pt_entry must be present");
 
+		/* Frame kept across exec() by reuse_pd_for_elf(), claim it as is */
+		if (SYS_PROG_FLAG(pt_entry) == EXEC_REUSE_FLAG) {
+			assert(sys_prog_flag == 0);
+			*ptep = TABLE_ADDRESS(pt_entry);
+
 		/* Ensure it's allocated with same flags. */
-		if (write_mode == READ_WRITE) {
+		} else if (write_mode == READ_WRITE) {
 			if ((pt_entry & (PAGE_SIZE - 1)) !=
 				(PE_USER_WRITABLE | sys_prog_flag)) {
 				return -1;
@@ -909,6 +1245,14 @@ is_valid_sys_prog_flag( uint32_t sys_prog_flag )
 			return 1;
 			break;
 
+		case MAP_FILE_BASE_FLAG :
+			return 1;
+			break;
+
+		case MAP_FILE_CONTINUE_FROM_BASE_FLAG :
+			return 1;
+			break;
+
 		/* Invalid sys programmer flag */
 		default :
 			return 0;
@@ -997,6 +1341,58 @@ allocate_user_zero_frame( uint32_t **pd, uint32_t virtual_address,
 	return 0;
 }
 
+/** @brief Maps a frame read-only for the user at a virtual address.
+ *
+ *  Allocates the page table on demand. If phys_address is 0 a new frame is
+ *  physalloc()ed, otherwise phys_address must be a frame of kernel memory,
+ *  which is shared rather than owned by the page table.
+ *
+ *  @param pd Page directory pointer
+ *  @param virtual_address Page aligned, unmapped user VM address
+ *  @param phys_address Kernel frame to share, or 0 for a new frame
+ *  @param sys_prog_flag Bits 9,10,11 to OR page table entry with
+ *  @return 0 on success, -1 on error.
+ */
+int
+map_user_frame( uint32_t **pd, uint32_t virtual_address,
+                uint32_t phys_address, uint32_t sys_prog_flag )
+{
+	affirm(pd);
+	affirm(PAGE_ALIGNED(virtual_address));
+	affirm(PAGE_ALIGNED(phys_address));
+	affirm(phys_address < USER_MEM_START);
+	assert(is_valid_pd(pd));
+
+	if (!is_valid_sys_prog_flag(sys_prog_flag)) {
+		return -1;
+	}
+	if (!pd[PD_INDEX(virtual_address)]) {
+		if (add_new_pt_to_pd(pd, virtual_address) < 0) {
+			log_warn("map_user_frame(): "
+			         "unable to allocate new page table in pd:%p for "
+			         "virtual_address: 0x%08lx", pd, virtual_address);
+			return -1;
+		}
+	}
+	uint32_t *ptep = get_ptep((const uint32_t **) pd, virtual_address);
+	affirm(ptep);
+	if (*ptep) {
+		log_info("map_user_frame(): "
+		         "virtual_address:0x%08lx already mapped", virtual_address);
+		return -1;
+	}
+	if (!phys_address) {
+		phys_address = physalloc();
+		if (!phys_address) {
+			return -1;
+		}
+	}
+	*ptep = phys_address | PE_USER_READABLE | sys_prog_flag;
+	invalidate_tlb((void *)virtual_address);
+
+	return 0;
+}
+
 /** Allocates a memory region in virtual memory.
  *
  *	If there aren't enough physical frames to satisfy allocation
@@ -1016,15 +1412,30 @@ allocate_region( uint32_t **pd, void *start, uint32_t len,
 	assert(write_mode == READ_WRITE || write_mode == READ_ONLY);
     uint32_t pages_to_alloc = (len + PAGE_SIZE - 1) / PAGE_SIZE;
 
-    /* Ensure we have enough free frames to fulfill request */
-    if (num_free_phys_frames() < pages_to_alloc) {
-        return -1;
-	}
-
 	/* u_start is not always page-aligned. For example, the data segment is
 	 * immediately succeeded by bss */
     uint32_t u_start = (uint32_t)start;
 
+    /* Ensure we have enough free frames to fulfill request. Pages already
+     * backed by a frame (DATA and BSS sharing a page, or frames kept across
+     * exec() by reuse_pd_for_elf()) do not need a new one. */
+	uint32_t frames_to_alloc = 0;
+    for (int i = 0; i < pages_to_alloc; ++i) {
+		uint32_t virtual_address = u_start + PAGE_SIZE * i;
+		uint32_t *pd_entry = pd[PD_INDEX(virtual_address)];
+		if (!pd_entry) {
+			++frames_to_alloc;
+			continue;
+		}
+		uint32_t *pt = (uint32_t *) TABLE_ADDRESS(pd_entry);
+		if (!TABLE_ADDRESS(pt[PT_INDEX(virtual_address)])) {
+			++frames_to_alloc;
+		}
+	}
+    if (num_free_phys_frames() < frames_to_alloc) {
+        return -1;
+	}
+
     /* Allocate 1 frame at a time. */
     for (int i = 0; i < pages_to_alloc; ++i) {
 		uint32_t virtual_address = u_start + PAGE_SIZE * i;
@@ -1108,9 +1519,9 @@ free_pt_memory( uint32_t *pt, int pd_index )
 				affirm_msg(TABLE_ADDRESS(pt_entry) != 0, "pt_entry:0x%08lx",
 						   pt_entry);
 
-				/* Free only if not sys wide zero frame */
+				/* Free only if not sys wide zero frame or shared frame */
 				uint32_t phys_address = TABLE_ADDRESS(pt_entry);
-				if (phys_address != SYS_ZERO_FRAME)
+				if (IS_OWNED_FRAME(phys_address))
 					physfree(phys_address);
 
 				/* always Zero the entry as well */
@@ -1120,19 +1531,25 @@ free_pt_memory( uint32_t *pt, int pd_index )
 	}
 }
 
-/** @brief Walks the page directory and frees the entire page directory,
- *		  page tables, and all physical frames
+/** @brief Frees some of the page tables of a page directory along with
+ *         their physical frames, so that large address spaces can be freed
+ *         a few page tables at a time.
  *
- *  @param pd Page directory to be freed.
+ *  @param pd Page directory whose page tables to free
+ *  @param next Page directory index to continue from, 0 to start from the
+ *         first user page table. Updated to where to continue from next.
+ *  @param max_tables Most page tables to free
+ *  @return 1 if page tables are left to free, 0 if all of them are freed
  */
-void
-free_pd_memory( void *pd )
+int
+free_pd_memory_some( void *pd, int *next, int max_tables )
 {
 	affirm(pd);
-	assert(is_valid_pd(pd));
+	affirm(next);
 	uint32_t **pd_cast = (uint32_t **) pd;
 
-	for (int i = NUM_KERN_PAGE_TABLES; i < PAGE_SIZE / sizeof(uint32_t); ++i) {
+	int i = *next < NUM_KERN_PAGE_TABLES ? NUM_KERN_PAGE_TABLES : *next;
+	for (; i < PAGE_SIZE / sizeof(uint32_t) && max_tables > 0; ++i) {
 
 		uint32_t *pd_entry = pd_cast[i];
 
@@ -1142,7 +1559,27 @@ free_pd_memory( void *pd )
 			uint32_t *pt = (uint32_t *) TABLE_ADDRESS(pd_entry);
 			free_pt_memory(pt, i);
 			sfree(pt, PAGE_SIZE);
+			pd_cast[i] = 0;
+			--max_tables;
 		}
 	}
+	*next = i;
+	return i < PAGE_SIZE / sizeof(uint32_t);
+}
+
+/** @brief Walks the page directory and frees the entire page directory,
+ *		  page tables, and all physical frames
+ *
+ *  @param pd Page directory to be freed.
+ */
+void
+free_pd_memory( void *pd )
+{
+	affirm(pd);
+	assert(is_valid_pd(pd));
+
+	int next = 0;
+	while (free_pd_memory_some(pd, &next, PAGE_SIZE / sizeof(uint32_t)))
+		continue;
 }
 
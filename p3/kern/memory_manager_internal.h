@@ -16,6 +16,15 @@
 #define NEW_PAGE_BASE_FLAG (1 << 9)
 #define NEW_PAGE_CONTINUE_FROM_BASE_FLAG (2 << 9)
 
+/* Marks a frame retained by reuse_pd_for_elf() across exec(). Only ever
+ * seen between reuse_pd_for_elf() and the end of the region allocation that
+ * follows it, where allocate_frame() claims the frame and sets real flags */
+#define EXEC_REUSE_FLAG (3 << 9)
+
+/* Pages mapped by map_file(), which remove_pages() frees like new_pages() */
+#define MAP_FILE_BASE_FLAG (4 << 9)
+#define MAP_FILE_CONTINUE_FROM_BASE_FLAG (5 << 9)
+
 /* 7 is 111 in binary, and we bitshift << 9 to only keep bits 9, 10, 11 in the
  * address
  */
@@ -52,10 +61,17 @@
 
 #define SYS_ZERO_FRAME (USER_MEM_START)
 
+/* Frames a page table owns and must physfree(), as opposed to the system wide
+ * zero frame and RAM disk frames in kernel memory shared by map_file() */
+#define IS_OWNED_FRAME(PHYS_ADDRESS) ((PHYS_ADDRESS) > SYS_ZERO_FRAME)
+
 mutex_t pages_mux;
 
 uint32_t *get_ptep( const uint32_t **pd, uint32_t virtual_address );
 int is_valid_sys_prog_flag( uint32_t sys_prog_flag );
 void unallocate_frame( uint32_t **pd, uint32_t virtual_address );
+int map_user_frame( uint32_t **pd, uint32_t virtual_address,
+                    uint32_t phys_address, uint32_t sys_prog_flag );
+int is_frame_window_entry( int pd_index, int pt_index );
 
 #endif /* MEMORY_MANAGER_INTERNAL_H_ */
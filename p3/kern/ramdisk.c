@@ -0,0 +1,416 @@
+/** @file ramdisk.c
+ *  @brief Access to compressed RAM disk files.
+ *
+ *  Compressed files (see ramdisk.h) are decompressed one block at a time, and
+ *  only the blocks a request touches are decompressed. Requests covering a
+ *  whole block, which is what exec() issues when loading a program, are
+ *  decompressed straight into the destination buffer. Partial block requests,
+ *  such as ELF header reads and small readfile() calls, go through a small
+ *  LRU cache of decompressed blocks so repeated reads of the same block only
+ *  decompress it once.
+ *
+ *  Which files are compressed is not guessed from their bytes: rdcompress
+ *  lists them in ramdisk_compressed_names, which ramdisk_init() resolves to
+ *  RAM disk files at boot. Only the header of a listed file is read.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <ramdisk.h>
+#include <stdint.h>		/* uint8_t, uint32_t */
+#include <stddef.h>		/* NULL */
+#include <string.h>		/* memcpy */
+#include <assert.h>		/* affirm */
+#include <logger.h>		/* log_warn */
+#include <exec2obj.h>	/* exec2obj_userapp_TOC, MAX_NUM_APP_ENTRIES */
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/* Number of decompressed blocks kept around */
+#define RAMDISK_CACHE_BLOCKS 8
+
+/** @brief A decompressed block
+ *
+ *  @param execbytes File the block belongs to, NULL if the entry is unused
+ *  @param block Block index within the file
+ *  @param len Number of valid bytes in data
+ *  @param last_used Value of cache_clock when last read, for LRU eviction
+ *  @param data Decompressed bytes
+ */
+typedef struct {
+	const char *execbytes;
+	int block;
+	int len;
+	uint32_t last_used;
+	char data[RAMDISK_BLOCK_SIZE];
+} cached_block_t;
+
+static cached_block_t cache[RAMDISK_CACHE_BLOCKS];
+static uint32_t cache_clock = 0;
+
+/* Guards cache and cache_clock */
+static mutex_t ramdisk_mux;
+
+/* Bytes of the RAM disk files rdcompress compressed, set by ramdisk_init()
+ * and only read afterwards */
+static const char *compressed_files[MAX_NUM_APP_ENTRIES];
+static int num_compressed_files = 0;
+
+/** @brief Initializes RAM disk access and finds the compressed files.
+ *
+ *  @pre No RAM disk file has been read yet
+ *  @return 0 on success, negative value on failure
+ */
+int
+ramdisk_init( void )
+{
+	if (mutex_init(&ramdisk_mux) < 0)
+		return -1;
+
+	for (int i = 0; ramdisk_compressed_names[i]; ++i) {
+		int j = 0;
+		while (j < exec2obj_userapp_count
+		       && strncmp(ramdisk_compressed_names[i],
+		                  exec2obj_userapp_TOC[j].execname,
+		                  MAX_EXECNAME_LEN) != 0)
+			++j;
+		if (j == exec2obj_userapp_count) {
+			log_warn("ramdisk_init(): no file %s on the RAM disk",
+			         ramdisk_compressed_names[i]);
+			continue;
+		}
+		affirm(num_compressed_files < MAX_NUM_APP_ENTRIES);
+		compressed_files[num_compressed_files++]
+		    = exec2obj_userapp_TOC[j].execbytes;
+	}
+	return 0;
+}
+
+/** @brief Checks whether rdcompress listed a RAM disk file as compressed.
+ *
+ *  @param execbytes Bytes of the file in the RAM disk
+ *  @return 1 if listed, 0 otherwise
+ */
+static int
+is_listed_compressed( const char *execbytes )
+{
+	for (int i = 0; i < num_compressed_files; ++i) {
+		if (compressed_files[i] == execbytes)
+			return 1;
+	}
+	return 0;
+}
+
+
+/** @brief Decompresses an LZ4 block.
+ *
+ *  Every read and write is bounds checked, so a corrupt block only makes
+ *  this function fail.
+ *
+ *  @param src Compressed bytes
+ *  @param src_len Number of compressed bytes
+ *  @param dst Buffer to decompress into
+ *  @param dst_len Size of dst
+ *  @return Number of bytes decompressed on success, -1 on corrupt input
+ */
+static int
+lz4_decompress( const uint8_t *src, int src_len, uint8_t *dst, int dst_len )
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_len;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_len;
+
+	while (ip < iend) {
+		int token = *ip++;
+
+		/* Literal run, with 255 valued bytes extending its length */
+		int lit_len = token >> 4;
+		if (lit_len == 15) {
+			int b;
+			do {
+				if (ip >= iend)
+					return -1;
+				b = *ip++;
+				lit_len += b;
+			} while (b == 255);
+		}
+		if (lit_len > iend - ip || lit_len > oend - op)
+			return -1;
+		memcpy(op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+
+		/* Last sequence holds only literals */
+		if (ip == iend)
+			break;
+
+		/* Match, copied from already decompressed output */
+		if (iend - ip < 2)
+			return -1;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op - dst)
+			return -1;
+
+		int match_len = token & 15;
+		if (match_len == 15) {
+			int b;
+			do {
+				if (ip >= iend)
+					return -1;
+				b = *ip++;
+				match_len += b;
+			} while (b == 255);
+		}
+		match_len += 4;
+		if (match_len > oend - op)
+			return -1;
+
+		/* Byte by byte, since a match may overlap its own output */
+		const uint8_t *match = op - offset;
+		while (match_len--)
+			*op++ = *match++;
+	}
+	return op - dst;
+}
+
+/** @brief Returns the header of a RAM disk file if it is compressed.
+ *
+ *  @param execbytes Bytes of the file in the RAM disk
+ *  @param execlen Number of bytes of the file in the RAM disk
+ *  @return Header if rdcompress listed the file and its header is well
+ *          formed, NULL otherwise
+ */
+static const ramdisk_header_t *
+compressed_header( const char *execbytes, int execlen )
+{
+	if (!is_listed_compressed(execbytes))
+		return NULL;
+
+	ramdisk_header_t hdr;
+	if (execlen < sizeof(hdr)) {
+		log_warn("compressed_header(): truncated header");
+		return NULL;
+	}
+
+	/* RAM disk files carry no alignment guarantee */
+	memcpy(&hdr, execbytes, sizeof(hdr));
+	if (hdr.magic != RAMDISK_MAGIC) {
+		log_warn("compressed_header(): bad magic %lx", hdr.magic);
+		return NULL;
+	}
+
+	if (hdr.num_blocks != (hdr.raw_len + RAMDISK_BLOCK_SIZE - 1)
+	                      / RAMDISK_BLOCK_SIZE) {
+		log_warn("compressed_header(): bad block count %lu for length %lu",
+		         hdr.num_blocks, hdr.raw_len);
+		return NULL;
+	}
+	if ((execlen - sizeof(hdr)) / sizeof(uint32_t) < hdr.num_blocks + 1) {
+		log_warn("compressed_header(): truncated block offsets");
+		return NULL;
+	}
+	return (const ramdisk_header_t *) execbytes;
+}
+
+/** @brief Finds the compressed bytes of a block.
+ *
+ *  @param execbytes Bytes of a compressed file
+ *  @param execlen Number of bytes of the compressed file
+ *  @param num_blocks Number of blocks in the file
+ *  @param block Block index
+ *  @param lenp Where the compressed length is stored
+ *  @return Pointer to the compressed bytes, NULL if the offsets are corrupt
+ */
+static const char *
+compressed_block( const char *execbytes, int execlen, uint32_t num_blocks,
+                  int block, int *lenp )
+{
+	const char *offsets = execbytes + sizeof(ramdisk_header_t);
+	const char *blocks = offsets + (num_blocks + 1) * sizeof(uint32_t);
+	uint32_t start, end;
+	memcpy(&start, offsets + block * sizeof(uint32_t), sizeof(start));
+	memcpy(&end, offsets + (block + 1) * sizeof(uint32_t), sizeof(end));
+
+	if (start > end || end > execbytes + execlen - blocks) {
+		log_warn("compressed_block(): bad offsets for block %d", block);
+		return NULL;
+	}
+	*lenp = end - start;
+	return blocks + start;
+}
+
+/** @brief Decompresses a block into a buffer.
+ *
+ *  @param execbytes Bytes of a compressed file
+ *  @param execlen Number of bytes of the compressed file
+ *  @param hdr Header of the compressed file
+ *  @param block Block index
+ *  @param dst Buffer of at least RAMDISK_BLOCK_SIZE bytes
+ *  @return Raw length of the block on success, -1 on corrupt input
+ */
+static int
+decompress_block( const char *execbytes, int execlen,
+                  const ramdisk_header_t *hdr, int block, char *dst )
+{
+	int raw_len = RAMDISK_BLOCK_SIZE;
+	if (block == hdr->num_blocks - 1)
+		raw_len = hdr->raw_len - block * RAMDISK_BLOCK_SIZE;
+
+	int comp_len;
+	const char *src = compressed_block(execbytes, execlen, hdr->num_blocks,
+	                                   block, &comp_len);
+	if (!src)
+		return -1;
+
+	/* Incompressible blocks are stored as is */
+	if (comp_len == raw_len) {
+		memcpy(dst, src, raw_len);
+		return raw_len;
+	}
+	if (lz4_decompress((const uint8_t *) src, comp_len, (uint8_t *) dst,
+	                   raw_len) != raw_len) {
+		log_warn("decompress_block(): corrupt block %d", block);
+		return -1;
+	}
+	return raw_len;
+}
+
+/** @brief Gets a decompressed block from the cache, decompressing it into
+ *         the least recently used entry on a miss.
+ *
+ *  @pre ramdisk_mux is held
+ *  @param execbytes Bytes of a compressed file
+ *  @param execlen Number of bytes of the compressed file
+ *  @param hdr Header of the compressed file
+ *  @param block Block index
+ *  @return Cache entry holding the block, NULL on corrupt input
+ */
+static cached_block_t *
+get_cached_block( const char *execbytes, int execlen,
+                  const ramdisk_header_t *hdr, int block )
+{
+	cached_block_t *victim = &cache[0];
+	++cache_clock;
+
+	for (int i = 0; i < RAMDISK_CACHE_BLOCKS; ++i) {
+		cached_block_t *entry = &cache[i];
+		if (entry->execbytes == execbytes && entry->block == block) {
+			entry->last_used = cache_clock;
+			return entry;
+		}
+		if (!entry->execbytes)
+			victim = entry;
+		else if (victim->execbytes && entry->last_used < victim->last_used)
+			victim = entry;
+	}
+	victim->execbytes = NULL;
+	int len = decompress_block(execbytes, execlen, hdr, block, victim->data);
+	if (len < 0)
+		return NULL;
+
+	victim->execbytes = execbytes;
+	victim->block = block;
+	victim->len = len;
+	victim->last_used = cache_clock;
+	return victim;
+}
+
+/** @brief Checks if a RAM disk file is stored compressed.
+ *
+ *  @param execbytes Bytes of the file in the RAM disk
+ *  @param execlen Number of bytes of the file in the RAM disk
+ *  @return 1 if compressed, 0 if stored raw
+ */
+int
+ramdisk_is_compressed( const char *execbytes, int execlen )
+{
+	affirm(execbytes);
+
+	return compressed_header(execbytes, execlen) != NULL;
+}
+
+/** @brief Returns the uncompressed length of a RAM disk file.
+ *
+ *  @param execbytes Bytes of the file in the RAM disk
+ *  @param execlen Number of bytes of the file in the RAM disk
+ *  @return Uncompressed file length
+ */
+int
+ramdisk_file_len( const char *execbytes, int execlen )
+{
+	affirm(execbytes);
+
+	const ramdisk_header_t *hdr = compressed_header(execbytes, execlen);
+	if (!hdr)
+		return execlen;
+
+	ramdisk_header_t hdr_copy;
+	memcpy(&hdr_copy, hdr, sizeof(hdr_copy));
+	return hdr_copy.raw_len;
+}
+
+/** @brief Copies uncompressed bytes of a RAM disk file into a buffer.
+ *
+ *  Handles both raw and compressed files.
+ *
+ *  @param execbytes Bytes of the file in the RAM disk
+ *  @param execlen Number of bytes of the file in the RAM disk
+ *  @param offset Offset into the uncompressed file to copy from
+ *  @param size Maximum number of bytes to copy
+ *  @param buf Buffer to copy into
+ *  @return Number of bytes copied on success, negative value on failure
+ */
+int
+ramdisk_getbytes( const char *execbytes, int execlen, int offset, int size,
+                  char *buf )
+{
+	affirm(execbytes);
+	affirm(buf);
+
+	int file_len = ramdisk_file_len(execbytes, execlen);
+	if (offset < 0 || size < 0 || offset > file_len)
+		return -1;
+
+	if (size > file_len - offset)
+		size = file_len - offset;
+
+	const ramdisk_header_t *hdr_p = compressed_header(execbytes, execlen);
+	if (!hdr_p) {
+		memcpy(buf, execbytes + offset, size);
+		return size;
+	}
+	ramdisk_header_t hdr;
+	memcpy(&hdr, hdr_p, sizeof(hdr));
+
+	int copied = 0;
+	while (copied < size) {
+		int pos = offset + copied;
+		int block = pos / RAMDISK_BLOCK_SIZE;
+		int block_off = pos % RAMDISK_BLOCK_SIZE;
+		int to_copy = RAMDISK_BLOCK_SIZE - block_off;
+		if (to_copy > size - copied)
+			to_copy = size - copied;
+
+		/* Whole blocks need no cache, decompress straight into buf */
+		if (block_off == 0 && to_copy == RAMDISK_BLOCK_SIZE) {
+			if (decompress_block(execbytes, execlen, &hdr, block,
+			                     buf + copied) < 0)
+				return -1;
+			copied += to_copy;
+			continue;
+		}
+		mutex_lock(&ramdisk_mux);
+		cached_block_t *entry = get_cached_block(execbytes, execlen, &hdr,
+		                                         block);
+		if (!entry) {
+			mutex_unlock(&ramdisk_mux);
+			return -1;
+		}
+		affirm(block_off + to_copy <= entry->len);
+		memcpy(buf + copied, entry->data + block_off, to_copy);
+		mutex_unlock(&ramdisk_mux);
+		copied += to_copy;
+	}
+	return copied;
+}
@@ -0,0 +1,12 @@
+/** @file ramdisk_uncompressed.c
+ *  @brief List of compressed RAM disk files of a kernel built without
+ *         CONFIG_COMPRESS_RAMDISK, which is empty. rdcompress generates the
+ *         list otherwise, see config.mk.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <ramdisk.h>
+#include <stddef.h>		/* NULL */
+
+const char *ramdisk_compressed_names[] = { NULL };
@@ -0,0 +1,266 @@
+/** @file reaper.c
+ *  @brief Kernel thread which frees the memory of vanished tasks.
+ *
+ *  Freeing a task's address space takes time linear in its size, so the
+ *  last thread of a vanishing task does not do it. It hands its page
+ *  directory and its sibling threads' TCBs to the reaper and goes on to
+ *  wake its parent right away. The reaper is a kernel thread which only
+ *  runs when there is something to free, and yields after every
+ *  REAPER_BATCH_TABLES page tables or REAPER_BATCH_TCBS TCBs, so it takes
+ *  no more than its share of the CPU from user threads.
+ *
+ *  TCBs are freed by the reaper too, once their last reference is dropped,
+ *  see put_tcb(). Lookups of the tid -> TCB table take no lock, so a TCB
+ *  removed from it is only freed after a grace period in which the reaper
+ *  has seen no lookup in progress. The reaper waits for that holding no
+ *  lock, which is why it is the one to free TCBs.
+ *
+ *  The reaper thread belongs to a task of its own whose page directory is
+ *  the initial page directory, and never leaves kernel mode. It runs at
+ *  NICE_MAX, the smallest share of the CPU a thread can have.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <reaper.h>
+#include <task_manager.h>			/* create_pcb, create_tcb, free_tcb */
+#include <task_manager_internal.h>	/* pcb_t, tcb_t */
+#include <scheduler.h>				/* yield_execution, set_thread_nice */
+#include <priority.h>				/* NICE_MAX */
+#include <memory_manager.h>			/* get_initial_pd, free_pd_memory_some */
+#include <variable_queue.h>			/* Q_* */
+#include <lib_thread_management/mutex.h>	/* mutex_t */
+#include <lib_thread_management/waitqueue.h> /* waitqueue_t */
+#include <x86/asm.h>				/* disable_interrupts */
+#include <x86/cr.h>					/* get_cr0, get_cr3, set_cr3 */
+#include <malloc.h>					/* smalloc, sfree */
+#include <assert.h>					/* affirm */
+#include <logger.h>					/* log_warn */
+#include <stdint.h>					/* uint32_t */
+
+/** @brief Page tables freed between yields */
+#define REAPER_BATCH_TABLES 16
+
+/** @brief TCBs freed between yields */
+#define REAPER_BATCH_TCBS 32
+
+/** @brief What is left of a vanished task for the reaper to free
+ *
+ *  @param pd Page directory, freed along with its page tables and frames
+ *  @param threads TCBs of the task's threads other than the last one
+ *  @param reap_link Link in the reaper's list of jobs
+ */
+typedef struct reap_job {
+	void *pd;
+	vanished_threads_list_t threads;
+	Q_NEW_LINK(reap_job) reap_link;
+} reap_job_t;
+
+Q_NEW_HEAD(reap_job_list_t, reap_job);
+
+/* Jobs not started yet and TCBs with no references left, guarded by
+ * reap_mux, and where the reaper waits for either */
+static reap_job_list_t reap_jobs;
+static vanished_threads_list_t reap_tcbs;
+static mutex_t reap_mux;
+static waitqueue_t reap_wq;
+
+static tcb_t *reaper_tcb;
+
+static void reaper_main( void );
+
+/** @brief Starts the reaper thread.
+ *
+ *  @pre The initial user programs are loaded, the reaper must not be the
+ *       first thread the scheduler runs
+ *  @return 0 on success, negative value on failure
+ */
+int
+reaper_init( void )
+{
+	Q_INIT_HEAD(&reap_jobs);
+	Q_INIT_HEAD(&reap_tcbs);
+	if (mutex_init(&reap_mux) < 0 || waitqueue_init(&reap_wq) < 0)
+		return -1;
+
+	uint32_t pid, tid;
+	pcb_t *pcb = create_pcb(&pid, get_initial_pd(), NULL);
+	if (!pcb)
+		return -1;
+	set_task_name(pcb, "reaper");
+
+	reaper_tcb = create_tcb(pcb, &tid);
+	if (!reaper_tcb)
+		return -1;
+
+	/* Freeing is never urgent. A thread blocking on reap_mux lends the
+	 * reaper its priority while it holds it, see mutex.c */
+	set_thread_nice(reaper_tcb, NICE_MAX);
+
+	/* Lay out the stack as context_switch() leaves it, so that switching to
+	 * the reaper for the first time returns into reaper_main() */
+	uint32_t *esp = get_kern_stack_hi(reaper_tcb);
+	*(--esp) = 0; /* reaper_main() does not return */
+	*(--esp) = (uint32_t) reaper_main;
+	for (int i = 0; i < 7; ++i)
+		*(--esp) = 0; /* %ebp, %eax, %ebx, %ecx, %edx, %edi, %esi */
+	*(--esp) = get_cr0();
+	*(--esp) = (uint32_t) get_initial_pd();
+	set_kern_esp(reaper_tcb, esp);
+
+	return make_thread_runnable(reaper_tcb);
+}
+
+/** @brief Hands what is left of a vanishing task to the reaper.
+ *
+ *  Takes the TCBs of every thread of the task but the last one, and the
+ *  task's page directory. Switches to the initial page directory, so the
+ *  caller keeps running in kernel memory only.
+ *
+ *  @param owning_task PCB of the vanishing task
+ *  @param last_tcb TCB of the last thread of the task, the caller
+ *  @pre There are no more active threads in the task
+ *  @return 0 on success, negative value if out of memory, in which case
+ *          nothing is taken and the caller frees everything itself
+ */
+int
+reap_task_later( pcb_t *owning_task, tcb_t *last_tcb )
+{
+	affirm(owning_task);
+	affirm(last_tcb);
+	affirm(!Q_GET_FRONT(&(owning_task->active_threads_list)));
+	affirm(owning_task->pd);
+
+	reap_job_t *job = smalloc(sizeof(reap_job_t));
+	if (!job) {
+		log_warn("reap_task_later(): out of memory");
+		return -1;
+	}
+	Q_INIT_ELEM(job, reap_link);
+
+	/* Everything but the last thread, which is freed when reaped */
+	Q_INIT_HEAD(&(job->threads));
+	tcb_t *curr = Q_GET_FRONT(&(owning_task->vanished_threads_list));
+	while (curr && curr != last_tcb) {
+		tcb_t *next = Q_GET_NEXT(curr, task_thread_link);
+		Q_REMOVE(&(owning_task->vanished_threads_list), curr,
+		         task_thread_link);
+		Q_INSERT_TAIL(&(job->threads), curr, task_thread_link);
+		curr = next;
+	}
+	affirm(Q_GET_FRONT(&(owning_task->vanished_threads_list)) == last_tcb);
+	affirm(Q_GET_TAIL(&(owning_task->vanished_threads_list)) == last_tcb);
+
+	/* Stop using the page directory before handing it over */
+	affirm(TABLE_ADDRESS(get_cr3()) == (uint32_t) owning_task->pd);
+	set_cr3((uint32_t) get_initial_pd());
+	job->pd = owning_task->pd;
+	owning_task->pd = NULL;
+
+	mutex_lock(&reap_mux);
+	Q_INSERT_TAIL(&reap_jobs, job, reap_link);
+	mutex_unlock(&reap_mux);
+
+	/* Queue the reaper without switching to it, it is in no hurry */
+	disable_interrupts();
+	switch_safe_wake_n(&reap_wq, 1);
+	enable_interrupts();
+	return 0;
+}
+
+/** @brief Hands a TCB with no references left to the reaper to free.
+ *
+ *  @param tcb TCB, already removed from the tid -> TCB table
+ *  @return Void.
+ */
+void
+reap_tcb_later( tcb_t *tcb )
+{
+	affirm(tcb);
+	affirm(!tcb->refs);
+	affirm(!Q_IN_SOME_QUEUE(tcb, task_thread_link));
+
+	mutex_lock(&reap_mux);
+	Q_INSERT_TAIL(&reap_tcbs, tcb, task_thread_link);
+	mutex_unlock(&reap_mux);
+
+	disable_interrupts();
+	switch_safe_wake_n(&reap_wq, 1);
+	enable_interrupts();
+}
+
+/** @brief Frees TCBs with no references left once no lookup may still be
+ *         looking at them, yielding between batches.
+ *
+ *  @param tcbs TCBs to free
+ *  @return Void.
+ */
+static void
+reap_tcbs_now( vanished_threads_list_t *tcbs )
+{
+	/* Lookups in progress were preempted, let them finish */
+	while (!no_tcb_lookups())
+		yield_execution(RUNNABLE, NULL, NULL, NULL);
+
+	int freed = 0;
+	tcb_t *tcb;
+	while ((tcb = Q_GET_FRONT(tcbs))) {
+		Q_REMOVE(tcbs, tcb, task_thread_link);
+		free_tcb_memory(tcb);
+		if (++freed % REAPER_BATCH_TCBS == 0)
+			yield_execution(RUNNABLE, NULL, NULL, NULL);
+	}
+}
+
+/** @brief Frees everything in a job, yielding between batches.
+ *
+ *  @param job Job to free
+ *  @return Void.
+ */
+static void
+reap( reap_job_t *job )
+{
+	int next = 0;
+	while (free_pd_memory_some(job->pd, &next, REAPER_BATCH_TABLES))
+		yield_execution(RUNNABLE, NULL, NULL, NULL);
+	sfree(job->pd, PAGE_SIZE);
+
+	int freed = 0;
+	tcb_t *tcb;
+	while ((tcb = Q_GET_FRONT(&(job->threads)))) {
+		Q_REMOVE(&(job->threads), tcb, task_thread_link);
+		free_tcb(tcb);
+		if (++freed % REAPER_BATCH_TCBS == 0)
+			yield_execution(RUNNABLE, NULL, NULL, NULL);
+	}
+	sfree(job, sizeof(reap_job_t));
+}
+
+/** @brief Body of the reaper thread, frees TCBs and jobs in the order they
+ *         came in and blocks while there are none.
+ *
+ *  @return Does not return.
+ */
+static void
+reaper_main( void )
+{
+	while (1) {
+		mutex_lock(&reap_mux);
+		reap_job_t *job = Q_GET_FRONT(&reap_jobs);
+		if (!job && !Q_GET_FRONT(&reap_tcbs)) {
+			wait_unlock(&reap_wq, &reap_mux);
+			continue;
+		}
+		if (job)
+			Q_REMOVE(&reap_jobs, job, reap_link);
+
+		/* Take every TCB queued so far */
+		vanished_threads_list_t tcbs = reap_tcbs;
+		Q_INIT_HEAD(&reap_tcbs);
+		mutex_unlock(&reap_mux);
+
+		reap_tcbs_now(&tcbs);
+		if (job)
+			reap(job);
+	}
+}
@@ -0,0 +1,243 @@
+/** @file rusage.c
+ *  @brief CPU and resource usage accounting, and the getrusage() syscall,
+ *         see rusage.h.
+ *
+ *  A thread's counters are only ever written by the thread itself: its
+ *  runtime and switch counts by the scheduler as it switches out, its page
+ *  faults and syscalls by the handlers it runs. So counting needs no lock,
+ *  only readers of another thread's 64-bit runtime disable interrupts so as
+ *  not to see it half written.
+ *
+ *  A task's PCB holds the usage of its vanished threads, and of its reaped
+ *  child tasks separately, both guarded by set_status_vanish_wait_mux. A
+ *  thread folds its usage into its PCB in the same critical section which
+ *  moves it to the vanished threads list, so getrusage() adding up the PCB
+ *  and the active threads counts every thread exactly once.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <rusage.h>
+#include <asm.h>				/* outb(), rdtsc(), disable/enable_interrupts() */
+#include <stdint.h>				/* uint32_t, uint64_t, UINT32_MAX */
+#include <stddef.h>				/* NULL */
+#include <string.h>				/* memset() */
+#include <assert.h>				/* affirm() */
+#include <scheduler.h>			/* get_running_thread() */
+#include <timer_driver.h>		/* get_tsc_per_tick() */
+#include <memory_manager.h>		/* is_valid_user_pointer() */
+#include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <task_manager_internal.h> /* pcb_t, tcb_t */
+#include <variable_queue.h>		/* Q_GET_FRONT(), Q_GET_NEXT() */
+#include <lib_thread_management/mutex.h> /* mutex_lock() */
+
+/** @brief Zeroes usage counters
+ *
+ *  @param usage Counters to zero
+ *  @return Void.
+ */
+void
+usage_init( usage_t *usage )
+{
+	affirm(usage);
+	memset(usage, 0, sizeof(usage_t));
+}
+
+/** @brief Adds usage counters to others
+ *
+ *  @param to Counters to add to
+ *  @param from Counters to add
+ *  @return Void.
+ */
+void
+usage_add( usage_t *to, const usage_t *from )
+{
+	affirm(to && from);
+	to->runtime += from->runtime;
+	to->voluntary_switches += from->voluntary_switches;
+	to->involuntary_switches += from->involuntary_switches;
+	to->page_faults += from->page_faults;
+	to->syscalls += from->syscalls;
+	to->threads += from->threads;
+}
+
+/** @brief Counts a syscall made by the running thread, called by every
+ *         syscall wrapper before its handler.
+ *
+ *  @return Void.
+ */
+void
+count_syscall( void )
+{
+	tcb_t *tcb = get_running_thread();
+	if (tcb)
+		tcb->usage.syscalls++;
+}
+
+/** @brief Counts a page fault taken by the running thread.
+ *
+ *  @return Void.
+ */
+void
+count_page_fault( void )
+{
+	tcb_t *tcb = get_running_thread();
+	if (tcb)
+		tcb->usage.page_faults++;
+}
+
+/** @brief Copies a thread's usage, charging the running thread the time
+ *         slice it is in.
+ *
+ *  @param tcb Thread
+ *  @param usage Where to copy the thread's usage to
+ *  @return Void.
+ */
+static void
+get_thread_usage( tcb_t *tcb, usage_t *usage )
+{
+	disable_interrupts();
+	*usage = tcb->usage;
+	if (tcb == get_running_thread())
+		usage->runtime += rdtsc() - tcb->run_start;
+	enable_interrupts();
+	usage->threads = 1;
+}
+
+/** @brief Adds up the usage of every thread of a task, active or vanished.
+ *
+ *  @pre pcb->set_status_vanish_wait_mux is held
+ *  @param pcb Task
+ *  @param usage Where to store the task's usage
+ *  @return Void.
+ */
+void
+get_task_usage( pcb_t *pcb, usage_t *usage )
+{
+	affirm(pcb && usage);
+
+	*usage = pcb->usage;
+	for (tcb_t *thread = Q_GET_FRONT(&pcb->active_threads_list); thread;
+	     thread = Q_GET_NEXT(thread, task_thread_link)) {
+		usage_t thread_usage;
+		get_thread_usage(thread, &thread_usage);
+		usage_add(usage, &thread_usage);
+	}
+}
+
+/** @brief Folds the usage of the running thread into its task's PCB, when
+ *         the thread vanishes.
+ *
+ *  @pre tcb->owning_task->set_status_vanish_wait_mux is held
+ *  @param tcb Running thread, which is vanishing
+ *  @return Void.
+ */
+void
+fold_thread_usage( tcb_t *tcb )
+{
+	affirm(tcb && tcb == get_running_thread());
+
+	/* Charge the time slice so far, the rest of it goes uncounted */
+	usage_t usage;
+	get_thread_usage(tcb, &usage);
+	usage_add(&tcb->owning_task->usage, &usage);
+}
+
+/** @brief Folds the usage of a reaped child task, and of the child tasks it
+ *         reaped, into its parent's PCB.
+ *
+ *  @param parent Task which reaped child
+ *  @param child Vanished child task, none of whose threads run anymore
+ *  @return Void.
+ */
+void
+fold_child_usage( pcb_t *parent, pcb_t *child )
+{
+	affirm(parent && child);
+
+	mutex_lock(&parent->set_status_vanish_wait_mux);
+	usage_add(&parent->child_usage, &child->usage);
+	usage_add(&parent->child_usage, &child->child_usage);
+	mutex_unlock(&parent->set_status_vanish_wait_mux);
+}
+
+/** @brief Converts TSC cycles to milliseconds.
+ *
+ *  The timer ticks every millisecond, so this divides by the TSC cycles per
+ *  tick. Done with a single divl, which the kernel has without libgcc.
+ *
+ *  @param cycles TSC cycles
+ *  @return Milliseconds, 0 if the TSC rate is not known yet, UINT32_MAX if
+ *          too many
+ */
+uint32_t
+cycles_to_ms( uint64_t cycles )
+{
+	uint32_t per_tick = get_tsc_per_tick();
+	if (!per_tick)
+		return 0;
+
+	uint32_t hi = cycles >> 32;
+	uint32_t lo = cycles;
+	if (hi >= per_tick)
+		return UINT32_MAX;
+
+	uint32_t ms, rem;
+	__asm__("divl %4"
+	        : "=a"(ms), "=d"(rem)
+	        : "a"(lo), "d"(hi), "rm"(per_tick));
+	(void) rem;
+	return ms;
+}
+
+/** @brief Handler for the getrusage() syscall.
+ *
+ *  RUSAGE_SELF reports the usage of every thread of the calling task, active
+ *  or vanished, RUSAGE_CHILDREN that of the child tasks it has reaped and
+ *  their own reaped children, and RUSAGE_THREAD that of the calling thread.
+ *
+ *  @param who RUSAGE_SELF, RUSAGE_CHILDREN or RUSAGE_THREAD
+ *  @param rusage Where to store the usage
+ *  @return 0 on success, negative value on error
+ */
+int
+getrusage( int who, rusage_t *rusage )
+{
+	/* Acknowledge interrupt */
+	outb(INT_CTL_PORT, INT_ACK_CURRENT);
+
+	if (!is_valid_user_pointer(rusage, READ_WRITE)
+	    || !is_valid_user_pointer((char *) (rusage + 1) - 1, READ_WRITE))
+		return -1;
+
+	tcb_t *tcb = get_running_thread();
+	pcb_t *pcb = tcb->owning_task;
+	usage_t usage;
+
+	switch (who) {
+		case RUSAGE_SELF:
+			mutex_lock(&pcb->set_status_vanish_wait_mux);
+			get_task_usage(pcb, &usage);
+			mutex_unlock(&pcb->set_status_vanish_wait_mux);
+			break;
+		case RUSAGE_CHILDREN:
+			mutex_lock(&pcb->set_status_vanish_wait_mux);
+			usage = pcb->child_usage;
+			mutex_unlock(&pcb->set_status_vanish_wait_mux);
+			break;
+		case RUSAGE_THREAD:
+			get_thread_usage(tcb, &usage);
+			break;
+		default:
+			return -1;
+	}
+
+	rusage->runtime_cycles = usage.runtime;
+	rusage->runtime_ms = cycles_to_ms(usage.runtime);
+	rusage->voluntary_switches = usage.voluntary_switches;
+	rusage->involuntary_switches = usage.involuntary_switches;
+	rusage->page_faults = usage.page_faults;
+	rusage->syscalls = usage.syscalls;
+	rusage->threads = usage.threads;
+	return 0;
+}
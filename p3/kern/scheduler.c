@@ -1,42 +1,226 @@
 /** @file scheduler.c
- *	@brief A round-robin scheduler.
+ *	@brief A weighted fair scheduler.
+ *
+ *	Every thread has a nice value, from NICE_MIN to NICE_MAX, which gives it
+ *	a weight: 1024 at nice 0, and about 1.25 times less per nice step up.
+ *	A thread's virtual runtime is the CPU time it ran, in TSC cycles, scaled
+ *	by 1024 over its weight, so a thread of twice the weight accrues virtual
+ *	runtime half as fast. Runnable threads are kept in a tree ordered by
+ *	virtual runtime and each time slice goes to the leftmost one, which gives
+ *	every thread a share of the CPU proportional to its weight. Threads of
+ *	equal virtual runtime run in the order they became runnable, so threads
+ *	of equal weight take turns like in round-robin.
+ *
+ *	A thread which wakes up or is created is placed no further behind the
+ *	smallest virtual runtime than a time slice, so it runs soon but cannot
+ *	claim the time it spent blocked. Directed yields still run the thread
+ *	asked for, which keeps its own virtual runtime, and a yield to any thread
+ *	goes to the leftmost other one even if that one has run more.
+ *
+ *	Deadline threads form a class of their own, run ahead of every other
+ *	thread. A deadline thread declares a period, a runtime budget and a
+ *	relative deadline, in ticks, and each period it may run for its budget
+ *	and should be done by its deadline. Runnable deadline threads are kept in
+ *	a second tree ordered by absolute deadline, and the earliest one runs,
+ *	so on one CPU every deadline is met as long as the deadline threads'
+ *	bandwidths, budget over deadline, add up to at most one. Admission
+ *	control keeps them there. A deadline thread which runs out of budget is
+ *	throttled: it goes to the sleep queue until its next period starts,
+ *	which replenishes its budget.
+ *
+ *	Every task is in a task group, group 0 unless it joins another, and
+ *	child tasks start in their parent's. A group other than 0 may be given
+ *	a quota of CPU time per period, which the fair threads of all its tasks
+ *	share. Once they have used it up the group is throttled: its threads
+ *	are taken out of the runnable tree as they come up, and wait in the
+ *	group's throttled queue until scheduler_on_tick() starts the group's
+ *	next period. Deadline threads are not charged to their group.
+ *
+ *	When nothing is runnable, get_next_run() returns the idle thread, which
+ *	halts the CPU in the kernel, see idle.c. It is in neither runnable tree
+ *	and is charged no virtual runtime, so it never competes with other
+ *	threads, and it cannot be yielded to.
  *
  *	Note: As mutexes are implemented by manipulating the schedulers
  *	so that threads waiting on a lock are not executed, the scheduler
  *	itself uses disable/enable interrupts to protect critical sections.
- *	All critical sections protected this way must be short. */
+ *	All critical sections protected this way must be short.
+ *
+ *	Timer and keyboard handlers run on a dedicated interrupt stack, which
+ *	lets thread kernel stacks leave out room for nested interrupts. Since the
+ *	interrupt stack is not a thread's, nothing may context switch while on
+ *	it: a thread made runnable there only goes into the runnable tree and a
+ *	switch is marked as pending, as is one for a time slice ending there,
+ *	which run_irq_handler() carries out once back on the interrupted
+ *	thread's kernel stack.
+ *
+ *	Whether a thread woken by make_thread_runnable() preempts the running
+ *	thread is decided in one place, wake_preempts(), for every wakeup:
+ *	kernel mutexes, sleep(), readline(), make_runnable() and the rest.
+ *	Under WAKE_TAIL the woken thread only goes in its runnable tree, under
+ *	WAKE_PREEMPT it runs right away, and under WAKE_PREEMPT_SLICE it runs
+ *	right away only if the running thread has used a given share of its
+ *	time slice, so that a thread waking others in a tight loop is not
+ *	switched out on every wakeup. The idle thread always gives way, and
+ *	the deadline and task group rules come first.
+ *
+ *	Switching to a thread of another task writes %cr3, which flushes the
+ *	TLB. With a gang batch set, see set_gang_batch(), the next fair thread
+ *	is taken from the running thread's task rather than the leftmost one,
+ *	for up to that many switches in a row, as long as it is within a slice
+ *	per switch of the batch of the leftmost thread's virtual runtime. Its
+ *	time is charged as usual, so a task's threads only run earlier, not
+ *	more, and the leftmost thread runs once the batch is over.
+ *
+ *	A thread holding a kernel mutex others wait on runs at the nice value
+ *	of the highest priority waiter if that is lower than its own, see
+ *	mutex.c, so a thread of high nice value cannot hold up the waiters for
+ *	long. The scheduler only weighs virtual runtime with it.
+ *
+ *	Every switch charges the TSC cycles since the outgoing thread was
+ *	switched in to its usage, and counts as voluntary if the thread blocked
+ *	or yielded and as involuntary if it was preempted, see rusage.h. */
 
 #include <scheduler.h>
+#include <priority.h>		/* NICE_MIN, NICE_MAX */
+#include <deadline.h>		/* DL_MAX_PERIOD */
+#include <task_group.h>		/* TASK_GROUP_MAX, TASK_GROUP_MAX_PERIOD */
+#include <wake_policy.h>	/* WAKE_TAIL, WAKE_PREEMPT, WAKE_PREEMPT_SLICE */
+#include <gang_dispatch.h>	/* GANG_BATCH_MAX */
 #include <task_manager.h>	/* tcb_t */
 #include <task_manager_internal.h> /* To use Q MACROS on tcb */
-#include <variable_queue.h> /* Q_NEW_LINK() */
+#include <variable_tree.h> /* T_NEW_HEAD(), T_INSERT(), T_REMOVE() */
 #include <context_switch.h> /* context_switch() */
 #include <assert.h>			/* affirm() */
 #include <malloc.h>			/* smalloc(), sfree() */
 #include <stdint.h>			/* uint32_t */
 #include <cr.h>				/* get_esp0() */
 #include <logger.h>			/* log_warn() */
-#include <asm.h>			/* enable/disable_interrupts() */
+#include <asm.h>			/* enable/disable_interrupts(), rdtsc() */
 #include <iret_travel.h>
+#include <kstack.h>			/* get_irq_stack_lo() */
+#include <eflags.h>			/* get_eflags(), set_eflags() */
+#include <rusage.h>			/* usage_t */
+#include <timer_driver.h>	/* get_tsc_per_tick(), get_total_ticks() */
+#include <lib_thread_management/sleep.h> /* enqueue_sleeper() */
 #include <simics.h>
 
 /* Timer interrupts every ms, we want to swap every 2 ms. */
 #define WAIT_TICKS 2
 
+/* Bandwidth of a deadline thread, budget over relative deadline, is in
+ * units of 1 / DL_BW_ONE. Periods fit in 16 bits, so this fits in 32. */
+#define DL_BW_SHIFT 16
+#define DL_BW_ONE (1 << DL_BW_SHIFT)
+
+/* Most runnable threads gang_next_run() looks through for one of the
+ * running thread's task */
+#define GANG_SCAN_MAX 16
+
+/** @brief Whether a thread is in the deadline class */
+#define IS_DEADLINE(TCB) ((TCB)->dl_period != 0)
+
+/** @brief Nice value a fair thread runs at, counting priority inheritance */
+#define EFFECTIVE_NICE(TCB) ((TCB)->nice < (TCB)->inherited_nice \
+                             ? (TCB)->nice : (TCB)->inherited_nice)
+
+/** @brief Task group of a thread */
+#define GROUP_OF(TCB) (&task_groups[(TCB)->owning_task->task_group])
+
 /* Whether scheduler has been initialized */
 static int scheduler_init = 0;
 
 /* Whether currently in multi-threaded environment */
 static int multi_threads = 0;
 
-/* Thread queues.*/
-static queue_t runnable_q;
+/* 2^32 / weight for each nice value from NICE_MIN, where the weight is
+ * 1024 * 1.25^-nice, rounded so that neighbouring weights differ by 1.25x.
+ * Virtual runtime is scaled with these to spare a 64-bit division. */
+static const uint32_t nice_to_inv_weight[NICE_MAX - NICE_MIN + 1] = {
+	/* -20 */     48388,     59856,     76039,     92817,    118348,
+	/* -15 */    147320,    184698,    229616,    287308,    360437,
+	/* -10 */    449829,    563644,    704092,    875808,   1099582,
+	/*  -5 */   1376151,   1717299,   2157191,   2708049,   3363325,
+	/*   0 */   4194304,   5237764,   6557201,   8165337,  10153586,
+	/*   5 */  12820797,  15790320,  19976592,  24970740,  31350126,
+	/*  10 */  39045157,  49367440,  61356675,  76695844,  95443717,
+	/*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+/* Runnable threads, ordered by virtual runtime */
+T_NEW_HEAD(run_tree_t, tcb);
+static run_tree_t runnable_tree;
 static tcb_t *running_thread = NULL; // Currently running thread
 
-static void swap_running_thread( tcb_t *to_run );
+/* Runs when no other thread is runnable, never in a runnable tree */
+static tcb_t *idle_thread = NULL;
+
+/* Runnable deadline threads, ordered by absolute deadline. They run before
+ * any thread in runnable_tree */
+static run_tree_t deadline_tree;
+
+/* Sum of the bandwidths of deadline threads, at most DL_BW_ONE */
+static uint32_t total_dl_bw = 0;
+
+/** @brief CPU bandwidth of a task group. Written with interrupts disabled */
+typedef struct {
+	uint32_t quota; /* Ticks of CPU time per period, 0 if unlimited */
+	uint32_t period; /* Ticks */
+	uint32_t period_start; /* Tick the current period started at */
+	uint64_t quota_cycles; /* Quota in TSC cycles */
+	uint64_t used; /* TSC cycles run by the group this period */
+	queue_t throttled; /* Threads waiting for the next period */
+} task_group_t;
+
+static task_group_t task_groups[TASK_GROUP_MAX];
+
+/* Never decreasing lower bound on the virtual runtime of runnable threads,
+ * which threads waking up are placed against */
+static uint64_t min_vruntime = 0;
+
+/* Number of device interrupt handlers in progress, only the outermost one
+ * switches to the interrupt stack */
+static volatile int irq_depth = 0;
+
+/* Whether an interrupt handler wants the running thread switched out */
+static volatile int switch_pending = 0;
+
+/* Whether a woken thread preempts the thread waking it, see
+ * wake_preempts() */
+static int wake_policy = WAKE_DEFAULT_POLICY;
+static int wake_slice_percent = WAKE_DEFAULT_SLICE_PERCENT;
+
+/* Most switches in a row gang_next_run() keeps within a task, 0 if off,
+ * and the switches in a row made within the running thread's task */
+static uint32_t gang_batch = 0;
+static uint32_t gang_run = 0;
+
+static void swap_running_thread( tcb_t *to_run, int voluntary );
 
 static void switch_threads(tcb_t *running, tcb_t *to_run);
 
+static void charge_thread( tcb_t *tcb, uint64_t now );
+
+static void place_thread( tcb_t *tcb );
+
+static void insert_runnable( tcb_t *tcb );
+
+static void remove_runnable( tcb_t *tcb );
+
+static tcb_t *peek_next_run( void );
+
+static void leave_deadline_class( tcb_t *tcb );
+
+static void preempt_running( void );
+
+static int is_throttled( tcb_t *tcb, uint64_t now );
+
+static int refill_task_groups( unsigned int num_ticks );
+
+static int wake_preempts( tcb_t *woken );
+
+static tcb_t *gang_next_run( tcb_t *leftmost, uint64_t now );
+
 /** @brief Whether the scheduler is initialized
  *
  *	@return 1 if initialized, 0 if not. */
@@ -79,29 +263,289 @@ status_str(status_t status)
 }
 
 /** @brief Get the next tcb that should be ran while
- *		   managing the runnable queue.
+ *		   managing the runnable trees.
  *
- *  @return A runnable tcb not in the runnable queue */
+ *  @return The runnable deadline tcb with the earliest deadline if any,
+ *          else the runnable tcb with the least virtual runtime, no longer
+ *          in its runnable tree, else the idle thread */
 tcb_t *
 get_next_run( void )
 {
-	tcb_t *tcb = Q_GET_FRONT(&runnable_q);
+	tcb_t *tcb = peek_next_run();
+	if (tcb)
+		remove_runnable(tcb);
+	else
+		tcb = idle_thread;
 	if (!tcb) panic("DEADLOCK");
-	Q_REMOVE(&runnable_q, tcb, scheduler_queue);
 
 	assert(get_tcb_status(tcb) == RUNNABLE);
 	return tcb;
 }
 
-/** @brief Add thread to the runnable queue.
+/** @brief Add thread to the runnable tree of its class.
  *
- *  @param tcb Thread to add to the runnable queue
+ *  The running thread is first charged for the time it ran, any other
+ *  thread is placed, see place_thread().
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb Thread to add to the runnable tree
  *  @return Void. */
 void
 add_to_run( tcb_t *tcb )
 {
+	if (tcb == running_thread)
+		charge_thread(tcb, rdtsc());
+	else
+		place_thread(tcb);
+
+	insert_runnable(tcb);
+}
+
+/** @brief Sets the thread to run when no other thread is runnable.
+ *
+ *  @param tcb Idle thread, which must never block or vanish
+ *  @return Void. */
+void
+set_idle_thread( tcb_t *tcb )
+{
+	affirm(tcb && !idle_thread);
 	tcb->status = RUNNABLE;
-	Q_INSERT_TAIL(&runnable_q, tcb, scheduler_queue);
+	idle_thread = tcb;
+}
+
+/** @brief Sets the wakeup policy, see wake_preempts().
+ *
+ *  @param policy WAKE_TAIL, WAKE_PREEMPT or WAKE_PREEMPT_SLICE
+ *  @param slice_percent Share of its time slice in percent the running
+ *         thread must have used to be preempted under WAKE_PREEMPT_SLICE,
+ *         from 0 to 100
+ *  @return Void. */
+void
+set_scheduler_wake_policy( int policy, int slice_percent )
+{
+	affirm(policy == WAKE_TAIL || policy == WAKE_PREEMPT
+	       || policy == WAKE_PREEMPT_SLICE);
+	affirm(0 <= slice_percent && slice_percent <= 100);
+
+	disable_interrupts();
+	wake_policy = policy;
+	wake_slice_percent = slice_percent;
+	enable_interrupts();
+}
+
+/** @brief Sets how many switches in a row may go to threads of the
+ *         running thread's task, see gang_next_run().
+ *
+ *  @param batch Switches in a row, from 0 to GANG_BATCH_MAX, 0 to always
+ *         run the leftmost thread
+ *  @return Void. */
+void
+set_scheduler_gang_batch( int batch )
+{
+	affirm(0 <= batch && batch <= GANG_BATCH_MAX);
+
+	disable_interrupts();
+	gang_batch = batch;
+	enable_interrupts();
+}
+
+/** @brief Sets the nice value of a thread, which weighs its share of the
+ *         CPU from then on.
+ *
+ *  @param tcb Thread
+ *  @param nice Nice value, from NICE_MIN to NICE_MAX
+ *  @return Void. */
+void
+set_thread_nice( tcb_t *tcb, int nice )
+{
+	affirm(NICE_MIN <= nice && nice <= NICE_MAX);
+
+	disable_interrupts();
+	/* Time already run is charged at the old weight */
+	if (tcb == running_thread)
+		charge_thread(tcb, rdtsc());
+	tcb->nice = nice;
+	enable_interrupts();
+}
+
+/** @brief Gets the priority a thread waits on kernel mutexes at, which
+ *         their owners inherit, see mutex.c.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb Thread
+ *  @return Nice value it runs at, lower values first. NICE_MIN for a
+ *          deadline thread, which outranks every fair thread */
+int
+get_thread_priority( tcb_t *tcb )
+{
+	return IS_DEADLINE(tcb) ? NICE_MIN : EFFECTIVE_NICE(tcb);
+}
+
+/** @brief Sets the nice value a thread inherits from the waiters on the
+ *         mutexes it holds.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb Thread
+ *  @param nice Nice value, NICE_MAX if it inherits none
+ *  @return Void. */
+void
+set_thread_inherited_nice( tcb_t *tcb, int nice )
+{
+	affirm(NICE_MIN <= nice && nice <= NICE_MAX);
+
+	/* Every unlock gets here, mostly with nothing to change */
+	if (tcb->inherited_nice == nice)
+		return;
+
+	/* Time already run is charged at the old weight */
+	if (tcb == running_thread)
+		charge_thread(tcb, rdtsc());
+	tcb->inherited_nice = nice;
+}
+
+/** @brief Puts the running thread in the deadline class, or takes it out.
+ *
+ *  The thread's first period starts right away. Admission fails if the
+ *  bandwidths of the deadline threads would add up to more than one.
+ *
+ *  @param period Period in ticks, at most DL_MAX_PERIOD, 0 to leave the
+ *         deadline class
+ *  @param budget Ticks of CPU time per period, at least 1
+ *  @param deadline Ticks from the start of each period to its deadline,
+ *         from budget to period
+ *  @return 0 on success, negative value if admission fails */
+int
+set_thread_deadline( uint32_t period, uint32_t budget, uint32_t deadline )
+{
+	tcb_t *tcb = running_thread;
+	affirm(!period || (0 < budget && budget <= deadline && deadline <= period
+	                   && period <= DL_MAX_PERIOD));
+
+	disable_interrupts();
+	uint32_t old_bw = IS_DEADLINE(tcb)
+	                  ? (tcb->dl_budget << DL_BW_SHIFT) / tcb->dl_rel_deadline
+	                  : 0;
+	uint32_t bw = period ? (budget << DL_BW_SHIFT) / deadline : 0;
+	if (total_dl_bw - old_bw + bw > DL_BW_ONE) {
+		enable_interrupts();
+		log_info("set_thread_deadline(): admission of tid:%d failed",
+		         tcb->tid);
+		return -1;
+	}
+
+	/* Settle the time run so far in the old class */
+	charge_thread(tcb, rdtsc());
+	if (IS_DEADLINE(tcb))
+		leave_deadline_class(tcb);
+	if (period) {
+		total_dl_bw += bw;
+		tcb->dl_period = period;
+		tcb->dl_budget = budget;
+		tcb->dl_rel_deadline = deadline;
+		tcb->dl_period_start = get_total_ticks();
+		tcb->dl_deadline = tcb->dl_period_start + deadline;
+		tcb->dl_runtime = (int64_t) budget * get_tsc_per_tick();
+	}
+	enable_interrupts();
+	return 0;
+}
+
+/** @brief Ends the running deadline thread's work for its current period.
+ *
+ *  If the next period has already started, it starts it. Otherwise the
+ *  thread is to sleep until it does, see wait_period().
+ *
+ *  @param release Where to store the tick the next period starts at
+ *  @return 1 if the current period's deadline was missed, 0 if not,
+ *          negative value if the running thread is not a deadline thread */
+int
+end_thread_period( unsigned int *release )
+{
+	tcb_t *tcb = running_thread;
+	if (!IS_DEADLINE(tcb))
+		return -1;
+
+	disable_interrupts();
+	unsigned int now = get_total_ticks();
+	int missed = now > tcb->dl_deadline;
+	*release = tcb->dl_period_start + tcb->dl_period;
+	if (now >= *release) {
+		charge_thread(tcb, rdtsc());
+		place_thread(tcb);
+		*release = now;
+	}
+	enable_interrupts();
+	return missed;
+}
+
+/** @brief Lets a new thread inherit the nice value and virtual runtime of
+ *         the thread creating it.
+ *
+ *  Starting from its creator's virtual runtime keeps a thread from getting
+ *  more than its share by creating threads.
+ *
+ *  @param child New thread, not runnable yet
+ *  @param parent Thread creating it
+ *  @return Void. */
+void
+inherit_scheduling( tcb_t *child, tcb_t *parent )
+{
+	/* The creator's virtual runtime changes on ticks */
+	disable_interrupts();
+	child->nice = parent->nice;
+	child->vruntime = parent->vruntime;
+	enable_interrupts();
+}
+
+/** @brief Sets the CPU quota of a task group.
+ *
+ *  The group starts a new period right away, so threads it had throttled
+ *  become runnable again.
+ *
+ *  @param group Task group, other than 0
+ *  @param quota Ticks of CPU time per period, 0 for no quota
+ *  @param period Period in ticks, from quota to TASK_GROUP_MAX_PERIOD
+ *  @return Void. */
+void
+set_task_group_quota( int group, uint32_t quota, uint32_t period )
+{
+	affirm(0 < group && group < TASK_GROUP_MAX);
+	affirm(!quota || (quota <= period && period <= TASK_GROUP_MAX_PERIOD));
+
+	disable_interrupts();
+	/* Time already run counts towards the old quota */
+	charge_thread(running_thread, rdtsc());
+
+	task_group_t *tg = &task_groups[group];
+	tg->quota = quota;
+	tg->period = period;
+	tg->quota_cycles = (uint64_t) quota * get_tsc_per_tick();
+	tg->period_start = get_total_ticks();
+	tg->used = 0;
+	while (Q_GET_FRONT(&tg->throttled)) {
+		tcb_t *tcb = Q_GET_FRONT(&tg->throttled);
+		Q_REMOVE(&tg->throttled, tcb, scheduler_queue);
+		add_to_run(tcb);
+	}
+	enable_interrupts();
+}
+
+/** @brief Moves a task to a task group.
+ *
+ *  @param pcb Task
+ *  @param group Task group, from 0 to TASK_GROUP_MAX - 1
+ *  @return Void. */
+void
+set_task_group( pcb_t *pcb, int group )
+{
+	affirm(0 <= group && group < TASK_GROUP_MAX);
+
+	disable_interrupts();
+	/* Time already run counts towards the old group */
+	if (running_thread->owning_task == pcb)
+		charge_thread(running_thread, rdtsc());
+	pcb->task_group = group;
+	enable_interrupts();
 }
 
 /** @brief Yield execution of current thread, storing it at
@@ -141,37 +585,50 @@ yield_execution( status_t store_status, tcb_t *tcb,
 			panic("Trying to store thread with unknown status!");
 			break;
 	}
+	affirm_msg(!irq_depth, "yield_execution() on the interrupt stack");
 	disable_interrupts();
 
-	if (tcb && (get_tcb_status(tcb) != RUNNABLE)
-		&& (get_tcb_status(tcb) != RUNNING)) {
+	if (tcb && (tcb == idle_thread || ((get_tcb_status(tcb) != RUNNABLE)
+		&& (get_tcb_status(tcb) != RUNNING)))) {
 		log_warn("Trying to yield_execution to non-runnable or running"
 				 " thread with tid %d", tcb->tid);
 		enable_interrupts();
 		return -1;
 	}
 
-	/* Callback/Add self to end of queue */
+	/* A dead thread gives its bandwidth back */
+	if (store_status == DEAD && IS_DEADLINE(running_thread)) {
+		charge_thread(running_thread, rdtsc());
+		leave_deadline_class(running_thread);
+	}
+
+	/* Callback/Add self to runnable tree */
 	running_thread->status = store_status;
-	if (store_status == RUNNABLE)
+	if (store_status == RUNNABLE) {
+		/* A yield to any thread goes to the leftmost other thread, even if it
+		 * has more virtual runtime than this one, so yielding always lets
+		 * another thread run */
+		if (!tcb && (tcb = peek_next_run()))
+			remove_runnable(tcb);
 		add_to_run(running_thread);
-	else if (callback)
+	} else if (callback) {
 		callback(running_thread, data);
+	}
 
 	/* Get tcb to swap to */
 	if (!tcb)
 		tcb = get_next_run();
 
 	else {
-		/* Ensure this thread is no longer in the runnable queue */
+		/* Ensure this thread is no longer in the runnable tree */
 		/* In the case where a waiting thread is made runnable by a vanished
 		 * child task thread that wakes it up, the waiting thread's TCB
-		 * will not be in the runnable_q and so no removing is needed */
-		if (Q_IN_SOME_QUEUE(tcb, scheduler_queue))
-			Q_REMOVE(&runnable_q, tcb, scheduler_queue);
+		 * will not be in the runnable tree and so no removing is needed */
+		if (T_IN_TREE(tcb, run_tree_link))
+			remove_runnable(tcb);
 	}
 
-	swap_running_thread(tcb);
+	swap_running_thread(tcb, 1);
 	return 0;
 }
 
@@ -225,7 +682,12 @@ init_scheduler( void )
 	/* Initialize once and only once */
 	affirm(!scheduler_init);
 
-	Q_INIT_HEAD(&runnable_q);
+	T_INIT_HEAD(&runnable_tree);
+	T_INIT_HEAD(&deadline_tree);
+	for (int i = 0; i < TASK_GROUP_MAX; ++i) {
+		task_groups[i].quota = 0;
+		Q_INIT_HEAD(&task_groups[i].throttled);
+	}
 
 	scheduler_init = 1;
 
@@ -252,7 +714,7 @@ make_thread_runnable_helper( tcb_t *tcbp, int switch_safe )
 	log("Making thread %d runnable", tcbp->tid);
 
 
-	/* Add tcb to runnable queue, as any thread starts as runnable */
+	/* Add tcb to runnable tree, as any thread starts as runnable */
 	disable_interrupts();
 
 	if (tcbp->status == RUNNABLE || tcbp->status == RUNNING) {
@@ -267,11 +729,25 @@ make_thread_runnable_helper( tcb_t *tcbp, int switch_safe )
 	if (tcbp->status == UNINITIALIZED || switch_safe) {
 		add_to_run(tcbp);
 	} else {
-		/* "Improve" preemptibility by immediately swapping to thread
-		 * being made runnable. To avoid doing so for newly registered
-		 * threads, only swap immediately if status != UNINITIALIZED. */
-		add_to_run(running_thread);
-		swap_running_thread(tcbp);
+		/* Newly registered threads, UNINITIALIZED, never preempt. Woken
+		 * ones do as the wakeup policy says */
+		place_thread(tcbp);
+		int preempt = wake_preempts(tcbp);
+		if (irq_depth) {
+			/* Cannot switch on the interrupt stack, the leftmost thread
+			 * runs once off it. That is this one unless it ran more than
+			 * its share before blocking */
+			insert_runnable(tcbp);
+			if (preempt)
+				switch_pending = 1;
+			return 0;
+		}
+		if (preempt) {
+			add_to_run(running_thread);
+			swap_running_thread(tcbp, 0);
+		} else {
+			insert_runnable(tcbp);
+		}
 	}
 
 	if (!switch_safe)
@@ -306,6 +782,50 @@ make_thread_runnable( tcb_t *tcbp )
 	return make_thread_runnable_helper(tcbp, 0);
 }
 
+/** @brief Makes every thread of a queue runnable at once.
+ *
+ *  Each is placed and queued as make_thread_runnable() would, but whether
+ *  to preempt the running thread is only acted on once, after all of them
+ *  are queued, by switching to the thread to run next. So waking many
+ *  threads costs one switch at most, rather than possibly one per thread.
+ *
+ *	@param woken Queue of BLOCKED threads, linked through scheduler_queue,
+ *	       empty on return
+ *	@return Number of threads made runnable */
+int
+make_threads_runnable( queue_t *woken )
+{
+	affirm(scheduler_init && woken);
+
+	disable_interrupts();
+	int count = 0;
+	int preempt = 0;
+	tcb_t *tcbp;
+	while ((tcbp = Q_GET_FRONT(woken))) {
+		Q_REMOVE(woken, tcbp, scheduler_queue);
+		affirm(tcbp->status == BLOCKED);
+		place_thread(tcbp);
+		preempt |= wake_preempts(tcbp);
+		insert_runnable(tcbp);
+		count++;
+	}
+
+	/* As in make_thread_runnable_helper(), no switch on the interrupt
+	 * stack */
+	if (irq_depth) {
+		if (preempt)
+			switch_pending = 1;
+		return count;
+	}
+	if (preempt) {
+		add_to_run(running_thread);
+		swap_running_thread(get_next_run(), 0);
+	} else {
+		enable_interrupts();
+	}
+	return count;
+}
+
 /** @brief Sets the very first running thread for the scheduler
  *
  *  @return Void.
@@ -317,6 +837,7 @@ start_first_running_thread( void )
 	tcb_t *first_thread = get_next_run();
 	affirm(first_thread);
 	first_thread->status = RUNNING;
+	first_thread->run_start = rdtsc();
 	running_thread = first_thread;
 
 	affirm(first_thread->owning_task);
@@ -341,6 +862,9 @@ start_first_running_thread( void )
 
 
 /** @brief Callback for ticks.
+ *
+ *  Runs in the timer interrupt handler, whose interrupt gate leaves
+ *  interrupts disabled, and nothing here enables them.
  *
  *  @param num_ticks Number of ticks since startup
  *  @return Void.
@@ -351,15 +875,298 @@ scheduler_on_tick( unsigned int num_ticks )
 	if (!scheduler_init)
 		return;
 
-	if (num_ticks % WAIT_TICKS == 0) {
+	int unthrottled = refill_task_groups(num_ticks);
+
+	/* A deadline thread or task group is throttled on the first tick it is
+	 * out of budget, not just at the end of a time slice */
+	int out_of_budget = 0;
+	if (running_thread) {
+		uint64_t now = rdtsc();
+		out_of_budget = IS_DEADLINE(running_thread)
+		    ? running_thread->dl_runtime
+		      <= (int64_t) (now - running_thread->run_start)
+		    : is_throttled(running_thread, now);
+	}
+
+	if (num_ticks % WAIT_TICKS == 0 || out_of_budget || unthrottled) {
+		if (irq_depth) {
+			switch_pending = 1;
+			return;
+		}
 		disable_interrupts();
-		add_to_run(running_thread);
-		swap_running_thread(get_next_run());
+		preempt_running();
 	}
 }
 
+/** @brief Runs a device interrupt handler on the interrupt stack, then
+ *         switches threads if the handler asked to.
+ *
+ *  Nested interrupts stay on the interrupt stack. A switch asked for by any
+ *  of them is carried out by the outermost one, on the interrupted thread's
+ *  kernel stack.
+ *
+ *  @param handler Interrupt handler
+ *  @return Void.
+ */
+void
+run_irq_handler( void (*handler)( void ) )
+{
+	char *irq_stack_lo = get_irq_stack_lo();
+
+	/* Interrupts taken while booting run on the boot stack */
+	if (irq_depth++ || !irq_stack_lo) {
+		handler();
+		irq_depth--;
+		return;
+	}
+	call_on_stack(handler, irq_stack_lo + IRQ_STACK_SIZE);
+	irq_depth--;
+
+	/* Leave the interrupt flag as the interrupt gate set it if not
+	 * switching */
+	uint32_t eflags = get_eflags();
+	disable_interrupts();
+	if (!switch_pending || !scheduler_init || !running_thread) {
+		switch_pending = 0;
+		set_eflags(eflags);
+		return;
+	}
+	switch_pending = 0;
+	preempt_running();
+}
+
 /* ------- HELPER FUNCTIONS -------- */
 
+/** @brief Switches the running thread out for the next one to run, after
+ *         putting it back in its runnable tree or, if it is a deadline
+ *         thread out of budget, throttling it until its next period.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@return Void.
+ */
+static void
+preempt_running( void )
+{
+	tcb_t *tcb = running_thread;
+	charge_thread(tcb, rdtsc());
+
+	if (IS_DEADLINE(tcb) && tcb->dl_runtime <= 0) {
+		/* Throttle it, unless its next period already started */
+		unsigned int release = tcb->dl_period_start + tcb->dl_period;
+		if (get_total_ticks() < release) {
+			tcb->status = BLOCKED;
+			enqueue_sleeper(tcb, release);
+			swap_running_thread(get_next_run(), 0);
+			return;
+		}
+		place_thread(tcb);
+	}
+	insert_runnable(tcb);
+	swap_running_thread(get_next_run(), 0);
+}
+
+/** @brief Whether a thread being woken should preempt the running thread.
+ *
+ *  This is the one place the wakeup policy is applied.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param woken Thread being woken, placed already
+ *	@return 1 if it should run right away, 0 if it should only be queued
+ */
+static int
+wake_preempts( tcb_t *woken )
+{
+	tcb_t *running = running_thread;
+	if (running == idle_thread)
+		return 1;
+
+	/* Deadline threads only give way to earlier deadlines, and throttled
+	 * threads wait for their group's next period */
+	if (IS_DEADLINE(running))
+		return IS_DEADLINE(woken) && woken->dl_deadline < running->dl_deadline;
+	if (IS_DEADLINE(woken))
+		return 1;
+	if (is_throttled(woken, rdtsc()))
+		return 0;
+
+	switch (wake_policy) {
+		case WAKE_TAIL:
+			return 0;
+		case WAKE_PREEMPT:
+			return 1;
+		default: {
+			/* run_start is reset whenever the thread is charged, so this
+			 * is the time used of the current slice */
+			uint64_t used = rdtsc() - running->run_start;
+			uint64_t slice = (uint64_t) WAIT_TICKS * get_tsc_per_tick();
+			return used * 100 >= slice * wake_slice_percent;
+		}
+	}
+}
+
+/** @brief Inserts a thread in the runnable tree of its class.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param tcb Thread, charged or placed already. The idle thread is only
+ *	       marked runnable
+ *	@return Void.
+ */
+static void
+insert_runnable( tcb_t *tcb )
+{
+	tcb->status = RUNNABLE;
+	if (tcb == idle_thread)
+		return;
+	if (IS_DEADLINE(tcb))
+		T_INSERT(&deadline_tree, tcb, dl_deadline, run_tree_link);
+	else
+		T_INSERT(&runnable_tree, tcb, vruntime, run_tree_link);
+}
+
+/** @brief Removes a thread from the runnable tree of its class.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param tcb Runnable thread
+ *	@return Void.
+ */
+static void
+remove_runnable( tcb_t *tcb )
+{
+	if (IS_DEADLINE(tcb))
+		T_REMOVE(&deadline_tree, tcb, run_tree_link);
+	else
+		T_REMOVE(&runnable_tree, tcb, run_tree_link);
+}
+
+/** @brief Gets the thread get_next_run() would take without taking it.
+ *
+ *  Threads of throttled task groups which come up on the way are moved to
+ *  their group's throttled queue. With a gang batch set, a fair thread of
+ *  the running thread's task may be taken over the leftmost one, see
+ *  gang_next_run().
+ *
+ *	@pre Interrupts disabled when called.
+ *	@return Runnable thread, NULL if there is none
+ */
+static tcb_t *
+peek_next_run( void )
+{
+	tcb_t *tcb = T_GET_MIN(&deadline_tree);
+	if (tcb)
+		return tcb;
+
+	uint64_t now = rdtsc();
+	while ((tcb = T_GET_MIN(&runnable_tree)) && is_throttled(tcb, now)) {
+		T_REMOVE(&runnable_tree, tcb, run_tree_link);
+		tcb->status = BLOCKED;
+		Q_INSERT_TAIL(&GROUP_OF(tcb)->throttled, tcb, scheduler_queue);
+	}
+	if (tcb && gang_batch)
+		tcb = gang_next_run(tcb, now);
+	return tcb;
+}
+
+/** @brief Picks a runnable thread of the running thread's task to run
+ *         instead of the leftmost one, which keeps the TLB warm.
+ *
+ *  Only a thread within gang_batch time slices of the leftmost thread's
+ *  virtual runtime, among the first GANG_SCAN_MAX runnable threads, is
+ *  taken, and only for gang_batch switches in a row, so that other tasks
+ *  wait for a bounded time.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param leftmost Leftmost fair thread, not throttled
+ *	@param now Current TSC
+ *	@return Thread to run next
+ */
+static tcb_t *
+gang_next_run( tcb_t *leftmost, uint64_t now )
+{
+	tcb_t *running = running_thread;
+	if (!running || gang_run >= gang_batch
+	    || leftmost->owning_task == running->owning_task)
+		return leftmost;
+
+	uint64_t window = (uint64_t) gang_batch * WAIT_TICKS
+	                  * get_tsc_per_tick();
+	tcb_t *tcb = leftmost;
+	for (int i = 0; tcb && i < GANG_SCAN_MAX; ++i) {
+		if (tcb->vruntime - leftmost->vruntime > window)
+			break;
+		if (tcb != running && tcb->owning_task == running->owning_task
+		    && !is_throttled(tcb, now))
+			return tcb;
+		tcb = T_GET_NEXT(tcb, run_tree_link);
+	}
+	return leftmost;
+}
+
+/** @brief Whether a fair thread's task group has used up its quota.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param tcb Fair thread
+ *	@param now Current TSC, counting the running thread's time slice so far
+ *	@return 1 if it has, 0 if not
+ */
+static int
+is_throttled( tcb_t *tcb, uint64_t now )
+{
+	task_group_t *tg = GROUP_OF(tcb);
+	if (!tg->quota)
+		return 0;
+
+	uint64_t used = tg->used;
+	if (tcb == running_thread)
+		used += now - tcb->run_start;
+	return used >= tg->quota_cycles;
+}
+
+/** @brief Starts a new period for every task group whose current one is
+ *         over, making the threads it throttled runnable again.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param num_ticks Number of ticks since startup
+ *	@return 1 if any thread was made runnable, 0 if not
+ */
+static int
+refill_task_groups( unsigned int num_ticks )
+{
+	int unthrottled = 0;
+
+	for (int i = 1; i < TASK_GROUP_MAX; ++i) {
+		task_group_t *tg = &task_groups[i];
+		if (!tg->quota || num_ticks - tg->period_start < tg->period)
+			continue;
+		tg->period_start = num_ticks;
+		tg->used = 0;
+		while (Q_GET_FRONT(&tg->throttled)) {
+			tcb_t *tcb = Q_GET_FRONT(&tg->throttled);
+			Q_REMOVE(&tg->throttled, tcb, scheduler_queue);
+			add_to_run(tcb);
+			unthrottled = 1;
+		}
+	}
+	return unthrottled;
+}
+
+/** @brief Takes a thread out of the deadline class, giving back its
+ *         bandwidth.
+ *
+ *	@pre Interrupts disabled when called.
+ *	@param tcb Deadline thread which is not in a runnable tree
+ *	@return Void.
+ */
+static void
+leave_deadline_class( tcb_t *tcb )
+{
+	total_dl_bw -= (tcb->dl_budget << DL_BW_SHIFT) / tcb->dl_rel_deadline;
+	tcb->dl_period = 0;
+
+	/* Its virtual runtime stood still meanwhile */
+	if (tcb->vruntime < min_vruntime)
+		tcb->vruntime = min_vruntime;
+}
+
 /** @brief Swaps the running thread to to_run.
  *
  *	@pre Interrupts disabled when called.
@@ -368,10 +1175,12 @@ scheduler_on_tick( unsigned int num_ticks )
  *					is blocked. For any other store status scheduler determines
  *					queue to store thread into.
  *	@param store_status	Status with which to store old thread.
+ *	@param voluntary 1 if the running thread blocks or yields, 0 if it is
+ *	       preempted
  *	@return Void.
  */
 static void
-swap_running_thread( tcb_t *to_run )
+swap_running_thread( tcb_t *to_run, int voluntary )
 {
 	assert(to_run);
 	affirm_msg(scheduler_init, "Scheduler has to be initialized before calling "
@@ -380,6 +1189,7 @@ swap_running_thread( tcb_t *to_run )
 	/* No-op if we swap with ourselves */
 	if (to_run->tid == running_thread->tid) {
 		affirm(to_run->status == RUNNABLE);
+		to_run->status = RUNNING;
 		enable_interrupts();
 		return;
 	}
@@ -388,6 +1198,17 @@ swap_running_thread( tcb_t *to_run )
 	to_run->status = RUNNING;
 	running_thread = to_run;
 
+	/* Switches in a row within a task, see gang_next_run() */
+	if (to_run->owning_task != running->owning_task)
+		gang_run = 0;
+	else if (gang_run < GANG_BATCH_MAX)
+		gang_run++;
+
+	if (voluntary)
+		running->usage.voluntary_switches++;
+	else
+		running->usage.involuntary_switches++;
+
 	/* Interrupts are enabled inside context switch, once it's safe to do so. */
 	switch_threads(running, to_run);
 
@@ -407,12 +1228,109 @@ switch_threads(tcb_t *running, tcb_t *to_run)
 	assert(running && to_run);
 	assert(to_run->tid != running->tid);
 
+	/* Charge the time slice that just ended. A thread put back in the
+	 * runnable tree was charged as it went in, and its key must not change
+	 * in the tree, so the cycles since only count towards its usage */
+	uint64_t now = rdtsc();
+	if (T_IN_TREE(running, run_tree_link))
+		running->usage.runtime += now - running->run_start;
+	else
+		charge_thread(running, now);
+	to_run->run_start = now;
+
 	/* Let thread know where to come back to on USER->KERN mode switch */
 	set_esp0((uint32_t)to_run->kernel_stack_hi);
 
 	context_switch((void **)&(running->kernel_esp), to_run->kernel_esp);
 }
 
+/** @brief Scales CPU time by 1024 over the weight of a nice value.
+ *
+ *  Computes (delta * inverse weight) >> 22 from 32x32 bit products, as
+ *  delta may not fit in 32 bits.
+ *
+ *  @param delta CPU time in TSC cycles
+ *  @param nice Nice value
+ *  @return Virtual runtime
+ */
+static uint64_t
+scale_by_weight( uint64_t delta, int nice )
+{
+	uint64_t inv_weight = nice_to_inv_weight[nice - NICE_MIN];
+	uint64_t hi = (delta >> 32) * inv_weight;
+	uint64_t lo = (delta & 0xffffffff) * inv_weight;
+	return (hi << 10) + (lo >> 22);
+}
+
+/** @brief Charges a running thread for the time since it last was, to its
+ *         usage and its virtual runtime and task group, or its budget if it
+ *         is a deadline thread.
+ *
+ *  @pre Interrupts disabled when called, tcb not in a runnable tree.
+ *  @param tcb Thread running until now
+ *  @param now Current TSC
+ *  @return Void.
+ */
+static void
+charge_thread( tcb_t *tcb, uint64_t now )
+{
+	assert(!T_IN_TREE(tcb, run_tree_link));
+
+	uint64_t delta = now - tcb->run_start;
+	tcb->run_start = now;
+	tcb->usage.runtime += delta;
+	if (tcb == idle_thread)
+		return;
+	if (IS_DEADLINE(tcb)) {
+		tcb->dl_runtime -= (int64_t) delta;
+		return;
+	}
+	GROUP_OF(tcb)->used += delta;
+	tcb->vruntime += scale_by_weight(delta, EFFECTIVE_NICE(tcb));
+
+	/* Nothing runnable is further behind than both tcb and the leftmost
+	 * thread */
+	uint64_t vruntime = tcb->vruntime;
+	tcb_t *leftmost = T_GET_MIN(&runnable_tree);
+	if (leftmost && leftmost->vruntime < vruntime)
+		vruntime = leftmost->vruntime;
+	if (vruntime > min_vruntime)
+		min_vruntime = vruntime;
+}
+
+/** @brief Places a thread about to become runnable no further behind the
+ *         smallest virtual runtime than a time slice. A deadline thread
+ *         instead starts a new period if its current one is over.
+ *
+ *  Periods start a period apart, unless a whole period went by since the
+ *  last one should have started, then the new one starts now.
+ *
+ *  @pre Interrupts disabled when called.
+ *  @param tcb Thread which is not in a runnable tree
+ *  @return Void.
+ */
+static void
+place_thread( tcb_t *tcb )
+{
+	if (IS_DEADLINE(tcb)) {
+		unsigned int now = get_total_ticks();
+		unsigned int start = tcb->dl_period_start + tcb->dl_period;
+		if (now < start)
+			return;
+		if (now >= start + tcb->dl_period)
+			start = now;
+		tcb->dl_period_start = start;
+		tcb->dl_deadline = start + tcb->dl_rel_deadline;
+		tcb->dl_runtime = (int64_t) tcb->dl_budget * get_tsc_per_tick();
+		return;
+	}
+
+	uint64_t credit = (uint64_t) WAIT_TICKS * get_tsc_per_tick();
+	uint64_t floor = min_vruntime > credit ? min_vruntime - credit : 0;
+	if (tcb->vruntime < floor)
+		tcb->vruntime = floor;
+}
+
 /** @brief Whether we have multiple threads registered with the scheduler
  *
  *  @return 1 if there are multiple threads, 0 if not */
@@ -27,9 +27,22 @@ void start_first_running_thread( void );
 
 int get_running_tid( void );
 void scheduler_on_tick( unsigned int num_ticks );
+void run_irq_handler( void (*handler)( void ) );
 int make_thread_runnable( tcb_t *tcbp );
 int switch_safe_make_thread_runnable( tcb_t *tcbp );
+int make_threads_runnable( queue_t *woken );
 int yield_execution( status_t store_status, tcb_t *tcb,
 		void (*callback)(tcb_t *, void *), void *data );
+void set_idle_thread( tcb_t *tcb );
+void set_scheduler_wake_policy( int policy, int slice_percent );
+void set_scheduler_gang_batch( int batch );
+void set_thread_nice( tcb_t *tcb, int nice );
+int get_thread_priority( tcb_t *tcb );
+void set_thread_inherited_nice( tcb_t *tcb, int nice );
+void inherit_scheduling( tcb_t *child, tcb_t *parent );
+int set_thread_deadline( uint32_t period, uint32_t budget, uint32_t deadline );
+int end_thread_period( unsigned int *release );
+void set_task_group_quota( int group, uint32_t quota, uint32_t period );
+void set_task_group( pcb_t *pcb, int group );
 
 #endif /* SCHEDULER_H_ */
@@ -0,0 +1,121 @@
+/** @file sysenter.c
+ *  @brief Fast system call entry with sysenter and sysexit
+ *
+ *  On CPUs which have them, user programs may make most system calls with
+ *  sysenter instead of INT, putting the INT gate's vector in %eax and the
+ *  argument, or argument packet address, in %esi as usual. sysenter and
+ *  sysexit skip the IDT and the privilege checks of INT and iret, and the
+ *  entry in sysenter.S saves only what INT and the syscall wrappers would
+ *  leave different, so it is cheaper. The INT gates stay for every system
+ *  call.
+ *
+ *  The entry lays out the same frame at the top of the kernel stack as an
+ *  INT from user mode. It is not used for the system calls which replace
+ *  or copy that frame, such as fork(), exec() and swexn(), nor for those
+ *  which never return.
+ *
+ *  sysenter loads %esp from IA32_SYSENTER_ESP, which points at the top of
+ *  a small stack of its own holding the address of esp0 in the TSS, so the
+ *  entry finds the running thread's kernel stack there without having to
+ *  update the MSR on every context switch. The stack is not the TSS itself
+ *  since sysenter keeps EFL_TF: a single stepping thread takes a debug trap
+ *  on the first instruction of the entry, with %esp as sysenter left it.
+ *
+ *  The entry clears the user's flags before running kernel code, as INT
+ *  gates do, since an EFL_NT left set would turn the next iret into a task
+ *  return.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <sysenter.h>
+#include <asm.h>		/* wrmsr() */
+#include <seg.h>		/* SEGSEL_KERNEL_CS, SEGSEL_TSS */
+#include <gdt.h>		/* gdt_base_addr() */
+#include <assert.h>		/* affirm() */
+#include <stddef.h>		/* NULL */
+#include <logger.h>		/* log_info() */
+#include <rusage.h>		/* count_syscall() */
+
+typedef int (*syscall_0_t)( void );
+typedef int (*syscall_1_t)( uint32_t );
+typedef int (*syscall_2_t)( uint32_t, uint32_t );
+typedef int (*syscall_3_t)( uint32_t, uint32_t, uint32_t );
+typedef int (*syscall_4_t)( uint32_t, uint32_t, uint32_t, uint32_t );
+
+/* Fast system calls by vector, NULL for the ones only the INT gates take */
+static fast_syscall_t *fast_table[SYSENTER_VECTORS];
+
+/* Stack sysenter starts on, its top word holds the address of esp0 */
+static uint32_t sysenter_stack[SYSENTER_STACK_WORDS];
+
+/** @brief Sets up sysenter if the CPU has it.
+ *
+ *  @return 0 on success, including when the CPU does not have sysenter,
+ *          negative value on error
+ */
+int
+install_sysenter( void )
+{
+	if (!(cpuid_edx(CPUID_FEATURES) & CPUID_SEP)) {
+		log_info("install_sysenter(): no sysenter, INT gates only");
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < num_fast_syscalls; ++i) {
+		fast_syscall_t *sc = &fast_syscalls[i];
+		if (sc->vector >= SYSENTER_VECTORS || !sc->handler
+		    || sc->num_args > 4 || fast_table[sc->vector])
+			return -1;
+		fast_table[sc->vector] = sc;
+	}
+
+	/* Base address of the TSS, scattered over its GDT descriptor */
+	uint8_t *desc = (uint8_t *) gdt_base_addr() + SEGSEL_TSS;
+	uint32_t tss = desc[2] | (desc[3] << 8) | (desc[4] << 16)
+	               | ((uint32_t) desc[7] << 24);
+
+	uint32_t *top = &sysenter_stack[SYSENTER_STACK_WORDS - 1];
+	*top = tss + TSS_ESP0_OFFSET;
+
+	wrmsr(IA32_SYSENTER_CS, SEGSEL_KERNEL_CS);
+	wrmsr(IA32_SYSENTER_ESP, (uint32_t) top);
+	wrmsr(IA32_SYSENTER_EIP, (uint32_t) sysenter_handler);
+	return 0;
+}
+
+/** @brief Calls the handler of a system call made with sysenter.
+ *
+ *  Arguments are passed as the INT gates' wrappers pass them, see
+ *  asm_interrupt_handler_template.h.
+ *
+ *  @param vector IDT vector of the system call's INT gate
+ *  @param args Argument, or address of the argument packet, from %esi
+ *  @return What the handler returns, negative value if the system call is
+ *          not made with sysenter
+ */
+int
+sysenter_dispatch( uint32_t vector, uint32_t *args )
+{
+	/* Charge the syscall to the running thread, see rusage.c */
+	count_syscall();
+
+	fast_syscall_t *sc = vector < SYSENTER_VECTORS ? fast_table[vector]
+	                                               : NULL;
+	if (!sc)
+		return -1;
+
+	switch (sc->num_args) {
+		case 0:
+			return ((syscall_0_t) sc->handler)();
+		case 1:
+			return ((syscall_1_t) sc->handler)((uint32_t) args);
+		case 2:
+			return ((syscall_2_t) sc->handler)(args[0], args[1]);
+		case 3:
+			return ((syscall_3_t) sc->handler)(args[0], args[1], args[2]);
+		default:
+			return ((syscall_4_t) sc->handler)(args[0], args[1], args[2],
+			                                   args[3]);
+	}
+}
@@ -21,41 +21,41 @@
 #include <simics.h>	/* sim_reg_process */
 #include <logger.h>	/* log */
 #include <iret_travel.h>	/* iret_travel */
-#include <atomic_utils.h>	/* add_one_atomic */
+#include <idr.h>	/* idr_t */
+#include <kstack.h>	/* kstack_alloc, kstack_free */
+#include <rusage.h>	/* usage_init */
+#include <reaper.h>	/* reap_tcb_later */
+#include <priority.h>	/* NICE_MAX */
+#include <atomic_utils.h>	/* add_one_atomic, compare_and_swap_atomic */
 #include <memory_manager.h> /* get_new_page_table, vm_enable_task */
 #include <variable_queue.h> /* Q_INSERT_TAIL */
-#include <lib_thread_management/hashmap.h>	/* map_* functions */
+#include <variable_htable.h>	/* H_INSERT, H_GET, H_REMOVE, H_QUIESCENT */
+#include <variable_tree.h>	/* T_INIT_ELEM, T_IN_TREE */
 #include <lib_thread_management/mutex.h>	/* mutex_t */
+#include <lib_thread_management/rwlock.h>	/* rwlock_t */
 #include <lib_memory_management/memory_management.h> /* new_pages */
 
 #define ELF_IF (1 << 9);
 
 
-static uint32_t get_unique_tid( void );
-static uint32_t get_unique_pid( void );
+/* pid -> PCB, and allocator of the lowest free pid. A task's pid is held by
+ * the task until it is reaped. The PCB is only found by find_pcb() from
+ * creation until remove_pcb(). */
+static idr_t pid_idr;
 
-Q_NEW_HEAD(pcb_list_t, pcb);
-static pcb_list_t pcb_list;
+/* Allocator of the lowest free tid, find_tcb() goes through the tid map.
+ * A tid is held by its TCB, and a task's first thread tid also by its PCB
+ * until the task is reaped, since wait() returns it. */
+static idr_t tid_idr;
 
 /* List of PCBs whose running task is init() */
 Q_NEW_HEAD(init_pcb_list_t, pcb);
 static init_pcb_list_t init_pcb_list;
-static mutex_t init_pcb_list_mux;
+static rwlock_t init_pcb_list_lock;
 
-static mutex_t pcb_list_mux;
-static mutex_t tcb_map_mux;
-
-/** @brief Next tid to be assigned. Only to be updated by get_unique_tid
- *
- *  This starts from 1 since an uninitialized tid is 0, so we know that
- *  for any pcb such that pcb->first_thread_tid = 0 we know that within
- *  a particular call to create_tcb() we are creating the first thread
- *  of a task
- */
-static uint32_t next_tid = 1;
-
-/** @brief Next pid to be assigned. Only to be updated by get_unique_pid */
-static uint32_t next_pid = 1;
+/* tid -> TCB, for find_tcb(). Lookups take no lock, see variable_htable.h.
+ * A TCB removed from it is only freed once no lookup may still see it. */
+static htable_t tcb_table;
 
 
 /** @brief Gets the pd for a TCB pointer
@@ -108,11 +108,13 @@ set_task_exit_status( int status )
 void
 task_manager_init ( void )
 {
-	map_init();
-	mutex_init(&pcb_list_mux);
-	mutex_init(&init_pcb_list_mux);
-	mutex_init(&tcb_map_mux);
-	Q_INIT_HEAD(&pcb_list);
+	rwlock_init(&init_pcb_list_lock);
+	affirm(H_INIT_TABLE(&tcb_table) == 0);
+
+	/* ID 0 is never handed out, so a tid of 0 means uninitialized and a
+	 * parent pid of 0 means no parent */
+	affirm(idr_init(&pid_idr) == 0);
+	affirm(idr_init(&tid_idr) == 0);
 }
 
 /** @brief Gets the status of a tcb
@@ -251,15 +253,34 @@ task_start( uint32_t tid, uint32_t user_esp, uint32_t entry_point )
 pcb_t *
 find_pcb( uint32_t pid )
 {
-	mutex_lock(&pcb_list_mux);
-	pcb_t *res = Q_GET_FRONT(&pcb_list);
-	while (res && res->pid != pid)
-		res = Q_GET_NEXT(res, task_link);
-	mutex_unlock(&pcb_list_mux);
-	return res;
+	return idr_find(&pid_idr, pid);
+}
+
+/** @brief Takes a reference on a PCB found by pid, see idr_find_hold()
+ *
+ *  @param pcb PCB
+ *  @return Void.
+ */
+static void
+hold_pcb( void *pcb )
+{
+	get_pcb(pcb);
+}
+
+/** @brief Looks for pcb with given pid, and takes a reference on it so that
+ *         it can be used until put_pcb() even if the task is reaped.
+ *
+ *	@param pid Task id to look for
+ *	@return Pointer to pcb on success, NULL on failure */
+pcb_t *
+find_and_get_pcb( uint32_t pid )
+{
+	return idr_find_hold(&pid_idr, pid, hold_pcb);
 }
 
-/** @brief Removes a PCB from system wide list of PCBs.
+/** @brief Hides a PCB from find_pcb(). Its pid is not recycled until the
+ *         task is reaped and all its child tasks are gone.
+ *
  *  @param pcbp PCB pointer
  *  @return Void.
  */
@@ -267,12 +288,53 @@ void
 remove_pcb( pcb_t *pcbp )
 {
 	affirm(pcbp);
-	mutex_lock(&pcb_list_mux);
-	Q_REMOVE(&pcb_list, pcbp, task_link);
-	mutex_unlock(&pcb_list_mux);
+	idr_set(&pid_idr, pcbp->pid, NULL);
+}
+
+/* Function and data for_each_task() calls */
+typedef struct {
+	void (*fn)( pcb_t *pcb, void *data );
+	void *data;
+} for_each_task_t;
+
+/** @brief Calls for_each_task()'s function on a PCB found by pid
+ *
+ *  @param pid Unused
+ *  @param pcb PCB
+ *  @param data Function and data to call it with
+ *  @return Void.
+ */
+static void
+for_each_task_helper( uint32_t pid, void *pcb, void *data )
+{
+	for_each_task_t *call = data;
+	call->fn(pcb, call->data);
+}
+
+/** @brief Calls a function on the PCB of every task find_pcb() can find,
+ *         in increasing pid order.
+ *
+ *  The function runs with the pid map locked, so no PCB it is called on can
+ *  be removed or freed under it. It must be short, take no lock and not
+ *  call find_pcb(), remove_pcb() or anything else creating or freeing tasks.
+ *  To use a PCB after it returns, take a reference on it with get_pcb().
+ *
+ *  @param fn Function called with each PCB and data
+ *  @param data Passed on to fn
+ *  @return Void.
+ */
+void
+for_each_task( void (*fn)( pcb_t *pcb, void *data ), void *data )
+{
+	affirm(fn);
+	for_each_task_t call = { fn, data };
+	idr_for_each(&pid_idr, for_each_task_helper, &call);
 }
 
 /** @brief Looks for tcb with given tid.
+ *
+ *  Only for a thread the caller knows cannot be freed meanwhile, such as
+ *  one of its own task's which it created, else use find_and_get_tcb().
  *
  *	@param tid Thread id to look for
  *
@@ -280,10 +342,62 @@ remove_pcb( pcb_t *pcbp )
 tcb_t *
 find_tcb( uint32_t tid )
 {
-	mutex_lock(&tcb_map_mux);
-	tcb_t *res = (tcb_t *)map_get(tid);
-	mutex_unlock(&tcb_map_mux);
-	return res;
+	return H_GET(&tcb_table, tid, tcb, tid, tid2tcb_link);
+}
+
+/** @brief Takes a reference on a TCB found by tid, unless it is being
+ *         freed, see H_GET_HOLD()
+ *
+ *  @param v_tcb TCB
+ *  @return 0 on success, negative value if the TCB has no references left
+ */
+static int
+hold_tcb( void *v_tcb )
+{
+	tcb_t *tcb = (tcb_t *) v_tcb;
+	uint32_t refs;
+	do {
+		refs = *(volatile uint32_t *) &(tcb->refs);
+		if (!refs)
+			return -1;
+	} while (compare_and_swap_atomic(&(tcb->refs), refs, refs + 1) != refs);
+	return 0;
+}
+
+/** @brief Looks for tcb with given tid, and takes a reference on it so that
+ *         it can be used until put_tcb() even if the thread is reaped.
+ *
+ *	@param tid Thread id to look for
+ *	@return Pointer to tcb on success, NULL on failure */
+tcb_t *
+find_and_get_tcb( uint32_t tid )
+{
+	return H_GET_HOLD(&tcb_table, tid, tcb, tid, tid2tcb_link, hold_tcb);
+}
+
+/** @brief Drops a reference on a TCB, handing it to the reaper to free with
+ *         the last reference
+ *
+ *  @param tcb TCB
+ *  @return Void.
+ */
+void
+put_tcb( tcb_t *tcb )
+{
+	affirm(tcb->refs > 0);
+	if (sub_one_atomic(&(tcb->refs)) == 1)
+		reap_tcb_later(tcb);
+}
+
+/** @brief Checks whether find_tcb() may still be looking at a TCB removed
+ *         by free_tcb()
+ *
+ *  @return 1 if no lookup is in progress, 0 otherwise
+ */
+int
+no_tcb_lookups( void )
+{
+	return H_QUIESCENT(&tcb_table);
 }
 
 /** @brief Initializes new pcb, and corresponding tcb.
@@ -307,11 +421,15 @@ create_pcb( uint32_t *pid, void *pd, pcb_t *parent_pcb)
 		return NULL;
 	}
 	if (mutex_init(&(pcb->set_status_vanish_wait_mux)) < 0) {
-		free_pcb_but_not_pd(pcb);
+		sfree(pcb, sizeof(pcb_t));
+		return NULL;
+	}
+	/* Found by find_pcb() only once fully initialized */
+	if (idr_alloc(&pid_idr, NULL, pid) < 0) {
+		sfree(pcb, sizeof(pcb_t));
 		return NULL;
 	}
 	pcb->pd = pd;
-	*pid = get_unique_pid();
 	pcb->pid = *pid;
 	pcb->exit_status = 0;
 
@@ -327,14 +445,14 @@ create_pcb( uint32_t *pid, void *pd, pcb_t *parent_pcb)
 	Q_INIT_HEAD(&(pcb->waiting_threads_list));
 	pcb->num_waiting_threads = 0;
 
-	/* Set parent task PCB pointer if present */
-	if (parent_pcb) {
-		pcb->parent_pcb = parent_pcb;
-		pcb->parent_pid = parent_pcb->pid;
-	} else {
-		pcb->parent_pcb = NULL;
-		pcb->parent_pid = 0;
-	}
+	/* Set parent task PCB pointer if present, keeping the parent PCB
+	 * around for when we vanish, see vanish.c */
+	pcb->refs = 1;
+	pcb->has_vanished = 0;
+	pcb->claimed = 0;
+	pcb->parent_pcb = parent_pcb;
+	if (parent_pcb)
+		add_one_atomic(&(parent_pcb->refs));
 	/* Link to later put this PCB on its parent's vanished_child_tasks_list */
 	Q_INIT_ELEM(pcb, vanished_child_tasks_link);
 	pcb->total_threads = 0;
@@ -350,11 +468,16 @@ create_pcb( uint32_t *pid, void *pd, pcb_t *parent_pcb)
 	pcb->first_thread_tid = 0;
 	pcb->last_thread = NULL;
 
-	/* Add to pcb linked list */
-	mutex_lock(&pcb_list_mux);
-	Q_INIT_ELEM(pcb, task_link);
-	Q_INSERT_TAIL(&pcb_list, pcb, task_link);
-	mutex_unlock(&pcb_list_mux);
+	/* No open files, fork() fills these in from the parent */
+	fd_table_init(pcb->fd_table);
+
+	usage_init(&pcb->usage);
+	usage_init(&pcb->child_usage);
+
+	/* Child tasks start in their parent's task group */
+	pcb->task_group = parent_pcb ? parent_pcb->task_group : 0;
+
+	idr_set(&pid_idr, pcb->pid, pcb);
 
 	return pcb;
 }
@@ -381,19 +504,33 @@ create_tcb( pcb_t *owning_task, uint32_t *tid )
 		return NULL;
 	}
 
-	*tid = get_unique_tid();
+	if (idr_alloc(&tid_idr, NULL, tid) < 0) {
+		sfree(tcb, sizeof(tcb_t));
+		return NULL;
+	}
 	tcb->tid = *tid;
 
 	tcb->status = UNINITIALIZED;
 	tcb->owning_task = owning_task;
+	tcb->refs = 1;
 
 	tcb->collected_vanished_child = NULL;
-
-	tcb->kernel_stack_lo = smalloc(KERNEL_THREAD_STACK_SIZE);
+	tcb->wait_tid = 0;
+	tcb->exited = 0;
+	tcb->exit_value = NULL;
+	tcb->joiner = NULL;
+	waitqueue_init(&tcb->exit_wq);
+	tcb->waitqueue = NULL;
+	tcb->sleep_expiry_date = 0;
+
+	/* Kernel stacks come with a guard page below them, so an overflow
+	 * faults right away */
+	tcb->kernel_stack_lo = kstack_alloc();
 
 	if (!tcb->kernel_stack_lo) {
+		idr_put(&tid_idr, tcb->tid);
 		sfree(tcb, sizeof(tcb_t));
-		log_info("create_tcb(): smalloc() kernel stack returned NULL");
+		log_info("create_tcb(): kstack_alloc() returned NULL");
 
 		return NULL;
 	}
@@ -404,7 +541,9 @@ create_tcb( pcb_t *owning_task, uint32_t *tid )
 	/* Add to owning task's list of threads, increment num_active_threads not
 	 * DEAD */
 	Q_INIT_ELEM(tcb, scheduler_queue);
-	Q_INIT_ELEM(tcb, tid2tcb_queue);
+	Q_INIT_ELEM(tcb, sleep_link);
+	T_INIT_ELEM(tcb, run_tree_link);
+	H_INIT_ELEM(tcb, tid2tcb_link);
 	Q_INIT_ELEM(tcb, task_thread_link);
 
 	mutex_lock(&owning_task->set_status_vanish_wait_mux);
@@ -415,15 +554,12 @@ create_tcb( pcb_t *owning_task, uint32_t *tid )
 	/* Set first thread tid of pcb */
 	if (owning_task->first_thread_tid == 0) {
 		owning_task->first_thread_tid = *tid;
+		idr_get(&tid_idr, *tid);
 	}
 	mutex_unlock(&owning_task->set_status_vanish_wait_mux);
 
 	log("Inserting thread with tid %lu", tcb->tid);
-	mutex_lock(&tcb_map_mux);
-	map_insert(tcb);
-	mutex_unlock(&tcb_map_mux);
-
-	memset(tcb->kernel_stack_lo, 0, KERNEL_THREAD_STACK_SIZE);
+	H_INSERT(&tcb_table, tcb, tid, tid2tcb_link);
 
 	log("create_tcb(): tcb->stack_lo:%p", tcb->kernel_stack_lo);
 	tcb->kernel_esp = tcb->kernel_stack_lo;
@@ -438,8 +574,26 @@ create_tcb( pcb_t *owning_task, uint32_t *tid )
 	tcb->swexn_stack = 0;
 	tcb->swexn_arg = NULL;
 
-	*(tcb->kernel_stack_hi) = 0xcafebabe;
-	*(tcb->kernel_stack_lo) = 0xdeadbeef;
+	usage_init(&tcb->usage);
+	tcb->run_start = 0;
+
+	/* Threads made by fork() and thread_fork() inherit these instead */
+	tcb->nice = 0;
+	tcb->vruntime = 0;
+
+	/* Nothing inherited until a thread waits on a mutex this one holds */
+	tcb->inherited_nice = NICE_MAX;
+	Q_INIT_HEAD(&tcb->held_mutexes);
+	tcb->blocked_on = NULL;
+	tcb->mutex_losses = 0;
+
+	/* The deadline class is not inherited, bandwidth is per thread */
+	tcb->dl_period = 0;
+	tcb->dl_budget = 0;
+	tcb->dl_rel_deadline = 0;
+	tcb->dl_period_start = 0;
+	tcb->dl_deadline = 0;
+	tcb->dl_runtime = 0;
 
 	return tcb;
 }
@@ -546,26 +700,6 @@ get_user_eflags( void )
 	return eflags;
 }
 
-/** @brief Returns a unique pid.
- *
- *  @return Unique pid
- */
-static uint32_t
-get_unique_pid( void )
-{
-	return add_one_atomic(&next_pid);
-}
-
-/** @brief Returns a unique tid.
- *
- *  @return Unique tid
- */
-static uint32_t
-get_unique_tid( void )
-{
-	return add_one_atomic(&next_tid);
-}
-
 /** @brief Returns the pid of the currently running thread
  *
  *  @return Void.
@@ -584,10 +718,13 @@ get_pid( void )
 	return pid;
 }
 
-/** @brief Frees a TCB and removes the TCB from tid2tcb hashmap list
+/** @brief Removes a TCB from the tid -> TCB table and drops the reference
+ *         it was created with
  *
+ *  The TCB is freed by the reaper once the last reference is gone and no
+ *  lookup may still be looking at it, see put_tcb().
  *
- *  @pre TCB must not be in any list/queue except for the tid2tcb hashmap list
+ *  @pre TCB must not be in any list/queue except for the tid -> TCB table
  *  @pre TCB must not be holding on to any vanished child taskss
  *  @pre TCB must be DEAD
  *
@@ -604,16 +741,59 @@ free_tcb(tcb_t *tcb)
 	affirm(tcb->status == DEAD);
 	affirm(!(Q_IN_SOME_QUEUE(tcb, waiting_threads_link)));
 	affirm(!(Q_IN_SOME_QUEUE(tcb, scheduler_queue)));
-	affirm(!(Q_IN_SOME_QUEUE(tcb, tid2tcb_queue)));
+	affirm(!(T_IN_TREE(tcb, run_tree_link)));
 	affirm(!(Q_IN_SOME_QUEUE(tcb, task_thread_link)));
 	affirm(tcb->status == DEAD);
 
 
-	/* free stack and structure memory */
-	sfree(tcb->kernel_stack_lo, KERNEL_THREAD_STACK_SIZE);
-	sfree(tcb, sizeof(tcb_t));
+	affirm(H_REMOVE(&tcb_table, tcb->tid, tcb, tid, tid2tcb_link) == tcb);
+	idr_put(&tid_idr, tcb->tid);
 
 	log_info("free_tcb(): cleaned up thread tid:%d", tcb->tid);
+	put_tcb(tcb);
+}
+
+/** @brief Frees a TCB's kernel stack and the TCB itself
+ *
+ *  @pre The TCB has no references left and no_tcb_lookups() has been seen
+ *       true since
+ *  @param tcb TCB
+ *  @return Void.
+ */
+void
+free_tcb_memory( tcb_t *tcb )
+{
+	affirm(tcb);
+	affirm(!tcb->refs);
+
+	kstack_free(tcb->kernel_stack_lo, tcb->tid);
+	sfree(tcb, sizeof(tcb_t));
+}
+
+/** @brief Takes a reference on a PCB, keeping it from being freed until
+ *         put_pcb().
+ *
+ *  @param pcb PCB, which must not have been freed yet
+ *  @return Void.
+ */
+void
+get_pcb( pcb_t *pcb )
+{
+	affirm(pcb->refs > 0);
+	add_one_atomic(&(pcb->refs));
+}
+
+/** @brief Drops a reference on a PCB, freeing it with the last reference
+ *
+ *  @param pcb PCB
+ *  @return Void.
+ */
+void
+put_pcb( pcb_t *pcb )
+{
+	affirm(pcb->refs > 0);
+	if (sub_one_atomic(&(pcb->refs)) == 1)
+		sfree(pcb, sizeof(pcb_t));
 }
 
 /** @brief Frees a PCB along with selected fields
@@ -650,15 +830,25 @@ free_pcb_but_not_pd_helper(pcb_t *pcb, int free_last_thread )
 		affirm(Q_GET_FRONT(&pcb->vanished_threads_list) == pcb->last_thread);
 		affirm(Q_GET_TAIL(&pcb->vanished_threads_list) == pcb->last_thread);
 		affirm(pcb->last_thread);
-		map_remove(pcb->last_thread->tid);
 		free_tcb(pcb->last_thread);
 	}
 
-	sfree(pcb, sizeof(pcb_t));
+	/* Let go of the IDs this task held on to, see pid_idr and tid_idr */
+	if (pcb->first_thread_tid)
+		idr_put(&tid_idr, pcb->first_thread_tid);
+	idr_set(&pid_idr, pcb->pid, NULL);
+	idr_put(&pid_idr, pcb->pid);
 	log_info("free_pcb_but_not_pd(): "
 		     "complete cleaned up pcb->first_thread_tid:%d",
 			 pcb->first_thread_tid);
 
+	/* Let go of the parent PCB, then of our own PCB, which our unreaped
+	 * child tasks may still hold on to */
+	if (pcb->parent_pcb)
+		put_pcb(pcb->parent_pcb);
+	pcb->parent_pcb = NULL;
+	put_pcb(pcb);
+
 }
 
 /** @brief Frees PCB along with its last thread's TCB. Used during a call to
@@ -702,7 +892,7 @@ register_if_init_task( char *execname, uint32_t pid )
 {
 	affirm(execname);
 
-	mutex_lock(&init_pcb_list_mux);
+	rwlock_write_lock(&init_pcb_list_lock);
 	int init_strlen = strlen("init");
 	if ((execname[init_strlen] == '\0')
 		&& (strncmp(execname, "init", init_strlen) == 0)) {
@@ -721,7 +911,7 @@ register_if_init_task( char *execname, uint32_t pid )
 		}
 		curr = next;
 	}
-	mutex_unlock(&init_pcb_list_mux);
+	rwlock_write_unlock(&init_pcb_list_lock);
 
 }
 
@@ -733,13 +923,13 @@ register_if_init_task( char *execname, uint32_t pid )
 pcb_t *
 get_init_pcbp( void )
 {
-	mutex_lock(&init_pcb_list_mux);
+	rwlock_read_lock(&init_pcb_list_lock);
 
 	pcb_t * init_pcbp = Q_GET_FRONT(&init_pcb_list);
 	affirm(init_pcbp);
 	affirm(safe_strcmp(init_pcbp->execname, "init") == 0);
 
-	mutex_unlock(&init_pcb_list_mux);
+	rwlock_read_unlock(&init_pcb_list_lock);
 
 	return init_pcbp;
 }
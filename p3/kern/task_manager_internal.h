@@ -10,9 +10,14 @@
 #define TASK_MANAGER_INTERNAL_H_
 
 #include <variable_queue.h> /* Q_NEW_LINK */
+#include <variable_htable.h> /* H_NEW_LINK */
+#include <variable_tree.h> /* T_NEW_LINK */
 #include <scheduler.h> /* status_t */
 #include <lib_thread_management/mutex.h> /* mutex_t */
+#include <lib_thread_management/waitqueue.h> /* waitqueue_t */
 #include <memory_manager.h> /* USER_STR_LEN */
+#include <tmpfs.h> /* open_file_t, MAX_OPEN_FILES */
+#include <rusage.h> /* usage_t */
 
 typedef struct pcb pcb_t;
 typedef struct tcb tcb_t;
@@ -47,20 +52,30 @@ Q_NEW_HEAD(active_child_tasks_list_t, pcb);
  *                              to vanish
  *  @param num_waiting_threads Number of threads waiting for child tasks to
  *                             vanish.
- *  @param parent_pcb Pointer to parent task's PCB. If parent task has vanished,
- *                    this is a pointer to the init executable's PCB.
+ *  @param parent_pcb Pointer to parent task's PCB, NULL if none. Holds a
+ *                    reference on the parent PCB until this task is reaped.
+ *                    Never changes, if the parent task has vanished this task
+ *                    goes to init when it vanishes.
+ *  @param refs References on this PCB: one held by the task until it is
+ *              reaped, and one per child task which has not been reaped.
+ *  @param has_vanished Set once the last thread of this task vanishes, after
+ *                      which child tasks go to init.
+ *  @param claimed Set while a thread of the parent task waits for this very
+ *                 task, so no other thread waits for it too.
  * 	@param vanished_child_tasks_link Variable queue link for inserting this PCB
  * 	                                 into its parent PCB's vanished child tasks
  * 	                                 list.
- *	@param total_threads Total threads every created
+ *	@param total_threads Threads not reaped by thread_join()
  *	@param active_threads_list List of active threads (not DEAD)
  *	@param num_active_threads Number of threads not DEAD
  *	@param vanished_threads_list List of vanished threads (DEAD)
  *	@param num_vanished_threads Number of vanished threads
  *	@param first_thread_tid Thread ID of task's first thread
  *	@param last_thread Last thread to vanish in task
- *  @param task_link Variable queue link for kernel wide list of all running
- *         tasks.
+ *  @param fd_table Open files, indexed by file descriptor
+ *  @param usage Usage of the task's vanished threads
+ *  @param child_usage Usage of the task's reaped child tasks
+ *  @param task_group Task group whose CPU quota the task's threads share
  */
 struct pcb
 {
@@ -86,13 +101,18 @@ struct pcb
 	uint32_t num_waiting_threads;
 
 	pcb_t *parent_pcb;
-	uint32_t parent_pid;
+	uint32_t refs;
+	int has_vanished;
+
+	/* Set while a parent thread waits for this very task, under the parent
+	 * PCB's set_status_vanish_wait_mux, see wait.c */
+	int claimed;
 
 	/* When the last thread of this task has vanished, this link is used
 	 * to put the PCB on its parent task's vanished_child_tasks_list */
 	Q_NEW_LINK(pcb) vanished_child_tasks_link;
 
-	uint32_t total_threads; /* total threads every created */
+	uint32_t total_threads; /* threads not reaped by thread_join() */
 
 	active_threads_list_t active_threads_list; /* list of owned threads */
 	uint32_t num_active_threads; /* number of threads not DEAD */
@@ -102,13 +122,16 @@ struct pcb
 
 	uint32_t first_thread_tid;
 	tcb_t *last_thread;
-	Q_NEW_LINK(pcb) task_link; /**< Variable queue link for kernel wide list of
-	                             *  all running tasks */
-
 	Q_NEW_LINK(pcb) init_pcb_link;
 
+	open_file_t *fd_table[MAX_OPEN_FILES]; /* Open files, indexed by fd */
 
+	/* Filled in by vanishing threads and reaped children, see rusage.c */
+	usage_t usage;
+	usage_t child_usage;
 
+	/* Written with interrupts disabled, see scheduler.c */
+	int task_group;
 };
 /** @brief Thread control block */
 struct tcb {
@@ -117,7 +140,9 @@ struct tcb {
 	Q_NEW_LINK(tcb) waiting_threads_link;
 
 	Q_NEW_LINK(tcb) scheduler_queue; /* Link for queues in scheduler */
-	Q_NEW_LINK(tcb) tid2tcb_queue; /* Link for hashmap of TCB queues */
+	Q_NEW_LINK(tcb) sleep_link; /* Link for the sleep queue */
+	T_NEW_LINK(tcb) run_tree_link; /* Link for the runnable tree */
+	H_NEW_LINK(tcb) tid2tcb_link; /* Link for the tid -> TCB table */
 
 	/* This link is for the owning task's active_threads_list or
 	 * vanished_threads_list. Using the same link name enforces that
@@ -125,11 +150,23 @@ struct tcb {
 	Q_NEW_LINK(tcb) task_thread_link; /* Link for TCB queue in PCB */
 
     pcb_t *collected_vanished_child; /* for use on wait */
+	uint32_t wait_tid; /* Child task waited on while blocked, 0 for any */
+
+	/* Guarded by the owning task's set_status_vanish_wait_mux */
+	int exited; /* Set once vanished, after which thread_join() may reap */
+	void *exit_value; /* Left by thread_exit() for thread_join() */
+	tcb_t *joiner; /* Thread blocked in thread_join() on this one, or NULL */
+	waitqueue_t exit_wq; /* Where the joiner waits for exited */
 
 	status_t status; /* Thread's status */
 	pcb_t *owning_task; /* PCB of process that owns this thread */
 	uint32_t tid; /* Thread ID */
 
+	/* References: one held from creation until free_tcb(), and one per
+	 * find_and_get_tcb() not yet put_tcb(). Freed by the reaper with the
+	 * last one, see reaper.c */
+	uint32_t refs;
+
 	/* Stack info. Needed for resuming execution.
 	* General purpose registers, program counter
 	* are stored on stack pointed to by esp. */
@@ -143,12 +180,41 @@ struct tcb {
 	/* Info for syscalls */
 	/* When this thread should be woken up (if it is sleeping) */
 	uint32_t sleep_expiry_date;
+	/* Wait queue blocked on, or NULL, written with interrupts disabled */
+	struct waitqueue *waitqueue;
 
 	/* Software exception handler info. Handler/stack NULL if not registered */
 	uint32_t swexn_handler;
 	uint32_t swexn_stack;
 	void	*swexn_arg;
 	int		 has_swexn_handler;
+
+	/* Usage so far, and the TSC when this thread last started running */
+	usage_t usage;
+	uint64_t run_start;
+
+	/* Weighted fair scheduling, written with interrupts disabled. The
+	 * virtual runtime is the key of the runnable tree, see scheduler.c */
+	int nice;
+	uint64_t vruntime;
+
+	/* Priority inheritance, written with interrupts disabled. The thread
+	 * runs at the lower of nice and inherited_nice, the highest priority of
+	 * the threads waiting on the mutexes it holds, see mutex.c */
+	int inherited_nice;
+	held_mutexes_t held_mutexes;
+	mutex_t *blocked_on; /* Mutex waited on, or NULL */
+	int mutex_losses; /* Times woken to find the mutex taken again */
+
+	/* Deadline class, dl_period 0 if not in it. Periods and deadlines are
+	 * in ticks, the absolute deadline keys the deadline tree and the budget
+	 * left this period is in TSC cycles, see scheduler.c */
+	uint32_t dl_period;
+	uint32_t dl_budget;
+	uint32_t dl_rel_deadline;
+	uint32_t dl_period_start;
+	uint64_t dl_deadline;
+	int64_t dl_runtime;
 };
 #endif /* TASK_MANAGER_INTERNAL_H_ */
 
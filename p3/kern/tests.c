@@ -10,27 +10,89 @@
 #include <physalloc.h>	/* physalloc_test() */
 #include <interrupt_defines.h>	/* INT_CTL_PORT, INT_ACK_CURRENT */
 #include <lib_thread_management/mutex.h>
+#include <lib_thread_management/rwlock.h>
+#include <lib_thread_management/waitqueue.h>
 #include <memory_manager.h>
 #include <x86/cr.h>
 #include <x86/page.h>
 #include <common_kern.h>    /* USER_MEM_START */
+#include <scheduler.h>      /* get_running_thread(), get_thread_priority() */
 
 /* These definitions have to match the ones in user/progs/test_suite.c */
 #define MULT_FORK_TEST	0
 #define MUTEX_TEST		1
 #define PHYSALLOC_TEST	2
 #define PD_CONSISTENCY  3
+
+/* These definitions have to match the ones in user/progs/exec_bench.c */
+#define EXEC_BENCH_PHYSALLOCS	4
+#define EXEC_BENCH_SMALLOCS		5
+
+/* These definitions have to match the ones in
+ * user/progs/pi_inversion_test.c */
+#define PI_TEST_SPIN	6
+#define PI_TEST_HOLD	7
+#define PI_TEST_TAKE	8
+
+/* These definitions have to match the ones in
+ * user/progs/mutex_handoff_bench.c */
+#define MUTEX_BENCH_COMPETE	9
+#define MUTEX_BENCH_HANDOFF	10
+
+/* These definitions have to match the ones in
+ * user/progs/rwlock_lookup_bench.c */
+#define LOOKUP_BENCH_RWLOCK	11
+#define LOOKUP_BENCH_MUTEX	12
+
+/* These definitions have to match the ones in
+ * user/progs/wake_all_bench.c */
+#define WAKE_BENCH_WAIT		13
+#define WAKE_BENCH_WAITERS	14
+#define WAKE_BENCH_WAKE_ALL	15
+#define WAKE_BENCH_WAKE_ONE	16
+
+/* Critical sections each mutex benchmark call goes through, and the
+ * increments each section does */
+#define MUTEX_BENCH_ROUNDS	256
+#define MUTEX_BENCH_SECTION	64
+
 #define TOTAL_USER_FRAMES (machine_phys_frames() - (USER_MEM_START / PAGE_SIZE))
 
 static volatile int total_sum_fork = 0;
 static volatile int total_sum_mux = 0;
 static mutex_t mux;
 
+/* Lock of the priority inversion test */
+static volatile int total_sum_pi = 0;
+static mutex_t pi_mux;
+
+/* Locks of the mutex benchmark, one in each unlock mode */
+static volatile int total_sum_bench = 0;
+static mutex_t compete_mux;
+static mutex_t handoff_mux;
+
+/* Locks of the lookup benchmark, read locked or locked around lookups */
+static rwlock_t lookup_lock;
+static mutex_t lookup_mux;
+
+/* Wait queue of the wakeup benchmark, waiters wait for the generation to
+ * change */
+static volatile int bench_generation = 0;
+static waitqueue_t bench_wq;
+
 /* Init is run once, before any syscalls can be made */
 void
 init_tests( void )
 {
     mutex_init(&mux);
+    mutex_init(&pi_mux);
+    mutex_init(&compete_mux);
+    mutex_init(&handoff_mux);
+    mutex_set_handoff(&handoff_mux, 1);
+    rwlock_init(&lookup_lock);
+    rwlock_set_prefer_writers(&lookup_lock, 1);
+    mutex_init(&lookup_mux);
+    waitqueue_init(&bench_wq);
 }
 
 /** @brief Tests physalloc and physfree
@@ -69,7 +131,7 @@ test_physalloc( void )
 	/* Use all phys frames */
 	int total = (machine_phys_frames() - (USER_MEM_START / PAGE_SIZE));
 	int i = 0;
-	uint32_t all_phys[1024];
+	static uint32_t all_phys[1024]; /* Larger than a kernel stack */
 	log("after all_phys");
 	while (i < 1024) {
 		all_phys[i] = physalloc();
@@ -166,6 +228,134 @@ mutex_test( void )
     return 0;
 }
 
+/** @brief Spins for as long as the priority inversion test holds its lock.
+ *
+ *  @return Void.  */
+static void
+pi_test_spin( void )
+{
+    for (int i = 0; i < 1 << 22; ++i)
+        total_sum_pi++;
+}
+
+/** @brief Checks whether a thread is queued on the priority inversion
+ *         test's lock.
+ *
+ *  @return 1 if one is, 0 otherwise  */
+static int
+pi_test_has_waiter( void )
+{
+    /* Waiters are queued with interrupts disabled */
+    disable_interrupts();
+    int has_waiter = Q_GET_FRONT(&pi_mux.waiters_queue) != NULL;
+    enable_interrupts();
+    return has_waiter;
+}
+
+/** @brief Holds the priority inversion test's lock from before a thread
+ *         waits on it until pi_test_spin() is done after that.
+ *
+ *  @return Priority the holder ran at right before unlocking, the waiter's
+ *          if it was inherited  */
+static int
+pi_test_hold( void )
+{
+    mutex_lock(&pi_mux);
+    /* Until the waiter is queued, and so has boosted this thread */
+    while (!pi_test_has_waiter())
+        continue;
+    pi_test_spin();
+
+    disable_interrupts();
+    int priority = get_thread_priority(get_running_thread());
+    enable_interrupts();
+
+    mutex_unlock(&pi_mux);
+    return priority;
+}
+
+/** @brief Waits on the priority inversion test's lock.
+ *
+ *  @return 0  */
+static int
+pi_test_take( void )
+{
+    mutex_lock(&pi_mux);
+    mutex_unlock(&pi_mux);
+    return 0;
+}
+
+/** @brief Goes through short critical sections for the mutex benchmark.
+ *
+ *  @param mp Mutex guarding them
+ *  @return 0  */
+static int
+mutex_bench( mutex_t *mp )
+{
+    for (int i = 0; i < MUTEX_BENCH_ROUNDS; ++i) {
+        mutex_lock(mp);
+        for (int j = 0; j < MUTEX_BENCH_SECTION; ++j)
+            total_sum_bench++;
+        mutex_unlock(mp);
+    }
+    return 0;
+}
+
+/** @brief Goes through short read only sections for the lookup benchmark,
+ *         under a readers-writer lock or a mutex.
+ *
+ *  @param rwp Lock read locked around them, NULL to use mp
+ *  @param mp Mutex locked around them otherwise
+ *  @return Sum of what the sections read */
+static int
+lookup_bench( rwlock_t *rwp, mutex_t *mp )
+{
+    int sum = 0;
+    for (int i = 0; i < MUTEX_BENCH_ROUNDS; ++i) {
+        if (rwp)
+            rwlock_read_lock(rwp);
+        else
+            mutex_lock(mp);
+        for (int j = 0; j < MUTEX_BENCH_SECTION; ++j)
+            sum += total_sum_bench;
+        if (rwp)
+            rwlock_read_unlock(rwp);
+        else
+            mutex_unlock(mp);
+    }
+    return sum;
+}
+
+/** @brief Waits on the wakeup benchmark's wait queue until the next
+ *         wakeup.
+ *
+ *  @return 0 */
+static int
+wake_bench_wait( void )
+{
+    int generation = bench_generation;
+    wait_event(&bench_wq, bench_generation != generation);
+    return 0;
+}
+
+/** @brief Wakes every thread waiting in the wakeup benchmark, all at once
+ *         or one at a time.
+ *
+ *  @param all Whether to wake them all at once
+ *  @return Number of threads woken */
+static int
+wake_bench_wake( int all )
+{
+    bench_generation++;
+    if (all)
+        return wake_all(&bench_wq);
+
+    int woken = 0;
+    while (wake_one(&bench_wq))
+        woken++;
+    return woken;
+}
+
 /** @brief Tests consistency of pd
  *
  *  @return Void.  */
@@ -201,6 +391,33 @@ test_int_handler( int test_num )
         case PD_CONSISTENCY:
             test_pd_consistency();
             return 0;
+        case EXEC_BENCH_PHYSALLOCS:
+            return physalloc_calls();
+        case EXEC_BENCH_SMALLOCS:
+            return smalloc_calls();
+        case PI_TEST_SPIN:
+            pi_test_spin();
+            return 0;
+        case PI_TEST_HOLD:
+            return pi_test_hold();
+        case PI_TEST_TAKE:
+            return pi_test_take();
+        case MUTEX_BENCH_COMPETE:
+            return mutex_bench(&compete_mux);
+        case MUTEX_BENCH_HANDOFF:
+            return mutex_bench(&handoff_mux);
+        case LOOKUP_BENCH_RWLOCK:
+            return lookup_bench(&lookup_lock, NULL);
+        case LOOKUP_BENCH_MUTEX:
+            return lookup_bench(NULL, &lookup_mux);
+        case WAKE_BENCH_WAIT:
+            return wake_bench_wait();
+        case WAKE_BENCH_WAITERS:
+            return bench_wq.num_waiters;
+        case WAKE_BENCH_WAKE_ALL:
+            return wake_bench_wake(1);
+        case WAKE_BENCH_WAKE_ONE:
+            return wake_bench_wake(0);
     }
 
     return 0;
@@ -10,9 +10,10 @@
  */
 
 #include <interrupt_defines.h> /* INT_CTL_PORT, INT_ACK_CURRENT */
-#include <asm.h> /* outb() */
+#include <asm.h> /* outb(), rdtsc() */
 #include <assert.h> /* assert() */
 #include <stddef.h> /* NULL */
+#include <stdint.h> /* uint32_t, uint64_t */
 #include <timer_defines.h> /* TIMER_SQUARE_WAVE */
 
 /** @brief Get 8 least significant bits in x. */
@@ -30,6 +31,10 @@ static void (*application_tickback) (unsigned int) = NULL;
 /* Total ticks caught */
 static unsigned int total_ticks = 0;
 
+/* TSC at the last tick, and TSC cycles per tick averaged over recent ticks */
+static uint64_t last_tick_tsc = 0;
+static uint32_t tsc_per_tick = 0;
+
 /** @brief Get number of ticks since startup
  *
  *  @return Number of ticks since startup */
@@ -39,6 +44,15 @@ get_total_ticks( void )
 	return total_ticks;
 }
 
+/** @brief Get TSC cycles per tick, for converting TSC cycles to time
+ *
+ *  @return TSC cycles per tick, 0 until the timer has ticked twice */
+uint32_t
+get_tsc_per_tick( void )
+{
+	return tsc_per_tick;
+}
+
 /*********************************************************************/
 /*                                                                   */
 /* Internal helper functions                                         */
@@ -60,6 +74,15 @@ timer_int_handler( void )
 {
 	uint32_t current_total_ticks = ++total_ticks;
 	affirm(application_tickback);
+
+	/* Late ticks make single deltas noisy, so keep a running average */
+	uint64_t now = rdtsc();
+	if (last_tick_tsc) {
+		uint32_t delta = (uint32_t) (now - last_tick_tsc);
+		tsc_per_tick = tsc_per_tick ? tsc_per_tick - tsc_per_tick / 8 + delta / 8
+		                            : delta;
+	}
+	last_tick_tsc = now;
 	++total_ticks; // Avoid ghost bug
 	--total_ticks; // Avoid ghost bug
 	outb(INT_CTL_PORT, INT_ACK_CURRENT);
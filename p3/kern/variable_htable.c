@@ -0,0 +1,379 @@
+/** @file variable_htable.c
+ *  @brief Type independent implementation of the hash table in
+ *         variable_htable.h
+ *
+ *  Elements are handled as void pointers, with their key and link found at
+ *  the offsets the H_* macros pass in.
+ *
+ *  The kernel runs on one CPU, so lookups only race with writers through
+ *  preemption. A compiler barrier is enough to keep every store which
+ *  publishes a change after the stores it depends on, and every field a
+ *  lookup relies on is read once into a local.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <variable_htable.h>
+#include <stdint.h>			/* uint32_t */
+#include <stddef.h>			/* NULL, size_t */
+#include <string.h>			/* memset */
+#include <malloc.h>			/* smalloc, sfree */
+#include <assert.h>			/* affirm, assert */
+#include <logger.h>			/* log_warn */
+#include <atomic_utils.h>	/* add_one_atomic, sub_one_atomic */
+
+/** @brief Keeps the compiler from moving memory accesses across it */
+#define BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/** @brief Reads a field once, as lookups may be preempted by writers */
+#define READ_ONCE(X) (*(volatile __typeof__(X) *) &(X))
+
+/** @brief Next pointer of an element in the chains of bucket array gen */
+#define NEXT(ELEM, LINK_OFF, GEN) \
+	(((void **) ((char *) (ELEM) + (LINK_OFF)))[(GEN)])
+
+/** @brief Key of an element */
+#define KEY(ELEM, KEY_OFF) (*(uint32_t *) ((char *) (ELEM) + (KEY_OFF)))
+
+/** @brief Hash for placement into a bucket
+ *
+ *  Hash function taken from https://github.com/skeeto/hash-prospector
+ *
+ *  @param x Key to be hashed
+ *  @return Hash.
+ */
+static uint32_t
+hash( uint32_t x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+/** @brief Index of a key's bucket in a bucket array
+ *
+ *  @param key Key
+ *  @param len Length of the bucket array, a power of two
+ *  @return Bucket index
+ */
+static uint32_t
+bucket_of( uint32_t key, uint32_t len )
+{
+	return hash(key) & (len - 1);
+}
+
+/** @brief Walks a chain looking for a key
+ *
+ *  @param elem First element of the chain
+ *  @param key Key to look for
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @param gen Bucket array the chain belongs to
+ *  @return Element with the key, NULL if not found
+ */
+static void *
+chain_find( void *elem, uint32_t key, size_t key_off, size_t link_off,
+            int gen )
+{
+	while (elem && KEY(elem, key_off) != key)
+		elem = READ_ONCE(NEXT(elem, link_off, gen));
+	return elem;
+}
+
+/** @brief Unlinks the element with a key from a chain
+ *
+ *  @pre table->mux is held
+ *  @param headp Bucket holding the chain
+ *  @param key Key of the element to unlink
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @param gen Bucket array the chain belongs to
+ *  @return Unlinked element, NULL if not found
+ */
+static void *
+chain_unlink( void **headp, uint32_t key, size_t key_off, size_t link_off,
+              int gen )
+{
+	while (*headp && KEY(*headp, key_off) != key)
+		headp = &NEXT(*headp, link_off, gen);
+
+	void *elem = *headp;
+	if (elem) {
+		/* The element keeps its next pointer, so a lookup standing on it
+		 * carries on down the chain */
+		*headp = NEXT(elem, link_off, gen);
+	}
+	return elem;
+}
+
+/** @brief Starts moving the table to a bucket array of a new length
+ *
+ *  Leaves the table as is if the new bucket array cannot be allocated.
+ *
+ *  @pre table->mux is held and the table is not resizing
+ *  @param table Hash table
+ *  @param len Length of the new bucket array
+ *  @return Void.
+ */
+static void
+start_resize( htable_t *table, uint32_t len )
+{
+	int gen = !(table->state & H_GENERATION);
+	assert(!table->buckets[gen]);
+
+	void **buckets = smalloc(len * sizeof(void *));
+	if (!buckets) {
+		log_warn("start_resize(): unable to allocate %lu buckets", len);
+		return;
+	}
+	memset(buckets, 0, len * sizeof(void *));
+	table->buckets[gen] = buckets;
+	table->len[gen] = len;
+	table->migrated = 0;
+	BARRIER();
+	table->state = gen | H_RESIZING;
+}
+
+/** @brief Moves a few old buckets to the current bucket array, starting or
+ *         finishing a resize as needed
+ *
+ *  Called after every insert and remove.
+ *
+ *  @pre table->mux is held
+ *  @param table Hash table
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @return Void.
+ */
+static void
+resize_step( htable_t *table, size_t key_off, size_t link_off )
+{
+	int gen = table->state & H_GENERATION;
+	uint32_t len = table->len[gen];
+
+	if (!(table->state & H_RESIZING)) {
+		/* Free the old bucket array of the last resize once no lookup can
+		 * be walking it, and only then start another */
+		int old = !gen;
+		if (table->buckets[old]) {
+			if (READ_ONCE(table->readers))
+				return;
+			sfree(table->buckets[old], table->len[old] * sizeof(void *));
+			table->buckets[old] = NULL;
+			table->len[old] = 0;
+		}
+		if (table->count > len)
+			start_resize(table, 2 * len);
+		else if (len > H_MIN_BUCKETS && table->count < len / 4)
+			start_resize(table, len / 2);
+		return;
+	}
+
+	int old = !gen;
+	for (int i = 0; i < H_MIGRATE_PER_OP
+	     && table->migrated < table->len[old]; ++i) {
+		/* Old chains are left as they are for lookups still walking them,
+		 * each element is pushed onto its new chain through its other next
+		 * pointer */
+		void *elem = table->buckets[old][table->migrated];
+		while (elem) {
+			void **headp = &table->buckets[gen][bucket_of(KEY(elem, key_off),
+			                                              len)];
+			NEXT(elem, link_off, gen) = *headp;
+			BARRIER();
+			*headp = elem;
+			elem = NEXT(elem, link_off, old);
+		}
+		BARRIER();
+		table->migrated++;
+	}
+	if (table->migrated < table->len[old])
+		return;
+
+	/* Every element is in the current bucket array, new lookups stop looking
+	 * at the old one. It is freed once the lookups that might still be are
+	 * done, see above */
+	table->state = gen;
+}
+
+/** @brief Initializes an empty hash table
+ *
+ *  @param table Hash table
+ *  @return 0 on success, negative value on failure
+ */
+int
+htable_init( htable_t *table )
+{
+	affirm(table);
+
+	table->buckets[0] = smalloc(H_MIN_BUCKETS * sizeof(void *));
+	if (!table->buckets[0])
+		return -1;
+	memset(table->buckets[0], 0, H_MIN_BUCKETS * sizeof(void *));
+	table->len[0] = H_MIN_BUCKETS;
+	table->buckets[1] = NULL;
+	table->len[1] = 0;
+	table->state = 0;
+	table->migrated = 0;
+	table->count = 0;
+	table->readers = 0;
+
+	if (mutex_init(&table->mux) < 0) {
+		sfree(table->buckets[0], H_MIN_BUCKETS * sizeof(void *));
+		return -1;
+	}
+	return 0;
+}
+
+/** @brief Inserts an element whose key is not in the table yet
+ *
+ *  @param table Hash table
+ *  @param elem Element
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @return Void.
+ */
+void
+htable_insert( htable_t *table, void *elem, size_t key_off, size_t link_off )
+{
+	affirm(table);
+	affirm(elem);
+
+	mutex_lock(&table->mux);
+
+	/* New elements always go into the current bucket array */
+	int gen = table->state & H_GENERATION;
+	void **headp = &table->buckets[gen][bucket_of(KEY(elem, key_off),
+	                                              table->len[gen])];
+	NEXT(elem, link_off, gen) = *headp;
+	BARRIER();
+	*headp = elem;
+	table->count++;
+
+	resize_step(table, key_off, link_off);
+	mutex_unlock(&table->mux);
+}
+
+/** @brief Looks up an element by key without taking a lock
+ *
+ *  @param table Hash table
+ *  @param key Key to look for
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @return Element with the key, NULL if not found
+ */
+void *
+htable_get( htable_t *table, uint32_t key, size_t key_off, size_t link_off )
+{
+	return htable_get_hold(table, key, key_off, link_off, NULL);
+}
+
+/** @brief Looks up an element by key without taking a lock, taking a
+ *         reference on it while the lookup still keeps it from being freed
+ *
+ *  @param table Hash table
+ *  @param key Key to look for
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @param hold Takes a reference on the element, negative value if it is
+ *         being removed, NULL to take none
+ *  @return Element with the key, NULL if not found or hold failed
+ */
+void *
+htable_get_hold( htable_t *table, uint32_t key, size_t key_off,
+                 size_t link_off, int (*hold)( void *elem ) )
+{
+	affirm(table);
+
+	add_one_atomic(&table->readers);
+	BARRIER();
+
+	/* Read migrated before searching the current bucket array. An old bucket
+	 * moved later is still searched on its old chain, one moved earlier is
+	 * complete on the current one. */
+	uint32_t state = READ_ONCE(table->state);
+	uint32_t migrated = READ_ONCE(table->migrated);
+	int gen = state & H_GENERATION;
+	void *head = READ_ONCE(table->buckets[gen][bucket_of(key,
+	                                                     table->len[gen])]);
+	void *elem = chain_find(head, key, key_off, link_off, gen);
+
+	if (!elem && (state & H_RESIZING)) {
+		int old = !gen;
+		uint32_t b = bucket_of(key, table->len[old]);
+		if (b >= migrated) {
+			head = READ_ONCE(table->buckets[old][b]);
+			elem = chain_find(head, key, key_off, link_off, old);
+		}
+	}
+	if (elem && hold && hold(elem) < 0)
+		elem = NULL;
+
+	BARRIER();
+	sub_one_atomic(&table->readers);
+	return elem;
+}
+
+/** @brief Removes an element by key
+ *
+ *  Lookups in progress may still be looking at the element, so the caller
+ *  may only free it once htable_quiescent() is next seen true.
+ *
+ *  @param table Hash table
+ *  @param key Key of the element to remove
+ *  @param key_off Offset of the key in an element
+ *  @param link_off Offset of the link in an element
+ *  @return Removed element, NULL if not found
+ */
+void *
+htable_remove( htable_t *table, uint32_t key, size_t key_off,
+               size_t link_off )
+{
+	affirm(table);
+
+	mutex_lock(&table->mux);
+
+	int gen = table->state & H_GENERATION;
+	void *elem = chain_unlink(&table->buckets[gen][bucket_of(key,
+	                                               table->len[gen])],
+	                          key, key_off, link_off, gen);
+
+	/* Elements of old buckets not moved yet are only on their old chain */
+	if (!elem && (table->state & H_RESIZING)) {
+		int old = !gen;
+		uint32_t b = bucket_of(key, table->len[old]);
+		if (b >= table->migrated) {
+			elem = chain_unlink(&table->buckets[old][b], key, key_off,
+			                    link_off, old);
+		}
+	}
+	if (!elem) {
+		mutex_unlock(&table->mux);
+		return NULL;
+	}
+	table->count--;
+	resize_step(table, key_off, link_off);
+
+	mutex_unlock(&table->mux);
+	return elem;
+}
+
+/** @brief Checks whether no lookup is in progress
+ *
+ *  Lookups starting later cannot find elements removed so far, so those
+ *  may be freed if this returns 1.
+ *
+ *  @param table Hash table
+ *  @return 1 if no lookup is in progress, 0 otherwise
+ */
+int
+htable_quiescent( htable_t *table )
+{
+	affirm(table);
+
+	BARRIER();
+	return READ_ONCE(table->readers) == 0;
+}
@@ -0,0 +1,211 @@
+/** @file variable_htable.h
+ *
+ *  @brief Generalized intrusive hash table, keyed by a uint32_t field of
+ *  its elements.
+ *
+ *  Like variable_queue.h, elements embed a link generated by H_NEW_LINK()
+ *  and the H_* macros take the element type and the names of its key and
+ *  link fields. Bucket arrays are contiguous arrays of chain heads whose
+ *  length is a power of two.
+ *
+ *  Lookups with H_GET() take no lock. Inserts and removes are serialized by
+ *  the table's mutex, and each publishes its change to a chain with a single
+ *  store, so a lookup walking the chain sees either the old or the new
+ *  chain. A lookup announces itself in the table's readers count. A lookup
+ *  may still be standing on an element H_REMOVE() has just unlinked, so the
+ *  element may only be freed once H_QUIESCENT() has been seen true after
+ *  H_REMOVE() returned. H_GET_HOLD() lets the caller take a reference on the
+ *  element before the lookup ends, so it can keep using it past that point.
+ *
+ *  The table grows when it holds more elements than buckets and shrinks when
+ *  it holds fewer than a quarter as many. Resizing is incremental: a new
+ *  bucket array is published next to the old one, and every insert or remove
+ *  then moves the chains of a few old buckets into the new array. The link
+ *  has a next pointer per bucket array, so an element moved to the new array
+ *  stays on its old chain for lookups still walking it. Lookups made while
+ *  resizing search the new array and, if their old bucket has not been moved
+ *  yet, the old one. The old bucket array is freed by a later insert or
+ *  remove which finds no lookup in progress, and no new resize starts
+ *  before then.
+ *
+ *  This header file is not placed in inc/ since it is private to the kernel's
+ *  own modules.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef _VARIABLE_HTABLE_H_
+#define _VARIABLE_HTABLE_H_
+
+#include <stddef.h> /* offsetof */
+#include <stdint.h> /* uint32_t */
+#include <lib_thread_management/mutex.h> /* mutex_t */
+
+/** @brief Bucket array length never shrunk below */
+#define H_MIN_BUCKETS 16
+
+/** @brief Old buckets moved to the new bucket array per insert or remove */
+#define H_MIGRATE_PER_OP 4
+
+/* Bits of htable_t state */
+#define H_GENERATION 0x1 /* Bucket array inserts go into */
+#define H_RESIZING 0x2 /* Other bucket array still being moved */
+
+/** @brief Head of a hash table.
+ *
+ *  Only ever read through the H_* macros. Bucket array and link next
+ *  pointer i go together, state says which of the two is current.
+ *
+ *  @param buckets Bucket arrays, NULL if not in use
+ *  @param len Length of each bucket array, a power of two
+ *  @param state H_GENERATION and H_RESIZING bits, written with one store so
+ *         lookups read a consistent pair
+ *  @param migrated Number of old buckets moved to the current array
+ *  @param count Number of elements in the table
+ *  @param readers Number of lookups in progress
+ *  @param mux Serializes inserts and removes
+ */
+typedef struct {
+	void **buckets[2];
+	uint32_t len[2];
+	uint32_t state;
+	uint32_t migrated;
+	uint32_t count;
+	uint32_t readers;
+	mutex_t mux;
+} htable_t;
+
+/** @def H_NEW_LINK(H_ELEM_TYPE)
+ *
+ *  @brief Instantiates a link within a structure, allowing that structure to
+ *         be put in a hash table.
+ *
+ *  Usage: <br>
+ *  typedef struct H_ELEM_TYPE {<br>
+ *  H_NEW_LINK(H_ELEM_TYPE) LINK_NAME; //instantiate the link <br>
+ *  } H_ELEM_TYPE; <br>
+ *
+ *  index i is the next pointer of the chain in bucket array i
+ *
+ *  @param H_ELEM_TYPE the type of the structure containing the link
+ **/
+#define H_NEW_LINK(H_ELEM_TYPE) \
+struct {\
+	struct H_ELEM_TYPE *next[2];\
+}
+
+/** @def H_INIT_TABLE(H_TABLE)
+ *
+ *  @brief Initializes an empty hash table with H_MIN_BUCKETS buckets.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @return 0 on success, negative value on failure
+ **/
+#define H_INIT_TABLE(H_TABLE) \
+	(htable_init(H_TABLE))
+
+/** @def H_INIT_ELEM(H_ELEM, LINK_NAME)
+ *
+ *  @brief Initializes the link named LINK_NAME in an instance of the
+ *         structure H_ELEM.
+ *
+ *  @param H_ELEM pointer to the structure instance containing the link
+ *  @param LINK_NAME the name of the link to initialize
+ **/
+#define H_INIT_ELEM(H_ELEM, LINK_NAME) \
+do {\
+	(H_ELEM)->LINK_NAME.next[0] = NULL;\
+	(H_ELEM)->LINK_NAME.next[1] = NULL;\
+} while (0)
+
+/** @def H_INSERT(H_TABLE, H_ELEM, KEY_NAME, LINK_NAME)
+ *
+ *  @brief Inserts an element whose key is not in the table yet.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @param H_ELEM pointer to the element to insert
+ *  @param KEY_NAME name of the uint32_t key field of the element
+ *  @param LINK_NAME name of the H_NEW_LINK link field of the element
+ **/
+#define H_INSERT(H_TABLE, H_ELEM, KEY_NAME, LINK_NAME) \
+	htable_insert((H_TABLE), (H_ELEM),\
+	              offsetof(__typeof__(*(H_ELEM)), KEY_NAME),\
+	              offsetof(__typeof__(*(H_ELEM)), LINK_NAME))
+
+/** @def H_GET(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME)
+ *
+ *  @brief Looks up an element by key without taking a lock.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @param KEY key to look for
+ *  @param H_ELEM_TYPE the type of the elements, a structure
+ *  @param KEY_NAME name of the uint32_t key field of the element
+ *  @param LINK_NAME name of the H_NEW_LINK link field of the element
+ *  @return pointer to the element, NULL if not found
+ **/
+#define H_GET(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME) \
+	((struct H_ELEM_TYPE *) htable_get((H_TABLE), (KEY),\
+	                                   offsetof(struct H_ELEM_TYPE, KEY_NAME),\
+	                                   offsetof(struct H_ELEM_TYPE, LINK_NAME)))
+
+/** @def H_GET_HOLD(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME, HOLD)
+ *
+ *  @brief Looks up an element by key without taking a lock, and calls HOLD
+ *         on it before the lookup ends.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @param KEY key to look for
+ *  @param H_ELEM_TYPE the type of the elements, a structure
+ *  @param KEY_NAME name of the uint32_t key field of the element
+ *  @param LINK_NAME name of the H_NEW_LINK link field of the element
+ *  @param HOLD int (*)( void * ) taking a reference on the element, which
+ *         returns a negative value if the element is on its way out
+ *  @return pointer to the element, NULL if not found or HOLD failed
+ **/
+#define H_GET_HOLD(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME, HOLD) \
+	((struct H_ELEM_TYPE *) htable_get_hold((H_TABLE), (KEY),\
+	                                 offsetof(struct H_ELEM_TYPE, KEY_NAME),\
+	                                 offsetof(struct H_ELEM_TYPE, LINK_NAME),\
+	                                 (HOLD)))
+
+/** @def H_REMOVE(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME)
+ *
+ *  @brief Removes an element by key. Lookups may still be looking at the
+ *         element until H_QUIESCENT() is next seen true.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @param KEY key of the element to remove
+ *  @param H_ELEM_TYPE the type of the elements, a structure
+ *  @param KEY_NAME name of the uint32_t key field of the element
+ *  @param LINK_NAME name of the H_NEW_LINK link field of the element
+ *  @return pointer to the removed element, NULL if not found
+ **/
+#define H_REMOVE(H_TABLE, KEY, H_ELEM_TYPE, KEY_NAME, LINK_NAME) \
+	((struct H_ELEM_TYPE *) htable_remove((H_TABLE), (KEY),\
+	                                      offsetof(struct H_ELEM_TYPE, KEY_NAME),\
+	                                      offsetof(struct H_ELEM_TYPE, LINK_NAME)))
+
+/** @def H_QUIESCENT(H_TABLE)
+ *
+ *  @brief Checks whether no lookup is in progress, in which case elements
+ *         removed so far may be freed.
+ *
+ *  @param H_TABLE pointer to the htable_t
+ *  @return 1 if no lookup is in progress, 0 otherwise
+ **/
+#define H_QUIESCENT(H_TABLE) \
+	(htable_quiescent(H_TABLE))
+
+/* Type independent implementation, only to be called through the macros */
+int htable_init( htable_t *table );
+void htable_insert( htable_t *table, void *elem, size_t key_off,
+                    size_t link_off );
+void *htable_get( htable_t *table, uint32_t key, size_t key_off,
+                  size_t link_off );
+void *htable_get_hold( htable_t *table, uint32_t key, size_t key_off,
+                       size_t link_off, int (*hold)( void *elem ) );
+void *htable_remove( htable_t *table, uint32_t key, size_t key_off,
+                     size_t link_off );
+int htable_quiescent( htable_t *table );
+
+#endif /* _VARIABLE_HTABLE_H_ */
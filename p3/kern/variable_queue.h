@@ -289,8 +289,8 @@ struct {\
 \
 	/* Not at tail of queue, update child's prev */\
 	} else {\
-		affirm_msg((Q_TOINSERT)->(LINK_NAME).next != NULL,\
-				   "Variable queue element pointer's next cannot be NULL!")\
+		affirm_msg(((Q_TOINSERT)->LINK_NAME).next != NULL,\
+				   "Variable queue element pointer's next cannot be NULL!");\
 		((((Q_TOINSERT)->LINK_NAME).next)->LINK_NAME).prev = Q_TOINSERT;\
 	}\
 } while(0)
@@ -376,8 +376,8 @@ struct {\
 \
 	/* Not at front of queue, update ancestor's next */\
 	} else {\
-		affirm_msg((Q_TOINSERT)->(LINK_NAME).prev != NULL,\
-				   "Variable queue element pointer's prev cannot be NULL!")\
+		affirm_msg(((Q_TOINSERT)->LINK_NAME).prev != NULL,\
+				   "Variable queue element pointer's prev cannot be NULL!");\
 		((((Q_TOINSERT)->LINK_NAME).prev)->LINK_NAME).next = Q_TOINSERT;\
 	}\
 } while(0)
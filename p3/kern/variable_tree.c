@@ -0,0 +1,298 @@
+/** @file variable_tree.c
+ *  @brief Type independent implementation of the red-black tree in
+ *         variable_tree.h
+ *
+ *  Elements are handled as void pointers, with their key and link found at
+ *  the offsets the T_* macros pass in. Missing children are NULL and count
+ *  as black.
+ *
+ *  Rotations and fixups are written once for both directions: dir picks a
+ *  child, and !dir its sibling.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <variable_tree.h>
+#include <stdint.h>			/* uint64_t */
+#include <stddef.h>			/* NULL, size_t */
+#include <assert.h>			/* assert */
+
+/** @brief Layout of the link T_NEW_LINK() generates */
+typedef struct {
+	void *parent;
+	void *child[2];
+	int color;
+} tree_link_t;
+
+/** @brief Layout of the head T_NEW_HEAD() generates */
+typedef struct {
+	void *root;
+	void *min;
+} tree_head_t;
+
+/** @brief Link of an element */
+#define LINK(ELEM, LINK_OFF) ((tree_link_t *) ((char *) (ELEM) + (LINK_OFF)))
+
+/** @brief Key of an element */
+#define KEY(ELEM, KEY_OFF) (*(uint64_t *) ((char *) (ELEM) + (KEY_OFF)))
+
+/** @brief Whether an element, possibly a missing child, is red */
+#define IS_RED(ELEM, LINK_OFF) \
+	((ELEM) && LINK((ELEM), (LINK_OFF))->color == T_RED)
+
+/** @brief Points whatever pointed to old, its parent's child pointer or the
+ *         root, to new instead.
+ *
+ *  @param head Tree head
+ *  @param parent Parent of old, NULL if old is the root
+ *  @param old Element being replaced
+ *  @param new Replacement, may be NULL
+ *  @param link_off Offset of the link in the element
+ *  @return Void.
+ */
+static void
+replace_child( tree_head_t *head, void *parent, void *old, void *new,
+               size_t link_off )
+{
+	if (!parent)
+		head->root = new;
+	else if (LINK(parent, link_off)->child[0] == old)
+		LINK(parent, link_off)->child[0] = new;
+	else
+		LINK(parent, link_off)->child[1] = new;
+}
+
+/** @brief Rotates the child of elem opposite to dir into elem's place,
+ *         elem becoming its child on the dir side.
+ *
+ *  @param head Tree head
+ *  @param elem Element to rotate down
+ *  @param dir 0 to rotate left, 1 to rotate right
+ *  @param link_off Offset of the link in the element
+ *  @return Void.
+ */
+static void
+rotate( tree_head_t *head, void *elem, int dir, size_t link_off )
+{
+	tree_link_t *link = LINK(elem, link_off);
+	void *up = link->child[!dir];
+	tree_link_t *up_link = LINK(up, link_off);
+
+	link->child[!dir] = up_link->child[dir];
+	if (up_link->child[dir])
+		LINK(up_link->child[dir], link_off)->parent = elem;
+
+	up_link->parent = link->parent;
+	replace_child(head, link->parent, elem, up, link_off);
+
+	up_link->child[dir] = elem;
+	link->parent = up;
+}
+
+/** @brief Gets the leftmost element of a subtree.
+ *
+ *  @param elem Root of the subtree
+ *  @param link_off Offset of the link in the element
+ *  @return Leftmost element
+ */
+static void *
+leftmost( void *elem, size_t link_off )
+{
+	while (LINK(elem, link_off)->child[0])
+		elem = LINK(elem, link_off)->child[0];
+	return elem;
+}
+
+/** @brief Gets the element following elem in key order.
+ *
+ *  @param elem Element in a tree
+ *  @param link_off Offset of the link in the element
+ *  @return Next element, NULL if elem is the last one
+ */
+void *
+tree_next( void *elem, size_t link_off )
+{
+	assert(elem && LINK(elem, link_off)->color != T_DETACHED);
+
+	if (LINK(elem, link_off)->child[1])
+		return leftmost(LINK(elem, link_off)->child[1], link_off);
+
+	void *parent = LINK(elem, link_off)->parent;
+	while (parent && LINK(parent, link_off)->child[1] == elem) {
+		elem = parent;
+		parent = LINK(elem, link_off)->parent;
+	}
+	return parent;
+}
+
+/** @brief Inserts an element, after any element with the same key.
+ *
+ *  @param v_head Tree head
+ *  @param elem Element not in any tree through this link
+ *  @param key_off Offset of the uint64_t key in the element
+ *  @param link_off Offset of the link in the element
+ *  @return Void.
+ */
+void
+tree_insert( void *v_head, void *elem, size_t key_off, size_t link_off )
+{
+	tree_head_t *head = v_head;
+	tree_link_t *link = LINK(elem, link_off);
+	assert(link->color == T_DETACHED);
+
+	/* Equal keys go right, after the elements already there */
+	uint64_t key = KEY(elem, key_off);
+	void *parent = NULL;
+	int dir = 0;
+	for (void *curr = head->root; curr;
+	     curr = LINK(curr, link_off)->child[dir]) {
+		parent = curr;
+		dir = key >= KEY(curr, key_off);
+	}
+	link->parent = parent;
+	link->child[0] = NULL;
+	link->child[1] = NULL;
+	link->color = T_RED;
+	if (parent)
+		LINK(parent, link_off)->child[dir] = elem;
+	else
+		head->root = elem;
+
+	if (!head->min || key < KEY(head->min, key_off))
+		head->min = elem;
+
+	/* Restore that no red element has a red parent */
+	void *x = elem;
+	while (IS_RED(LINK(x, link_off)->parent, link_off)) {
+		void *p = LINK(x, link_off)->parent;
+		/* A red parent is never the root, which is black */
+		void *g = LINK(p, link_off)->parent;
+		dir = LINK(g, link_off)->child[1] == p;
+		void *uncle = LINK(g, link_off)->child[!dir];
+
+		if (IS_RED(uncle, link_off)) {
+			LINK(p, link_off)->color = T_BLACK;
+			LINK(uncle, link_off)->color = T_BLACK;
+			LINK(g, link_off)->color = T_RED;
+			x = g;
+			continue;
+		}
+		if (LINK(p, link_off)->child[!dir] == x) {
+			rotate(head, p, dir, link_off);
+			x = p;
+			p = LINK(x, link_off)->parent;
+		}
+		LINK(p, link_off)->color = T_BLACK;
+		LINK(g, link_off)->color = T_RED;
+		rotate(head, g, !dir, link_off);
+	}
+	LINK(head->root, link_off)->color = T_BLACK;
+}
+
+/** @brief Restores the black height of a tree after a black element was
+ *         removed from above x.
+ *
+ *  @param head Tree head
+ *  @param x Element which took the removed element's place, may be NULL
+ *  @param parent Parent of x
+ *  @param link_off Offset of the link in the element
+ *  @return Void.
+ */
+static void
+remove_fixup( tree_head_t *head, void *x, void *parent, size_t link_off )
+{
+	while (x != head->root && !IS_RED(x, link_off)) {
+		/* x is one black short, and so its sibling is never missing */
+		int dir = LINK(parent, link_off)->child[0] != x;
+		void *sibling = LINK(parent, link_off)->child[!dir];
+
+		if (IS_RED(sibling, link_off)) {
+			LINK(sibling, link_off)->color = T_BLACK;
+			LINK(parent, link_off)->color = T_RED;
+			rotate(head, parent, dir, link_off);
+			sibling = LINK(parent, link_off)->child[!dir];
+		}
+		tree_link_t *s_link = LINK(sibling, link_off);
+		if (!IS_RED(s_link->child[0], link_off)
+		    && !IS_RED(s_link->child[1], link_off)) {
+			s_link->color = T_RED;
+			x = parent;
+			parent = LINK(x, link_off)->parent;
+			continue;
+		}
+		if (!IS_RED(s_link->child[!dir], link_off)) {
+			LINK(s_link->child[dir], link_off)->color = T_BLACK;
+			s_link->color = T_RED;
+			rotate(head, sibling, !dir, link_off);
+			sibling = LINK(parent, link_off)->child[!dir];
+			s_link = LINK(sibling, link_off);
+		}
+		s_link->color = LINK(parent, link_off)->color;
+		LINK(parent, link_off)->color = T_BLACK;
+		LINK(s_link->child[!dir], link_off)->color = T_BLACK;
+		rotate(head, parent, dir, link_off);
+		x = head->root;
+		break;
+	}
+	if (x)
+		LINK(x, link_off)->color = T_BLACK;
+}
+
+/** @brief Removes an element from its tree.
+ *
+ *  @param v_head Head of the tree elem is in
+ *  @param elem Element to remove
+ *  @param link_off Offset of the link in the element
+ *  @return Void.
+ */
+void
+tree_remove( void *v_head, void *elem, size_t link_off )
+{
+	tree_head_t *head = v_head;
+	tree_link_t *link = LINK(elem, link_off);
+	assert(link->color != T_DETACHED);
+
+	if (head->min == elem)
+		head->min = tree_next(elem, link_off);
+
+	/* x takes the place of whichever element leaves its position, which is
+	 * elem itself, or its successor if elem has two children */
+	void *x, *parent;
+	int color;
+	if (!link->child[0] || !link->child[1]) {
+		x = link->child[0] ? link->child[0] : link->child[1];
+		parent = link->parent;
+		color = link->color;
+		if (x)
+			LINK(x, link_off)->parent = parent;
+		replace_child(head, parent, elem, x, link_off);
+	} else {
+		/* The successor has no left child */
+		void *succ = leftmost(link->child[1], link_off);
+		tree_link_t *s_link = LINK(succ, link_off);
+		x = s_link->child[1];
+		color = s_link->color;
+		if (s_link->parent == elem) {
+			parent = succ;
+		} else {
+			parent = s_link->parent;
+			if (x)
+				LINK(x, link_off)->parent = parent;
+			LINK(parent, link_off)->child[0] = x;
+			s_link->child[1] = link->child[1];
+			LINK(link->child[1], link_off)->parent = succ;
+		}
+		s_link->child[0] = link->child[0];
+		LINK(link->child[0], link_off)->parent = succ;
+		s_link->parent = link->parent;
+		s_link->color = link->color;
+		replace_child(head, link->parent, elem, succ, link_off);
+	}
+	if (color == T_BLACK)
+		remove_fixup(head, x, parent, link_off);
+
+	link->parent = NULL;
+	link->child[0] = NULL;
+	link->child[1] = NULL;
+	link->color = T_DETACHED;
+}
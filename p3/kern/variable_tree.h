@@ -0,0 +1,168 @@
+/** @file variable_tree.h
+ *
+ *  @brief Generalized intrusive balanced search tree, keyed by a uint64_t
+ *  field of its elements.
+ *
+ *  Like variable_queue.h, elements embed a link generated by T_NEW_LINK()
+ *  and the T_* macros take the element type and the names of its key and
+ *  link fields. The tree is a red-black tree, so inserts and removes take
+ *  O(log n) time, and its head caches the element with the smallest key,
+ *  so T_GET_MIN() takes O(1) time.
+ *
+ *  Elements with equal keys are kept in insertion order, a new element going
+ *  after those already in the tree. An element's key must not change while
+ *  it is in the tree, remove it first.
+ *
+ *  Like a queue, a tree must only be manipulated by one thread at any one
+ *  time.
+ *
+ *  This header file is not placed in inc/ since it is private to the kernel's
+ *  own modules.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef _VARIABLE_TREE_H_
+#define _VARIABLE_TREE_H_
+
+#include <stddef.h> /* NULL, offsetof */
+#include <stdint.h> /* uint64_t */
+
+/* Colors of a link, an element not in any tree has none */
+#define T_DETACHED 0
+#define T_RED 1
+#define T_BLACK 2
+
+/** @def T_NEW_HEAD(T_HEAD_TYPE, T_ELEM_TYPE)
+ *
+ *  @brief Generates a new structure of type T_HEAD_TYPE representing the head
+ *  of a tree of elements of type T_ELEM_TYPE.
+ *
+ *  Usage: T_NEW_HEAD(T_HEAD_TYPE, T_ELEM_TYPE); //create the type <br>
+ *         T_HEAD_TYPE headName; //instantiate a head of the given type
+ *
+ *  @param T_HEAD_TYPE the type you wish the newly-generated structure to have.
+ *  @param T_ELEM_TYPE the type of elements stored in the tree.
+ *         T_ELEM_TYPE must be a structure.
+ **/
+#define T_NEW_HEAD(T_HEAD_TYPE, T_ELEM_TYPE) \
+typedef struct {\
+	struct T_ELEM_TYPE *root;\
+	struct T_ELEM_TYPE *min;\
+} T_HEAD_TYPE;
+
+/** @def T_NEW_LINK(T_ELEM_TYPE)
+ *
+ *  @brief Instantiates a link within a structure, allowing that structure to
+ *         be put in a tree created with T_NEW_HEAD.
+ *
+ *  Usage: <br>
+ *  typedef struct T_ELEM_TYPE {<br>
+ *  T_NEW_LINK(T_ELEM_TYPE) LINK_NAME; //instantiate the link <br>
+ *  } T_ELEM_TYPE; <br>
+ *
+ *  index 0 of child is the left child, index 1 the right child
+ *
+ *  @param T_ELEM_TYPE the type of the structure containing the link
+ **/
+#define T_NEW_LINK(T_ELEM_TYPE) \
+struct {\
+	struct T_ELEM_TYPE *parent;\
+	struct T_ELEM_TYPE *child[2];\
+	int color;\
+}
+
+/** @def T_INIT_HEAD(T_HEAD)
+ *
+ *  @brief Initializes the head of a tree to an empty tree.
+ *
+ *  @param T_HEAD pointer to the tree head to initialize
+ **/
+#define T_INIT_HEAD(T_HEAD) do\
+{\
+	(T_HEAD)->root = NULL;\
+	(T_HEAD)->min = NULL;\
+} while (0)
+
+/** @def T_INIT_ELEM(T_ELEM, LINK_NAME)
+ *
+ *  @brief Initializes the link named LINK_NAME in an instance of the
+ *         structure T_ELEM.
+ *
+ *  @param T_ELEM pointer to the structure instance containing the link
+ *  @param LINK_NAME the name of the link to initialize
+ **/
+#define T_INIT_ELEM(T_ELEM, LINK_NAME) do\
+{\
+	(T_ELEM)->LINK_NAME.parent = NULL;\
+	(T_ELEM)->LINK_NAME.child[0] = NULL;\
+	(T_ELEM)->LINK_NAME.child[1] = NULL;\
+	(T_ELEM)->LINK_NAME.color = T_DETACHED;\
+} while (0)
+
+/** @def T_IN_TREE(T_ELEM, LINK_NAME)
+ *
+ *  @brief Whether an element is in some tree through the link LINK_NAME.
+ *
+ *  @param T_ELEM pointer to the element
+ *  @param LINK_NAME name of the T_NEW_LINK link field of the element
+ *  @return 1 if it is, 0 if not
+ **/
+#define T_IN_TREE(T_ELEM, LINK_NAME) \
+	((T_ELEM)->LINK_NAME.color != T_DETACHED)
+
+/** @def T_GET_MIN(T_HEAD)
+ *
+ *  @brief Gets the element with the smallest key, the one inserted first if
+ *         several share it.
+ *
+ *  @param T_HEAD pointer to the tree head
+ *  @return pointer to the element, NULL if the tree is empty
+ **/
+#define T_GET_MIN(T_HEAD) ((T_HEAD)->min)
+
+/** @def T_GET_NEXT(T_ELEM, LINK_NAME)
+ *
+ *  @brief Gets the element following T_ELEM in key order.
+ *
+ *  @param T_ELEM pointer to an element in a tree
+ *  @param LINK_NAME name of the T_NEW_LINK link field of the element
+ *  @return pointer to the next element, NULL if T_ELEM is the last one
+ **/
+#define T_GET_NEXT(T_ELEM, LINK_NAME) \
+	((__typeof__(T_ELEM)) tree_next((T_ELEM),\
+	                                offsetof(__typeof__(*(T_ELEM)), LINK_NAME)))
+
+/** @def T_INSERT(T_HEAD, T_ELEM, KEY_NAME, LINK_NAME)
+ *
+ *  @brief Inserts an element which is not in any tree through LINK_NAME.
+ *
+ *  @param T_HEAD pointer to the tree head
+ *  @param T_ELEM pointer to the element to insert
+ *  @param KEY_NAME name of the uint64_t key field of the element
+ *  @param LINK_NAME name of the T_NEW_LINK link field of the element
+ **/
+#define T_INSERT(T_HEAD, T_ELEM, KEY_NAME, LINK_NAME) \
+	tree_insert((T_HEAD), (T_ELEM),\
+	            offsetof(__typeof__(*(T_ELEM)), KEY_NAME),\
+	            offsetof(__typeof__(*(T_ELEM)), LINK_NAME))
+
+/** @def T_REMOVE(T_HEAD, T_ELEM, LINK_NAME)
+ *
+ *  @brief Removes an element from the tree it is in, leaving its link as
+ *         T_INIT_ELEM() does.
+ *
+ *  @param T_HEAD pointer to the head of the tree the element is in
+ *  @param T_ELEM pointer to the element to remove
+ *  @param LINK_NAME name of the T_NEW_LINK link field of the element
+ **/
+#define T_REMOVE(T_HEAD, T_ELEM, LINK_NAME) \
+	tree_remove((T_HEAD), (T_ELEM),\
+	            offsetof(__typeof__(*(T_ELEM)), LINK_NAME))
+
+/* Type independent implementation, only to be called through the macros */
+void tree_insert( void *head, void *elem, size_t key_off, size_t link_off );
+void tree_remove( void *head, void *elem, size_t link_off );
+void *tree_next( void *elem, size_t link_off );
+
+#endif /* _VARIABLE_TREE_H_ */
@@ -0,0 +1,256 @@
+/** @file rdcompress.c
+ *  @brief Host tool which compresses RAM disk files in place.
+ *
+ *  Usage: rdcompress -t table.c file...
+ *
+ *  Each file is rewritten in the compressed RAM disk format described in
+ *  kern/inc/ramdisk.h, one LZ4 block per RAMDISK_BLOCK_SIZE bytes. Files
+ *  which are already compressed, or which would not get smaller, are left
+ *  untouched, so running the tool twice over the same files is harmless.
+ *
+ *  table.c is then written with the table the kernel looks up compressed
+ *  files in, listing the RAM disk name of every file stored compressed.
+ *
+ *  Built and run by the build when CONFIG_COMPRESS_RAMDISK is enabled in
+ *  config.mk.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ramdisk.h>
+
+/* LZ4 block format constants */
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_SEARCH_LIMIT 12
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+
+/* Worst case LZ4 output for a block, all literals plus length bytes */
+#define BLOCK_BOUND (RAMDISK_BLOCK_SIZE + RAMDISK_BLOCK_SIZE / 255 + 16)
+
+/** @brief Hashes the 4 bytes at p */
+static uint32_t
+hash4( const uint8_t *p )
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/** @brief Writes an LZ4 length extension for len >= 15 */
+static uint8_t *
+put_length( uint8_t *op, int len )
+{
+	len -= 15;
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+/** @brief Writes one LZ4 sequence. match_len is 0 for the final sequence,
+ *         which holds only literals. */
+static uint8_t *
+put_sequence( uint8_t *op, const uint8_t *lit, int lit_len, int offset,
+              int match_len )
+{
+	uint8_t *token = op++;
+	int match_code = match_len ? match_len - MIN_MATCH : 0;
+
+	*token = ((lit_len < 15 ? lit_len : 15) << 4)
+	         | (match_code < 15 ? match_code : 15);
+	if (lit_len >= 15)
+		op = put_length(op, lit_len);
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if (match_len) {
+		*op++ = offset & 0xff;
+		*op++ = offset >> 8;
+		if (match_code >= 15)
+			op = put_length(op, match_code);
+	}
+	return op;
+}
+
+/** @brief Greedy LZ4 block compressor.
+ *
+ *  @param src Bytes to compress
+ *  @param len Number of bytes, at most RAMDISK_BLOCK_SIZE
+ *  @param dst Output buffer of at least BLOCK_BOUND bytes
+ *  @return Compressed length
+ */
+static int
+lz4_compress( const uint8_t *src, int len, uint8_t *dst )
+{
+	int table[1 << HASH_BITS];
+	memset(table, -1, sizeof(table));
+
+	uint8_t *op = dst;
+	int anchor = 0;
+	int pos = 0;
+
+	while (pos + MATCH_SEARCH_LIMIT <= len) {
+		uint32_t h = hash4(src + pos);
+		int cand = table[h];
+		table[h] = pos;
+
+		if (cand < 0 || pos - cand > MAX_OFFSET
+		    || memcmp(src + cand, src + pos, MIN_MATCH) != 0) {
+			++pos;
+			continue;
+		}
+		int match_len = MIN_MATCH;
+		while (pos + match_len < len - LAST_LITERALS
+		       && src[cand + match_len] == src[pos + match_len])
+			++match_len;
+
+		op = put_sequence(op, src + anchor, pos - anchor, pos - cand,
+		                  match_len);
+		pos += match_len;
+		anchor = pos;
+	}
+	return put_sequence(op, src + anchor, len - anchor, 0, 0) - dst;
+}
+
+/** @brief Compresses one file in place.
+ *
+ *  @param path File to compress
+ *  @param compressedp Set to 1 if the file is stored compressed afterwards,
+ *         0 if it is stored raw
+ *  @return 0 on success or if the file was left alone, -1 on error
+ */
+static int
+compress_file( const char *path, int *compressedp )
+{
+	*compressedp = 0;
+
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long raw_len = ftell(f);
+	rewind(f);
+
+	uint8_t *raw = malloc(raw_len ? raw_len : 1);
+	if (!raw || fread(raw, 1, raw_len, f) != raw_len) {
+		fprintf(stderr, "%s: read failed\n", path);
+		fclose(f);
+		free(raw);
+		return -1;
+	}
+	fclose(f);
+
+	uint32_t magic = 0;
+	if (raw_len >= sizeof(magic))
+		memcpy(&magic, raw, sizeof(magic));
+	if (magic == RAMDISK_MAGIC) {
+		*compressedp = 1;
+		free(raw);
+		return 0;
+	}
+
+	ramdisk_header_t hdr;
+	hdr.magic = RAMDISK_MAGIC;
+	hdr.raw_len = raw_len;
+	hdr.num_blocks = (raw_len + RAMDISK_BLOCK_SIZE - 1) / RAMDISK_BLOCK_SIZE;
+
+	uint32_t *offsets = calloc(hdr.num_blocks + 1, sizeof(uint32_t));
+	uint8_t *blocks = malloc(hdr.num_blocks * BLOCK_BOUND + 1);
+	if (!offsets || !blocks) {
+		fprintf(stderr, "%s: out of memory\n", path);
+		free(raw);
+		free(offsets);
+		free(blocks);
+		return -1;
+	}
+	uint32_t out = 0;
+	for (uint32_t i = 0; i < hdr.num_blocks; ++i) {
+		long block_len = raw_len - (long) i * RAMDISK_BLOCK_SIZE;
+		if (block_len > RAMDISK_BLOCK_SIZE)
+			block_len = RAMDISK_BLOCK_SIZE;
+		const uint8_t *src = raw + (long) i * RAMDISK_BLOCK_SIZE;
+
+		offsets[i] = out;
+		int comp_len = lz4_compress(src, block_len, blocks + out);
+
+		/* Store incompressible blocks as is, see ramdisk.h */
+		if (comp_len >= block_len) {
+			memcpy(blocks + out, src, block_len);
+			comp_len = block_len;
+		}
+		out += comp_len;
+	}
+	offsets[hdr.num_blocks] = out;
+
+	long total = sizeof(hdr) + (hdr.num_blocks + 1) * sizeof(uint32_t) + out;
+	int res = 0;
+	if (total < raw_len) {
+		f = fopen(path, "wb");
+		if (!f
+		    || fwrite(&hdr, sizeof(hdr), 1, f) != 1
+		    || fwrite(offsets, sizeof(uint32_t), hdr.num_blocks + 1, f)
+		       != hdr.num_blocks + 1
+		    || fwrite(blocks, 1, out, f) != out) {
+			fprintf(stderr, "%s: write failed\n", path);
+			res = -1;
+		}
+		if (f)
+			fclose(f);
+		printf("rdcompress: %s %ld -> %ld bytes\n", path, raw_len, total);
+		*compressedp = !res;
+	}
+	free(raw);
+	free(offsets);
+	free(blocks);
+	return res;
+}
+
+/** @brief Returns the name a file goes by on the RAM disk, its base name */
+static const char *
+ramdisk_name( const char *path )
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	if (argc < 3 || strcmp(argv[1], "-t") != 0) {
+		fprintf(stderr, "usage: rdcompress -t table.c file...\n");
+		return 1;
+	}
+	FILE *table = fopen(argv[2], "w");
+	if (!table) {
+		perror(argv[2]);
+		return 1;
+	}
+	fprintf(table, "/* Generated by rdcompress, do not edit */\n\n"
+	               "#include <stddef.h>\n\n"
+	               "const char *%s[] = {\n", RAMDISK_TABLE_NAME);
+
+	int res = 0;
+	for (int i = 3; i < argc; ++i) {
+		int compressed;
+		if (compress_file(argv[i], &compressed) < 0)
+			res = 1;
+		if (compressed)
+			fprintf(table, "\t\"%s\",\n", ramdisk_name(argv[i]));
+	}
+	fprintf(table, "\tNULL\n};\n");
+	if (fclose(table) != 0) {
+		perror(argv[2]);
+		res = 1;
+	}
+	return res;
+}
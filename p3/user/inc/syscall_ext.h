@@ -0,0 +1,129 @@
+/** @file syscall_ext.h
+ *  @brief Prototypes of the system calls this kernel provides beyond the
+ *         Pebbles specification in syscall.h.
+ */
+
+#ifndef SYSCALL_EXT_H_
+#define SYSCALL_EXT_H_
+
+/* open() flags and lseek() whence, these have to match kern/inc/tmpfs.h */
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR   2
+#define O_CREAT  0x100
+#define O_TRUNC  0x200
+#define O_APPEND 0x400
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* waitpid() and wait_many() flags, these have to match
+ * kern/lib_life_cycle/life_cycle.h */
+#define WNOHANG 0x1
+
+/* Most child tasks one wait_many() call collects */
+#define WAIT_MANY_MAX 256
+
+/* getrusage() who, and the usage it reports. These have to match
+ * kern/inc/rusage.h */
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN 1
+#define RUSAGE_THREAD 2
+
+typedef struct {
+	unsigned long long runtime_cycles; /* CPU time in TSC cycles */
+	unsigned int runtime_ms; /* CPU time in milliseconds */
+	unsigned int voluntary_switches; /* Switched out to block or yield */
+	unsigned int involuntary_switches; /* Preempted */
+	unsigned int page_faults;
+	unsigned int syscalls;
+	unsigned int threads; /* Threads the usage adds up */
+} rusage_t;
+
+/* Nice values and set_priority() which. These have to match
+ * kern/inc/priority.h */
+#define NICE_MIN -20
+#define NICE_MAX 19
+#define PRIO_THREAD 0
+#define PRIO_TASK 1
+
+/* Longest set_deadline() period in ticks. This has to match
+ * kern/inc/deadline.h */
+#define DL_MAX_PERIOD 65535
+
+/* Task groups and the longest set_group_quota() period in ticks. These
+ * have to match kern/inc/task_group.h */
+#define TASK_GROUP_MAX 16
+#define TASK_GROUP_MAX_PERIOD 65535
+
+/* set_wake_policy() policies. These have to match kern/inc/wake_policy.h */
+#define WAKE_TAIL 0
+#define WAKE_PREEMPT 1
+#define WAKE_PREEMPT_SLICE 2
+
+/* Most set_gang_batch() switches in a row. This has to match
+ * kern/inc/gang_dispatch.h */
+#define GANG_BATCH_MAX 64
+
+/* task_snapshot() buffer layout, see kern/inc/task_snapshot.h for the
+ * meaning of each field. These have to match it. */
+#define TASK_SNAPSHOT_VERSION 1
+#define TASK_SNAPSHOT_NAME_LEN 32
+
+typedef struct {
+	unsigned int version;
+	unsigned int header_size;
+	unsigned int entry_size;
+	unsigned int num_entries;
+	unsigned int num_tasks;
+	unsigned int ticks;
+	unsigned int tsc_per_tick;
+	unsigned int cr3_writes;
+} task_snapshot_header_t;
+
+typedef struct {
+	unsigned int pid;
+	unsigned int ppid;
+	char execname[TASK_SNAPSHOT_NAME_LEN];
+	unsigned int num_threads;
+	unsigned int num_running;
+	unsigned int num_runnable;
+	unsigned int num_blocked;
+	unsigned int num_descheduled;
+	unsigned int num_child_tasks;
+	unsigned long long runtime_cycles;
+	unsigned int runtime_ms;
+	unsigned int voluntary_switches;
+	unsigned int involuntary_switches;
+	unsigned int page_faults;
+	unsigned int syscalls;
+} task_snapshot_entry_t;
+
+int map_file( char *filename, void *base, char **datap );
+int open( char *filename, int flags );
+int read( int fd, char *buf, int len );
+int write( int fd, char *buf, int len );
+int lseek( int fd, int offset, int whence );
+int close( int fd );
+int unlink( char *filename );
+int waitpid( int tid, int *status_ptr, int flags );
+int wait_many( int *status_array, int *tid_array, int max, int flags );
+int getrusage( int who, rusage_t *usage );
+int task_snapshot( void *buf, int len );
+void thread_exit( void *status );
+int thread_join( int tid, void **statusp );
+int set_priority( int which, int id, int nice );
+int set_deadline( int period, int runtime, int deadline );
+int wait_period( void );
+int set_group_quota( int group, int quota, int period );
+int join_group( int group );
+int set_wake_policy( int policy, int slice_percent );
+int set_gang_batch( int batch );
+
+/* Whether system calls enter the kernel with sysenter, which they do by
+ * default when the CPU has it, or with INT. In libsyscall, not a system
+ * call */
+int use_sysenter( int on );
+
+#endif /* SYSCALL_EXT_H_ */
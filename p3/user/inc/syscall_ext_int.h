@@ -0,0 +1,32 @@
+/** @file syscall_ext_int.h
+ *  @brief IDT vectors of the system calls this kernel provides beyond the
+ *         Pebbles specification in syscall_int.h.
+ *
+ *  These definitions have to match the ones in kern/inc/syscall_ext_int.h
+ */
+
+#ifndef SYSCALL_EXT_INT_H_
+#define SYSCALL_EXT_INT_H_
+
+#define MAP_FILE_INT 0x80
+#define OPEN_INT 0x81
+#define READ_INT 0x82
+#define WRITE_INT 0x83
+#define CLOSE_INT 0x84
+#define UNLINK_INT 0x85
+#define LSEEK_INT 0x86
+#define WAITPID_INT 0x87
+#define WAIT_MANY_INT 0x88
+#define GETRUSAGE_INT 0x89
+#define TASK_SNAPSHOT_INT 0x8A
+#define THREAD_EXIT_INT 0x8B
+#define THREAD_JOIN_INT 0x8C
+#define SET_PRIORITY_INT 0x8D
+#define SET_DEADLINE_INT 0x8E
+#define WAIT_PERIOD_INT 0x8F
+#define SET_GROUP_QUOTA_INT 0x90
+#define JOIN_GROUP_INT 0x91
+#define SET_WAKE_POLICY_INT 0x92
+#define SET_GANG_BATCH_INT 0x93
+
+#endif /* SYSCALL_EXT_INT_H_ */
@@ -72,12 +72,10 @@ install_autostack(void *stack_high, void *stack_low)
 	assert(global_stack_low == 0);
 	global_stack_low = stack_low;
 
-	/* Initialize thread status for root thread except for exit_cvar */
+	/* Initialize thread status for root thread */
 	root_tstatus.thr_stack_low = stack_low;
 	root_tstatus.thr_stack_high = stack_high;
 	root_tstatus.tid = gettid();
-	root_tstatus.exited = 0;
-	root_tstatus.status = 0;
 
 	/* esp3 argument points to an address 1 word higher than first address */
 	Swexn(exn_stack + PAGE_SIZE - WORD_SIZE, pf_swexn_handler, 0, 0);
@@ -0,0 +1,44 @@
+/** @file sysenter.h
+ *  @brief Macro for system call wrappers to enter the kernel with sysenter
+ *         when they can, see sysenter.S
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#ifndef SYSENTER_H_
+#define SYSENTER_H_
+
+/* sysenter_state values */
+#define SYSENTER_UNKNOWN	0 /* Not checked whether the CPU has sysenter */
+#define SYSENTER_ON			1 /* Use sysenter */
+#define SYSENTER_OFF		2 /* Use INT */
+
+/* cpuid leaf, and bit of %edx in it, telling whether the CPU has sysenter
+ * and sysexit. These have to match kern/inc/sysenter.h */
+#define CPUID_FEATURES	1
+#define CPUID_SEP		(1 << 11)
+
+/** @def SYSCALL(VECTOR)
+ *  @brief Makes the system call whose INT gate is at VECTOR, with sysenter
+ *         if the CPU has it and with INT otherwise.
+ *
+ *  Takes the argument in %esi and returns the result in %eax as INT does.
+ *  Clobbers %ecx and %edx, which are caller save. Only for the system
+ *  calls kern/sysenter.S takes.
+ *
+ *  @param VECTOR IDT vector of the system call
+ */
+#define SYSCALL(VECTOR)\
+	movl $VECTOR, %eax;\
+	cmpl $SYSENTER_ON, sysenter_state;\
+	je 1f;\
+	cmpl $SYSENTER_OFF, sysenter_state;\
+	je 2f;\
+	call sysenter_probe; /* Sets sysenter_state, keeps %eax */\
+	cmpl $SYSENTER_ON, sysenter_state;\
+	jne 2f;\
+1:	call sysenter_call;\
+	jmp 3f;\
+2:	int $VECTOR;\
+3:
+
+#endif /* SYSENTER_H_ */
@@ -28,17 +28,13 @@ extern int THR_INITIALIZED;
  *  @param thr_stack_low Lowest valid memory address in thread stack
  *  @param thr_stack_high Highest valid memory address in thread stack
  *  @param tid Thread ID (matching that of gettid() syscall)
- *  @param exit_cvar A cvar which will receive a broadcast on thr_exit
- *  @param exited Whether the thread has exited
- *  @param statusp Status which the thread exited with. Valid iff exited == 1
+ *
+ *  Exit statuses are kept by the kernel, see thread_join().
  */
 typedef struct {
 	char *thr_stack_low;
 	char *thr_stack_high;
 	int tid;
-    cond_t *exit_cvar;
-    int exited;
-    void *status;
 } thr_status_t;
 
 /** @brief Status for root thread */
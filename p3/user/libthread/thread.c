@@ -3,10 +3,11 @@
  *  @brief This file implements the Thread Management API declared in
  *         thread.h
  *
- *  Threads are 1:1 with kernel threads. Communication across threads
- *  is managed through a tid -> thread_status hashmap. This is used
- *  to enable join to receive exit status from exiting thread, as well
- *  as to clean up its resources.
+ *  Threads are 1:1 with kernel threads. The kernel keeps a thread's exit
+ *  status once it vanishes with thread_exit(), and thread_join() blocks in
+ *  the kernel until the thread is gone, so joining neither spins nor needs
+ *  a condition variable. A tid -> thread_status hashmap only remembers each
+ *  thread's stack, for the joining thread to free.
  *
  *  @author Nicklaus Choo (nchoo)
  *  @author Andre Nascimento (anascime)
@@ -19,7 +20,7 @@
 #include <assert.h> /* assert() */
 #include <mutex.h> /* mutex_t */
 #include <string.h> /* memset() */
-#include <cond.h> /* con_wait(), con_signal() */
+#include <syscall_ext.h> /* thread_exit(), thread_join() */
 #include <simics.h> /* MAGIC_BREAK */
 #include <ureg.h> /* ureg_t */
 #include <autostack_internals.h> /* child_pf_handler(), Swexn() */
@@ -39,7 +40,7 @@ mutex_t malloc_mutex;
 /** @brief Indicates whether thr library has been initialized */
 int THR_INITIALIZED = 0;
 
-/** @brief Mutex for thread status info. */
+/** @brief Mutex for the thread status hashmap. */
 mutex_t thr_status_mux;
 
 
@@ -75,16 +76,6 @@ thr_init( unsigned int size )
 	}
     /* Initialize hashmap to store thread status information */
     init_map();
-
-	/* Allocate exit_cvar for root thread */
-	cond_t *exit_cvar = malloc(sizeof(exit_cvar));
-	if (!exit_cvar)
-		return -1;
-
-	/* Initialize exit_cvar for root thread and add to hashtable */
-	if (cond_init(exit_cvar) < 0)
-		return -1;
-	root_tstatus.exit_cvar = exit_cvar;
 	insert(&root_tstatus);
     THR_INITIALIZED = 1;
 
@@ -126,19 +117,7 @@ thr_create( void *(*func)(void *), void *arg )
 	}
     memset(child_tp, 0, sizeof(thr_status_t));
 
-	cond_t *exit_cvar = malloc(sizeof(exit_cvar));
-	if (!exit_cvar) {
-		free(thr_stack);
-		free(child_tp);
-		return -1;
-	}
-
-	if (cond_init(exit_cvar) < 0) {
-		return -1;
-	}
-
     /* Set child_tp values */
-	child_tp->exit_cvar = exit_cvar;
 	child_tp->thr_stack_low = thr_stack;
 	child_tp->thr_stack_high = thr_stack + THR_STACK_SIZE;
 	assert(((uint32_t)child_tp->thr_stack_high) % ALIGN == 0);
@@ -147,8 +126,12 @@ thr_create( void *(*func)(void *), void *arg )
     mutex_lock(&thr_status_mux);
 
 	int tid = thread_fork(child_tp->thr_stack_high, func, arg);
-	if (tid < 0)
+	if (tid < 0) {
+		mutex_unlock(&thr_status_mux);
+		free(thr_stack);
+		free(child_tp);
 		return -1;
+	}
 
     /* In parent thread, update child information. */
     child_tp->tid = tid;
@@ -164,6 +147,10 @@ thr_create( void *(*func)(void *), void *arg )
 /** @brief Joins a diffent thread, collecting its exit status
  *         and cleaning up its resources. Blocks until thread exits.
  *
+ *  Taking the thread out of the hashmap first makes this the only thread
+ *  to join it, and keeps its entry from being confused with that of a new
+ *  thread reusing its tid once the kernel has reaped it.
+ *
  *  @param tid ID of thread to join
  *  @param statusp Memory location where to store exit status.
  *  @return 0 on success, negative number on failure
@@ -172,47 +159,31 @@ int
 thr_join( int tid, void **statusp )
 {
     mutex_lock(&thr_status_mux);
+	thr_status_t *thr_statusp = remove(tid);
+    mutex_unlock(&thr_status_mux);
 
-	/* con_wait for thread with tid to exit */
-    thr_status_t *thr_statusp;
-	while (1) {
-		/* If some other thread already cleaned up (or if that thread was
-         * never created), do nothing more, return */
-		if ((thr_statusp = get(tid)) == NULL) {
-			mutex_unlock(&thr_status_mux);
-			return -2;
-		}
-		/* If exited and not cleaned up, break and clean up */
-		if (thr_statusp->exited)
-			break;
-
-        cond_wait(thr_statusp->exit_cvar, &thr_status_mux);
-    }
-    /* Collect exit status if statusp non-NULL */
-    assert(thr_statusp->exited);
-    if (statusp) {
-        *statusp = thr_statusp->status;
+	/* Some other thread already joined it, or it was never created */
+	if (!thr_statusp)
+		return -2;
+
+	/* Blocks in the kernel until the thread has vanished */
+	if (thread_join(tid, statusp) < 0) {
+		mutex_lock(&thr_status_mux);
+		insert(thr_statusp);
+		mutex_unlock(&thr_status_mux);
+		return -1;
 	}
-    /* Remove from hashmap, signaling we've cleaned up this thread */
-    remove(tid);
 
-    /* Free child stack and thread status and cond var */
+    /* Free child stack and thread status */
     if (thr_statusp->thr_stack_low == global_stack_low) {
 		if (remove_pages(thr_statusp->thr_stack_low) < 0)
 			return -3;
 	} else {
-		/* free child stack */
         free(thr_statusp->thr_stack_low);
 	}
-    cond_destroy(thr_statusp->exit_cvar);
-    free(thr_statusp->exit_cvar);
-
-    /* Free statusp if not root */
 	if (thr_statusp != &root_tstatus) {
 		free(thr_statusp);
 	}
-    mutex_unlock(&thr_status_mux);
-
     return 0;
 }
 
@@ -224,25 +195,8 @@ thr_join( int tid, void **statusp )
 void
 thr_exit( void *status )
 {
-	int tid = gettid();
-
-    mutex_lock(&thr_status_mux);
-
-    thr_status_t *tp = get(tid);
-    assert(tp);
-    assert(tp->tid == tid);
-
-    /* Store exit status for retrieval in thr_join */
-    tp->exited = 1;
-    tp->status = status;
-
-	/* Tell all waiting joining threads of exit */
-    cond_broadcast(tp->exit_cvar);
-    mutex_unlock(&thr_status_mux);
-
-
-    /* Exit thread */
-    vanish();
+	/* The kernel hands status to thr_join() */
+	thread_exit(status);
 }
 
 /** @brief Yield to another thread.
@@ -0,0 +1,161 @@
+/** @file deadline_miss_bench.c
+ *  @brief Counts missed deadlines of a periodic thread under heavy load,
+ *         as a normal thread and as a deadline thread.
+ *
+ *  Usage: deadline_miss_bench [seconds] [spinners]
+ *
+ *  Forks spinners child tasks (8 by default) which spin at NICE_MIN. Then
+ *  runs a periodic loop doing WORK_MS of work every PERIOD_TICKS, which has
+ *  to be done DEADLINE_TICKS into each period, for the given number of
+ *  seconds (10 by default): first as a normal thread sleeping until each
+ *  period starts, then as a deadline thread with set_deadline() and
+ *  wait_period(). Reports the missed deadlines of both, and fails if the
+ *  deadline thread missed any.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_SPINNERS 8
+#define MAX_SPINNERS 64
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for every spinner to be forked before the first run starts */
+#define START_DELAY_TICKS 200
+
+/* Periodic work, budgeted with a tick to spare for runtime_ms rounding */
+#define PERIOD_TICKS 10
+#define DEADLINE_TICKS 10
+#define BUDGET_TICKS 4
+#define WORK_MS 2
+
+/** @brief Spins at NICE_MIN until the end tick, then exits.
+ *
+ *  @param end Tick to stop spinning at
+ *  @return Does not return.
+ */
+static void
+spin( int end )
+{
+	set_priority(PRIO_THREAD, 0, NICE_MIN);
+	while (get_ticks() < end)
+		continue;
+	exit(0);
+}
+
+/** @brief Spins until the calling thread got WORK_MS more of CPU time.
+ *
+ *  @return Void.
+ */
+static void
+work( void )
+{
+	rusage_t usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	unsigned int done = usage.runtime_ms + WORK_MS;
+	do {
+		getrusage(RUSAGE_THREAD, &usage);
+	} while (usage.runtime_ms < done);
+}
+
+/** @brief Runs the periodic work as a normal thread, which sleeps until
+ *         each period starts and checks its deadline itself.
+ *
+ *  @param num_periods Number of periods to run
+ *  @return Number of missed deadlines
+ */
+static int
+run_normal( int num_periods )
+{
+	int missed = 0;
+	int release = get_ticks();
+	for (int i = 0; i < num_periods; ++i) {
+		work();
+		int now = get_ticks();
+		if (now > release + DEADLINE_TICKS)
+			missed++;
+		release += PERIOD_TICKS;
+		if (now < release)
+			sleep(release - now);
+	}
+	return missed;
+}
+
+/** @brief Runs the periodic work as a deadline thread.
+ *
+ *  @param num_periods Number of periods to run
+ *  @return Number of missed deadlines, negative value if admission failed
+ */
+static int
+run_deadline( int num_periods )
+{
+	if (set_deadline(PERIOD_TICKS, BUDGET_TICKS, DEADLINE_TICKS) < 0)
+		return -1;
+
+	int missed = 0;
+	for (int i = 0; i < num_periods; ++i) {
+		work();
+		missed += wait_period();
+	}
+	set_deadline(0, 0, 0);
+	return missed;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_spinners = argc > 2 ? atoi(argv[2]) : DEFAULT_SPINNERS;
+	if (seconds <= 0 || num_spinners < 0 || num_spinners > MAX_SPINNERS) {
+		printf("usage: deadline_miss_bench [seconds] [spinners], at most %d "
+		       "spinners\n", MAX_SPINNERS);
+		exit(-1);
+	}
+	int num_periods = seconds * TICKS_PER_SECOND / PERIOD_TICKS;
+
+	/* Spin through both runs, with time to spare for the deadline run to
+	 * fall behind */
+	int start = get_ticks() + START_DELAY_TICKS;
+	int end = start + 3 * seconds * TICKS_PER_SECOND;
+	int forked = 0;
+	for (; forked < num_spinners; ++forked) {
+		int tid = fork();
+		if (tid == 0)
+			spin(end);
+		if (tid < 0) {
+			printf("deadline_miss_bench: fork() failed\n");
+			exit(-1);
+		}
+	}
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+
+	int normal_missed = run_normal(num_periods);
+	int deadline_missed = run_deadline(num_periods);
+	if (deadline_missed < 0)
+		printf("deadline_miss_bench: set_deadline() admission failed\n");
+	int failed = deadline_missed != 0;
+
+	lprintf("deadline_miss_bench: %d spinners, %d periods of %d ticks, "
+	        "normal thread missed %d, deadline thread missed %d, %s",
+	        num_spinners, num_periods, PERIOD_TICKS, normal_missed,
+	        deadline_missed, failed ? "FAIL" : "PASS");
+	printf("deadline_miss_bench: %d spinners, %d periods of %d ticks, "
+	       "normal thread missed %d, deadline thread missed %d, %s\n",
+	       num_spinners, num_periods, PERIOD_TICKS, normal_missed,
+	       deadline_missed, failed ? "FAIL" : "PASS");
+
+	int status;
+	for (int i = 0; i < forked; ++i)
+		wait(&status);
+	exit(failed ? -1 : 0);
+}
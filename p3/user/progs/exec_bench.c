@@ -0,0 +1,127 @@
+/** @file exec_bench.c
+ *  @brief Measures exec() latency and allocator traffic from a big process
+ *         by repeatedly exec()ing itself.
+ *
+ *  Usage: exec_bench [pages]
+ *
+ *  Before each exec() the process touches its BSS_LEN byte bss array and
+ *  the given number of pages (1024 by default) of new_pages() memory, so
+ *  exec() has a big image to replace. Each generation passes on the number
+ *  of exec()s left, the tick count at the start of the chain and the
+ *  physalloc() and smalloc() calls counted so far.
+ *
+ *  Only calls made by exec() itself are counted: the kernel's counts are
+ *  read right before exec() and again first thing in the new image. Touching
+ *  the memory takes one physalloc() per page, which is left out.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+#include "test.h" /* run_test */
+
+/* These definitions have to match the ones in kern/tests.c */
+#define EXEC_BENCH_PHYSALLOCS	4
+#define EXEC_BENCH_SMALLOCS		5
+
+#define NUM_EXECS 1000
+#define DEFAULT_PAGES 1024
+#define BSS_LEN (256 * 1024)
+
+/* Far above the program and below its stack */
+#define REGION_BASE ((char *) 0x40000000)
+
+/* Arguments each generation passes on */
+#define ARG_LEFT		1
+#define ARG_START		2
+#define ARG_PAGES		3
+#define ARG_PHYSALLOCS	4
+#define ARG_SMALLOCS	5
+#define ARG_PHYS_BEFORE	6
+#define ARG_SMALL_BEFORE 7
+#define NUM_ARGS		8
+
+#define ARG_BUF_LEN 16
+
+static char big_bss[BSS_LEN];
+
+int
+main( int argc, char *argv[] )
+{
+	/* First, before anything else allocates */
+	int phys_now = run_test(EXEC_BENCH_PHYSALLOCS);
+	int small_now = run_test(EXEC_BENCH_SMALLOCS);
+
+	int left = NUM_EXECS;
+	int start = get_ticks();
+	int pages = DEFAULT_PAGES;
+	int physallocs = 0;
+	int smallocs = 0;
+
+	if (argc == NUM_ARGS) {
+		left = atoi(argv[ARG_LEFT]);
+		start = atoi(argv[ARG_START]);
+		pages = atoi(argv[ARG_PAGES]);
+		physallocs = atoi(argv[ARG_PHYSALLOCS])
+		             + phys_now - atoi(argv[ARG_PHYS_BEFORE]);
+		smallocs = atoi(argv[ARG_SMALLOCS])
+		           + small_now - atoi(argv[ARG_SMALL_BEFORE]);
+	} else if (argc == 2) {
+		pages = atoi(argv[1]);
+	}
+	if (pages < 0) {
+		printf("usage: exec_bench [pages]\n");
+		exit(-1);
+	}
+
+	if (left == 0) {
+		int elapsed = get_ticks() - start;
+		lprintf("exec_bench: %d execs from %d pages + %d bytes bss in %d "
+		        "ticks, %d physalloc() and %d smalloc() calls",
+		        NUM_EXECS, pages, BSS_LEN, elapsed, physallocs, smallocs);
+		printf("exec_bench: %d execs from %d pages + %d bytes bss in %d "
+		       "ticks\n", NUM_EXECS, pages, BSS_LEN, elapsed);
+		printf("exec_bench: %d physalloc() and %d smalloc() calls, "
+		       "%d and %d per exec\n", physallocs, smallocs,
+		       physallocs / NUM_EXECS, smallocs / NUM_EXECS);
+		exit(0);
+	}
+
+	/* Become a big process */
+	for (int i = 0; i < BSS_LEN; i += PAGE_SIZE)
+		big_bss[i] = 1;
+	if (pages > 0) {
+		if (new_pages(REGION_BASE, pages * PAGE_SIZE) < 0) {
+			lprintf("exec_bench: new_pages() failed with %d left", left);
+			exit(-1);
+		}
+		for (int i = 0; i < pages; ++i)
+			REGION_BASE[i * PAGE_SIZE] = 1;
+	}
+
+	char bufs[NUM_ARGS][ARG_BUF_LEN];
+	snprintf(bufs[ARG_LEFT], ARG_BUF_LEN, "%d", left - 1);
+	snprintf(bufs[ARG_START], ARG_BUF_LEN, "%d", start);
+	snprintf(bufs[ARG_PAGES], ARG_BUF_LEN, "%d", pages);
+	snprintf(bufs[ARG_PHYSALLOCS], ARG_BUF_LEN, "%d", physallocs);
+	snprintf(bufs[ARG_SMALLOCS], ARG_BUF_LEN, "%d", smallocs);
+
+	char *args[NUM_ARGS + 1];
+	args[0] = "exec_bench";
+	for (int i = 1; i < NUM_ARGS; ++i)
+		args[i] = bufs[i];
+	args[NUM_ARGS] = 0;
+
+	/* Last, so only exec() itself is counted */
+	snprintf(bufs[ARG_PHYS_BEFORE], ARG_BUF_LEN, "%d",
+	         run_test(EXEC_BENCH_PHYSALLOCS));
+	snprintf(bufs[ARG_SMALL_BEFORE], ARG_BUF_LEN, "%d",
+	         run_test(EXEC_BENCH_SMALLOCS));
+	exec("exec_bench", args);
+
+	lprintf("exec_bench: exec() failed with %d left", left);
+	exit(-1);
+}
@@ -0,0 +1,92 @@
+/** @file exit_rate_bench.c
+ *  @brief Measures how many tasks per second can vanish and be reaped.
+ *
+ *  Usage: exit_rate_bench [num_workers] [iterations]
+ *
+ *  Forks num_workers workers (8 by default), each of which forks and reaps
+ *  a child iterations times (1000 by default). Every child forks a
+ *  grandchild and exits right away, so the grandchild is orphaned and
+ *  reaped by init. Workers live in separate subtrees, so only orphans
+ *  contend on the same parent.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_WORKERS 8
+#define DEFAULT_ITERATIONS 1000
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/** @brief Forks and reaps children which each leave an orphan behind
+ *
+ *  @param iterations Number of children to fork
+ *  @return Void.
+ */
+static void
+worker( int iterations )
+{
+	for (int i = 0; i < iterations; ++i) {
+		int tid = fork();
+		if (tid == 0) {
+			/* Orphaned grandchild, or nothing if out of memory */
+			if (fork() == 0)
+				exit(0);
+			exit(0);
+		}
+		if (tid < 0) {
+			lprintf("exit_rate_bench: fork() failed");
+			exit(-1);
+		}
+		int status;
+		if (wait(&status) != tid || status != 0) {
+			lprintf("exit_rate_bench: bad wait()");
+			exit(-1);
+		}
+	}
+	exit(0);
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_workers = DEFAULT_WORKERS;
+	int iterations = DEFAULT_ITERATIONS;
+	if (argc > 1)
+		num_workers = atoi(argv[1]);
+	if (argc > 2)
+		iterations = atoi(argv[2]);
+
+	int start = get_ticks();
+	for (int i = 0; i < num_workers; ++i) {
+		int tid = fork();
+		if (tid == 0)
+			worker(iterations);
+		if (tid < 0) {
+			lprintf("exit_rate_bench: unable to fork worker %d", i);
+			exit(-1);
+		}
+	}
+	for (int i = 0; i < num_workers; ++i) {
+		int status;
+		if (wait(&status) < 0 || status != 0) {
+			lprintf("exit_rate_bench: worker failed");
+			exit(-1);
+		}
+	}
+	int ticks = get_ticks() - start;
+
+	/* Each worker, child and grandchild exits once */
+	int exits = num_workers * (2 * iterations + 1);
+	int per_second = ticks > 0 ? exits * TICKS_PER_SECOND / ticks : 0;
+	lprintf("exit_rate_bench: %d exits in %d ticks, %d exits/s", exits, ticks,
+	        per_second);
+	printf("exit_rate_bench: %d exits in %d ticks, %d exits/s\n", exits,
+	       ticks, per_second);
+	exit(0);
+}
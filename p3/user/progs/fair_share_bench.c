@@ -0,0 +1,155 @@
+/** @file fair_share_bench.c
+ *  @brief Checks that CPU shares track the weights of nice values.
+ *
+ *  Usage: fair_share_bench [seconds] [nice ...]
+ *
+ *  Forks one spinning child task per nice value (0 0 5 10 by default),
+ *  setting its own nice value before each fork() so that the child
+ *  inherits it. The children spin together for the given number of seconds
+ *  (10 by default) and exit with the CPU time they got meanwhile. Reports
+ *  each child's share of the total against the share its weight calls for,
+ *  and fails if any is off by more than TOLERANCE_PERCENT of the expected
+ *  share.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_SECONDS 10
+#define MAX_CHILDREN 16
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for every child to be forked before they start spinning */
+#define START_DELAY_TICKS 200
+
+/* Most a share may be off, in percent of the expected share */
+#define TOLERANCE_PERCENT 5
+
+/* Weight of each nice value from NICE_MIN, the same as the kernel's */
+static const int nice_to_weight[NICE_MAX - NICE_MIN + 1] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */  9548,  7620,  6100,  4904,  3906,
+	/*  -5 */  3121,  2501,  1991,  1586,  1277,
+	/*   0 */  1024,   820,   655,   526,   423,
+	/*   5 */   335,   272,   215,   172,   137,
+	/*  10 */   110,    87,    70,    56,    45,
+	/*  15 */    36,    29,    23,    18,    15,
+};
+
+static int default_nices[] = { 0, 0, 5, 10 };
+
+/** @brief Spins from the start tick to the end tick, then exits with the
+ *         CPU time in ms it got in between.
+ *
+ *  @param start Tick to start spinning at
+ *  @param end Tick to stop spinning at
+ *  @return Does not return.
+ */
+static void
+spin( int start, int end )
+{
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	while (get_ticks() < end)
+		continue;
+	getrusage(RUSAGE_SELF, &after);
+	exit(after.runtime_ms - before.runtime_ms);
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_children = argc > 2 ? argc - 2 : 4;
+	if (seconds <= 0 || num_children > MAX_CHILDREN) {
+		printf("usage: fair_share_bench [seconds] [nice ...], at most %d "
+		       "nice values\n", MAX_CHILDREN);
+		exit(-1);
+	}
+	int nices[MAX_CHILDREN];
+	for (int i = 0; i < num_children; ++i) {
+		nices[i] = argc > 2 ? atoi(argv[i + 2]) : default_nices[i];
+		if (nices[i] < NICE_MIN || nices[i] > NICE_MAX) {
+			printf("fair_share_bench: nice values go from %d to %d\n",
+			       NICE_MIN, NICE_MAX);
+			exit(-1);
+		}
+	}
+
+	int start = get_ticks() + START_DELAY_TICKS;
+	int end = start + seconds * TICKS_PER_SECOND;
+	int tids[MAX_CHILDREN];
+	for (int i = 0; i < num_children; ++i) {
+		if (set_priority(PRIO_TASK, 0, nices[i]) < 0) {
+			printf("fair_share_bench: set_priority() failed\n");
+			exit(-1);
+		}
+		tids[i] = fork();
+		if (tids[i] == 0)
+			spin(start, end);
+		if (tids[i] < 0) {
+			printf("fair_share_bench: fork() failed\n");
+			exit(-1);
+		}
+	}
+	/* Wake up as soon as the children are done */
+	set_priority(PRIO_TASK, 0, NICE_MIN);
+
+	int ms[MAX_CHILDREN];
+	for (int i = 0; i < num_children; ++i) {
+		int status;
+		int tid = wait(&status);
+		for (int j = 0; j < num_children; ++j) {
+			if (tids[j] == tid)
+				ms[j] = status;
+		}
+	}
+	if (get_ticks() > end + START_DELAY_TICKS)
+		printf("fair_share_bench: children started late, shares are off\n");
+
+	int total_ms = 0;
+	int total_weight = 0;
+	for (int i = 0; i < num_children; ++i) {
+		total_ms += ms[i];
+		total_weight += nice_to_weight[nices[i] - NICE_MIN];
+	}
+	if (total_ms <= 0) {
+		printf("fair_share_bench: children got no CPU time\n");
+		exit(-1);
+	}
+
+	/* Shares in tenths of a percent */
+	int failed = 0;
+	for (int i = 0; i < num_children; ++i) {
+		int weight = nice_to_weight[nices[i] - NICE_MIN];
+		int expected = weight * 1000 / total_weight;
+		int got = ms[i] * 1000 / total_ms;
+		int off = got > expected ? got - expected : expected - got;
+		int ok = off * 100 <= expected * TOLERANCE_PERCENT;
+		failed |= !ok;
+
+		lprintf("fair_share_bench: nice %3d: %6d ms, share %3d.%d%%, "
+		        "expected %3d.%d%% %s", nices[i], ms[i], got / 10, got % 10,
+		        expected / 10, expected % 10, ok ? "" : "FAIL");
+		printf("fair_share_bench: nice %3d: %6d ms, share %3d.%d%%, "
+		       "expected %3d.%d%% %s\n", nices[i], ms[i], got / 10, got % 10,
+		       expected / 10, expected % 10, ok ? "" : "FAIL");
+	}
+	lprintf("fair_share_bench: %d ms of CPU over %d s, %s", total_ms,
+	        seconds, failed ? "FAIL" : "PASS");
+	printf("fair_share_bench: %d ms of CPU over %d s, %s\n", total_ms,
+	       seconds, failed ? "FAIL" : "PASS");
+	exit(failed ? -1 : 0);
+}
@@ -0,0 +1,213 @@
+/** @file gang_dispatch_bench.c
+ *  @brief Compares dispatching threads of one task in batches against
+ *         always running the leftmost thread, on a TLB-bound workload.
+ *
+ *  Usage: gang_dispatch_bench [seconds] [tasks] [threads]
+ *
+ *  Forks the given number of tasks (4 by default), each spinning in the
+ *  given number of threads (4 by default) for the given number of seconds
+ *  (5 by default). Every thread walks its task's WORKING_SET_PAGES pages
+ *  over and over, touching a byte of each, and counts the passes. The
+ *  working set fits in the TLB, so a thread runs fastest when the thread
+ *  it follows was of the same task and %cr3 was left alone.
+ *
+ *  Runs this with set_gang_batch() off and at a few batch sizes, and
+ *  reports the passes per second, the %cr3 writes per second from
+ *  task_snapshot(), and the smallest and largest share of the passes a
+ *  task got, which should stay near an even split. Turns batches off again
+ *  when done.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_SECONDS 5
+#define DEFAULT_TASKS 4
+#define DEFAULT_THREADS 4
+#define MAX_TASKS 16
+#define MAX_THREADS 16
+
+/* Pages each task walks, few enough for the TLB to hold them all */
+#define WORKING_SET_PAGES 32
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for every task to set up before they start spinning */
+#define START_DELAY_TICKS 200
+
+static int batches[] = { 0, 2, 4, 16 };
+
+static volatile char working_set[WORKING_SET_PAGES * PAGE_SIZE];
+static int passes[MAX_THREADS];
+static int start;
+static int end;
+
+/** @brief Walks the working set from the start tick to the end tick.
+ *
+ *  @param arg Where to count the passes
+ *  @return NULL
+ */
+static void *
+walk( void *arg )
+{
+	int *count = arg;
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+	while (get_ticks() < end) {
+		for (int i = 0; i < WORKING_SET_PAGES; ++i)
+			working_set[i * PAGE_SIZE]++;
+		(*count)++;
+	}
+	return NULL;
+}
+
+/** @brief Walks the working set in num_threads threads of the calling
+ *         task, then exits with the passes they made.
+ *
+ *  @param num_threads Number of threads to walk in
+ *  @return Does not return.
+ */
+static void
+run_task( int num_threads )
+{
+	int tids[MAX_THREADS];
+	if (thr_init(PAGE_SIZE) < 0)
+		exit(-1);
+	/* Fault the working set in before the clock starts */
+	for (int i = 0; i < WORKING_SET_PAGES; ++i)
+		working_set[i * PAGE_SIZE] = 0;
+	for (int i = 1; i < num_threads; ++i) {
+		tids[i] = thr_create(walk, &passes[i]);
+		if (tids[i] < 0)
+			task_vanish(-1);
+	}
+
+	walk(&passes[0]);
+	int total = passes[0];
+	for (int i = 1; i < num_threads; ++i) {
+		thr_join(tids[i], NULL);
+		total += passes[i];
+	}
+	exit(total);
+}
+
+/** @brief Gets the %cr3 writes since boot.
+ *
+ *  @return %cr3 writes, negative value on error
+ */
+static int
+get_cr3_writes( void )
+{
+	task_snapshot_header_t header;
+	if (task_snapshot(&header, sizeof(header)) < 0)
+		return -1;
+	return header.cr3_writes;
+}
+
+/** @brief Runs the workload under a batch size and reports on it.
+ *
+ *  @param batch Batch size for set_gang_batch()
+ *  @param seconds Seconds to run for
+ *  @param num_tasks Number of tasks
+ *  @param num_threads Number of threads per task
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( int batch, int seconds, int num_tasks, int num_threads )
+{
+	if (set_gang_batch(batch) < 0)
+		return -1;
+
+	start = get_ticks() + START_DELAY_TICKS;
+	end = start + seconds * TICKS_PER_SECOND;
+	int tids[MAX_TASKS];
+	for (int i = 0; i < num_tasks; ++i) {
+		tids[i] = fork();
+		if (tids[i] == 0)
+			run_task(num_threads);
+		if (tids[i] < 0)
+			return -1;
+	}
+
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+	int cr3_before = get_cr3_writes();
+	now = get_ticks();
+	if (now < end)
+		sleep(end - now);
+	int cr3_after = get_cr3_writes();
+
+	int task_passes[MAX_TASKS];
+	int total = 0;
+	int failed = cr3_before < 0 || cr3_after < 0;
+	for (int i = 0; i < num_tasks; ++i) {
+		int status;
+		int tid = wait(&status);
+		for (int j = 0; j < num_tasks; ++j) {
+			if (tids[j] == tid)
+				task_passes[j] = status;
+		}
+		failed |= status < 0;
+		total += status;
+	}
+	if (failed || total <= 0)
+		return -1;
+
+	/* Shares in tenths of a percent */
+	int min_share = 1000;
+	int max_share = 0;
+	for (int i = 0; i < num_tasks; ++i) {
+		int share = task_passes[i] * 1000 / total;
+		if (share < min_share)
+			min_share = share;
+		if (share > max_share)
+			max_share = share;
+	}
+	int expected = 1000 / num_tasks;
+	int per_second = total / seconds;
+	int cr3_per_second = (cr3_after - cr3_before) / seconds;
+
+	lprintf("gang_dispatch_bench: batch %2d: %8d passes/s, %5d cr3 writes/s, "
+	        "task shares %d.%d%% to %d.%d%% of %d.%d%%", batch, per_second,
+	        cr3_per_second, min_share / 10, min_share % 10, max_share / 10,
+	        max_share % 10, expected / 10, expected % 10);
+	printf("gang_dispatch_bench: batch %2d: %8d passes/s, %5d cr3 writes/s, "
+	       "task shares %d.%d%% to %d.%d%% of %d.%d%%\n", batch, per_second,
+	       cr3_per_second, min_share / 10, min_share % 10, max_share / 10,
+	       max_share % 10, expected / 10, expected % 10);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_tasks = argc > 2 ? atoi(argv[2]) : DEFAULT_TASKS;
+	int num_threads = argc > 3 ? atoi(argv[3]) : DEFAULT_THREADS;
+	if (seconds <= 0 || num_tasks <= 0 || num_tasks > MAX_TASKS
+	    || num_threads <= 0 || num_threads > MAX_THREADS) {
+		printf("usage: gang_dispatch_bench [seconds] [tasks] [threads], at "
+		       "most %d tasks of %d threads\n", MAX_TASKS, MAX_THREADS);
+		exit(-1);
+	}
+
+	int failed = 0;
+	for (int i = 0; i < sizeof(batches) / sizeof(batches[0]) && !failed; ++i)
+		failed = report(batches[i], seconds, num_tasks, num_threads) < 0;
+	set_gang_batch(0);
+
+	if (failed) {
+		lprintf("gang_dispatch_bench: a run failed");
+		printf("gang_dispatch_bench: a run failed\n");
+	}
+	exit(failed ? -1 : 0);
+}
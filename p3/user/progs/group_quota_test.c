@@ -0,0 +1,179 @@
+/** @file group_quota_test.c
+ *  @brief Checks that task group quotas keep a many-threaded task from
+ *         crowding out a single-threaded one.
+ *
+ *  Usage: group_quota_test [seconds] [threads]
+ *
+ *  Gives two task groups the same quota, half of every period, and forks a
+ *  task with the given number of spinning threads (16 by default) in one
+ *  and a task with a single spinning thread in the other, joining each
+ *  group before the fork() so that the child inherits it. Both spin for
+ *  the given number of seconds (10 by default) and exit with the CPU time
+ *  they got meanwhile. Without quotas the many-threaded task would get
+ *  nearly all of it; with them each should get half, and the test fails if
+ *  either share is off by more than TOLERANCE_PERCENT of that.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_THREADS 16
+#define MAX_THREADS 64
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for both tasks to set up before they start spinning */
+#define START_DELAY_TICKS 200
+
+/* Each group gets QUOTA_TICKS out of every PERIOD_TICKS */
+#define MANY_GROUP 1
+#define ONE_GROUP 2
+#define QUOTA_TICKS 5
+#define PERIOD_TICKS 10
+
+/* Most a share may be off, in percent of the expected share */
+#define TOLERANCE_PERCENT 5
+
+static int start;
+static int end;
+
+/** @brief Spins from the start tick to the end tick.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+spin( void *arg )
+{
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+	while (get_ticks() < end)
+		continue;
+	return NULL;
+}
+
+/** @brief Spins in num_threads threads of the calling task, then exits with
+ *         the CPU time in ms the task got meanwhile.
+ *
+ *  @param num_threads Number of threads to spin in
+ *  @return Does not return.
+ */
+static void
+run_task( int num_threads )
+{
+	int tids[MAX_THREADS];
+	if (num_threads > 1 && thr_init(PAGE_SIZE) < 0)
+		exit(-1);
+	for (int i = 1; i < num_threads; ++i) {
+		tids[i] = thr_create(spin, NULL);
+		if (tids[i] < 0)
+			task_vanish(-1);
+	}
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	spin(NULL);
+	for (int i = 1; i < num_threads; ++i)
+		thr_join(tids[i], NULL);
+	getrusage(RUSAGE_SELF, &after);
+
+	exit(after.runtime_ms - before.runtime_ms);
+}
+
+/** @brief Forks a task running run_task() in a task group.
+ *
+ *  @param group Task group for the child to inherit
+ *  @param num_threads Number of threads for it to spin in
+ *  @return Child's tid
+ */
+static int
+fork_in_group( int group, int num_threads )
+{
+	if (join_group(group) < 0) {
+		printf("group_quota_test: join_group() failed\n");
+		exit(-1);
+	}
+	int tid = fork();
+	if (tid == 0)
+		run_task(num_threads);
+	if (tid < 0) {
+		printf("group_quota_test: fork() failed\n");
+		exit(-1);
+	}
+	return tid;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+	if (seconds <= 0 || num_threads <= 0 || num_threads > MAX_THREADS) {
+		printf("usage: group_quota_test [seconds] [threads], at most %d "
+		       "threads\n", MAX_THREADS);
+		exit(-1);
+	}
+	if (set_group_quota(MANY_GROUP, QUOTA_TICKS, PERIOD_TICKS) < 0
+	    || set_group_quota(ONE_GROUP, QUOTA_TICKS, PERIOD_TICKS) < 0) {
+		printf("group_quota_test: set_group_quota() failed\n");
+		exit(-1);
+	}
+
+	start = get_ticks() + START_DELAY_TICKS;
+	end = start + seconds * TICKS_PER_SECOND;
+	int many_tid = fork_in_group(MANY_GROUP, num_threads);
+	int one_tid = fork_in_group(ONE_GROUP, 1);
+	join_group(0);
+
+	int many_ms = 0;
+	int one_ms = 0;
+	for (int i = 0; i < 2; ++i) {
+		int status;
+		int tid = wait(&status);
+		if (tid == many_tid)
+			many_ms = status;
+		if (tid == one_tid)
+			one_ms = status;
+	}
+	set_group_quota(MANY_GROUP, 0, 0);
+	set_group_quota(ONE_GROUP, 0, 0);
+
+	int total_ms = many_ms + one_ms;
+	if (many_ms < 0 || one_ms < 0 || total_ms <= 0) {
+		printf("group_quota_test: tasks failed or got no CPU time\n");
+		exit(-1);
+	}
+
+	/* Shares in tenths of a percent, each group should get half */
+	int expected = 500;
+	int failed = 0;
+	int ms[2] = { many_ms, one_ms };
+	int threads[2] = { num_threads, 1 };
+	for (int i = 0; i < 2; ++i) {
+		int got = ms[i] * 1000 / total_ms;
+		int off = got > expected ? got - expected : expected - got;
+		int ok = off * 100 <= expected * TOLERANCE_PERCENT;
+		failed |= !ok;
+
+		lprintf("group_quota_test: %2d threads: %6d ms, share %3d.%d%%, "
+		        "expected %3d.%d%% %s", threads[i], ms[i], got / 10, got % 10,
+		        expected / 10, expected % 10, ok ? "" : "FAIL");
+		printf("group_quota_test: %2d threads: %6d ms, share %3d.%d%%, "
+		       "expected %3d.%d%% %s\n", threads[i], ms[i], got / 10,
+		       got % 10, expected / 10, expected % 10, ok ? "" : "FAIL");
+	}
+	lprintf("group_quota_test: %d ms of CPU over %d s, %s", total_ms,
+	        seconds, failed ? "FAIL" : "PASS");
+	printf("group_quota_test: %d ms of CPU over %d s, %s\n", total_ms,
+	       seconds, failed ? "FAIL" : "PASS");
+	exit(failed ? -1 : 0);
+}
@@ -0,0 +1,84 @@
+/** @file map_file_bench.c
+ *  @brief Compares scanning a RAM disk file through map_file() against
+ *         scanning it with readfile() loops.
+ *
+ *  Usage: map_file_bench [filename]
+ *
+ *  Each pass sums every byte of the file, NUM_PASSES times over, and the
+ *  two sums must agree. Defaults to scanning itself.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define NUM_PASSES 20
+#define CHUNK 4096
+
+/* Page aligned, out of the way of the heap and stack */
+#define MAP_BASE ((void *) 0x40000000)
+
+static char buf[CHUNK];
+
+int
+main( int argc, char *argv[] )
+{
+	char *filename = "map_file_bench";
+	if (argc > 1)
+		filename = argv[1];
+
+	/* readfile() loops */
+	unsigned int read_sum = 0;
+	int start = get_ticks();
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		int offset = 0;
+		int res;
+		while ((res = readfile(filename, buf, CHUNK, offset)) > 0) {
+			for (int i = 0; i < res; ++i)
+				read_sum += (unsigned char) buf[i];
+			offset += res;
+		}
+		if (res < 0) {
+			printf("map_file_bench: readfile(%s) failed\n", filename);
+			exit(-1);
+		}
+	}
+	int read_ticks = get_ticks() - start;
+
+	/* map_file(), including the cost of mapping and unmapping */
+	unsigned int map_sum = 0;
+	int len = 0;
+	start = get_ticks();
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		char *data;
+		len = map_file(filename, MAP_BASE, &data);
+		if (len < 0) {
+			printf("map_file_bench: map_file(%s) failed\n", filename);
+			exit(-1);
+		}
+		for (int i = 0; i < len; ++i)
+			map_sum += (unsigned char) data[i];
+		if (remove_pages(MAP_BASE) < 0) {
+			printf("map_file_bench: remove_pages() failed\n");
+			exit(-1);
+		}
+	}
+	int map_ticks = get_ticks() - start;
+
+	if (read_sum != map_sum) {
+		printf("map_file_bench: checksums differ, %u vs %u\n",
+		       read_sum, map_sum);
+		exit(-1);
+	}
+	lprintf("map_file_bench: %s, %d bytes x %d, readfile %d ticks, "
+	        "map_file %d ticks", filename, len, NUM_PASSES, read_ticks,
+	        map_ticks);
+	printf("map_file_bench: %s, %d bytes x %d, readfile %d ticks, "
+	       "map_file %d ticks\n", filename, len, NUM_PASSES, read_ticks,
+	       map_ticks);
+	exit(0);
+}
@@ -0,0 +1,154 @@
+/** @file mutex_handoff_bench.c
+ *  @brief Compares kernel mutexes which let woken waiters compete for the
+ *         lock against ones which hand it to them, on short critical
+ *         sections.
+ *
+ *  Usage: mutex_handoff_bench [seconds] [threads]
+ *
+ *  Runs the given number of threads (4 by default) for the given number of
+ *  seconds (5 by default), each going through short critical sections
+ *  under one kernel test mutex as fast as it can, ROUNDS_PER_CALL of them
+ *  per system call. The sections only contend when a thread is preempted
+ *  in one, which is when handing the lock over starts a convoy of context
+ *  switches.
+ *
+ *  Does this once with a mutex in the default competing mode and once with
+ *  one set to hand off, and reports the critical sections per second, the
+ *  context switches per thousand sections, and the smallest share of the
+ *  sections a thread got, which shows how far waiters get barged past.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+#include "test.h" /* run_test */
+
+/* These definitions have to match the ones in kern/tests.c */
+#define MUTEX_BENCH_COMPETE	9
+#define MUTEX_BENCH_HANDOFF	10
+#define ROUNDS_PER_CALL		256
+
+#define DEFAULT_SECONDS 5
+#define DEFAULT_THREADS 4
+#define MAX_THREADS 32
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for every thread to be created before they start */
+#define START_DELAY_TICKS 200
+
+static int test_num;
+static int start;
+static int end;
+static int calls[MAX_THREADS];
+
+/** @brief Goes through critical sections from the start tick to the end
+ *         tick.
+ *
+ *  @param arg Where to count the system calls made
+ *  @return NULL
+ */
+static void *
+worker( void *arg )
+{
+	int *count = arg;
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+	while (get_ticks() < end) {
+		run_test(test_num);
+		(*count)++;
+	}
+	return NULL;
+}
+
+/** @brief Runs the workload on one of the test mutexes and reports on it.
+ *
+ *  @param name Name of the mode
+ *  @param num Test number of the mutex
+ *  @param seconds Seconds to run for
+ *  @param num_threads Number of threads
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( const char *name, int num, int seconds, int num_threads )
+{
+	test_num = num;
+	start = get_ticks() + START_DELAY_TICKS;
+	end = start + seconds * TICKS_PER_SECOND;
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int tids[MAX_THREADS];
+	for (int i = 0; i < num_threads; ++i) {
+		calls[i] = 0;
+		tids[i] = thr_create(worker, &calls[i]);
+		if (tids[i] < 0)
+			return -1;
+	}
+	for (int i = 0; i < num_threads; ++i)
+		thr_join(tids[i], NULL);
+	getrusage(RUSAGE_SELF, &after);
+
+	int total = 0;
+	int fewest = calls[0];
+	for (int i = 0; i < num_threads; ++i) {
+		total += calls[i];
+		if (calls[i] < fewest)
+			fewest = calls[i];
+	}
+	if (total <= 0)
+		return -1;
+
+	int per_second = total / seconds * ROUNDS_PER_CALL;
+	int switches = (after.voluntary_switches - before.voluntary_switches)
+	               + (after.involuntary_switches
+	                  - before.involuntary_switches);
+	/* Per thousand sections, in hundredths */
+	int per_thousand = (int) ((long long) switches * 100000
+	                          / ((long long) total * ROUNDS_PER_CALL));
+	/* Shares in tenths of a percent */
+	int share = fewest * 1000 / total;
+	int expected = 1000 / num_threads;
+
+	lprintf("mutex_handoff_bench: %-7s %9d sections/s, %d.%02d switches per "
+	        "1000, fewest %d.%d%% of %d.%d%%", name, per_second,
+	        per_thousand / 100, per_thousand % 100, share / 10, share % 10,
+	        expected / 10, expected % 10);
+	printf("mutex_handoff_bench: %-7s %9d sections/s, %d.%02d switches per "
+	       "1000, fewest %d.%d%% of %d.%d%%\n", name, per_second,
+	       per_thousand / 100, per_thousand % 100, share / 10, share % 10,
+	       expected / 10, expected % 10);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+	if (seconds <= 0 || num_threads <= 0 || num_threads > MAX_THREADS) {
+		printf("usage: mutex_handoff_bench [seconds] [threads], at most %d "
+		       "threads\n", MAX_THREADS);
+		exit(-1);
+	}
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("mutex_handoff_bench: unable to initialize");
+		exit(-1);
+	}
+
+	int failed = report("compete", MUTEX_BENCH_COMPETE, seconds,
+	                    num_threads) < 0
+	             || report("handoff", MUTEX_BENCH_HANDOFF, seconds,
+	                       num_threads) < 0;
+	if (failed)
+		lprintf("mutex_handoff_bench: a run failed");
+	thr_exit((void *) (failed ? -1 : 0));
+	return 0;
+}
@@ -0,0 +1,170 @@
+/** @file pi_inversion_test.c
+ *  @brief Checks that a thread holding a kernel mutex inherits the
+ *         priority of a thread waiting on it.
+ *
+ *  Usage: pi_inversion_test [spinners]
+ *
+ *  First times how long the kernel takes to do the work it does while
+ *  holding the test lock, with nothing else running. Then runs three kinds
+ *  of threads at different priorities:
+ *
+ *  low: at NICE_MAX, takes the test lock in the kernel and does the work
+ *  once a thread waits on it.
+ *  medium: the given number of threads (2 by default) at nice 0, which
+ *  spin in user mode until the high thread is done.
+ *  high: at NICE_MIN, waits on the test lock.
+ *
+ *  Without priority inheritance the low thread gets next to none of the
+ *  CPU against the spinners, and the high thread waits on it for many
+ *  times as long as the work takes. With it the low thread runs at
+ *  NICE_MIN until it unlocks. The test fails unless the low thread ran at
+ *  NICE_MIN and the high thread waited at most SLOWDOWN_MAX times as long
+ *  as the work takes, give or take SLACK_TICKS.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+#include "test.h" /* run_test */
+
+/* These definitions have to match the ones in kern/tests.c */
+#define PI_TEST_SPIN	6
+#define PI_TEST_HOLD	7
+#define PI_TEST_TAKE	8
+
+#define DEFAULT_SPINNERS 2
+#define MAX_SPINNERS 16
+
+/* Ticks after the start the medium and high threads start at, so that the
+ * low thread holds the lock by then */
+#define START_DELAY_TICKS 200
+#define MEDIUM_DELAY_TICKS 5
+#define HIGH_DELAY_TICKS 10
+
+/* Most the high thread may wait, in times the work takes plus ticks */
+#define SLOWDOWN_MAX 2
+#define SLACK_TICKS 5
+
+/* Spinners give up after this many times the longest wait allowed, so
+ * that a failing run ends */
+#define GIVE_UP_FACTOR 10
+
+static int start;
+static int give_up;
+static volatile int high_done = 0;
+static int low_priority;
+static int high_wait;
+
+/** @brief Sleeps until a tick.
+ *
+ *  @param tick Tick to wake up at
+ *  @return Void.
+ */
+static void
+sleep_until( int tick )
+{
+	int now = get_ticks();
+	if (now < tick)
+		sleep(tick - now);
+}
+
+/** @brief Holds the test lock at NICE_MAX until a thread waits on it and
+ *         the work is done.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+low( void *arg )
+{
+	set_priority(PRIO_THREAD, 0, NICE_MAX);
+	sleep_until(start);
+	low_priority = run_test(PI_TEST_HOLD);
+	return NULL;
+}
+
+/** @brief Spins at nice 0 until the high thread is done.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+medium( void *arg )
+{
+	set_priority(PRIO_THREAD, 0, 0);
+	sleep_until(start + MEDIUM_DELAY_TICKS);
+	while (!high_done && get_ticks() < give_up)
+		continue;
+	return NULL;
+}
+
+/** @brief Waits on the test lock at NICE_MIN.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+high( void *arg )
+{
+	set_priority(PRIO_THREAD, 0, NICE_MIN);
+	sleep_until(start + HIGH_DELAY_TICKS);
+	int before = get_ticks();
+	run_test(PI_TEST_TAKE);
+	high_wait = get_ticks() - before;
+	high_done = 1;
+	return NULL;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_spinners = argc > 1 ? atoi(argv[1]) : DEFAULT_SPINNERS;
+	if (num_spinners < 0 || num_spinners > MAX_SPINNERS) {
+		printf("usage: pi_inversion_test [spinners], at most %d spinners\n",
+		       MAX_SPINNERS);
+		exit(-1);
+	}
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("pi_inversion_test: unable to initialize");
+		exit(-1);
+	}
+
+	int before = get_ticks();
+	run_test(PI_TEST_SPIN);
+	int work_ticks = get_ticks() - before;
+	int max_wait = SLOWDOWN_MAX * work_ticks + SLACK_TICKS;
+
+	start = get_ticks() + START_DELAY_TICKS;
+	give_up = start + HIGH_DELAY_TICKS + GIVE_UP_FACTOR * max_wait;
+	int tids[MAX_SPINNERS + 2];
+	int num_threads = 0;
+	tids[num_threads++] = thr_create(low, NULL);
+	for (int i = 0; i < num_spinners; ++i)
+		tids[num_threads++] = thr_create(medium, NULL);
+	tids[num_threads++] = thr_create(high, NULL);
+	for (int i = 0; i < num_threads; ++i) {
+		if (tids[i] < 0) {
+			lprintf("pi_inversion_test: thr_create() failed");
+			thr_exit((void *) -1);
+		}
+	}
+	for (int i = 0; i < num_threads; ++i)
+		thr_join(tids[i], NULL);
+
+	int failed = low_priority != NICE_MIN || high_wait > max_wait;
+	lprintf("pi_inversion_test: %d spinners, low thread ran at nice %d, "
+	        "high thread waited %d ticks for %d ticks of work, at most %d, %s",
+	        num_spinners, low_priority, high_wait, work_ticks, max_wait,
+	        failed ? "FAIL" : "PASS");
+	printf("pi_inversion_test: %d spinners, low thread ran at nice %d, "
+	       "high thread waited %d ticks for %d ticks of work, at most %d, "
+	       "%s\n", num_spinners, low_priority, high_wait, work_ticks,
+	       max_wait, failed ? "FAIL" : "PASS");
+	thr_exit((void *) (failed ? -1 : 0));
+	return 0;
+}
@@ -0,0 +1,58 @@
+/** @file readfile_bench.c
+ *  @brief Measures readfile() throughput over a RAM disk file.
+ *
+ *  Usage: readfile_bench [filename [chunk]]
+ *
+ *  Reads the whole file chunk bytes at a time, NUM_PASSES times over, and
+ *  reports the elapsed ticks. Defaults to reading itself 512 bytes at a time.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define NUM_PASSES 20
+#define MAX_CHUNK 4096
+
+static char buf[MAX_CHUNK];
+
+int
+main( int argc, char *argv[] )
+{
+	char *filename = "readfile_bench";
+	int chunk = 512;
+
+	if (argc > 1)
+		filename = argv[1];
+	if (argc > 2)
+		chunk = atoi(argv[2]);
+	if (chunk <= 0 || chunk > MAX_CHUNK) {
+		printf("readfile_bench: chunk must be in (0, %d]\n", MAX_CHUNK);
+		exit(-1);
+	}
+
+	int total = 0;
+	int start = get_ticks();
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		int offset = 0;
+		int res;
+		while ((res = readfile(filename, buf, chunk, offset)) > 0) {
+			offset += res;
+		}
+		if (res < 0) {
+			printf("readfile_bench: readfile(%s) failed\n", filename);
+			exit(-1);
+		}
+		total += offset;
+	}
+	int elapsed = get_ticks() - start;
+
+	lprintf("readfile_bench: %s, %d bytes in %d byte chunks, %d ticks",
+	        filename, total, chunk, elapsed);
+	printf("readfile_bench: %s, %d bytes in %d byte chunks, %d ticks\n",
+	       filename, total, chunk, elapsed);
+	exit(0);
+}
@@ -0,0 +1,80 @@
+/** @file reap_latency_bench.c
+ *  @brief Measures how long wait() takes to return once a child with a
+ *         large address space exits.
+ *
+ *  For footprints from 1 MB to 256 MB, forks children which allocate and
+ *  touch that much memory with new_pages() and exit with the tick count at
+ *  the time they exit as their status. The parent reports the ticks from
+ *  the child's exit until its wait() returns. Stops at the first footprint
+ *  the kernel does not have the memory for.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define MB (1024 * 1024)
+#define MIN_FOOTPRINT_MB 1
+#define MAX_FOOTPRINT_MB 256
+#define ROUNDS 4
+#define ALLOC_TRIES 10
+
+/* Far above the program and its stack */
+#define REGION_BASE ((char *) 0x40000000)
+
+/** @brief Allocates and touches a region, then exits with the current tick
+ *         count as status
+ *
+ *  @param len Length of the region in bytes
+ *  @return Does not return.
+ */
+static void
+child( int len )
+{
+	/* The previous child's frames may not be freed yet */
+	int tries = 0;
+	while (new_pages(REGION_BASE, len) < 0) {
+		if (++tries == ALLOC_TRIES)
+			exit(-1);
+		sleep(1);
+	}
+	for (int i = 0; i < len; i += PAGE_SIZE)
+		REGION_BASE[i] = 1;
+	exit(get_ticks());
+}
+
+int
+main( int argc, char *argv[] )
+{
+	for (int mb = MIN_FOOTPRINT_MB; mb <= MAX_FOOTPRINT_MB; mb *= 2) {
+		int total = 0;
+		for (int r = 0; r < ROUNDS; ++r) {
+			int tid = fork();
+			if (tid == 0)
+				child(mb * MB);
+			if (tid < 0) {
+				lprintf("reap_latency_bench: fork() failed");
+				exit(-1);
+			}
+			int status;
+			if (wait(&status) != tid) {
+				lprintf("reap_latency_bench: bad wait()");
+				exit(-1);
+			}
+			if (status < 0) {
+				lprintf("reap_latency_bench: no memory for %d MB", mb);
+				printf("reap_latency_bench: no memory for %d MB\n", mb);
+				exit(0);
+			}
+			total += get_ticks() - status;
+		}
+		lprintf("reap_latency_bench: %d MB, %d ticks from exit to wait() "
+		        "over %d rounds", mb, total, ROUNDS);
+		printf("reap_latency_bench: %d MB, %d ticks from exit to wait() "
+		       "over %d rounds\n", mb, total, ROUNDS);
+	}
+	exit(0);
+}
@@ -0,0 +1,139 @@
+/** @file reap_rate_bench.c
+ *  @brief Measures how many children per second a supervisor can reap.
+ *
+ *  Usage: reap_rate_bench [num_children] [max_live]
+ *
+ *  Like a fork bomb supervisor, keeps up to max_live short-lived children
+ *  (64 by default) alive until num_children (4000 by default) have been
+ *  forked and reaped. Runs three rounds, reaping with wait() one child at a
+ *  time, with waitpid() on the oldest child, and with wait_many() draining
+ *  every vanished child at once, and reports reaps/s for each.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_CHILDREN 4000
+#define DEFAULT_MAX_LIVE 64
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* How a round reaps its children */
+#define REAP_WAIT 0
+#define REAP_WAITPID 1
+#define REAP_WAIT_MANY 2
+
+static const char *round_names[] = { "wait", "waitpid", "wait_many" };
+
+/** @brief Forks a child which exits right away with its exit status
+ *
+ *  @param status Exit status of the child
+ *  @return Child tid
+ */
+static int
+fork_child( int status )
+{
+	int tid = fork();
+	if (tid == 0)
+		exit(status);
+	if (tid < 0) {
+		lprintf("reap_rate_bench: fork() failed");
+		exit(-1);
+	}
+	return tid;
+}
+
+/** @brief Forks and reaps num_children children, at most max_live at a time
+ *
+ *  @param how REAP_WAIT, REAP_WAITPID or REAP_WAIT_MANY
+ *  @param num_children Number of children to fork
+ *  @param max_live Most children alive at once, at most WAIT_MANY_MAX
+ *  @param tids Array of max_live tids of live children
+ *  @param reaped_tids Array of max_live tids of reaped children
+ *  @param statuses Array of max_live exit statuses
+ *  @return Ticks taken.
+ */
+static int
+run_round( int how, int num_children, int max_live, int *tids,
+           int *reaped_tids, int *statuses )
+{
+	int forked = 0;
+	int reaped = 0;
+	int oldest = 0; /* Index into tids of the oldest live child */
+	int start = get_ticks();
+
+	while (reaped < num_children) {
+		while (forked < num_children && forked - reaped < max_live) {
+			tids[forked % max_live] = fork_child(forked);
+			forked++;
+		}
+
+		int n = 1;
+		switch (how) {
+		case REAP_WAIT:
+			if (wait(&statuses[0]) < 0)
+				n = -1;
+			break;
+		case REAP_WAITPID:
+			if (waitpid(tids[oldest], &statuses[0], 0) != tids[oldest]
+			    || statuses[0] != reaped)
+				n = -1;
+			oldest = (oldest + 1) % max_live;
+			break;
+		case REAP_WAIT_MANY:
+			n = wait_many(statuses, reaped_tids, max_live, 0);
+			break;
+		}
+		if (n <= 0) {
+			lprintf("reap_rate_bench: bad %s() after %d children",
+			        round_names[how], reaped);
+			exit(-1);
+		}
+		reaped += n;
+	}
+	return get_ticks() - start;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_children = DEFAULT_CHILDREN;
+	int max_live = DEFAULT_MAX_LIVE;
+	if (argc > 1)
+		num_children = atoi(argv[1]);
+	if (argc > 2)
+		max_live = atoi(argv[2]);
+	if (max_live < 2 || max_live > WAIT_MANY_MAX) {
+		lprintf("reap_rate_bench: max_live must be 2 to %d", WAIT_MANY_MAX);
+		exit(-1);
+	}
+
+	int *tids = malloc(max_live * sizeof(int));
+	int *reaped_tids = malloc(max_live * sizeof(int));
+	int *statuses = malloc(max_live * sizeof(int));
+	if (!tids || !reaped_tids || !statuses) {
+		lprintf("reap_rate_bench: out of memory");
+		exit(-1);
+	}
+
+	for (int how = REAP_WAIT; how <= REAP_WAIT_MANY; ++how) {
+		int ticks = run_round(how, num_children, max_live, tids, reaped_tids,
+		                      statuses);
+		int per_second = ticks > 0 ? num_children * TICKS_PER_SECOND / ticks
+		                           : 0;
+		lprintf("reap_rate_bench: %s, %d children in %d ticks, %d reaps/s",
+		        round_names[how], num_children, ticks, per_second);
+		printf("reap_rate_bench: %s, %d children in %d ticks, %d reaps/s\n",
+		       round_names[how], num_children, ticks, per_second);
+	}
+	free(tids);
+	free(reaped_tids);
+	free(statuses);
+	exit(0);
+}
@@ -0,0 +1,191 @@
+/** @file rwlock_lookup_bench.c
+ *  @brief Measures read-heavy system calls, which look up threads and
+ *         tasks, from many threads at once.
+ *
+ *  Usage: rwlock_lookup_bench [seconds] [threads]
+ *
+ *  Runs the given number of threads (8 by default) for the given number of
+ *  seconds (5 by default), each making one system call as fast as it can,
+ *  for each of:
+ *
+ *  yield: yield() to a tid no thread has, which fails once the lookup
+ *  misses.
+ *  make_runnable: make_runnable() of the calling thread, which fails once
+ *  the lookup finds it is not descheduled.
+ *  set_priority: set_priority() of a sleeping child task by pid, which
+ *  looks the task up under the pid map's readers-writer lock.
+ *  rwlock, mutex: ROUNDS_PER_CALL short read only sections under one
+ *  kernel test lock, read locked or locked as a mutex, which only differ
+ *  when a thread is preempted in one.
+ *
+ *  Reports the calls, or sections, per second and the context switches per
+ *  thousand of them.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+#include "test.h" /* run_test */
+
+/* These definitions have to match the ones in kern/tests.c */
+#define LOOKUP_BENCH_RWLOCK	11
+#define LOOKUP_BENCH_MUTEX	12
+#define ROUNDS_PER_CALL		256
+
+#define DEFAULT_SECONDS 5
+#define DEFAULT_THREADS 8
+#define MAX_THREADS 32
+
+/* No thread ever has this tid */
+#define NO_SUCH_TID 0x7FFFFFFF
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Ticks for every thread to be created before they start */
+#define START_DELAY_TICKS 200
+
+/* Workloads, see the file header */
+#define YIELD			0
+#define MAKE_RUNNABLE	1
+#define SET_PRIORITY	2
+#define RWLOCK			3
+#define MUTEX			4
+#define NUM_WORKLOADS	5
+
+static const char *names[NUM_WORKLOADS] = {
+	"yield", "make_runnable", "set_priority", "rwlock", "mutex"
+};
+
+static int workload;
+static int child_pid;
+static int start;
+static int end;
+static int calls[MAX_THREADS];
+
+/** @brief Makes a workload's system call from the start tick to the end
+ *         tick.
+ *
+ *  @param arg Where to count the system calls made
+ *  @return NULL
+ */
+static void *
+worker( void *arg )
+{
+	int *count = arg;
+	int tid = gettid();
+	int now = get_ticks();
+	if (now < start)
+		sleep(start - now);
+	while (get_ticks() < end) {
+		switch (workload) {
+			case YIELD:
+				yield(NO_SUCH_TID);
+				break;
+			case MAKE_RUNNABLE:
+				make_runnable(tid);
+				break;
+			case SET_PRIORITY:
+				set_priority(PRIO_TASK, child_pid, 0);
+				break;
+			case RWLOCK:
+				run_test(LOOKUP_BENCH_RWLOCK);
+				break;
+			case MUTEX:
+				run_test(LOOKUP_BENCH_MUTEX);
+				break;
+		}
+		(*count)++;
+	}
+	return NULL;
+}
+
+/** @brief Runs a workload and reports on it.
+ *
+ *  @param seconds Seconds to run for
+ *  @param num_threads Number of threads
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( int seconds, int num_threads )
+{
+	start = get_ticks() + START_DELAY_TICKS;
+	end = start + seconds * TICKS_PER_SECOND;
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int tids[MAX_THREADS];
+	for (int i = 0; i < num_threads; ++i) {
+		calls[i] = 0;
+		tids[i] = thr_create(worker, &calls[i]);
+		if (tids[i] < 0)
+			return -1;
+	}
+	for (int i = 0; i < num_threads; ++i)
+		thr_join(tids[i], NULL);
+	getrusage(RUSAGE_SELF, &after);
+
+	int total = 0;
+	for (int i = 0; i < num_threads; ++i)
+		total += calls[i];
+	if (workload == RWLOCK || workload == MUTEX)
+		total *= ROUNDS_PER_CALL;
+	if (total <= 0)
+		return -1;
+
+	int per_second = total / seconds;
+	int switches = (after.voluntary_switches - before.voluntary_switches)
+	               + (after.involuntary_switches
+	                  - before.involuntary_switches);
+	/* Per thousand calls, in hundredths */
+	int per_thousand = (int) ((long long) switches * 100000 / total);
+
+	lprintf("rwlock_lookup_bench: %-13s %9d/s, %d.%02d switches per 1000",
+	        names[workload], per_second, per_thousand / 100,
+	        per_thousand % 100);
+	printf("rwlock_lookup_bench: %-13s %9d/s, %d.%02d switches per 1000\n",
+	       names[workload], per_second, per_thousand / 100,
+	       per_thousand % 100);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	int num_threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+	if (seconds <= 0 || num_threads <= 0 || num_threads > MAX_THREADS) {
+		printf("usage: rwlock_lookup_bench [seconds] [threads], at most %d "
+		       "threads\n", MAX_THREADS);
+		exit(-1);
+	}
+
+	/* The child to look up sleeps through every workload. Fork before
+	 * there is more than one thread */
+	child_pid = fork();
+	if (child_pid == 0) {
+		sleep(NUM_WORKLOADS * (seconds * TICKS_PER_SECOND
+		                       + START_DELAY_TICKS));
+		exit(0);
+	}
+	if (child_pid < 0 || thr_init(PAGE_SIZE) < 0) {
+		lprintf("rwlock_lookup_bench: unable to initialize");
+		exit(-1);
+	}
+
+	int failed = 0;
+	for (workload = 0; workload < NUM_WORKLOADS && !failed; ++workload)
+		failed = report(seconds, num_threads) < 0;
+
+	int status;
+	wait(&status);
+	if (failed)
+		lprintf("rwlock_lookup_bench: a workload failed");
+	thr_exit((void *) (failed ? -1 : 0));
+	return 0;
+}
@@ -0,0 +1,81 @@
+/** @file switch_overhead_bench.c
+ *  @brief Measures the cost of a context switch.
+ *
+ *  Usage: switch_overhead_bench [num_yields]
+ *
+ *  Two threads of one task yield to each other num_yields times each
+ *  (100000 by default), so nearly all the time goes to yield() and the
+ *  context switch behind it. Reports the switches per second, and the CPU
+ *  cycles per switch and switch counts as getrusage() sees them, which also
+ *  shows whether the usage accounting done on every switch adds up.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_YIELDS 100000
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+static int num_yields = DEFAULT_YIELDS;
+static int main_tid;
+
+/** @brief Yields back to the main thread num_yields times */
+static void *
+ponger( void *arg )
+{
+	for (int i = 0; i < num_yields; ++i)
+		yield(main_tid);
+	return NULL;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	if (argc > 1)
+		num_yields = atoi(argv[1]);
+
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("switch_overhead_bench: unable to initialize");
+		exit(-1);
+	}
+	main_tid = thr_getid();
+	int tid = thr_create(ponger, NULL);
+	if (tid < 0) {
+		lprintf("switch_overhead_bench: thr_create() failed");
+		task_vanish(-1);
+	}
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int start = get_ticks();
+	for (int i = 0; i < num_yields; ++i)
+		yield(tid);
+	int ticks = get_ticks() - start;
+	getrusage(RUSAGE_SELF, &after);
+	thr_join(tid, NULL);
+
+	int switches = after.voluntary_switches - before.voluntary_switches;
+	int preempted = after.involuntary_switches - before.involuntary_switches;
+	/* Fits in 32 bits for any sensible num_yields, which spares us 64-bit
+	 * division */
+	unsigned int cycles = after.runtime_cycles - before.runtime_cycles;
+	int per_second = ticks > 0 ? switches * TICKS_PER_SECOND / ticks : 0;
+	int cycles_per_switch = switches > 0 ? cycles / switches : 0;
+
+	lprintf("switch_overhead_bench: %d switches (%d preempted) in %d ticks, "
+	        "%d switches/s, %d cycles/switch", switches, preempted, ticks,
+	        per_second, cycles_per_switch);
+	printf("switch_overhead_bench: %d switches (%d preempted) in %d ticks, "
+	       "%d switches/s, %d cycles/switch\n", switches, preempted, ticks,
+	       per_second, cycles_per_switch);
+	thr_exit(0);
+	return 0;
+}
@@ -0,0 +1,83 @@
+/** @file sysenter_bench.c
+ *  @brief Measures null system call latency entering the kernel with INT
+ *         and with sysenter.
+ *
+ *  Usage: sysenter_bench [seconds]
+ *
+ *  Calls gettid() as fast as it can for the given number of seconds (2 by
+ *  default), first through its INT gate and then with sysenter, if the CPU
+ *  has it. Reports the calls per second and the CPU cycles per call.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_SECONDS 2
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* gettid() calls between checks of the time */
+#define CALLS_PER_CHECK 1000
+
+static const char *names[2] = { "int", "sysenter" };
+
+/** @brief Calls gettid() for a number of seconds and reports on it.
+ *
+ *  @param sysenter Whether to enter the kernel with sysenter
+ *  @param seconds Seconds to run for
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( int sysenter, int seconds )
+{
+	if (use_sysenter(sysenter) < 0) {
+		lprintf("sysenter_bench: no sysenter on this CPU");
+		printf("sysenter_bench: no sysenter on this CPU\n");
+		return 0;
+	}
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int end = get_ticks() + seconds * TICKS_PER_SECOND;
+	int calls = 0;
+	while (get_ticks() < end) {
+		for (int i = 0; i < CALLS_PER_CHECK; ++i)
+			gettid();
+		calls += CALLS_PER_CHECK;
+	}
+	getrusage(RUSAGE_SELF, &after);
+
+	if (calls <= 0)
+		return -1;
+	int per_second = calls / seconds;
+	int cycles = (int) ((after.runtime_cycles - before.runtime_cycles)
+	                    / calls);
+
+	lprintf("sysenter_bench: %-8s %9d calls/s, %5d cycles per call",
+	        names[sysenter], per_second, cycles);
+	printf("sysenter_bench: %-8s %9d calls/s, %5d cycles per call\n",
+	       names[sysenter], per_second, cycles);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+	if (seconds <= 0) {
+		printf("usage: sysenter_bench [seconds]\n");
+		exit(-1);
+	}
+
+	int failed = report(0, seconds) < 0 || report(1, seconds) < 0;
+	if (failed)
+		lprintf("sysenter_bench: a workload failed");
+	exit(failed ? -1 : 0);
+	return 0;
+}
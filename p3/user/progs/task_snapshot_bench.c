@@ -0,0 +1,86 @@
+/** @file task_snapshot_bench.c
+ *  @brief Measures how long a task_snapshot() takes with many tasks.
+ *
+ *  Usage: task_snapshot_bench [num_tasks] [num_snapshots]
+ *
+ *  Forks num_tasks child tasks (5000 by default) which deschedule
+ *  themselves, takes num_snapshots snapshots (100 by default) of all of
+ *  them, and reports the time per snapshot. Then wakes the children up and
+ *  reaps them.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_TASKS 5000
+#define DEFAULT_SNAPSHOTS 100
+
+int
+main( int argc, char *argv[] )
+{
+	int num_tasks = DEFAULT_TASKS;
+	int num_snapshots = DEFAULT_SNAPSHOTS;
+	if (argc > 1)
+		num_tasks = atoi(argv[1]);
+	if (argc > 2)
+		num_snapshots = atoi(argv[2]);
+
+	int *tids = malloc(num_tasks * sizeof(int));
+	int len = sizeof(task_snapshot_header_t)
+	          + (num_tasks + 16) * sizeof(task_snapshot_entry_t);
+	char *buf = malloc(len);
+	if (!tids || !buf) {
+		lprintf("task_snapshot_bench: out of memory");
+		exit(-1);
+	}
+
+	int forked = 0;
+	while (forked < num_tasks) {
+		int tid = fork();
+		if (tid == 0) {
+			int reject = 0;
+			deschedule(&reject);
+			exit(0);
+		}
+		if (tid < 0)
+			break;
+		tids[forked++] = tid;
+	}
+
+	task_snapshot_header_t *header = (task_snapshot_header_t *) buf;
+	int start = get_ticks();
+	for (int i = 0; i < num_snapshots; ++i) {
+		if (task_snapshot(buf, len) < 0) {
+			lprintf("task_snapshot_bench: task_snapshot() failed");
+			break;
+		}
+	}
+	int ticks = get_ticks() - start;
+
+	/* Ticks are ms, report microseconds per snapshot */
+	int us = num_snapshots > 0 ? ticks * 1000 / num_snapshots : 0;
+	lprintf("task_snapshot_bench: %d tasks (%d in snapshot), %d snapshots "
+	        "in %d ticks, %d us/snapshot", forked, header->num_entries,
+	        num_snapshots, ticks, us);
+	printf("task_snapshot_bench: %d tasks (%d in snapshot), %d snapshots "
+	       "in %d ticks, %d us/snapshot\n", forked, header->num_entries,
+	       num_snapshots, ticks, us);
+
+	/* A child may not have descheduled itself yet */
+	for (int i = 0; i < forked; ++i) {
+		while (make_runnable(tids[i]) < 0)
+			yield(tids[i]);
+	}
+	int status;
+	for (int i = 0; i < forked; ++i)
+		wait(&status);
+
+	free(buf);
+	free(tids);
+	exit(0);
+}
@@ -0,0 +1,82 @@
+/** @file thread_churn_bench.c
+ *  @brief Measures how many threads per second can be created and vanish.
+ *
+ *  Usage: thread_churn_bench [num_threads] [batch]
+ *
+ *  Creates num_threads threads in total (10000 by default), batch (16 by
+ *  default) at a time, each of which exits right away, and joins every
+ *  batch before creating the next. Every thread_fork() needs a kernel stack
+ *  and every joined thread gives one back, so this mostly measures the
+ *  kernel stack allocator and thread_join(). With a batch of 1 it reports
+ *  create/join pairs per second.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_THREADS 10000
+#define DEFAULT_BATCH 16
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/** @brief Exits right away */
+static void *
+churner( void *arg )
+{
+	return arg;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_threads = DEFAULT_THREADS;
+	int batch = DEFAULT_BATCH;
+	if (argc > 1)
+		num_threads = atoi(argv[1]);
+	if (argc > 2)
+		batch = atoi(argv[2]);
+
+	int *tids = malloc(batch * sizeof(int));
+	if (batch <= 0 || !tids || thr_init(PAGE_SIZE) < 0) {
+		lprintf("thread_churn_bench: unable to initialize");
+		exit(-1);
+	}
+
+	int created = 0;
+	int start = get_ticks();
+	while (created < num_threads) {
+		int n = 0;
+		while (n < batch && created + n < num_threads) {
+			tids[n] = thr_create(churner, NULL);
+			if (tids[n] < 0) {
+				lprintf("thread_churn_bench: thr_create() failed after %d "
+				        "threads", created + n);
+				task_vanish(-1);
+			}
+			n++;
+		}
+		for (int i = 0; i < n; ++i) {
+			if (thr_join(tids[i], NULL) < 0) {
+				lprintf("thread_churn_bench: thr_join() failed");
+				task_vanish(-1);
+			}
+		}
+		created += n;
+	}
+	int ticks = get_ticks() - start;
+
+	int per_second = ticks > 0 ? created * TICKS_PER_SECOND / ticks : 0;
+	lprintf("thread_churn_bench: %d threads in %d ticks, %d threads/s",
+	        created, ticks, per_second);
+	printf("thread_churn_bench: %d threads in %d ticks, %d threads/s\n",
+	       created, ticks, per_second);
+	free(tids);
+	thr_exit(0);
+	return 0;
+}
@@ -0,0 +1,56 @@
+/** @file thread_limit_bench.c
+ *  @brief Measures how many threads can be alive at once.
+ *
+ *  Usage: thread_limit_bench [max_threads]
+ *
+ *  Creates threads which deschedule themselves until thr_create() fails or
+ *  max_threads (100000 by default) are alive, and reports how many there
+ *  were. Every thread holds a kernel stack, which is what usually runs out
+ *  first, since kernel memory is limited to the lowest 16 MB.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_MAX_THREADS 100000
+
+/** @brief Deschedules itself for good */
+static void *
+sleeper( void *arg )
+{
+	int reject = 0;
+	deschedule(&reject);
+	return NULL;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int max_threads = DEFAULT_MAX_THREADS;
+	if (argc > 1)
+		max_threads = atoi(argv[1]);
+
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("thread_limit_bench: unable to initialize");
+		exit(-1);
+	}
+	int created = 0;
+	int start = get_ticks();
+	while (created < max_threads && thr_create(sleeper, NULL) >= 0)
+		created++;
+	int ticks = get_ticks() - start;
+
+	lprintf("thread_limit_bench: %d threads alive at once, created in %d "
+	        "ticks", created + 1, ticks);
+	printf("thread_limit_bench: %d threads alive at once, created in %d "
+	       "ticks\n", created + 1, ticks);
+
+	/* The other threads never exit on their own */
+	task_vanish(0);
+	return 0;
+}
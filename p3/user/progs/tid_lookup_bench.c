@@ -0,0 +1,94 @@
+/** @file tid_lookup_bench.c
+ *  @brief Measures make_runnable() and yield(tid) latency with many threads.
+ *
+ *  Usage: tid_lookup_bench [num_threads]
+ *
+ *  Creates num_threads threads (10000 by default, fewer if thr_create() runs
+ *  out of memory), each of which deschedules itself over and over. Then
+ *  wakes every thread with make_runnable() and hands it the CPU with
+ *  yield(tid) for a few rounds, reporting the ticks taken. Both system
+ *  calls look the thread up by tid among all the others.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_THREADS 10000
+#define ROUNDS 4
+
+/** @brief Deschedules itself whenever it gets the CPU */
+static void *
+sleeper( void *arg )
+{
+	while (1) {
+		int reject = 0;
+		deschedule(&reject);
+	}
+	return NULL;
+}
+
+/** @brief Wakes a thread and yields to it, so that it deschedules again
+ *
+ *  @param tid Thread to wake
+ *  @return Number of system calls it took
+ */
+static int
+wake( int tid )
+{
+	int calls = 2;
+
+	/* The thread may not have descheduled itself yet */
+	while (make_runnable(tid) < 0) {
+		yield(tid);
+		calls += 2;
+	}
+	yield(tid);
+	return calls;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_threads = DEFAULT_THREADS;
+	if (argc > 1)
+		num_threads = atoi(argv[1]);
+
+	int *tids = malloc(num_threads * sizeof(int));
+	if (!tids || thr_init(PAGE_SIZE) < 0) {
+		lprintf("tid_lookup_bench: unable to initialize");
+		task_vanish(-1);
+	}
+	int created = 0;
+	while (created < num_threads) {
+		int tid = thr_create(sleeper, NULL);
+		if (tid < 0)
+			break;
+		tids[created++] = tid;
+	}
+
+	/* Make sure every thread has descheduled itself once */
+	for (int i = 0; i < created; ++i)
+		wake(tids[i]);
+
+	int calls = 0;
+	int start = get_ticks();
+	for (int r = 0; r < ROUNDS; ++r) {
+		for (int i = 0; i < created; ++i)
+			calls += wake(tids[i]);
+	}
+	int ticks = get_ticks() - start;
+
+	lprintf("tid_lookup_bench: %d threads, %d make_runnable/yield calls in "
+	        "%d ticks", created, calls, ticks);
+	printf("tid_lookup_bench: %d threads, %d make_runnable/yield calls in "
+	       "%d ticks\n", created, calls, ticks);
+
+	/* The other threads never exit on their own */
+	task_vanish(0);
+	return 0;
+}
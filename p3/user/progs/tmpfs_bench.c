@@ -0,0 +1,169 @@
+/** @file tmpfs_bench.c
+ *  @brief Measures in-memory file system throughput.
+ *
+ *  Writes and reads back a file sequentially in page sized chunks, then
+ *  reads and writes page sized chunks at random offsets, checking every
+ *  byte read. Finally reads a RAM disk file sequentially through the same
+ *  interface.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define FILE_NAME "tmpfs_bench_file"
+#define RAMDISK_FILE "tmpfs_bench"
+#define CHUNK 4096
+#define FILE_CHUNKS 256
+#define RANDOM_OPS 1024
+
+static char buf[CHUNK];
+static unsigned int seed;
+
+/** @brief Linear congruential generator for picking random chunks */
+static int
+next_random( void )
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/** @brief Fills buf with bytes derived from the chunk index */
+static void
+fill_chunk( int chunk )
+{
+	for (int i = 0; i < CHUNK; ++i)
+		buf[i] = (char) (chunk * 31 + i);
+}
+
+/** @brief Checks buf holds the bytes fill_chunk() wrote for a chunk */
+static int
+check_chunk( int chunk )
+{
+	for (int i = 0; i < CHUNK; ++i) {
+		if (buf[i] != (char) (chunk * 31 + i))
+			return -1;
+	}
+	return 0;
+}
+
+/** @brief Reports how many ticks moving a number of bytes took */
+static void
+report( const char *what, int bytes, int ticks )
+{
+	if (ticks > 0) {
+		lprintf("tmpfs_bench: %s %d KB in %d ticks", what, bytes / 1024,
+		        ticks);
+		printf("tmpfs_bench: %s %d KB in %d ticks\n", what, bytes / 1024,
+		       ticks);
+	} else {
+		lprintf("tmpfs_bench: %s %d KB in < 1 tick", what, bytes / 1024);
+		printf("tmpfs_bench: %s %d KB in < 1 tick\n", what, bytes / 1024);
+	}
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int fd = open(FILE_NAME, O_RDWR | O_CREAT | O_TRUNC);
+	if (fd < 0) {
+		lprintf("tmpfs_bench: open() failed");
+		exit(-1);
+	}
+
+	/* Sequential write */
+	int start = get_ticks();
+	for (int i = 0; i < FILE_CHUNKS; ++i) {
+		fill_chunk(i);
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			lprintf("tmpfs_bench: write() failed at chunk %d", i);
+			exit(-1);
+		}
+	}
+	report("sequential write", FILE_CHUNKS * CHUNK, get_ticks() - start);
+
+	/* Sequential read */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		lprintf("tmpfs_bench: lseek() failed");
+		exit(-1);
+	}
+	start = get_ticks();
+	for (int i = 0; i < FILE_CHUNKS; ++i) {
+		if (read(fd, buf, CHUNK) != CHUNK || check_chunk(i) < 0) {
+			lprintf("tmpfs_bench: bad read at chunk %d", i);
+			exit(-1);
+		}
+	}
+	report("sequential read", FILE_CHUNKS * CHUNK, get_ticks() - start);
+
+	if (read(fd, buf, CHUNK) != 0) {
+		lprintf("tmpfs_bench: read() past end of file");
+		exit(-1);
+	}
+
+	/* Random read */
+	seed = get_ticks();
+	start = get_ticks();
+	for (int i = 0; i < RANDOM_OPS; ++i) {
+		int chunk = next_random() % FILE_CHUNKS;
+		if (lseek(fd, chunk * CHUNK, SEEK_SET) != chunk * CHUNK
+		    || read(fd, buf, CHUNK) != CHUNK || check_chunk(chunk) < 0) {
+			lprintf("tmpfs_bench: bad random read of chunk %d", chunk);
+			exit(-1);
+		}
+	}
+	report("random read", RANDOM_OPS * CHUNK, get_ticks() - start);
+
+	/* Random write, rewriting chunks with the same bytes */
+	start = get_ticks();
+	for (int i = 0; i < RANDOM_OPS; ++i) {
+		int chunk = next_random() % FILE_CHUNKS;
+		fill_chunk(chunk);
+		if (lseek(fd, chunk * CHUNK, SEEK_SET) != chunk * CHUNK
+		    || write(fd, buf, CHUNK) != CHUNK) {
+			lprintf("tmpfs_bench: bad random write of chunk %d", chunk);
+			exit(-1);
+		}
+	}
+	report("random write", RANDOM_OPS * CHUNK, get_ticks() - start);
+
+	if (lseek(fd, 0, SEEK_END) != FILE_CHUNKS * CHUNK) {
+		lprintf("tmpfs_bench: random writes changed the file size");
+		exit(-1);
+	}
+	close(fd);
+	if (unlink(FILE_NAME) < 0 || open(FILE_NAME, O_RDONLY) >= 0) {
+		lprintf("tmpfs_bench: unlink() failed");
+		exit(-1);
+	}
+
+	/* Sequential read of a RAM disk file, which must be read-only */
+	if (open(RAMDISK_FILE, O_RDWR) >= 0) {
+		lprintf("tmpfs_bench: RAM disk file opened for writing");
+		exit(-1);
+	}
+	fd = open(RAMDISK_FILE, O_RDONLY);
+	if (fd < 0) {
+		lprintf("tmpfs_bench: unable to open RAM disk file");
+		exit(-1);
+	}
+	int total = 0;
+	int len;
+	start = get_ticks();
+	while ((len = read(fd, buf, CHUNK)) > 0)
+		total += len;
+	report("RAM disk sequential read", total, get_ticks() - start);
+	close(fd);
+
+	if (len < 0) {
+		lprintf("tmpfs_bench: RAM disk read failed");
+		exit(-1);
+	}
+	lprintf("tmpfs_bench: done");
+	printf("tmpfs_bench: done\n");
+	exit(0);
+}
@@ -0,0 +1,187 @@
+/** @file top.c
+ *  @brief Shows the tasks using the most CPU, refreshed every second.
+ *
+ *  Usage: top [refreshes]
+ *
+ *  Takes a task_snapshot() every second and lists the tasks which used the
+ *  most CPU time since the one before, refreshes times (forever by
+ *  default).
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* Tasks listed, so that the screen holds them with the two header lines */
+#define TOP_TASKS 20
+
+/* Entries the first snapshot buffer holds, it grows as needed */
+#define INITIAL_ENTRIES 64
+
+/** @brief A snapshot, and the buffer it is in */
+typedef struct {
+	char *buf;
+	int len;
+	task_snapshot_header_t *header;
+} snapshot_t;
+
+/** @brief Gets an entry of a snapshot.
+ *
+ *  @param snap Snapshot
+ *  @param i Index of the entry
+ *  @return Entry i
+ */
+static task_snapshot_entry_t *
+get_entry( snapshot_t *snap, int i )
+{
+	return (task_snapshot_entry_t *) (snap->buf + snap->header->header_size
+	                                  + i * snap->header->entry_size);
+}
+
+/** @brief Takes a snapshot, growing its buffer until every task fits.
+ *
+ *  @param snap Snapshot to take
+ *  @return 0 on success, negative value on error
+ */
+static int
+take_snapshot( snapshot_t *snap )
+{
+	while (1) {
+		if (task_snapshot(snap->buf, snap->len) < 0)
+			return -1;
+		snap->header = (task_snapshot_header_t *) snap->buf;
+		if (snap->header->version != TASK_SNAPSHOT_VERSION)
+			return -1;
+		if (snap->header->num_entries >= snap->header->num_tasks)
+			return 0;
+
+		/* Leave room for tasks created before the next try */
+		int len = snap->header->header_size
+		          + 2 * snap->header->num_tasks * snap->header->entry_size;
+		char *buf = malloc(len);
+		if (!buf)
+			return -1;
+		free(snap->buf);
+		snap->buf = buf;
+		snap->len = len;
+	}
+}
+
+/** @brief Finds the CPU time a task had in the previous snapshot.
+ *
+ *  Entries are in increasing pid order, so this walks both snapshots
+ *  together.
+ *
+ *  @param prev Previous snapshot
+ *  @param j Index into prev to resume from, updated
+ *  @param pid Task
+ *  @param cur_ms CPU time of the task in the current snapshot
+ *  @return CPU time in ms, 0 if the task is new
+ */
+static unsigned int
+prev_runtime_ms( snapshot_t *prev, int *j, unsigned int pid,
+                 unsigned int cur_ms )
+{
+	while (*j < prev->header->num_entries && get_entry(prev, *j)->pid < pid)
+		(*j)++;
+	if (*j == prev->header->num_entries || get_entry(prev, *j)->pid != pid)
+		return 0;
+
+	/* More than now means the pid went to a new task in between */
+	unsigned int prev_ms = get_entry(prev, *j)->runtime_ms;
+	return prev_ms <= cur_ms ? prev_ms : 0;
+}
+
+/** @brief Prints the tasks which used the most CPU between two snapshots.
+ *
+ *  @param prev Previous snapshot
+ *  @param cur Current snapshot
+ *  @return Void.
+ */
+static void
+show( snapshot_t *prev, snapshot_t *cur )
+{
+	int n = cur->header->num_entries;
+	unsigned int *delta = malloc(n * sizeof(unsigned int));
+	if (!delta)
+		return;
+
+	int j = 0;
+	unsigned int threads = 0;
+	for (int i = 0; i < n; ++i) {
+		task_snapshot_entry_t *entry = get_entry(cur, i);
+		delta[i] = entry->runtime_ms
+		           - prev_runtime_ms(prev, &j, entry->pid, entry->runtime_ms);
+		threads += entry->num_threads;
+	}
+	int elapsed = cur->header->ticks - prev->header->ticks;
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	set_cursor_pos(0, 0);
+	printf("top: %5d tasks, %5u threads, %6d ms since last refresh%-20s\n",
+	       n, threads, elapsed * 1000 / TICKS_PER_SECOND, "");
+	printf("  PID  PPID THR RUN BLK %%CPU  CPU(ms)    SWITCHES  FAULTS "
+	       "COMMAND         \n");
+
+	/* Pick the busiest tasks one at a time, there are only TOP_TASKS */
+	int shown = 0;
+	for (; shown < TOP_TASKS && shown < n; ++shown) {
+		int best = -1;
+		for (int i = 0; i < n; ++i) {
+			if (delta[i] != (unsigned int) -1
+			    && (best < 0 || delta[i] > delta[best]))
+				best = i;
+		}
+		task_snapshot_entry_t *entry = get_entry(cur, best);
+		printf("%5u %5u %3u %3u %3u %4u %8u %11u %7u %-16.16s\n",
+		       entry->pid, entry->ppid, entry->num_threads,
+		       entry->num_running + entry->num_runnable, entry->num_blocked,
+		       delta[best] * 100 / elapsed, entry->runtime_ms,
+		       entry->voluntary_switches + entry->involuntary_switches,
+		       entry->page_faults, entry->execname);
+		delta[best] = (unsigned int) -1;
+	}
+	for (; shown < TOP_TASKS; ++shown)
+		printf("%79s\n", "");
+	free(delta);
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int refreshes = argc > 1 ? atoi(argv[1]) : -1;
+
+	snapshot_t snaps[2];
+	for (int i = 0; i < 2; ++i) {
+		snaps[i].len = sizeof(task_snapshot_header_t)
+		               + INITIAL_ENTRIES * sizeof(task_snapshot_entry_t);
+		snaps[i].buf = malloc(snaps[i].len);
+		if (!snaps[i].buf) {
+			printf("top: out of memory\n");
+			exit(-1);
+		}
+	}
+	if (take_snapshot(&snaps[0]) < 0) {
+		printf("top: unable to take snapshot\n");
+		exit(-1);
+	}
+	for (int r = 1; refreshes < 0 || r <= refreshes; ++r) {
+		sleep(TICKS_PER_SECOND);
+		snapshot_t *prev = &snaps[(r - 1) % 2];
+		snapshot_t *cur = &snaps[r % 2];
+		if (take_snapshot(cur) < 0) {
+			printf("top: unable to take snapshot\n");
+			exit(-1);
+		}
+		show(prev, cur);
+	}
+	exit(0);
+}
@@ -0,0 +1,70 @@
+/** @file vanish_wait_bench.c
+ *  @brief Measures vanish() and wait() throughput with many live tasks.
+ *
+ *  Usage: vanish_wait_bench [num_tasks]
+ *
+ *  Forks num_tasks children (10000 by default, fewer if fork() runs out of
+ *  memory), each of which deschedules itself. Once all are alive, wakes them
+ *  one by one and reaps each with wait(), reporting the ticks taken. Every
+ *  exiting child looks up its parent by pid while the other children are
+ *  still alive.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_TASKS 10000
+
+int
+main( int argc, char *argv[] )
+{
+	int num_tasks = DEFAULT_TASKS;
+	if (argc > 1)
+		num_tasks = atoi(argv[1]);
+
+	int *tids = malloc(num_tasks * sizeof(int));
+	if (!tids) {
+		lprintf("vanish_wait_bench: out of memory");
+		exit(-1);
+	}
+	int forked = 0;
+	int start = get_ticks();
+	while (forked < num_tasks) {
+		int tid = fork();
+		if (tid == 0) {
+			int reject = 0;
+			deschedule(&reject);
+			exit(0);
+		}
+		if (tid < 0)
+			break;
+		tids[forked++] = tid;
+	}
+	int fork_ticks = get_ticks() - start;
+
+	/* Wake and reap the children in order */
+	start = get_ticks();
+	for (int i = 0; i < forked; ++i) {
+		/* The child may not have descheduled itself yet */
+		while (make_runnable(tids[i]) < 0)
+			yield(tids[i]);
+
+		int status;
+		if (wait(&status) < 0 || status != 0) {
+			lprintf("vanish_wait_bench: bad wait() after %d tasks", i);
+			exit(-1);
+		}
+	}
+	int reap_ticks = get_ticks() - start;
+
+	lprintf("vanish_wait_bench: %d tasks, fork %d ticks, vanish+wait %d ticks",
+	        forked, fork_ticks, reap_ticks);
+	printf("vanish_wait_bench: %d tasks, fork %d ticks, vanish+wait %d ticks\n",
+	       forked, fork_ticks, reap_ticks);
+	free(tids);
+	exit(0);
+}
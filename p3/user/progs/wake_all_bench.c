@@ -0,0 +1,125 @@
+/** @file wake_all_bench.c
+ *  @brief Measures waking many threads blocked on one kernel wait queue.
+ *
+ *  Usage: wake_all_bench [waiters]
+ *
+ *  Blocks the given number of threads (256 by default) on a kernel test
+ *  wait queue, then wakes them, for each of:
+ *
+ *  wake_all: every waiter at once, which decides whether to switch once.
+ *  wake_one: one waiter at a time, which may switch to each one it wakes
+ *  before waking the next.
+ *
+ *  Reports the ticks from the wakeup until every waiter has exited, and
+ *  the context switches per waiter woken.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+#include "test.h" /* run_test */
+
+/* These definitions have to match the ones in kern/tests.c */
+#define WAKE_BENCH_WAIT		13
+#define WAKE_BENCH_WAITERS	14
+#define WAKE_BENCH_WAKE_ALL	15
+#define WAKE_BENCH_WAKE_ONE	16
+
+#define DEFAULT_WAITERS 256
+#define MAX_WAITERS 1024
+
+/* Workloads, see the file header */
+#define WAKE_ALL		0
+#define WAKE_ONE		1
+#define NUM_WORKLOADS	2
+
+static const char *names[NUM_WORKLOADS] = { "wake_all", "wake_one" };
+
+static int tids[MAX_WAITERS];
+
+/** @brief Waits on the kernel test wait queue until woken.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+waiter( void *arg )
+{
+	run_test(WAKE_BENCH_WAIT);
+	return NULL;
+}
+
+/** @brief Runs a workload and reports on it.
+ *
+ *  @param workload Workload to run
+ *  @param num_waiters Number of waiting threads
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( int workload, int num_waiters )
+{
+	for (int i = 0; i < num_waiters; ++i) {
+		tids[i] = thr_create(waiter, NULL);
+		if (tids[i] < 0)
+			return -1;
+	}
+	/* Every waiter must be queued before the wakeup */
+	while (run_test(WAKE_BENCH_WAITERS) < num_waiters)
+		yield(-1);
+
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int start = get_ticks();
+	int woken = run_test(workload == WAKE_ALL ? WAKE_BENCH_WAKE_ALL
+	                                          : WAKE_BENCH_WAKE_ONE);
+	for (int i = 0; i < num_waiters; ++i)
+		thr_join(tids[i], NULL);
+	int ticks = get_ticks() - start;
+	getrusage(RUSAGE_SELF, &after);
+
+	if (woken != num_waiters)
+		return -1;
+
+	int switches = (after.voluntary_switches - before.voluntary_switches)
+	               + (after.involuntary_switches
+	                  - before.involuntary_switches);
+	/* Per waiter, in hundredths */
+	int per_waiter = switches * 100 / num_waiters;
+
+	lprintf("wake_all_bench: %-8s %d waiters, %6d ticks, %d.%02d switches "
+	        "per waiter", names[workload], num_waiters, ticks,
+	        per_waiter / 100, per_waiter % 100);
+	printf("wake_all_bench: %-8s %d waiters, %6d ticks, %d.%02d switches "
+	       "per waiter\n", names[workload], num_waiters, ticks,
+	       per_waiter / 100, per_waiter % 100);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_waiters = argc > 1 ? atoi(argv[1]) : DEFAULT_WAITERS;
+	if (num_waiters <= 0 || num_waiters > MAX_WAITERS) {
+		printf("usage: wake_all_bench [waiters], at most %d waiters\n",
+		       MAX_WAITERS);
+		exit(-1);
+	}
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("wake_all_bench: unable to initialize");
+		exit(-1);
+	}
+
+	int failed = 0;
+	for (int workload = 0; workload < NUM_WORKLOADS && !failed; ++workload)
+		failed = report(workload, num_waiters) < 0;
+
+	if (failed)
+		lprintf("wake_all_bench: a workload failed");
+	thr_exit((void *) (failed ? -1 : 0));
+	return 0;
+}
@@ -0,0 +1,266 @@
+/** @file wake_policy_bench.c
+ *  @brief Compares the wakeup policies on a ping-pong and a many-producer
+ *         workload.
+ *
+ *  Usage: wake_policy_bench [num_items] [num_producers]
+ *
+ *  Both workloads pass items through pipes, bounded buffers guarded by a
+ *  mutex and two condition variables, so that every item may wake a
+ *  thread blocked on the other end:
+ *
+ *  ping-pong: two threads bounce num_items items (20000 by default) back
+ *  and forth through a pair of one-slot pipes.
+ *  producers: num_producers threads (8 by default) each put num_items
+ *  items into one PIPE_SLOTS-slot pipe, which one consumer drains.
+ *
+ *  Runs both under WAKE_TAIL, WAKE_PREEMPT and WAKE_PREEMPT_SLICE at a few
+ *  shares of the slice, and reports the items per second and the context
+ *  switches per item of each, from which to pick the default policy. Puts
+ *  back the default policy when done.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <thread.h>
+#include <mutex.h>
+#include <cond.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <simics.h>
+
+#define DEFAULT_ITEMS 20000
+#define DEFAULT_PRODUCERS 8
+#define MAX_PRODUCERS 32
+#define PIPE_SLOTS 16
+
+/* The timer interrupts every ms */
+#define TICKS_PER_SECOND 1000
+
+/* The kernel's default, see kern/inc/wake_policy.h */
+#define DEFAULT_POLICY WAKE_PREEMPT_SLICE
+#define DEFAULT_SLICE_PERCENT 50
+
+/** @brief Bounded buffer of ints */
+typedef struct {
+	mutex_t mux;
+	cond_t not_empty;
+	cond_t not_full;
+	int slots;
+	int count;
+	int head;
+	int items[PIPE_SLOTS];
+} pipe_t;
+
+/** @brief Policy to run the workloads under */
+typedef struct {
+	const char *name;
+	int policy;
+	int slice_percent;
+} policy_run_t;
+
+static policy_run_t runs[] = {
+	{ "tail", WAKE_TAIL, 0 },
+	{ "preempt", WAKE_PREEMPT, 0 },
+	{ "preempt-slice 25%", WAKE_PREEMPT_SLICE, 25 },
+	{ "preempt-slice 50%", WAKE_PREEMPT_SLICE, 50 },
+	{ "preempt-slice 75%", WAKE_PREEMPT_SLICE, 75 },
+};
+
+static int num_items = DEFAULT_ITEMS;
+static pipe_t ping;
+static pipe_t pong;
+static pipe_t shared;
+
+/** @brief Initializes an empty pipe.
+ *
+ *  @param p Pipe
+ *  @param slots Number of items it holds at most, up to PIPE_SLOTS
+ *  @return Void.
+ */
+static void
+pipe_init( pipe_t *p, int slots )
+{
+	mutex_init(&p->mux);
+	cond_init(&p->not_empty);
+	cond_init(&p->not_full);
+	p->slots = slots;
+	p->count = 0;
+	p->head = 0;
+}
+
+/** @brief Puts an item in a pipe, blocking while it is full.
+ *
+ *  @param p Pipe
+ *  @param item Item
+ *  @return Void.
+ */
+static void
+pipe_put( pipe_t *p, int item )
+{
+	mutex_lock(&p->mux);
+	while (p->count == p->slots)
+		cond_wait(&p->not_full, &p->mux);
+	p->items[(p->head + p->count) % p->slots] = item;
+	p->count++;
+	cond_signal(&p->not_empty);
+	mutex_unlock(&p->mux);
+}
+
+/** @brief Takes an item out of a pipe, blocking while it is empty.
+ *
+ *  @param p Pipe
+ *  @return Item
+ */
+static int
+pipe_get( pipe_t *p )
+{
+	mutex_lock(&p->mux);
+	while (p->count == 0)
+		cond_wait(&p->not_empty, &p->mux);
+	int item = p->items[p->head];
+	p->head = (p->head + 1) % p->slots;
+	p->count--;
+	cond_signal(&p->not_full);
+	mutex_unlock(&p->mux);
+	return item;
+}
+
+/** @brief Sends back every item received on ping through pong.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+ponger( void *arg )
+{
+	for (int i = 0; i < num_items; ++i)
+		pipe_put(&pong, pipe_get(&ping));
+	return NULL;
+}
+
+/** @brief Puts num_items items in the shared pipe.
+ *
+ *  @param arg Unused
+ *  @return NULL
+ */
+static void *
+producer( void *arg )
+{
+	for (int i = 0; i < num_items; ++i)
+		pipe_put(&shared, i);
+	return NULL;
+}
+
+/** @brief Runs the ping-pong workload.
+ *
+ *  @return Number of items passed, negative value on error
+ */
+static int
+run_ping_pong( void )
+{
+	pipe_init(&ping, 1);
+	pipe_init(&pong, 1);
+	int tid = thr_create(ponger, NULL);
+	if (tid < 0)
+		return -1;
+	for (int i = 0; i < num_items; ++i) {
+		pipe_put(&ping, i);
+		pipe_get(&pong);
+	}
+	thr_join(tid, NULL);
+	return 2 * num_items;
+}
+
+/** @brief Runs the many-producer workload.
+ *
+ *  @param num_producers Number of producer threads
+ *  @return Number of items passed, negative value on error
+ */
+static int
+run_producers( int num_producers )
+{
+	int tids[MAX_PRODUCERS];
+	pipe_init(&shared, PIPE_SLOTS);
+	for (int i = 0; i < num_producers; ++i) {
+		tids[i] = thr_create(producer, NULL);
+		if (tids[i] < 0)
+			return -1;
+	}
+	for (int i = 0; i < num_producers * num_items; ++i)
+		pipe_get(&shared);
+	for (int i = 0; i < num_producers; ++i)
+		thr_join(tids[i], NULL);
+	return num_producers * num_items;
+}
+
+/** @brief Runs a workload and reports its throughput and switches.
+ *
+ *  @param workload Name of the workload
+ *  @param run Policy it runs under
+ *  @param num_producers Number of producers, 0 for ping-pong
+ *  @return 0 on success, negative value on error
+ */
+static int
+report( const char *workload, policy_run_t *run, int num_producers )
+{
+	rusage_t before, after;
+	getrusage(RUSAGE_SELF, &before);
+	int start = get_ticks();
+	int items = num_producers ? run_producers(num_producers)
+	                          : run_ping_pong();
+	int ticks = get_ticks() - start;
+	getrusage(RUSAGE_SELF, &after);
+	if (items < 0)
+		return -1;
+
+	int per_second = ticks > 0 ? items * TICKS_PER_SECOND / ticks : 0;
+	int switches = (after.voluntary_switches - before.voluntary_switches)
+	               + (after.involuntary_switches
+	                  - before.involuntary_switches);
+	/* In hundredths, to tell policies apart below one switch per item */
+	int per_item = items > 0 ? switches * 100 / items : 0;
+
+	lprintf("wake_policy_bench: %-9s %-18s %8d items/s, %d.%02d switches "
+	        "per item (%d preempted)", workload, run->name, per_second,
+	        per_item / 100, per_item % 100,
+	        after.involuntary_switches - before.involuntary_switches);
+	printf("wake_policy_bench: %-9s %-18s %8d items/s, %d.%02d switches "
+	       "per item (%d preempted)\n", workload, run->name, per_second,
+	       per_item / 100, per_item % 100,
+	       after.involuntary_switches - before.involuntary_switches);
+	return 0;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	if (argc > 1)
+		num_items = atoi(argv[1]);
+	int num_producers = argc > 2 ? atoi(argv[2]) : DEFAULT_PRODUCERS;
+	if (num_items <= 0 || num_producers <= 0
+	    || num_producers > MAX_PRODUCERS) {
+		printf("usage: wake_policy_bench [num_items] [num_producers], at "
+		       "most %d producers\n", MAX_PRODUCERS);
+		exit(-1);
+	}
+	if (thr_init(PAGE_SIZE) < 0) {
+		lprintf("wake_policy_bench: unable to initialize");
+		exit(-1);
+	}
+
+	int failed = 0;
+	for (int i = 0; i < sizeof(runs) / sizeof(runs[0]) && !failed; ++i) {
+		if (set_wake_policy(runs[i].policy, runs[i].slice_percent) < 0
+		    || report("ping-pong", &runs[i], 0) < 0
+		    || report("producers", &runs[i], num_producers) < 0)
+			failed = 1;
+	}
+	set_wake_policy(DEFAULT_POLICY, DEFAULT_SLICE_PERCENT);
+
+	if (failed)
+		lprintf("wake_policy_bench: a workload failed");
+	thr_exit((void *) (failed ? -1 : 0));
+	return 0;
+}
@@ -0,0 +1,123 @@
+/** @file wakeup_latency_bench.c
+ *  @brief Measures how soon a sleeping thread runs once its sleep expires,
+ *         and how much of an otherwise idle system the idle thread gets.
+ *
+ *  Usage: wakeup_latency_bench [num_sleeps]
+ *
+ *  Waits for a tick to start, reads the TSC, and sleeps SLEEP_TICKS ticks,
+ *  num_sleeps times (1000 by default). The wakeup latency is the time
+ *  slept past SLEEP_TICKS ticks, reported on average and at most in
+ *  microseconds. Also reports the share of the run the idle task got, from
+ *  task_snapshot(), which should be nearly all of it.
+ *
+ *  Host CPU usage has to be read off the host, e.g. with top on the QEMU
+ *  process while this runs: with the idle thread halting the CPU, QEMU
+ *  should use next to none.
+ *
+ *  @author Nicklaus Choo (nchoo)
+ */
+
+#include <syscall.h>
+#include <syscall_ext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <simics.h>
+
+#define DEFAULT_SLEEPS 1000
+#define SLEEP_TICKS 2
+
+/* Tasks task_snapshot() has room for */
+#define MAX_TASKS 64
+
+/** @brief Reads the TSC.
+ *
+ *  @return TSC value
+ */
+static unsigned long long
+read_tsc( void )
+{
+	unsigned long long tsc;
+	__asm__ __volatile__("rdtsc" : "=A" (tsc));
+	return tsc;
+}
+
+/** @brief Gets the CPU time of the idle task and the TSC cycles per tick.
+ *
+ *  @param buf Buffer for task_snapshot()
+ *  @param len Bytes of buf
+ *  @param tsc_per_tick Where to store the TSC cycles per tick
+ *  @return CPU time of the idle task in ms, negative value if not found
+ */
+static int
+idle_ms( char *buf, int len, unsigned int *tsc_per_tick )
+{
+	if (task_snapshot(buf, len) < 0)
+		return -1;
+
+	task_snapshot_header_t *header = (task_snapshot_header_t *) buf;
+	task_snapshot_entry_t *entries = (task_snapshot_entry_t *)
+		(buf + header->header_size);
+	*tsc_per_tick = header->tsc_per_tick;
+	for (unsigned int i = 0; i < header->num_entries; ++i) {
+		if (strcmp(entries[i].execname, "idle") == 0)
+			return entries[i].runtime_ms;
+	}
+	return -1;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	int num_sleeps = argc > 1 ? atoi(argv[1]) : DEFAULT_SLEEPS;
+	int len = sizeof(task_snapshot_header_t)
+	          + MAX_TASKS * sizeof(task_snapshot_entry_t);
+	char *buf = malloc(len);
+	if (num_sleeps <= 0 || !buf) {
+		printf("usage: wakeup_latency_bench [num_sleeps]\n");
+		exit(-1);
+	}
+
+	unsigned int tsc_per_tick;
+	int idle_before = idle_ms(buf, len, &tsc_per_tick);
+	unsigned int tsc_per_us = tsc_per_tick / 1000;
+	if (idle_before < 0 || tsc_per_us == 0) {
+		printf("wakeup_latency_bench: no idle task in task_snapshot()\n");
+		exit(-1);
+	}
+
+	int start = get_ticks();
+	int total_us = 0;
+	int max_us = 0;
+	for (int i = 0; i < num_sleeps; ++i) {
+		/* Start right as a tick does, so the sleep expires on a tick
+		 * exactly SLEEP_TICKS ticks later */
+		int tick = get_ticks();
+		while (get_ticks() == tick)
+			continue;
+		unsigned long long before = read_tsc();
+		sleep(SLEEP_TICKS);
+		unsigned int slept = read_tsc() - before;
+
+		int late = (int) (slept - SLEEP_TICKS * tsc_per_tick);
+		int us = late > 0 ? late / tsc_per_us : 0;
+		total_us += us;
+		if (us > max_us)
+			max_us = us;
+	}
+	int ticks = get_ticks() - start;
+	int idle_after = idle_ms(buf, len, &tsc_per_tick);
+
+	/* Ticks are ms */
+	int idle_percent = ticks > 0 ? (idle_after - idle_before) * 100 / ticks
+	                             : 0;
+	lprintf("wakeup_latency_bench: %d sleeps of %d ticks, wakeup latency "
+	        "%d us average, %d us max, idle %d%% of %d ticks", num_sleeps,
+	        SLEEP_TICKS, total_us / num_sleeps, max_us, idle_percent, ticks);
+	printf("wakeup_latency_bench: %d sleeps of %d ticks, wakeup latency "
+	       "%d us average, %d us max, idle %d%% of %d ticks\n", num_sleeps,
+	       SLEEP_TICKS, total_us / num_sleeps, max_us, idle_percent, ticks);
+
+	free(buf);
+	exit(0);
+}